@@ -0,0 +1,170 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef AMBIENT_H
+#define AMBIENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+#include "constants.h"
+
+// =========================================================
+//      Ambient Tables
+// =========================================================
+// 位相は 32bit で一周、上位 8bit をテーブルの index として使う
+constexpr size_t AMBIENT_TABLE_SIZE = 256;
+
+namespace ambient_detail {
+    /// constexpr 用の sin (-π..π の範囲で Taylor 展開)
+    constexpr double taylor_sin(double x) {
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 10; ++n) {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        return sum;
+    }
+    /// -127..127 の正弦波テーブル
+    constexpr auto make_sine_table() -> std::array<int8_t, AMBIENT_TABLE_SIZE> {
+        std::array<int8_t, AMBIENT_TABLE_SIZE> table{};
+        constexpr double PI_D = 3.14159265358979323846;
+        for (size_t i = 0; i < AMBIENT_TABLE_SIZE; ++i) {
+            double x = 2.0 * PI_D * static_cast<double>(i) / AMBIENT_TABLE_SIZE;
+            if (x > PI_D) { x -= 2.0 * PI_D; }
+            double v = taylor_sin(x) * 127.0;
+            table[i] = static_cast<int8_t>(v >= 0.0 ? v + 0.5 : v - 0.5);
+        }
+        return table;
+    }
+    /// 0..255 の smoothstep (ease in/out) テーブル
+    constexpr auto make_ease_table() -> std::array<uint8_t, AMBIENT_TABLE_SIZE> {
+        std::array<uint8_t, AMBIENT_TABLE_SIZE> table{};
+        for (size_t i = 0; i < AMBIENT_TABLE_SIZE; ++i) {
+            double t = static_cast<double>(i) / (AMBIENT_TABLE_SIZE - 1);
+            double v = t * t * (3.0 - 2.0 * t) * 255.0;
+            table[i] = static_cast<uint8_t>(v + 0.5);
+        }
+        return table;
+    }
+}
+
+constexpr std::array<int8_t, AMBIENT_TABLE_SIZE> AMBIENT_SINE = ambient_detail::make_sine_table();
+constexpr std::array<uint8_t, AMBIENT_TABLE_SIZE> AMBIENT_EASE = ambient_detail::make_ease_table();
+static_assert(AMBIENT_SINE[64] == 127, "sine table peak");
+static_assert(AMBIENT_SINE[192] == -127, "sine table trough");
+
+// =========================================================
+//      AmbientAnimator Class
+// =========================================================
+// 白色 LED の背景放射を、位相アキュムレータとテーブル参照だけで生成する
+enum class AmbientWave : uint8_t {
+    SINE,       // 正弦波
+    TRIANGLE,   // 三角波
+    SAW,        // のこぎり波
+    BREATH,     // ゆっくり膨らんで消える (ease in/out)
+};
+
+class AmbientAnimator {
+    static constexpr uint8_t FRAC_BITS = 16; // 位相アキュムレータの小数部
+
+    uint64_t    phase_acc_;     // 位相 (上位 32bit が一周、下位 FRAC_BITS は端数)
+    uint64_t    phase_inc_;     // 1usec あたりの位相増分
+    uint64_t    last_us_;
+    bool        started_;
+    AmbientWave wave_;
+    uint8_t     base_;          // 明るさの中心
+    uint8_t     depth_;         // 明るさの振れ幅
+    uint32_t    led_spread_;    // 隣の LED との位相差
+    std::array<uint32_t, MAX_KAMABOKO_NUM> kamaboko_offset_; // かまぼこ毎の位相差
+
+// impl AmbientAnimator
+public:
+    AmbientAnimator() :
+        phase_acc_(0),
+        phase_inc_(0),
+        last_us_(0),
+        started_(false),
+        wave_(AmbientWave::SINE),
+        base_(10),
+        depth_(10),
+        led_spread_(cycle_fraction(1, 10)),
+        kamaboko_offset_{} {
+        set_speed_mhz(1000);
+    }
+
+    /// 一周期の a/b を位相値に変換する
+    static constexpr auto cycle_fraction(uint32_t a, uint32_t b) -> uint32_t {
+        return static_cast<uint32_t>((static_cast<uint64_t>(a) << 32) / b);
+    }
+    void set_wave(AmbientWave wave) {wave_ = wave;}
+    /// 速度を mHz 単位で設定する (1000 で 1 秒一周)
+    void set_speed_mhz(uint32_t mhz) {
+        // 2^(32+FRAC_BITS) * mHz / 10^9 [1/usec]
+        phase_inc_ = ((static_cast<uint64_t>(mhz) << (32 + FRAC_BITS)) / 1000000000ULL);
+    }
+    void set_level(uint8_t base, uint8_t depth) {
+        base_ = base;
+        depth_ = depth;
+    }
+    void set_led_spread(uint32_t phase) {led_spread_ = phase;}
+    void set_kamaboko_offset(size_t kamaboko, uint32_t phase) {
+        if (kamaboko < MAX_KAMABOKO_NUM) {
+            kamaboko_offset_[kamaboko] = phase;
+        }
+    }
+    /// 64bit の usec タイムスタンプで位相を進める (ラップアラウンドしない)
+    void update(uint64_t now_us) {
+        if (started_) {
+            phase_acc_ += (now_us - last_us_) * phase_inc_;
+        }
+        last_us_ = now_us;
+        started_ = true;
+    }
+    auto phase() const -> uint32_t {
+        return static_cast<uint32_t>(phase_acc_ >> FRAC_BITS);
+    }
+    /// LED 一つ分の明るさ
+    auto level(size_t led) const -> uint8_t {
+        uint32_t ph = phase()
+                    + kamaboko_offset_[(led / MAX_EACH_LIGHT) % MAX_KAMABOKO_NUM]
+                    + static_cast<uint32_t>(led) * led_spread_;
+        int16_t wave = wave_value(static_cast<uint8_t>(ph >> 24));
+        int16_t lvl = base_ + ((static_cast<int16_t>(depth_) * wave) >> 7);
+        if (lvl < 0) {lvl = 0;}
+        else if (lvl > 255) {lvl = 255;}
+        return static_cast<uint8_t>(lvl);
+    }
+    /// 全 LED の明るさを setter(index, level) で渡す
+    template <typename F>
+    void render(size_t num, F&& setter) const {
+        for (size_t i = 0; i < num; ++i) {
+            setter(i, level(i));
+        }
+    }
+
+private:
+    /// 波形の値 (-127..127)
+    auto wave_value(uint8_t idx) const -> int16_t {
+        switch (wave_) {
+            default:
+            case AmbientWave::SINE:
+                return AMBIENT_SINE[idx];
+            case AmbientWave::TRIANGLE: {
+                int16_t tri = (idx < 128) ? idx : 255 - idx; // 0..127
+                return static_cast<int16_t>(tri * 2 - 127);
+            }
+            case AmbientWave::SAW:
+                return static_cast<int16_t>(idx) - 128;
+            case AmbientWave::BREATH: {
+                uint8_t up = (idx < 128) ? static_cast<uint8_t>(idx * 2) : static_cast<uint8_t>((255 - idx) * 2);
+                return static_cast<int16_t>(AMBIENT_EASE[up] - 128);
+            }
+        }
+    }
+};
+#endif // AMBIENT_H
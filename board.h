@@ -0,0 +1,64 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// =========================================================
+//      Board Selection
+// =========================================================
+// XIAO RP2040 と XIAO RP2350 は足の並びが同じだが、中身が違う
+//  - arduino-pico の Wire の割り当て: GP6/GP7 (i2c1) は RP2040 では Wire、RP2350 では Wire1
+//  - SRAM: RP2040 264KB、RP2350 520KB (バッファを BOARD_HEADROOM 倍にする)
+//  - RP2350 (Cortex-M33) は FPU と DSP 命令 (16bit x 2 の積和) がある (signal_kernels.h)
+// PICO_RP2350 は arduino-pico が RP2350 の board を選んだ時に定義する。ホストでは RP2040 と同じ
+#if defined(PICO_RP2350)
+#define BOARD_RP2350
+#define BOARD_NAME          "XIAO RP2350"
+#define TOUCH_WIRE          Wire1
+constexpr size_t BOARD_HEADROOM = 2;
+#else
+#define BOARD_RP2040
+#define BOARD_NAME          "XIAO RP2040"
+#define TOUCH_WIRE          Wire
+constexpr size_t BOARD_HEADROOM = 1;
+#endif
+
+// I2C (AT42QT1070 / PCA9544A)
+#define TOUCH_I2C_SDA       6
+#define TOUCH_I2C_SCL       7
+constexpr uint32_t TOUCH_I2C_CLOCK = 400000;
+
+// SK6812 (PIO)
+#define SK6812_DATA         D0
+
+// 何台かをつなぐ UART (USE_CLUSTER、cluster.h)。空いている足は D1 だけなので D0 と組にし、PIO で動かす
+// D0 を使うので LED は PCA9685 (USE_PCA9685) にする
+//  leader の TX → 全 follower の RX、follower の TX → diode で束ねて leader の RX
+#define CLUSTER_UART_TX     D1
+#define CLUSTER_UART_RX     D0
+constexpr size_t CLUSTER_UART_FIFO = 256;   // 受信の FIFO: 一番大きな返事 (CLUSTER_MAX_REPLY) が入る
+
+// SSD1331 (SPI0)
+#define DISPLAY_CS          D3
+#define DISPLAY_RST         D6
+#define DISPLAY_DC          D2
+#define DISPLAY_MOSI        D10
+#define DISPLAY_SCK         D8
+
+// XIAO の上にあるもの
+#define LED_HEARTBEAT       25      // RP2040: blue, RP2350: orange
+#if defined(BOARD_RP2040)
+//#define LED_GREEN           16      // RP2040 のみ (RP2350 では基板裏で未接続)
+//#define LED_RED             17
+#endif
+#define BOARD_NEO_POWER     23      // XIAO 上の NeoPixel の電源
+#define SWITCH_LEFT         D9      // 左のスイッチ
+#define SWITCH_RIGHT        D7      // 右のスイッチ
+
+#endif // BOARD_H
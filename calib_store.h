@@ -0,0 +1,265 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef CALIB_STORE_H
+#define CALIB_STORE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "constants.h"
+#include "topology.h"
+#include "tuning.h"
+
+// =========================================================
+//      Calibration Store Constants
+// =========================================================
+constexpr uint32_t CALIB_MAGIC = 0x4C414351;    // "QCAL"
+constexpr uint8_t CALIB_VERSION = 3;            // record の形を変えたら上げる (古いものは読まない)
+constexpr size_t CALIB_PAGE_SIZE = 256;         // flash の書き込み単位
+constexpr size_t CALIB_HEADER_SIZE = 16;
+constexpr size_t CALIB_TUNING_SIZE = TUNE_PARAMS * 2;
+constexpr size_t CALIB_MAX_RECORD = CALIB_HEADER_SIZE + MAX_KAMABOKO_NUM * 2 + MAX_SENS * 3 + CALIB_TUNING_SIZE;
+constexpr size_t CALIB_MAX_PAGES = (CALIB_MAX_RECORD + CALIB_PAGE_SIZE - 1) / CALIB_PAGE_SIZE;
+constexpr uint16_t CALIB_REF_TOLERANCE = 8;     // 温め起動で、保存した ref とのずれをここまで許す (+ noise)
+constexpr size_t CALIB_MIN_SECTORS = 2;         // 書くのに要る sector の数 (消している間も別の sector に一つ前が残る)
+
+//  record:
+//   [magic u32][version u8][block_count u8][pad_count u16][seq u32][crc32 u32]
+//   [mux u8, channel u8] x block_count
+//   [ref u16, noise u8] x pad_count
+//   [tuning u16] x TUNE_PARAMS (version 2 から。version 3 で cluster を足した)
+//  crc32 は crc の 4byte を除いた header と payload 全体にかける (little endian)
+
+// flash の操作 (ホストでは RAM の偽物を渡す)
+struct CalibFlash {
+    const uint8_t*  base;           // 読み出しは memory-mapped (XIP)
+    size_t          size;           // 領域の大きさ (sector_size の倍数)
+    size_t          sector_size;
+    int (*erase)(size_t offset);                                        // sector 単位、0: 成功
+    int (*program)(size_t offset, const uint8_t* data, size_t len);     // page 単位、0: 成功
+};
+
+// 起動を早くするために覚えておく値
+struct CalibData {
+    uint8_t         block_count;
+    KamabokoInfo    block[MAX_KAMABOKO_NUM];
+    uint16_t        ref[MAX_SENS];      // AT42QT の reference 値
+    uint8_t         noise[MAX_SENS];    // 触っていない時の raw - ref の最大値
+    Tuning          tuning;             // SysEx で変えて保存した値
+
+    auto pad_count() const -> size_t {return static_cast<size_t>(block_count) * MAX_EACH_SENS;}
+};
+
+inline auto calib_crc32(uint32_t crc, const uint8_t* p, size_t len) -> uint32_t {
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= p[i];
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+/// 起動時に読んだ ref が、保存した値と (topology も含めて) 合っているか
+inline auto calib_agrees(const CalibData& stored, const uint16_t* ref, size_t pads) -> bool {
+    if (pads != stored.pad_count()) {return false;}
+    for (size_t i = 0; i < pads; ++i) {
+        int diff = static_cast<int>(ref[i]) - static_cast<int>(stored.ref[i]);
+        if (diff < 0) {diff = -diff;}
+        if (diff > CALIB_REF_TOLERANCE + stored.noise[i]) {return false;}
+    }
+    return true;
+}
+
+// =========================================================
+//      CalibStore Class
+// =========================================================
+// flash の領域に record を追記していく (log 構造)
+// sector の残りに入らなくなったら次の sector を消して続ける。一番大きい seq が最新
+// 書いている途中で電源が切れても、CRC が合わない record は読み飛ばすので一つ前のものが残る
+// sector が一つしかないと、消した直後に電源が切れれば全部なくなるので、読むだけで書かない
+class CalibStore {
+    CalibFlash  flash_;
+    uint32_t    seq_;           // 最新の record の番号
+    size_t      next_page_;     // 次に書く page
+    uint32_t    records_;       // 見つかった正しい record の数
+    uint32_t    erases_;        // この起動で消した sector の数
+    uint8_t     buf_[CALIB_MAX_PAGES * CALIB_PAGE_SIZE];
+    static_assert(CALIB_MAX_PAGES * CALIB_PAGE_SIZE <= 4096, "a record must fit in one flash sector");
+
+// impl CalibStore
+public:
+    CalibStore() : flash_{}, seq_(0), next_page_(0), records_(0), erases_(0), buf_{} {}
+
+    void begin(const CalibFlash& flash) {
+        flash_ = flash;
+        seq_ = 0;
+        next_page_ = 0;
+        records_ = 0;
+        erases_ = 0;
+    }
+    /// 全 page を調べ、一番新しい正しい record を out に読む
+    auto load(CalibData& out) -> bool {
+        const size_t pages = page_count();
+        bool found = false;
+        records_ = 0;
+        size_t page = 0;
+        while (page < pages) {
+            const uint8_t* p = flash_.base + page * CALIB_PAGE_SIZE;
+            uint32_t seq = 0;
+            size_t len = decode(p, flash_.size - page * CALIB_PAGE_SIZE, nullptr, seq);
+            if (len == 0) {
+                page += 1;  // 空き、壊れた record、違う version
+                continue;
+            }
+            size_t used = (len + CALIB_PAGE_SIZE - 1) / CALIB_PAGE_SIZE;
+            records_ += 1;
+            if (!found || (static_cast<int32_t>(seq - seq_) > 0)) {
+                decode(p, len, &out, seq);
+                seq_ = seq;
+                next_page_ = (page + used) % pages;
+                found = true;
+            }
+            page += used;
+        }
+        return found;
+    }
+    /// 新しい record を追記する (writable() でなければ何もしない)
+    auto save(const CalibData& data) -> bool {
+        if (!writable()) {return false;}
+        size_t len = encode(data, seq_ + 1, buf_, sizeof(buf_));
+        if (len == 0) {return false;}
+        const size_t need = (len + CALIB_PAGE_SIZE - 1) / CALIB_PAGE_SIZE;
+        std::memset(buf_ + len, 0xff, need * CALIB_PAGE_SIZE - len);
+
+        const size_t pages = page_count();
+        const size_t per_sector = flash_.sector_size / CALIB_PAGE_SIZE;
+        size_t page = next_page_ % pages;
+        while (true) {
+            size_t sector_end = (page / per_sector + 1) * per_sector;
+            if ((page % per_sector == 0) || (page + need > sector_end)) {
+                // sector の頭から書く時は、古い record ごと消す
+                if (page + need > sector_end) {page = sector_end % pages;}
+                if (!is_blank(page, per_sector)) {
+                    if (flash_.erase(page * CALIB_PAGE_SIZE) != 0) {return false;}
+                    erases_ += 1;
+                }
+                break;
+            }
+            if (is_blank(page, need)) {break;}
+            page += 1;  // 途中で切れた record の跡は飛ばす
+        }
+        if (flash_.program(page * CALIB_PAGE_SIZE, buf_, need * CALIB_PAGE_SIZE) != 0) {return false;}
+        uint32_t seq = 0;
+        if (decode(flash_.base + page * CALIB_PAGE_SIZE, need * CALIB_PAGE_SIZE, nullptr, seq) != len) {
+            return false;   // 書けていない
+        }
+        seq_ = seq;
+        next_page_ = (page + need) % pages;
+        records_ += 1;
+        return true;
+    }
+
+    /// buf に record を作る。入らなければ 0
+    static auto encode(const CalibData& data, uint32_t seq, uint8_t* buf, size_t cap) -> size_t {
+        const size_t blocks = data.block_count;
+        const size_t pads = data.pad_count();
+        if (blocks > MAX_KAMABOKO_NUM) {return 0;}
+        const size_t len = CALIB_HEADER_SIZE + blocks * 2 + pads * 3 + CALIB_TUNING_SIZE;
+        if (len > cap) {return 0;}
+        put32(buf, CALIB_MAGIC);
+        buf[4] = CALIB_VERSION;
+        buf[5] = static_cast<uint8_t>(blocks);
+        put16(buf + 6, static_cast<uint16_t>(pads));
+        put32(buf + 8, seq);
+        uint8_t* p = buf + CALIB_HEADER_SIZE;
+        for (size_t b = 0; b < blocks; ++b) {
+            *p++ = data.block[b].mux;
+            *p++ = data.block[b].channel;
+        }
+        for (size_t i = 0; i < pads; ++i) {
+            put16(p, data.ref[i]);
+            p[2] = data.noise[i];
+            p += 3;
+        }
+        for (size_t i = 0; i < TUNE_PARAMS; ++i) {
+            put16(p, data.tuning.value[i]);
+            p += 2;
+        }
+        put32(buf + 12, record_crc(buf, len));
+        return len;
+    }
+    /// 正しい record なら長さを返す (out が nullptr なら確かめるだけ)
+    static auto decode(const uint8_t* p, size_t avail, CalibData* out, uint32_t& seq) -> size_t {
+        if ((avail < CALIB_HEADER_SIZE) || (get32(p) != CALIB_MAGIC) || (p[4] != CALIB_VERSION)) {return 0;}
+        const size_t blocks = p[5];
+        const size_t pads = get16(p + 6);
+        if ((blocks == 0) || (blocks > MAX_KAMABOKO_NUM) || (pads != blocks * MAX_EACH_SENS)) {return 0;}
+        const size_t len = CALIB_HEADER_SIZE + blocks * 2 + pads * 3 + CALIB_TUNING_SIZE;
+        if ((len > avail) || (get32(p + 12) != record_crc(p, len))) {return 0;}
+        seq = get32(p + 8);
+        if (out != nullptr) {
+            const uint8_t* q = p + CALIB_HEADER_SIZE;
+            out->block_count = static_cast<uint8_t>(blocks);
+            for (size_t b = 0; b < blocks; ++b) {
+                out->block[b] = KamabokoInfo{q[0], q[1], static_cast<uint16_t>(b * MAX_EACH_SENS)};
+                q += 2;
+            }
+            for (size_t i = 0; i < pads; ++i) {
+                out->ref[i] = get16(q);
+                out->noise[i] = q[2];
+                q += 3;
+            }
+            for (size_t i = 0; i < TUNE_PARAMS; ++i) {
+                out->tuning.value[i] = get16(q);
+                q += 2;
+            }
+            out->tuning.sanitize();
+        }
+        return len;
+    }
+
+    /// CALIB_MIN_SECTORS 以上あり、消しても一つ前の record が残る
+    auto writable() const -> bool {
+        return (flash_.base != nullptr) && (flash_.sector_size >= CALIB_PAGE_SIZE) &&
+               (flash_.size >= flash_.sector_size * CALIB_MIN_SECTORS);
+    }
+    auto seq() const -> uint32_t {return seq_;}
+    auto records() const -> uint32_t {return records_;}
+    auto erases() const -> uint32_t {return erases_;}
+    auto next_page() const -> size_t {return next_page_;}
+
+private:
+    auto page_count() const -> size_t {return flash_.size / CALIB_PAGE_SIZE;}
+    auto is_blank(size_t page, size_t count) const -> bool {
+        const uint8_t* p = flash_.base + page * CALIB_PAGE_SIZE;
+        for (size_t i = 0; i < count * CALIB_PAGE_SIZE; ++i) {
+            if (p[i] != 0xff) {return false;}
+        }
+        return true;
+    }
+    static auto record_crc(const uint8_t* p, size_t len) -> uint32_t {
+        uint32_t crc = calib_crc32(0, p, 12);
+        return calib_crc32(crc, p + CALIB_HEADER_SIZE, len - CALIB_HEADER_SIZE);
+    }
+    static void put16(uint8_t* p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+    }
+    static void put32(uint8_t* p, uint32_t v) {
+        put16(p, static_cast<uint16_t>(v));
+        put16(p + 2, static_cast<uint16_t>(v >> 16));
+    }
+    static auto get16(const uint8_t* p) -> uint16_t {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+    static auto get32(const uint8_t* p) -> uint32_t {
+        return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16);
+    }
+};
+#endif // CALIB_STORE_H
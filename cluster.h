@@ -0,0 +1,561 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "telemetry.h"
+#include "sensor_stream.h"  // varint
+#include "tuning.h"
+#include "constants.h"
+
+// =========================================================
+//      Cluster Constants
+// =========================================================
+// 何台かの QUBIT を UART でつなぎ、leader が全部のパッドを一つの ring として扱う
+//  leader の TX → 全 follower の RX (同じ線)
+//  follower の TX → leader の RX (ダイオードで束ねる。follower は呼ばれた時だけ送る)
+// leader は follower を一台ずつ呼び (poll)、follower は直近の sweep のうち触っている辺りのかまぼこだけを返す
+// ring の順は leader のパッド、follower 2, 3, ... のパッド (tuning の cluster の番号の順) で、最後は leader に戻る
+// MIDI は leader だけが出す (follower のタッチは、その board の LED にだけ使う)
+constexpr uint8_t CLUSTER_MAX_BOARDS = 8;           // tuning の cluster の最大値 (1: leader、2-8: follower)
+constexpr uint8_t CLUSTER_LEADER = 1;
+constexpr uint32_t CLUSTER_BAUD = 1000000;
+constexpr uint32_t CLUSTER_BYTE_NS = 10 * (1000000000u / CLUSTER_BAUD);  // start + 8bit + stop
+constexpr uint32_t CLUSTER_REPLY_TIMEOUT_US = 4000; // poll から返事が揃うまで (一番長い返事は約 2.5msec)
+constexpr uint8_t CLUSTER_ABSENT_MISSES = 4;        // 続けてこの回数答えなければ、いないものとする (パッドは 0)
+constexpr uint32_t CLUSTER_PROBE_US = 100000;       // いない board を呼び直す間隔 (一周に一台まで)
+constexpr size_t CLUSTER_MAX_HOT_BLOCKS = 12;       // 一つの返事で送るかまぼこの数 (4 本の指 x 両隣)
+constexpr uint16_t CLUSTER_HOT_LEVEL = 3;           // raw - ref がこれを超えたパッドのあるかまぼこと、その両隣を送る
+constexpr uint8_t CLUSTER_SYNC_WINDOW = 8;          // この数の往復のうち、一番速かったもので時計のずれを決める
+constexpr uint16_t CLUSTER_NO_SNAPSHOT = 0xffff;    // poll の have: leader は何も持っていない
+constexpr uint8_t CLUSTER_UNCHANGED = 0xff;         // 返事の count: leader が持っているものと同じ
+
+//  poll  (leader → follower): [to][seq][have u16][t1 u32]
+//  reply (follower → leader): [from][seq][t1 u32][t2 u32][t3 u32][pads u16][snap][sweep_us u32][count]
+//                             ([block][value varint x MAX_EACH_SENS]) x count
+//   t1-t3 は ClusterClock、snap は中身が変わるたびに進む番号 (have と同じなら count = UNCHANGED で中身は省く)
+//   送らなかったかまぼこは 0
+constexpr size_t CLUSTER_POLL_BYTES = 8;
+constexpr size_t CLUSTER_REPLY_HEADER = 22;
+constexpr size_t CLUSTER_BLOCK_MAX_BYTES = 1 + MAX_EACH_SENS * 3;
+constexpr size_t CLUSTER_MAX_REPLY = CLUSTER_REPLY_HEADER + CLUSTER_MAX_HOT_BLOCKS * CLUSTER_BLOCK_MAX_BYTES;
+static_assert(TUNE_INFO[static_cast<size_t>(TuneParam::CLUSTER)].max == CLUSTER_MAX_BOARDS, "tuning cluster is the board number");
+static_assert(MAX_KAMABOKO_NUM <= 0xff, "block number is one byte");
+
+enum class ClusterRole : uint8_t {STANDALONE, LEADER, FOLLOWER};
+
+/// tuning の cluster の値 → 役割
+inline auto cluster_role_of(uint16_t id) -> ClusterRole {
+    if (id == 0) {return ClusterRole::STANDALONE;}
+    return (id == CLUSTER_LEADER) ? ClusterRole::LEADER : ClusterRole::FOLLOWER;
+}
+
+// UART (ホストでは pipe や偽の線を渡す)
+struct ClusterPort {
+    size_t (*write)(const uint8_t* data, size_t len);  // 待たずに受け付けた byte 数を返す
+    int (*read)();                                      // 届いていなければ -1
+    uint32_t byte_ns;                                   // 1byte の送信時間 (時計のずれの補正。0: 補正しない)
+};
+
+inline auto cluster_get16(const uint8_t* p) -> uint16_t {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+inline auto cluster_get32(const uint8_t* p) -> uint32_t {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/// 送りかけのフレーム (UART の FIFO に入る分ずつ送り、待たない)
+template <size_t CAP>
+struct ClusterTx {
+    uint8_t     buf[CAP];
+    size_t      len = 0;
+    size_t      pos = 0;
+
+    auto busy() const -> bool {return pos < len;}
+    void start(size_t n) {
+        len = n;
+        pos = 0;
+    }
+    void pump(const ClusterPort& port) {
+        if (busy()) {pos += port.write(buf + pos, len - pos);}
+    }
+};
+
+// =========================================================
+//      ClusterClock Class
+// =========================================================
+// follower の時計と leader の時計のずれ (NTP と同じ、一往復の 4 つの時刻から)
+//  t1: leader が poll を送り始めた      t2: follower が poll を受け取った
+//  t3: follower が返事を送り始めた      t4: leader が返事を受け取った
+//  往復 = (t4 - t1) - (t3 - t2)、ずれ = t2 - t1 - 往復 / 2 (行きと帰りが同じ時間とする)
+// 受け取った byte を読むのが task の周期で遅れる分は行きと帰りで違うので、窓の中で往復の一番短いものを使う
+// 時刻は 32bit usec。ずれも 32bit で回して持つので、起動した時刻がどれだけ離れていてもよい
+class ClusterClock {
+    uint32_t    offset_;        // follower - leader
+    uint32_t    rtt_us_;        // offset_ を決めた往復
+    uint32_t    best_offset_;   // 今の窓で一番速かったもの
+    uint32_t    best_rtt_;
+    uint8_t     window_;
+    bool        valid_;
+    bool        settled_;       // 一つ目の窓が終わった (それまでは一番速いものをすぐ使う)
+    uint32_t    samples_;
+    uint32_t    rejected_;      // 往復が負 (時刻がおかしい)
+
+// impl ClusterClock
+public:
+    ClusterClock() {reset();}
+
+    void reset() {
+        offset_ = rtt_us_ = best_offset_ = best_rtt_ = 0;
+        window_ = 0;
+        valid_ = settled_ = false;
+        samples_ = rejected_ = 0;
+    }
+    /// 一往復分を加える。t2 と t4 は受け取り終わった時刻なので、線の上にあった時間 (wire) を引いて揃える
+    void add(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4, uint32_t poll_wire_us, uint32_t reply_wire_us) {
+        const uint32_t there = t2 - poll_wire_us - t1;      // ずれ + 行き
+        const uint32_t back = t4 - reply_wire_us - t3;      // 帰り - ずれ
+        const int32_t rtt = static_cast<int32_t>(there + back);
+        if (rtt < 0) {
+            rejected_ += 1;
+            return;
+        }
+        const uint32_t offset = there - static_cast<uint32_t>(rtt / 2);
+        if ((window_ == 0) || (static_cast<uint32_t>(rtt) < best_rtt_)) {
+            best_rtt_ = static_cast<uint32_t>(rtt);
+            best_offset_ = offset;
+        }
+        window_ += 1;
+        samples_ += 1;
+        if (!settled_ || (window_ >= CLUSTER_SYNC_WINDOW)) {
+            offset_ = best_offset_;
+            rtt_us_ = best_rtt_;
+            valid_ = true;
+        }
+        if (window_ >= CLUSTER_SYNC_WINDOW) {
+            window_ = 0;
+            settled_ = true;
+        }
+    }
+    /// follower の時刻 → leader の時刻
+    auto to_leader(uint32_t follower_us) const -> uint32_t {return follower_us - offset_;}
+    auto to_follower(uint32_t leader_us) const -> uint32_t {return leader_us + offset_;}
+
+    auto valid() const -> bool {return valid_;}
+    auto offset_us() const -> int32_t {return static_cast<int32_t>(offset_);}
+    auto rtt_us() const -> uint32_t {return rtt_us_;}
+    auto samples() const -> uint32_t {return samples_;}
+    auto rejected() const -> uint32_t {return rejected_;}
+};
+
+// =========================================================
+//      ClusterFollower Class
+// =========================================================
+// follower: touch_task で sweep ごとに capture()、Link タスクで service() を呼ぶ
+// 自分が呼ばれたら直近の snapshot を返す (leader が同じものを持っていれば中身は省く)
+class ClusterFollower {
+    ClusterPort port_;
+    TelemetryReader<CLUSTER_POLL_BYTES> reader_;
+    ClusterTx<TELEMETRY_OVERHEAD + CLUSTER_MAX_REPLY> tx_;
+    uint8_t     id_;
+    // snapshot: 触っている辺りのかまぼこ ([block][value varint x MAX_EACH_SENS] x snap_count_)
+    uint8_t     snap_[CLUSTER_MAX_HOT_BLOCKS * CLUSTER_BLOCK_MAX_BYTES];
+    uint16_t    snap_len_;
+    uint8_t     snap_count_;
+    uint8_t     snap_seq_;
+    uint32_t    snap_us_;       // その sweep の時刻 (自分の時計)
+    uint16_t    pads_;
+    uint32_t    last_poll_us_;  // 誰宛てでも、最後に poll を受け取った時刻
+    uint32_t    polls_;         // 自分宛ての poll
+    uint32_t    replies_;
+    uint32_t    unchanged_;     // 中身を省いた返事
+    uint32_t    busy_;          // 前の返事を送っている間に呼ばれた
+    uint32_t    truncated_;     // CLUSTER_MAX_HOT_BLOCKS を超えて送れなかった snapshot
+
+// impl ClusterFollower
+public:
+    explicit ClusterFollower(const ClusterPort& port) :
+        port_(port), reader_(), tx_(), id_(0), snap_{}, snap_len_(0), snap_count_(0), snap_seq_(0), snap_us_(0),
+        pads_(0), last_poll_us_(0), polls_(0), replies_(0), unchanged_(0), busy_(0), truncated_(0) {}
+
+    /// 自分の番号 (2-CLUSTER_MAX_BOARDS)
+    void set_id(uint8_t id) {
+        id_ = id;
+        reader_.reset();
+    }
+    auto id() const -> uint8_t {return id_;}
+
+    /// 新しい sweep ごとに呼ぶ。閾値を超えたパッドのあるかまぼことその両隣を詰め、変わっていれば番号を進める
+    template <typename VALUES>
+    void capture(uint32_t sweep_us, const VALUES& values, size_t pads) {
+        if (pads > static_cast<size_t>(MAX_SENS)) {pads = MAX_SENS;}
+        pads_ = static_cast<uint16_t>(pads);
+        const size_t blocks = pads / MAX_EACH_SENS;
+        bool hot[MAX_KAMABOKO_NUM] = {};
+        for (size_t b = 0; b < blocks; ++b) {
+            for (size_t e = 0; e < MAX_EACH_SENS; ++e) {
+                if (values[b * MAX_EACH_SENS + e] > CLUSTER_HOT_LEVEL) {
+                    hot[b] = true;
+                    break;
+                }
+            }
+        }
+        uint8_t buf[sizeof(snap_)];
+        size_t len = 0;
+        uint8_t count = 0;
+        for (size_t b = 0; b < blocks; ++b) {
+            const bool send = hot[b] || ((b > 0) && hot[b - 1]) || ((b + 1 < blocks) && hot[b + 1]);
+            if (!send) {continue;}
+            if (count >= CLUSTER_MAX_HOT_BLOCKS) {
+                truncated_ += 1;
+                break;
+            }
+            buf[len++] = static_cast<uint8_t>(b);
+            for (size_t e = 0; e < MAX_EACH_SENS; ++e) {
+                len += varint_put(buf + len, values[b * MAX_EACH_SENS + e]);
+            }
+            count += 1;
+        }
+        if ((count == snap_count_) && (len == snap_len_) && (std::memcmp(buf, snap_, len) == 0)) {return;}
+        std::memcpy(snap_, buf, len);
+        snap_len_ = static_cast<uint16_t>(len);
+        snap_count_ = count;
+        snap_seq_ += 1;
+        snap_us_ = sweep_us;
+    }
+    /// 届いた poll を読み、自分宛てなら返事を送り始める
+    void service(uint32_t now_us) {
+        tx_.pump(port_);
+        // 溜まっていた poll のうち最後のものにだけ答える (leader が次の board に移っていたら答えない)
+        bool mine = false;
+        uint8_t seq = 0;
+        uint16_t have = CLUSTER_NO_SNAPSHOT;
+        uint32_t t1 = 0;
+        int c;
+        while ((c = port_.read()) >= 0) {
+            if (!reader_.feed(static_cast<uint8_t>(c))) {continue;}
+            if ((reader_.type() != TelemetryType::CLUSTER_POLL) || (reader_.length() != CLUSTER_POLL_BYTES)) {continue;}
+            const uint8_t* p = reader_.payload();
+            last_poll_us_ = now_us;
+            mine = (id_ != 0) && (p[0] == id_);
+            seq = p[1];
+            have = cluster_get16(p + 2);
+            t1 = cluster_get32(p + 4);
+        }
+        if (!mine) {return;}
+        polls_ += 1;
+        if (tx_.busy()) {
+            busy_ += 1;
+            return;
+        }
+        reply(seq, have, t1, now_us);
+        tx_.pump(port_);
+    }
+
+    auto last_poll_us() const -> uint32_t {return last_poll_us_;}
+    auto polls() const -> uint32_t {return polls_;}
+    auto replies() const -> uint32_t {return replies_;}
+    auto unchanged() const -> uint32_t {return unchanged_;}
+    auto busy() const -> uint32_t {return busy_;}
+    auto truncated() const -> uint32_t {return truncated_;}
+    auto errors() const -> uint32_t {return reader_.errors();}
+    auto snapshot_seq() const -> uint8_t {return snap_seq_;}
+
+private:
+    void reply(uint8_t seq, uint16_t have, uint32_t t1, uint32_t now_us) {
+        TelemetryWriter w(tx_.buf, sizeof(tx_.buf), TelemetryType::CLUSTER_REPLY);
+        w.put(id_);
+        w.put(seq);
+        w.put32(t1);
+        w.put32(now_us);    // t2: 受け取った (読んだ) 時刻
+        w.put32(now_us);    // t3: すぐに送り始める
+        w.put16(pads_);
+        w.put(snap_seq_);
+        w.put32(snap_us_);
+        if (have == snap_seq_) {
+            w.put(CLUSTER_UNCHANGED);
+            unchanged_ += 1;
+        } else {
+            w.put(snap_count_);
+            for (size_t i = 0; i < snap_len_; ++i) {w.put(snap_[i]);}
+        }
+        tx_.start(w.finish());
+        replies_ += 1;
+    }
+};
+
+// =========================================================
+//      ClusterLeader Class
+// =========================================================
+// leader から見た follower 一台
+struct ClusterBoard {
+    bool        known;          // 一度でも答えた (ring の中に場所がある。いなくなっても場所は残す)
+    bool        present;        // 今答えている
+    bool        merged;         // ring に入った (MAX_SENS に収まった)
+    uint8_t     misses;         // 続けて答えなかった回数
+    uint16_t    have;           // 受け取った snapshot の番号 (CLUSTER_NO_SNAPSHOT: 無い)
+    uint16_t    pads;
+    uint16_t    base;           // ring の中の最初のパッド番号
+    bool        fresh;          // touch_task がまだ使っていない snapshot がある
+    uint64_t    sweep_us;       // snapshot の sweep の時刻 (leader の時計)
+    uint64_t    last_poll_us;
+    uint32_t    polls;
+    uint32_t    replies;
+    uint32_t    timeouts;
+    ClusterClock clock;
+    uint16_t    value[MAX_SENS];
+};
+
+// leader: Link タスクで service() を呼び、follower を順に呼ぶ。touch_task は each_remote_pad() で ring に並べる
+//  一周: 答えている board を全部と、いない board を一台まで (CLUSTER_PROBE_US ごと)
+//  一台の待ちは CLUSTER_REPLY_TIMEOUT_US まで。follower の sweep が leader に届くまでは、長くても一周と task の周期
+class ClusterLeader {
+    ClusterPort port_;
+    TelemetryReader<CLUSTER_MAX_REPLY> reader_;
+    ClusterTx<TELEMETRY_OVERHEAD + CLUSTER_POLL_BYTES> tx_;
+    ClusterBoard board_[CLUSTER_MAX_BOARDS + 1];    // 番号 (2-CLUSTER_MAX_BOARDS) で引く
+    uint8_t     order_[CLUSTER_MAX_BOARDS];         // この周に呼ぶ board
+    uint8_t     order_len_;
+    uint8_t     order_pos_;
+    uint8_t     probe_;         // 次に呼び直す、いない board
+    uint8_t     waiting_;       // 返事を待っている board (0: 待っていない)
+    uint8_t     seq_;
+    uint64_t    poll_us_;
+    uint64_t    cycle_start_us_;
+    uint32_t    cycles_;
+    uint32_t    last_cycle_us_;
+    uint32_t    max_cycle_us_;
+    uint32_t    stray_;         // 待っていない / 番号の違う / 壊れた返事
+    uint16_t    local_pads_;
+    uint16_t    pad_count_;
+    bool        overflow_;      // MAX_SENS に入らなかった board がある
+
+// impl ClusterLeader
+public:
+    explicit ClusterLeader(const ClusterPort& port) : port_(port), reader_(), tx_(), local_pads_(0) {reset();}
+
+    /// 誰も知らない所から始める (役割を変えた時)
+    void reset() {
+        for (size_t id = 0; id <= CLUSTER_MAX_BOARDS; ++id) {
+            ClusterBoard& b = board_[id];
+            b.known = b.present = b.merged = b.fresh = false;
+            b.misses = 0;
+            b.have = CLUSTER_NO_SNAPSHOT;
+            b.pads = b.base = 0;
+            b.sweep_us = b.last_poll_us = 0;
+            b.polls = b.replies = b.timeouts = 0;
+            b.clock.reset();
+            std::memset(b.value, 0, sizeof(b.value));
+        }
+        order_len_ = order_pos_ = 0;
+        probe_ = CLUSTER_LEADER + 1;
+        waiting_ = seq_ = 0;
+        poll_us_ = cycle_start_us_ = 0;
+        cycles_ = last_cycle_us_ = max_cycle_us_ = stray_ = 0;
+        overflow_ = false;
+        reader_.reset();
+        tx_.start(0);
+        pad_count_ = local_pads_;
+    }
+    /// leader 自身のパッドの数 (ring の頭)
+    void set_local_pads(size_t pads) {
+        if (pads == local_pads_) {return;}
+        local_pads_ = static_cast<uint16_t>(pads);
+        relayout();
+    }
+    /// 届いた返事を読み、待ちが終わっていれば次の board を呼ぶ
+    void service(uint64_t now_us) {
+        tx_.pump(port_);
+        int c;
+        while ((c = port_.read()) >= 0) {
+            if (reader_.feed(static_cast<uint8_t>(c)) && (reader_.type() == TelemetryType::CLUSTER_REPLY)) {
+                on_reply(reader_.payload(), reader_.length(), now_us);
+            }
+        }
+        if ((waiting_ != 0) && (now_us - poll_us_ >= CLUSTER_REPLY_TIMEOUT_US)) {
+            on_timeout(board_[waiting_]);
+            waiting_ = 0;
+        }
+        if ((waiting_ == 0) && !tx_.busy()) {
+            poll_next(now_us);
+        }
+    }
+
+    /// ring 全体のパッドの数 (leader と、答えたことのある follower)
+    auto pad_count() const -> size_t {return pad_count_;}
+    /// follower のパッドを ring の番号で f(pad, value) に渡す (いなくなった board は 0)
+    template <typename F>
+    void each_remote_pad(F f) const {
+        for (size_t id = CLUSTER_LEADER + 1; id <= CLUSTER_MAX_BOARDS; ++id) {
+            const ClusterBoard& b = board_[id];
+            if (!b.merged) {continue;}
+            for (size_t i = 0; i < b.pads; ++i) {f(b.base + i, b.value[i]);}
+        }
+    }
+    /// 前に呼んだ後に届いた snapshot のうち、一番古い sweep の時刻 (leader の時計)。無ければ 0
+    auto take_fresh_us() -> uint64_t {
+        uint64_t oldest = 0;
+        for (size_t id = CLUSTER_LEADER + 1; id <= CLUSTER_MAX_BOARDS; ++id) {
+            ClusterBoard& b = board_[id];
+            if (!b.fresh) {continue;}
+            b.fresh = false;
+            if ((oldest == 0) || (b.sweep_us < oldest)) {oldest = b.sweep_us;}
+        }
+        return oldest;
+    }
+
+    auto board(size_t id) const -> const ClusterBoard& {return board_[id];}
+    auto cycles() const -> uint32_t {return cycles_;}
+    auto last_cycle_us() const -> uint32_t {return last_cycle_us_;}
+    auto max_cycle_us() const -> uint32_t {return max_cycle_us_;}
+    auto stray() const -> uint32_t {return stray_;}
+    auto errors() const -> uint32_t {return reader_.errors();}
+    auto frames() const -> uint32_t {return reader_.frames();}
+    auto overflow() const -> bool {return overflow_;}
+    void clear_max_cycle() {max_cycle_us_ = 0;}
+
+private:
+    void poll_next(uint64_t now_us) {
+        if (order_pos_ >= order_len_) {start_cycle(now_us);}
+        if (order_pos_ >= order_len_) {return;}     // 呼ぶ board が無い
+        const uint8_t id = order_[order_pos_++];
+        ClusterBoard& b = board_[id];
+        seq_ += 1;
+        TelemetryWriter w(tx_.buf, sizeof(tx_.buf), TelemetryType::CLUSTER_POLL);
+        w.put(id);
+        w.put(seq_);
+        w.put16(b.have);
+        w.put32(static_cast<uint32_t>(now_us));     // t1
+        tx_.start(w.finish());
+        tx_.pump(port_);
+        waiting_ = id;
+        poll_us_ = now_us;
+        b.last_poll_us = now_us;
+        b.polls += 1;
+    }
+    void start_cycle(uint64_t now_us) {
+        if (order_len_ > 0) {
+            cycles_ += 1;
+            last_cycle_us_ = static_cast<uint32_t>(now_us - cycle_start_us_);
+            if (last_cycle_us_ > max_cycle_us_) {max_cycle_us_ = last_cycle_us_;}
+        }
+        cycle_start_us_ = now_us;
+        order_len_ = order_pos_ = 0;
+        for (uint8_t id = CLUSTER_LEADER + 1; id <= CLUSTER_MAX_BOARDS; ++id) {
+            if (board_[id].present) {order_[order_len_++] = id;}
+        }
+        // いない board は一周に一台まで (答えない board で一周が長くならないように)
+        for (uint8_t n = 0; n < CLUSTER_MAX_BOARDS - CLUSTER_LEADER; ++n) {
+            const uint8_t id = probe_;
+            probe_ = (probe_ >= CLUSTER_MAX_BOARDS) ? CLUSTER_LEADER + 1 : probe_ + 1;
+            const ClusterBoard& b = board_[id];
+            if (b.present) {continue;}
+            if ((b.polls == 0) || (now_us - b.last_poll_us >= CLUSTER_PROBE_US)) {
+                order_[order_len_++] = id;
+                break;
+            }
+        }
+    }
+    void on_reply(const uint8_t* p, size_t len, uint64_t now_us) {
+        if ((len < CLUSTER_REPLY_HEADER) || (p[0] != waiting_) || (p[1] != seq_)) {
+            stray_ += 1;
+            return;
+        }
+        ClusterBoard& b = board_[waiting_];
+        const uint8_t count = p[21];
+        if ((count != CLUSTER_UNCHANGED) && !valid_blocks(p + CLUSTER_REPLY_HEADER, len - CLUSTER_REPLY_HEADER, count, cluster_get16(p + 14))) {
+            stray_ += 1;
+            return;
+        }
+        waiting_ = 0;
+        b.replies += 1;
+        b.misses = 0;
+        const uint32_t poll_wire = static_cast<uint32_t>((TELEMETRY_OVERHEAD + CLUSTER_POLL_BYTES) * port_.byte_ns / 1000);
+        const uint32_t reply_wire = static_cast<uint32_t>((TELEMETRY_OVERHEAD + len) * port_.byte_ns / 1000);
+        b.clock.add(cluster_get32(p + 2), cluster_get32(p + 6), cluster_get32(p + 10), static_cast<uint32_t>(now_us),
+                    poll_wire, reply_wire);
+        bool layout = !b.known;
+        b.known = true;
+        b.present = true;
+        uint16_t pads = cluster_get16(p + 14);
+        if (pads > MAX_SENS) {pads = MAX_SENS;}
+        if (pads != b.pads) {
+            b.pads = pads;
+            layout = true;
+        }
+        if (layout) {relayout();}
+
+        const uint8_t snap = p[16];
+        if (count == CLUSTER_UNCHANGED) {return;}   // have と同じ
+        std::memset(b.value, 0, sizeof(b.value));
+        const uint8_t* q = p + CLUSTER_REPLY_HEADER;
+        const uint8_t* end = p + len;
+        for (uint8_t k = 0; k < count; ++k) {
+            const size_t first = static_cast<size_t>(*q++) * MAX_EACH_SENS;
+            for (size_t e = 0; e < MAX_EACH_SENS; ++e) {
+                uint32_t v;
+                q += varint_get(q, end, v);
+                b.value[first + e] = static_cast<uint16_t>(v);
+            }
+        }
+        b.have = snap;
+        // sweep の時刻を leader の時計で (今より前にしかならない)
+        const uint32_t leader32 = b.clock.to_leader(cluster_get32(p + 17));
+        const int32_t ago = static_cast<int32_t>(static_cast<uint32_t>(now_us) - leader32);
+        b.sweep_us = (ago > 0) ? now_us - static_cast<uint32_t>(ago) : now_us;
+        b.fresh = true;
+    }
+    /// かまぼこの番号と varint が全部読めるか (読めなければ何も変えない)
+    static auto valid_blocks(const uint8_t* q, size_t len, uint8_t count, uint16_t pads) -> bool {
+        const uint8_t* end = q + len;
+        for (uint8_t k = 0; k < count; ++k) {
+            if ((q >= end) || ((static_cast<size_t>(*q) + 1) * MAX_EACH_SENS > pads) ||
+                ((static_cast<size_t>(*q) + 1) * MAX_EACH_SENS > static_cast<size_t>(MAX_SENS))) {return false;}
+            q += 1;
+            for (size_t e = 0; e < MAX_EACH_SENS; ++e) {
+                uint32_t v;
+                const size_t n = varint_get(q, end, v);
+                if ((n == 0) || (v > 0xffff)) {return false;}
+                q += n;
+            }
+        }
+        return q == end;
+    }
+    void on_timeout(ClusterBoard& b) {
+        b.timeouts += 1;
+        if (!b.present) {return;}
+        b.misses += 1;
+        if (b.misses < CLUSTER_ABSENT_MISSES) {return;}
+        // いなくなった: 場所は残し、パッドは 0 (戻ってきたら全部送り直してもらう)
+        b.present = false;
+        b.have = CLUSTER_NO_SNAPSHOT;
+        b.fresh = false;
+        std::memset(b.value, 0, sizeof(b.value));
+    }
+    /// leader のパッド、follower の番号の順に並べる
+    void relayout() {
+        size_t base = local_pads_;
+        overflow_ = false;
+        for (size_t id = CLUSTER_LEADER + 1; id <= CLUSTER_MAX_BOARDS; ++id) {
+            ClusterBoard& b = board_[id];
+            b.merged = false;
+            if (!b.known) {continue;}
+            if (base + b.pads > static_cast<size_t>(MAX_SENS)) {
+                overflow_ = true;
+                continue;
+            }
+            b.base = static_cast<uint16_t>(base);
+            b.merged = true;
+            base += b.pads;
+        }
+        pad_count_ = static_cast<uint16_t>(base);
+    }
+};
+#endif // CLUSTER_H
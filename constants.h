@@ -16,14 +16,17 @@ constexpr int CUBIT_VERSION = 0;
 //#define TEST_MODE
 #ifdef TEST_MODE
 constexpr int MAX_KAMABOKO_NUM = 1;
+#elif defined(QUBIT_KAMABOKO_NUM)
+constexpr int MAX_KAMABOKO_NUM = QUBIT_KAMABOKO_NUM;  // ホストのベンチマークで大きさを変える
 #else
-constexpr int MAX_KAMABOKO_NUM = 16;
+constexpr int MAX_KAMABOKO_NUM = 32;  // 入れ物の大きさ。実際の数は起動時の探索で決まる (PCA9544A 8個 x 4ch)
 #endif
 
 constexpr int MAX_EACH_SENS = 6;
 constexpr int MAX_SENS = MAX_EACH_SENS*MAX_KAMABOKO_NUM; // 全センサの数
 
 constexpr size_t MAX_NOTE = 96; // 1system が取りうる最大 Note 番号
+constexpr int ZONE_PADS = static_cast<int>(MAX_NOTE); // 一つの MIDI channel に割り当てるパッドの数。超えた分は次の channel で同じ音域を繰り返す
 constexpr int MAX_LOCATE = MAX_NOTE*100;
 constexpr int MAX_EACH_LIGHT = 6;
 constexpr int MAX_LIGHT = MAX_EACH_LIGHT*MAX_KAMABOKO_NUM;
@@ -50,8 +53,13 @@ constexpr uint8_t PCA9685_OFSADRS = 16;
 #define USE_AT42QT1070  // Touch Sensor: Adrs:0x1B
 #define USE_PCA9544A    // I2C Multiplexer: Adrs:0x70-0x77
 #define USE_SSD1331     // OLED Driver: SPI Device
+#define USE_PROFILER    // 区間ごとの処理時間を集計する (外すと計測コードは消える)
+//#define USE_HEAP_WRAP   // heap_monitor で malloc/free (newlib の中の確保も) を数える。リンクに -Wl,--wrap=_malloc_r,--wrap=_free_r,--wrap=_calloc_r,--wrap=_realloc_r,--wrap=_memalign_r が要る
+//#define USE_CLUSTER     // 何台かを UART でつなぎ、一つの鍵盤にする (cluster.h。USE_PCA9685 が要る)
+//#define USE_HOT_BENCH   // 'x': HOT_FUNC の関数を XIP cache を空にした時と温まった時で測る
+//#define HOT_IN_FLASH    // HOT_FUNC を無効にして flash から実行する (USE_HOT_BENCH と組み合わせて比べる)
 
-void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity);
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us = 0);
 void debug_pt(int pt);
 
 #endif
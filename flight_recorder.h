@@ -0,0 +1,580 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#include "sensor_stream.h"  // varint / zigzag
+#include "calib_store.h"    // CalibFlash / calib_crc32
+#include "tuning.h"
+#include "placement.h"
+#include "board.h"
+#include "constants.h"
+
+// =========================================================
+//      Flight Recorder Constants
+// =========================================================
+// 演奏中にずっと、直近の sweep と出来事を RAM に残しておき、何か起きたら止めて flash に書く
+//  sweep: Core1 が毎 sweep 書く。前の sweep との差分を詰めて、32 回に一回は keyframe
+//  event: Core0 が書く (送った / 受けた MIDI、タッチの状態が変わった時)
+constexpr size_t FLIGHT_SWEEP_BYTES = 32768 * BOARD_HEADROOM;  // 2 のべき乗
+constexpr size_t FLIGHT_EVENT_BYTES = 4096 * BOARD_HEADROOM;   // 2 のべき乗
+constexpr uint8_t FLIGHT_KEYFRAME_INTERVAL = 32;    // 古い方が上書きされても、ここまでで読み始められる
+constexpr uint32_t FLIGHT_MAGIC = 0x544C4651;       // "QFLT" (RAM に残っているか)
+constexpr uint32_t FLIGHT_DUMP_MAGIC = 0x50444651;  // "QFDP" (flash の dump)
+constexpr uint8_t FLIGHT_DUMP_VERSION = 2;         // 2: tuning に cluster を足した
+constexpr size_t FLIGHT_PAGE_SIZE = 256;            // flash の書き込み単位。dump の頭の 1 page が header
+constexpr size_t FLIGHT_DUMP_BYTES = FLIGHT_PAGE_SIZE + FLIGHT_SWEEP_BYTES + FLIGHT_EVENT_BYTES;
+
+//  ring の中の record: [len u16][type u8][...]
+//   K  keyframe  [time u32 varint][pads varint][value varint x pads]
+//   D  delta     [dt varint][変わったパッドの bitmap (pads+7)/8 byte][zigzag(差分) varint x 変わった数]
+//   N  delta     [dt varint][zigzag(差分) 4bit x pads (下位から)][15 以上だったものの (差分 - 15) varint ...]
+//   M  MIDI 送信  [time u32][status][data1][data2]       time は元の sweep の時刻 (qubit_replay と同じ)
+//   I  MIDI 受信  [time u32][status][data1][data2]
+//   T  タッチ     [time u32][slot][flags][note][location x100 i16][intensity i16]  flags bit0: touched
+//   F  止めた所   [time u32][reason]
+enum class FlightRec : uint8_t {
+    KEY = 'K',
+    DELTA = 'D',
+    NIBBLE = 'N',
+    MIDI_OUT = 'M',
+    MIDI_IN = 'I',
+    TRACK = 'T',
+    FREEZE = 'F',
+};
+enum class FlightReason : uint8_t {
+    NONE,
+    SWITCH,     // 左右のスイッチを同時に長押し
+    SYSEX,      // tuning.h の freeze
+    WATCHDOG,   // watchdog で再起動した (RAM に残っていたもの)
+    STALL,      // Core1 の sweep が止まった
+    SERIAL,     // 'f'
+};
+enum class FlightState : uint8_t {
+    ARMED = 1,
+    FROZEN,
+    DUMPED,
+};
+constexpr size_t FLIGHT_EVENT_MAX = 16;
+
+inline auto flight_reason_name(uint8_t reason) -> const char* {
+    static const char* const NAMES[] = {"none", "switch", "sysex", "watchdog", "stall", "serial"};
+    return (reason < sizeof(NAMES) / sizeof(NAMES[0])) ? NAMES[reason] : "?";
+}
+
+inline auto flight_put32(uint8_t* p, uint32_t v) -> size_t {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+    return 4;
+}
+inline auto flight_get32(const uint8_t* p) -> uint32_t {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// =========================================================
+//      FlightRing Class
+// =========================================================
+// 長さ付きの record を入れる ring。一杯なら古い record から捨てて入れる
+// 書くのは一つの core だけ。読むのは止めた (freeze) 後だけなので lock は要らない
+// 再起動しても中身を残すため、constructor では何もしない (reset() で空にする)
+template <size_t N>
+class FlightRing {
+    static_assert((N & (N - 1)) == 0, "FlightRing size must be a power of two");
+
+    uint32_t    head_;          // 書いた byte 数 (折り返さない)
+    uint32_t    tail_;          // 捨てた byte 数
+    uint32_t    records_;       // 今入っている record の数
+    uint32_t    overwritten_;   // 上書きで捨てた record の数
+    uint8_t     buf_[N];
+
+// impl FlightRing
+public:
+    FlightRing() = default;
+
+    void reset() {
+        head_ = 0;
+        tail_ = 0;
+        records_ = 0;
+        overwritten_ = 0;
+    }
+    /// 一つの record を入れる。入らないほど大きいものは捨てる
+    auto HOT_FUNC(push)(const uint8_t* rec, size_t len) -> bool {
+        if ((len == 0) || (len > 0xffff) || (len + 2 > N)) {return false;}
+        while (N - (head_ - tail_) < len + 2) {
+            tail_ += 2 + length_at(tail_);
+            records_ -= 1;
+            overwritten_ += 1;
+        }
+        buf_[head_ & (N - 1)] = static_cast<uint8_t>(len);
+        buf_[(head_ + 1) & (N - 1)] = static_cast<uint8_t>(len >> 8);
+        const size_t idx = (head_ + 2) & (N - 1);
+        const size_t first = (len < N - idx) ? len : N - idx;
+        std::memcpy(buf_ + idx, rec, first);
+        std::memcpy(buf_, rec + first, len - first);
+        head_ += static_cast<uint32_t>(len + 2);
+        records_ += 1;
+        return true;
+    }
+    /// 再起動の後: 長さを辿って head にちょうど着くか (電源を入れた直後のでたらめな RAM を弾く)
+    auto valid() const -> bool {
+        if (head_ - tail_ > N) {return false;}
+        uint32_t p = tail_;
+        uint32_t n = 0;
+        while (p != head_) {
+            if (head_ - p < 2) {return false;}
+            size_t len = length_at(p);
+            if ((len == 0) || (head_ - p - 2 < len)) {return false;}
+            p += static_cast<uint32_t>(2 + len);
+            n += 1;
+        }
+        return n == records_;
+    }
+    /// 古い方から i byte 目 (長さの 2byte も含む)
+    auto byte_at(size_t i) const -> uint8_t {return buf_[(tail_ + i) & (N - 1)];}
+    auto used() const -> size_t {return head_ - tail_;}
+    auto records() const -> uint32_t {return records_;}
+    auto overwritten() const -> uint32_t {return overwritten_;}
+
+private:
+    auto length_at(uint32_t pos) const -> size_t {
+        return buf_[pos & (N - 1)] | (buf_[(pos + 1) & (N - 1)] << 8);
+    }
+};
+
+// =========================================================
+//      FlightSweepEncoder / Decoder
+// =========================================================
+// sensor_stream.h の SweepEncoder と同じく前の sweep との差分だが、数秒分を RAM に入れたいので詰める
+//  触っていない所が静かな時は、変わったパッドだけ (D)
+//  ノイズで全体が少しずつ動く時は、差分をパッドごとに 4bit (N)
+// 毎回、小さくなる方を選ぶ
+template <size_t PADS>
+class FlightSweepEncoder {
+    uint16_t    prev_[PADS];
+    uint32_t    delta_[PADS];   // zigzag(今 - 前)
+    uint32_t    prev_time_us_;
+    uint16_t    pads_;
+    uint8_t     since_key_;
+    bool        force_key_;
+
+// impl FlightSweepEncoder
+public:
+    static constexpr size_t BITMAP_BYTES = (PADS + 7) / 8;
+    static constexpr size_t NIBBLE_BYTES = (PADS + 1) / 2;
+    static constexpr size_t MAX_RECORD = 1 + 5 + 3 + (BITMAP_BYTES > NIBBLE_BYTES ? BITMAP_BYTES : NIBBLE_BYTES) + PADS * 3;
+    static constexpr uint32_t NIBBLE_ESCAPE = 15;   // これ以上の差分は、nibble の後ろに varint で書く
+
+    FlightSweepEncoder() = default;
+
+    /// 次は keyframe にする (最初に必ず呼ぶ)
+    void reset() {force_key_ = true;}
+    /// 最後に書いた sweep の時刻
+    auto last_time_us() const -> uint32_t {return prev_time_us_;}
+    /// 一回分の sweep を buf (MAX_RECORD 以上) に書き、長さを返す
+    template <typename VALUES>
+    auto HOT_FUNC(encode)(uint8_t* buf, uint32_t time_us, const VALUES& values, size_t pads) -> size_t {
+        if (pads > PADS) {pads = PADS;}
+        const bool key = force_key_ || (pads != pads_) || (since_key_ >= FLIGHT_KEYFRAME_INTERVAL);
+        size_t n = 0;
+        if (key) {
+            buf[n++] = static_cast<uint8_t>(FlightRec::KEY);
+            n += varint_put(buf + n, time_us);
+            n += varint_put(buf + n, static_cast<uint32_t>(pads));
+            for (size_t i = 0; i < pads; ++i) {
+                prev_[i] = static_cast<uint16_t>(values[i]);
+                n += varint_put(buf + n, prev_[i]);
+            }
+            pads_ = static_cast<uint16_t>(pads);
+            since_key_ = 0;
+            force_key_ = false;
+            prev_time_us_ = time_us;
+            return n;
+        }
+        // 差分を取りながら、二つの形の大きさを数える
+        size_t sparse = (pads + 7) / 8;
+        size_t nibble = (pads + 1) / 2;
+        for (size_t i = 0; i < pads; ++i) {
+            uint16_t v = static_cast<uint16_t>(values[i]);
+            uint32_t z = zigzag(static_cast<int32_t>(v) - prev_[i]);
+            prev_[i] = v;
+            delta_[i] = z;
+            if (z != 0) {sparse += varint_len(z);}
+            if (z >= NIBBLE_ESCAPE) {nibble += varint_len(z - NIBBLE_ESCAPE);}
+        }
+        const bool use_nibble = nibble < sparse;
+        buf[n++] = static_cast<uint8_t>(use_nibble ? FlightRec::NIBBLE : FlightRec::DELTA);
+        n += varint_put(buf + n, time_us - prev_time_us_);
+        prev_time_us_ = time_us;
+        since_key_ += 1;
+        uint8_t* head = buf + n;
+        if (use_nibble) {
+            const size_t bytes = (pads + 1) / 2;
+            n += bytes;
+            for (size_t i = 0; i < bytes; ++i) {head[i] = 0;}
+            for (size_t i = 0; i < pads; ++i) {
+                uint32_t z = delta_[i];
+                uint8_t code = static_cast<uint8_t>(z < NIBBLE_ESCAPE ? z : NIBBLE_ESCAPE);
+                head[i >> 1] |= static_cast<uint8_t>(code << ((i & 1) * 4));
+                if (code == NIBBLE_ESCAPE) {n += varint_put(buf + n, z - NIBBLE_ESCAPE);}
+            }
+        } else {
+            const size_t bytes = (pads + 7) / 8;
+            n += bytes;
+            for (size_t i = 0; i < bytes; ++i) {head[i] = 0;}
+            for (size_t i = 0; i < pads; ++i) {
+                if (delta_[i] == 0) {continue;}
+                head[i >> 3] |= static_cast<uint8_t>(1 << (i & 7));
+                n += varint_put(buf + n, delta_[i]);
+            }
+        }
+        return n;
+    }
+
+private:
+    static auto varint_len(uint32_t v) -> size_t {
+        return (v < (1u << 7)) ? 1 : (v < (1u << 14)) ? 2 : (v < (1u << 21)) ? 3 : (v < (1u << 28)) ? 4 : 5;
+    }
+};
+
+template <size_t PADS>
+class FlightSweepDecoder {
+    uint16_t    values_[PADS];
+    uint32_t    time_us_;
+    size_t      pads_;
+    bool        synced_;    // keyframe を読むまでは値が決まらない
+
+// impl FlightSweepDecoder
+public:
+    FlightSweepDecoder() : values_{}, time_us_(0), pads_(0), synced_(false) {}
+
+    /// record (長さの後ろから) を一つ読む。値が確定したら true
+    auto decode(const uint8_t* p, size_t len) -> bool {
+        const uint8_t* end = p + len;
+        if (len < 1) {return false;}
+        const FlightRec type = static_cast<FlightRec>(*p++);
+        uint32_t t, v;
+        size_t n;
+        if ((n = varint_get(p, end, t)) == 0) {return false;}
+        p += n;
+        if (type == FlightRec::KEY) {
+            uint32_t pads;
+            if ((n = varint_get(p, end, pads)) == 0) {return false;}
+            p += n;
+            if (pads > PADS) {return false;}
+            for (size_t i = 0; i < pads; ++i) {
+                if ((n = varint_get(p, end, v)) == 0) {return false;}
+                p += n;
+                values_[i] = static_cast<uint16_t>(v);
+            }
+            pads_ = pads;
+            time_us_ = t;
+            synced_ = true;
+            return true;
+        }
+        if (!synced_) {return false;}
+        const uint8_t* head = p;
+        if (type == FlightRec::NIBBLE) {
+            p += (pads_ + 1) / 2;
+            if (p > end) {return false;}
+            for (size_t i = 0; i < pads_; ++i) {
+                v = (head[i >> 1] >> ((i & 1) * 4)) & 0x0f;
+                if (v == FlightSweepEncoder<PADS>::NIBBLE_ESCAPE) {
+                    uint32_t rest;
+                    if ((n = varint_get(p, end, rest)) == 0) {return false;}
+                    p += n;
+                    v += rest;
+                }
+                values_[i] = static_cast<uint16_t>(values_[i] + unzigzag(v));
+            }
+        } else if (type == FlightRec::DELTA) {
+            p += (pads_ + 7) / 8;
+            if (p > end) {return false;}
+            for (size_t i = 0; i < pads_; ++i) {
+                if ((head[i >> 3] & (1 << (i & 7))) == 0) {continue;}
+                if ((n = varint_get(p, end, v)) == 0) {return false;}
+                p += n;
+                values_[i] = static_cast<uint16_t>(values_[i] + unzigzag(v));
+            }
+        } else {
+            return false;
+        }
+        time_us_ += t;
+        return true;
+    }
+    auto value(size_t pad) const -> uint16_t {return values_[pad];}
+    auto time_us() const -> uint32_t {return time_us_;}
+    auto pads() const -> size_t {return pads_;}
+};
+
+// =========================================================
+//      FlightRecorder Class
+// =========================================================
+// __uninitialized_ram (placement.h の NOINIT_DATA) に置くので、watchdog で再起動しても中身が残る
+// 起動の直後は前の中身なので、survived() で確かめてから dump し、arm() で空にする
+// 書き込み: record_sweep は Core1、それ以外は Core0。どちらも state が ARMED の時だけ
+template <size_t PADS, size_t SWEEP_BYTES, size_t EVENT_BYTES>
+class FlightRecorder {
+    uint32_t                        magic_;
+    volatile FlightState            state_;
+    FlightReason                    reason_;
+    uint16_t                        pads_;
+    uint32_t                        frozen_us_;
+    FlightSweepEncoder<PADS>        encoder_;       // Core1 だけが使う
+    uint8_t                         scratch_[FlightSweepEncoder<PADS>::MAX_RECORD];
+    FlightRing<SWEEP_BYTES>         sweeps_;
+    FlightRing<EVENT_BYTES>         events_;
+
+// impl FlightRecorder
+public:
+    using Sweeps = FlightRing<SWEEP_BYTES>;
+    using Events = FlightRing<EVENT_BYTES>;
+
+    FlightRecorder() = default;
+
+    /// 空にして記録を始める (書く側の core が止まっているか、記録していない時に呼ぶ)
+    void arm(size_t pads) {
+        sweeps_.reset();
+        events_.reset();
+        encoder_.reset();
+        reason_ = FlightReason::NONE;
+        pads_ = static_cast<uint16_t>(pads);
+        frozen_us_ = 0;
+        magic_ = FLIGHT_MAGIC;
+        std::atomic_thread_fence(std::memory_order_release);   // 空にしてから、もう一方の core に見せる
+        state_ = FlightState::ARMED;
+    }
+    /// 起動した時に、前の起動の記録が壊れずに残っているか
+    auto survived() const -> bool {
+        return (magic_ == FLIGHT_MAGIC) &&
+               ((state_ == FlightState::ARMED) || (state_ == FlightState::FROZEN)) &&
+               sweeps_.valid() && events_.valid();
+    }
+    auto recording() const -> bool {return state_ == FlightState::ARMED;}
+
+    /// Core1: 毎 sweep
+    template <typename VALUES>
+    void HOT_FUNC(record_sweep)(uint32_t time_us, const VALUES& values, size_t pads) {
+        if (state_ != FlightState::ARMED) {return;}
+        size_t len = encoder_.encode(scratch_, time_us, values, pads);
+        sweeps_.push(scratch_, len);
+    }
+    /// Core0: MIDI の送信 (FlightRec::MIDI_OUT) / 受信 (FlightRec::MIDI_IN)
+    void record_midi(FlightRec type, uint32_t time_us, uint8_t status, uint8_t data1, uint8_t data2) {
+        if (state_ != FlightState::ARMED) {return;}
+        uint8_t rec[FLIGHT_EVENT_MAX];
+        rec[0] = static_cast<uint8_t>(type);
+        size_t n = 1 + flight_put32(rec + 1, time_us);
+        rec[n++] = status;
+        rec[n++] = data1;
+        rec[n++] = data2;
+        events_.push(rec, n);
+    }
+    /// Core0: タッチの状態が変わった時
+    void record_track(uint32_t time_us, uint8_t slot, bool touched, uint8_t note, int16_t location_x100, int16_t intensity) {
+        if (state_ != FlightState::ARMED) {return;}
+        uint8_t rec[FLIGHT_EVENT_MAX];
+        rec[0] = static_cast<uint8_t>(FlightRec::TRACK);
+        size_t n = 1 + flight_put32(rec + 1, time_us);
+        rec[n++] = slot;
+        rec[n++] = touched ? 1 : 0;
+        rec[n++] = note;
+        rec[n++] = static_cast<uint8_t>(location_x100);
+        rec[n++] = static_cast<uint8_t>(static_cast<uint16_t>(location_x100) >> 8);
+        rec[n++] = static_cast<uint8_t>(intensity);
+        rec[n++] = static_cast<uint8_t>(static_cast<uint16_t>(intensity) >> 8);
+        events_.push(rec, n);
+    }
+    /// 記録を止める。ARMED でなければ (もう止まっている) false
+    auto freeze(FlightReason reason, uint32_t now_us) -> bool {
+        if (state_ != FlightState::ARMED) {return false;}
+        uint8_t rec[FLIGHT_EVENT_MAX];
+        rec[0] = static_cast<uint8_t>(FlightRec::FREEZE);
+        size_t n = 1 + flight_put32(rec + 1, now_us);
+        rec[n++] = static_cast<uint8_t>(reason);
+        events_.push(rec, n);
+        reason_ = reason;
+        frozen_us_ = now_us;
+        state_ = FlightState::FROZEN;
+        return true;
+    }
+    void mark_dumped() {state_ = FlightState::DUMPED;}
+
+    auto state() const -> FlightState {return state_;}
+    auto reason() const -> FlightReason {return reason_;}
+    auto pads() const -> size_t {return pads_;}
+    auto frozen_us() const -> uint32_t {return frozen_us_;}
+    auto last_sweep_us() const -> uint32_t {return encoder_.last_time_us();}
+    auto sweeps() const -> const Sweeps& {return sweeps_;}
+    auto events() const -> const Events& {return events_;}
+};
+using QubitFlightRecorder = FlightRecorder<MAX_SENS, FLIGHT_SWEEP_BYTES, FLIGHT_EVENT_BYTES>;
+static_assert(std::is_trivially_default_constructible<QubitFlightRecorder>::value,
+              "the recorder lives in uninitialized RAM: no constructor may clear it");
+
+// =========================================================
+//      Flight Dump
+// =========================================================
+//  flash の領域の頭から:
+//   page 0: header
+//    [magic u32][version u8][reason u8][pads u16][seq u32][frozen_us u32]
+//    [sweep bytes u32][sweep records u32][sweep overwritten u32]
+//    [event bytes u32][event records u32][event overwritten u32]
+//    [body crc32 u32][tuning u16 x TUNE_PARAMS] ... [header crc32 u32 (page の最後)]
+//   page 1-: sweep ring の中身 (古い順、[len u16][record] の並び)、続けて event ring の中身
+struct FlightDumpInfo {
+    uint8_t     reason;
+    uint16_t    pads;
+    uint32_t    seq;
+    uint32_t    frozen_us;
+    uint32_t    sweep_bytes;
+    uint32_t    sweep_records;
+    uint32_t    sweep_overwritten;
+    uint32_t    event_bytes;
+    uint32_t    event_records;
+    uint32_t    event_overwritten;
+    Tuning      tuning;
+
+    auto total_bytes() const -> size_t {return FLIGHT_PAGE_SIZE + sweep_bytes + event_bytes;}
+};
+constexpr size_t FLIGHT_HEADER_TUNING = 44;
+static_assert(FLIGHT_HEADER_TUNING + TUNE_PARAMS * 2 + 4 <= FLIGHT_PAGE_SIZE, "flight dump header must fit in one page");
+
+/// header を読む。header と中身の crc が合えば true (image は dump の全体)
+inline auto flight_dump_read(const uint8_t* image, size_t avail, FlightDumpInfo& out) -> bool {
+    if ((avail < FLIGHT_PAGE_SIZE) || (flight_get32(image) != FLIGHT_DUMP_MAGIC) || (image[4] != FLIGHT_DUMP_VERSION)) {
+        return false;
+    }
+    if (flight_get32(image + FLIGHT_PAGE_SIZE - 4) != calib_crc32(0, image, FLIGHT_PAGE_SIZE - 4)) {return false;}
+    out.reason = image[5];
+    out.pads = static_cast<uint16_t>(image[6] | (image[7] << 8));
+    out.seq = flight_get32(image + 8);
+    out.frozen_us = flight_get32(image + 12);
+    out.sweep_bytes = flight_get32(image + 16);
+    out.sweep_records = flight_get32(image + 20);
+    out.sweep_overwritten = flight_get32(image + 24);
+    out.event_bytes = flight_get32(image + 28);
+    out.event_records = flight_get32(image + 32);
+    out.event_overwritten = flight_get32(image + 36);
+    for (size_t i = 0; i < TUNE_PARAMS; ++i) {
+        const uint8_t* p = image + FLIGHT_HEADER_TUNING + i * 2;
+        out.tuning.value[i] = static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+    if ((out.sweep_bytes > avail) || (out.event_bytes > avail) || (out.total_bytes() > avail)) {return false;}
+    return flight_get32(image + 40) == calib_crc32(0, image + FLIGHT_PAGE_SIZE, out.sweep_bytes + out.event_bytes);
+}
+
+/// 止めた記録を flash の領域に書く (Core0。書いている間 Core1 は止まる)
+template <typename RECORDER>
+auto flight_dump_write(const RECORDER& rec, const CalibFlash& flash, const Tuning& tuning, uint32_t seq) -> bool {
+    const auto& sweeps = rec.sweeps();
+    const auto& events = rec.events();
+    const size_t body = sweeps.used() + events.used();
+    const size_t total = FLIGHT_PAGE_SIZE + body;
+    if ((flash.base == nullptr) || (flash.sector_size == 0) || (total > flash.size)) {return false;}
+    for (size_t offset = 0; offset < total; offset += flash.sector_size) {
+        if (flash.erase(offset) != 0) {return false;}
+    }
+    // 中身を page ごとに書き、crc を取っておく
+    uint8_t page[FLIGHT_PAGE_SIZE];
+    uint32_t crc = 0;
+    size_t pos = 0;
+    size_t offset = FLIGHT_PAGE_SIZE;
+    while (pos < body) {
+        size_t n = 0;
+        for (; (n < FLIGHT_PAGE_SIZE) && (pos < body); ++n, ++pos) {
+            page[n] = (pos < sweeps.used()) ? sweeps.byte_at(pos) : events.byte_at(pos - sweeps.used());
+        }
+        crc = calib_crc32(crc, page, n);
+        std::memset(page + n, 0xff, FLIGHT_PAGE_SIZE - n);
+        if (flash.program(offset, page, FLIGHT_PAGE_SIZE) != 0) {return false;}
+        offset += FLIGHT_PAGE_SIZE;
+    }
+    // header は最後に書く (途中で電源が切れたら dump は無いことになる)
+    std::memset(page, 0xff, FLIGHT_PAGE_SIZE);
+    flight_put32(page, FLIGHT_DUMP_MAGIC);
+    page[4] = FLIGHT_DUMP_VERSION;
+    page[5] = static_cast<uint8_t>(rec.reason());
+    page[6] = static_cast<uint8_t>(rec.pads());
+    page[7] = static_cast<uint8_t>(rec.pads() >> 8);
+    flight_put32(page + 8, seq);
+    flight_put32(page + 12, rec.frozen_us());
+    flight_put32(page + 16, static_cast<uint32_t>(sweeps.used()));
+    flight_put32(page + 20, sweeps.records());
+    flight_put32(page + 24, sweeps.overwritten());
+    flight_put32(page + 28, static_cast<uint32_t>(events.used()));
+    flight_put32(page + 32, events.records());
+    flight_put32(page + 36, events.overwritten());
+    flight_put32(page + 40, crc);
+    for (size_t i = 0; i < TUNE_PARAMS; ++i) {
+        page[FLIGHT_HEADER_TUNING + i * 2] = static_cast<uint8_t>(tuning.value[i]);
+        page[FLIGHT_HEADER_TUNING + i * 2 + 1] = static_cast<uint8_t>(tuning.value[i] >> 8);
+    }
+    flight_put32(page + FLIGHT_PAGE_SIZE - 4, calib_crc32(0, page, FLIGHT_PAGE_SIZE - 4));
+    if (flash.program(0, page, FLIGHT_PAGE_SIZE) != 0) {return false;}
+    FlightDumpInfo check;
+    return flight_dump_read(flash.base, flash.size, check) && (check.seq == seq);
+}
+
+// =========================================================
+//      FlightUpload Class
+// =========================================================
+// 'd': flash の dump を [offset u32][data] の FLIGHT フレームにして頭から順に送る
+// 一フレームが CDC の送信 FIFO に丸ごと入るよう、FLIGHT_UPLOAD_CHUNK ずつに分ける
+constexpr size_t FLIGHT_UPLOAD_CHUNK = 128;
+constexpr size_t FLIGHT_UPLOAD_FRAME = TELEMETRY_OVERHEAD + 4 + FLIGHT_UPLOAD_CHUNK;
+static_assert(FLIGHT_UPLOAD_FRAME <= TELEMETRY_TX_FIFO, "an upload frame must fit in the CDC TX FIFO");
+
+class FlightUpload {
+    const uint8_t*  image_;
+    size_t          pos_;
+    size_t          end_;
+
+// impl FlightUpload
+public:
+    FlightUpload() : image_(nullptr), pos_(0), end_(0) {}
+
+    void start(const uint8_t* image, size_t total) {
+        image_ = image;
+        pos_ = 0;
+        end_ = (image != nullptr) ? total : 0;
+    }
+    auto active() const -> bool {return pos_ < end_;}
+    auto position() const -> size_t {return pos_;}
+    /// room (送信 FIFO の空き) に入るなら次のフレームを frame に作って長さを返す。入らない時と終わった時は 0
+    auto next(uint8_t* frame, size_t cap, size_t room) -> size_t {
+        if (!active()) {return 0;}
+        const size_t n = (end_ - pos_ < FLIGHT_UPLOAD_CHUNK) ? end_ - pos_ : FLIGHT_UPLOAD_CHUNK;
+        if (room < TELEMETRY_OVERHEAD + 4 + n) {return 0;}
+        TelemetryWriter w(frame, cap, TelemetryType::FLIGHT);
+        w.put32(static_cast<uint32_t>(pos_));
+        for (size_t i = 0; i < n; i++) {w.put(image_[pos_ + i]);}
+        const size_t len = w.finish();
+        if (len != 0) {pos_ += n;}
+        return len;
+    }
+};
+
+/// [len u16][record] の並びを一つずつ fn(record, len) に渡す。途中で壊れていれば false
+template <typename FN>
+auto flight_each_record(const uint8_t* p, size_t bytes, FN fn) -> bool {
+    size_t pos = 0;
+    while (pos + 2 <= bytes) {
+        size_t len = p[pos] | (p[pos + 1] << 8);
+        if ((len == 0) || (pos + 2 + len > bytes)) {return false;}
+        fn(p + pos + 2, len);
+        pos += 2 + len;
+    }
+    return pos == bytes;
+}
+#endif // FLIGHT_RECORDER_H
@@ -12,16 +12,23 @@
 #ifndef GLOBAL_TIMER_H
 #define GLOBAL_TIMER_H
  
+#include <cstdint>
+#ifdef ARDUINO
 #include <Arduino.h>
+#endif
 
 constexpr int MINIMUM_RESOLUTION = 2; // 2msec
+constexpr uint32_t MINIMUM_RESOLUTION_US = MINIMUM_RESOLUTION*1000;
+
+//  usec の時刻 (Timebase) から、従来の 2msec 単位の globalTime と
+//  10msec/100msec/1sec イベントを作る互換層。割り込みは使わない
 
 class GlobalTimer {
 
 public:
-  GlobalTimer( void ) : _globalTime(0), _gtOld(0), _timer100msec(0), _timer100msec_sabun(0),
-                        _timer1sec(0), _timer1sec_sabun(0), _timer10msec_event(false),
-                        _timer100msec_event(false), _timer1sec_event(false) {}
+  GlobalTimer( void ) : _timer10msec_event(false), _timer100msec_event(false), _timer1sec_event(false),
+                        _globalTime(0), _gtOld(0), _timer10msec(0), _timer10msec_sabun(0),
+                        _timer100msec(0), _timer100msec_sabun(0), _timer1sec(0), _timer1sec_sabun(0) {}
 
   void      setGlobalTime( uint16_t tm ){ _globalTime = tm;}
   void      incGlobalTime( void ){ _globalTime++;}
@@ -33,6 +40,23 @@ public:
   uint16_t  timer10ms( void ) const { return _timer10msec;}
   uint16_t  timer100ms( void ) const { return _timer100msec;}
   uint16_t  timer1s( void ) const { return _timer1sec;}
+  uint32_t  missed10ms( void ) const { return _missed10msec;}  // 一回の loop で 10msec 以上経過して畳まれた回数
+
+  //  前回からの経過を 2msec 単位で返す (端数は次回に繰り越す)
+  long      advanceTo( uint64_t nowUs )
+  {
+    if ( !_usStarted ){
+      _lastUs = nowUs;
+      _usStarted = true;
+      return 0;
+    }
+    uint64_t  elapsed = nowUs - _lastUs + _usCarry;
+    _lastUs = nowUs;
+    long      ticks = static_cast<long>(elapsed / MINIMUM_RESOLUTION_US);
+    _usCarry = static_cast<uint32_t>(elapsed % MINIMUM_RESOLUTION_US);
+    _globalTime = static_cast<uint16_t>(_globalTime + ticks);
+    return ticks;
+  }
 
   void      clearAllTimerEvent( void ){ _timer10msec_event = _timer100msec_event = _timer1sec_event = false;}
   bool      timer10msecEvent( void ) const { return _timer10msec_event;}
@@ -42,11 +66,14 @@ public:
   void      updateTimer( long diff )
   {
     _timer10msec_sabun += (uint16_t)diff;
+    int folded = 0;
     while ( _timer10msec_sabun >= 10/MINIMUM_RESOLUTION ){
       _timer10msec++;
       _timer10msec_event = true;
       _timer10msec_sabun -= 10/MINIMUM_RESOLUTION;
+      folded++;
     }
+    if ( folded > 1 ){ _missed10msec += folded - 1; }
 
     _timer100msec_sabun += (uint16_t)diff;
     while ( _timer100msec_sabun >= 100/MINIMUM_RESOLUTION ){
@@ -76,5 +103,9 @@ private:
   uint16_t  _timer100msec_sabun;
   uint16_t  _timer1sec;
   uint16_t  _timer1sec_sabun;
+  uint32_t  _missed10msec = 0;
+  uint64_t  _lastUs = 0;
+  uint32_t  _usCarry = 0;
+  bool      _usStarted = false;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <cstdint>
+
+// =========================================================
+//      Governor Constants
+// =========================================================
+constexpr uint32_t GOV_WINDOW_US = 100000;      // slack を集計する期間
+constexpr uint32_t GOV_LOW_SLACK_PCT = 10;      // これを下回ったら負荷が高い
+constexpr uint32_t GOV_HIGH_SLACK_PCT = 30;     // これを上回ったら余裕がある
+constexpr uint32_t GOV_TOUCH_LATE_US = 2000;    // touch の遅れの上限
+constexpr uint32_t GOV_RECOVER_WINDOWS = 5;     // 余裕が続いたら一段階戻す
+
+// =========================================================
+//      OverloadGovernor Class
+// =========================================================
+// Core0 の空き時間 (slack = 1 - タスクが走った時間 / 期間) と touch タスクの遅れを測り、
+// 負荷が高い時は決まった順序で仕事を減らす。touch→MIDI は減らさない
+enum class LoadLevel : uint8_t {
+    NORMAL,         // 全部やる
+    SKIP_DISPLAY,   // 表示ページの更新を飛ばす
+    NO_AMBIENT,     // 背景の白色アニメーションをやめる
+    LOW_LED_RATE,   // LED のフレームレートを下げる
+};
+constexpr uint8_t MAX_LOAD_LEVEL = static_cast<uint8_t>(LoadLevel::LOW_LED_RATE);
+
+class OverloadGovernor {
+    LoadLevel   level_;
+    uint64_t    window_start_us_;
+    uint32_t    busy_us_;           // この期間にタスクが走っていた時間の合計
+    uint32_t    max_touch_late_us_; // この期間の touch タスクの最大の遅れ
+    uint32_t    good_windows_;
+    uint8_t     last_slack_pct_;
+
+    // 外から見るためのカウンタ
+    uint32_t    shed_display_;
+    uint32_t    shed_ambient_;
+    uint32_t    shed_led_;
+    uint32_t    level_changes_;
+
+// impl OverloadGovernor
+public:
+    OverloadGovernor() :
+        level_(LoadLevel::NORMAL),
+        window_start_us_(0),
+        busy_us_(0),
+        max_touch_late_us_(0),
+        good_windows_(0),
+        last_slack_pct_(100),
+        shed_display_(0),
+        shed_ambient_(0),
+        shed_led_(0),
+        level_changes_(0) {}
+
+    /// loop() 一回分の sched.run() を記録する。ran ならその時間は busy
+    /// それ以外 (何も起動しなかった run()、run() の外の仕事、loop() の呼ばれる間) は slack とみなす
+    void account_loop(uint64_t start_us, uint64_t end_us, bool ran) {
+        if (window_start_us_ == 0) {
+            window_start_us_ = start_us;
+        }
+        if (ran) {
+            busy_us_ += static_cast<uint32_t>(end_us - start_us);
+        }
+        if (end_us - window_start_us_ >= GOV_WINDOW_US) {
+            close_window(static_cast<uint32_t>(end_us - window_start_us_));
+            window_start_us_ = end_us;
+        }
+    }
+    /// touch タスクの起動の遅れを記録する
+    void account_touch_late(uint32_t late_us) {
+        if (late_us > max_touch_late_us_) {
+            max_touch_late_us_ = late_us;
+        }
+    }
+
+    auto level() const -> LoadLevel {return level_;}
+    auto level_num() const -> uint8_t {return static_cast<uint8_t>(level_);}
+    auto slack_pct() const -> uint8_t {return last_slack_pct_;}
+    auto shed_display() const -> uint32_t {return shed_display_;}
+    auto shed_ambient() const -> uint32_t {return shed_ambient_;}
+    auto shed_led() const -> uint32_t {return shed_led_;}
+    auto shed_total() const -> uint32_t {return shed_display_ + shed_ambient_ + shed_led_;}
+    auto level_changes() const -> uint32_t {return level_changes_;}
+
+    /// 各段階で仕事を減らすかどうか。減らしたらカウントする
+    auto shed_display_page() -> bool {
+        if (level_ < LoadLevel::SKIP_DISPLAY) {return false;}
+        shed_display_ += 1;
+        return true;
+    }
+    auto shed_ambient_frame() -> bool {
+        if (level_ < LoadLevel::NO_AMBIENT) {return false;}
+        shed_ambient_ += 1;
+        return true;
+    }
+    auto low_led_rate() const -> bool {
+        return level_ >= LoadLevel::LOW_LED_RATE;
+    }
+    void count_shed_led_frames(uint32_t frames) {
+        shed_led_ += frames;
+    }
+
+private:
+    void close_window(uint32_t window_us) {
+        uint32_t busy_pct = (static_cast<uint64_t>(busy_us_) * 100) / window_us;
+        uint32_t slack_pct = busy_pct >= 100 ? 0 : 100 - busy_pct;
+        last_slack_pct_ = static_cast<uint8_t>(slack_pct);
+        bool pressure = (slack_pct < GOV_LOW_SLACK_PCT) || (max_touch_late_us_ > GOV_TOUCH_LATE_US);
+        bool relaxed = (slack_pct > GOV_HIGH_SLACK_PCT) && (max_touch_late_us_ <= GOV_TOUCH_LATE_US / 4);
+
+        if (pressure) {
+            // 負荷が高い: 一段階ずつ減らす
+            good_windows_ = 0;
+            if (level_num() < MAX_LOAD_LEVEL) {
+                level_ = static_cast<LoadLevel>(level_num() + 1);
+                level_changes_ += 1;
+            }
+        } else if (relaxed) {
+            // 余裕が続いたら一段階ずつ戻す
+            good_windows_ += 1;
+            if ((good_windows_ >= GOV_RECOVER_WINDOWS) && (level_ != LoadLevel::NORMAL)) {
+                level_ = static_cast<LoadLevel>(level_num() - 1);
+                level_changes_ += 1;
+                good_windows_ = 0;
+            }
+        } else {
+            good_windows_ = 0;
+        }
+        busy_us_ = 0;
+        max_touch_late_us_ = 0;
+    }
+};
+#endif // GOVERNOR_H
@@ -0,0 +1,209 @@
+/* ========================================
+ *
+ *	heap_monitor.cpp
+ *		description: Heap use instrumentation
+ *
+ *	Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ * ========================================
+*/
+#include  <cstdlib>
+#include  <new>
+#include  <malloc.h>
+
+#include  "heap_monitor.h"
+
+#if defined(ARDUINO)
+#include  <Arduino.h>     // get_core_num()
+#include  "constants.h"
+  #ifdef USE_HEAP_WRAP
+    #define HEAP_HOOK_NEWLIB
+  #endif
+#else
+  // ホスト (tools/heap_check): glibc の malloc/free を --wrap で数える
+  #define HEAP_HOOK_HOST
+  static inline unsigned get_core_num( void ){ return 0; }
+#endif
+
+//---------------------------------------------------------
+//  数は core ごとに持ち、それぞれの core は自分の分だけを書く
+//  (read-modify-write が二つの core でぶつからない)
+//---------------------------------------------------------
+constexpr unsigned HEAP_CORES = 2;
+struct HeapCounters {
+  volatile uint32_t allocs;
+  volatile uint32_t frees;
+  volatile uint32_t bytes;
+};
+static HeapCounters       heap_count[HEAP_CORES];
+static volatile bool      heap_armed = false;
+static volatile uint32_t  heap_peak = 0;
+
+static inline void count_alloc( size_t size )
+{
+  if ( !heap_armed ){ return; }
+  HeapCounters& c = heap_count[get_core_num() % HEAP_CORES];
+  c.allocs = c.allocs + 1;
+  c.bytes = c.bytes + static_cast<uint32_t>(size);
+}
+static inline void count_free( void )
+{
+  if ( !heap_armed ){ return; }
+  HeapCounters& c = heap_count[get_core_num() % HEAP_CORES];
+  c.frees = c.frees + 1;
+}
+static uint32_t heap_in_use( void )
+{
+#if defined(__GLIBC__)
+  struct mallinfo2 mi = mallinfo2();
+#else
+  struct mallinfo mi = mallinfo();
+#endif
+  return static_cast<uint32_t>(mi.uordblks);
+}
+//---------------------------------------------------------
+void heap_monitor_arm( void )
+{
+  heap_armed = false;
+  for ( auto& c : heap_count ){
+    c.allocs = 0;
+    c.frees = 0;
+    c.bytes = 0;
+  }
+  heap_peak = heap_in_use();
+  heap_armed = true;
+}
+void heap_monitor_disarm( void )
+{
+  heap_armed = false;
+}
+void heap_monitor_sample( void )
+{
+  uint32_t used = heap_in_use();
+  if ( used > heap_peak ){ heap_peak = used; }
+}
+HeapStats heap_monitor_stats( void )
+{
+  HeapStats st = {};
+  for ( auto& c : heap_count ){
+    st.allocs += c.allocs;
+    st.frees += c.frees;
+    st.bytes += c.bytes;
+  }
+  st.in_use = heap_in_use();
+  st.peak = heap_peak;
+  if ( st.in_use > st.peak ){ st.peak = st.in_use; }
+#if defined(HEAP_HOOK_NEWLIB) || defined(HEAP_HOOK_HOST)
+  st.malloc_hooked = true;
+#else
+  st.malloc_hooked = false;
+#endif
+  return st;
+}
+
+#if defined(HEAP_HOOK_NEWLIB)
+//---------------------------------------------------------
+//		newlib の確保の入口 (-Wl,--wrap=_malloc_r ...)
+//    malloc() も、printf や strdup など newlib の中の確保も
+//    すべて _malloc_r / _free_r を通る
+//---------------------------------------------------------
+extern "C" {
+void* __real__malloc_r( struct _reent* r, size_t size );
+void  __real__free_r( struct _reent* r, void* p );
+void* __real__calloc_r( struct _reent* r, size_t n, size_t size );
+void* __real__realloc_r( struct _reent* r, void* p, size_t size );
+void* __real__memalign_r( struct _reent* r, size_t align, size_t size );
+
+void* __wrap__malloc_r( struct _reent* r, size_t size )
+{
+  count_alloc(size);
+  return __real__malloc_r(r, size);
+}
+void __wrap__free_r( struct _reent* r, void* p )
+{
+  if ( p != nullptr ){ count_free(); }
+  __real__free_r(r, p);
+}
+void* __wrap__calloc_r( struct _reent* r, size_t n, size_t size )
+{
+  count_alloc(n * size);
+  return __real__calloc_r(r, n, size);
+}
+void* __wrap__realloc_r( struct _reent* r, void* p, size_t size )
+{
+  // 置き直しは確保と解放の一組として数える
+  if ( size != 0 ){ count_alloc(size); }
+  if ( p != nullptr ){ count_free(); }
+  return __real__realloc_r(r, p, size);
+}
+void* __wrap__memalign_r( struct _reent* r, size_t align, size_t size )
+{
+  count_alloc(size);
+  return __real__memalign_r(r, align, size);
+}
+}
+#elif defined(HEAP_HOOK_HOST)
+//---------------------------------------------------------
+//		glibc の malloc/free (-Wl,--wrap=malloc ...)
+//---------------------------------------------------------
+extern "C" {
+void* __real_malloc( size_t size );
+void  __real_free( void* p );
+void* __real_calloc( size_t n, size_t size );
+void* __real_realloc( void* p, size_t size );
+
+void* __wrap_malloc( size_t size )
+{
+  count_alloc(size);
+  return __real_malloc(size);
+}
+void __wrap_free( void* p )
+{
+  if ( p != nullptr ){ count_free(); }
+  __real_free(p);
+}
+void* __wrap_calloc( size_t n, size_t size )
+{
+  count_alloc(n * size);
+  return __real_calloc(n, size);
+}
+void* __wrap_realloc( void* p, size_t size )
+{
+  if ( size != 0 ){ count_alloc(size); }
+  if ( p != nullptr ){ count_free(); }
+  return __real_realloc(p, size);
+}
+}
+#endif
+
+//---------------------------------------------------------
+//		operator new/delete
+//    std::string, std::function などの確保はすべてここを通る
+//    malloc を wrap している時はそこで数えるので、ここでは数えない
+//---------------------------------------------------------
+static void* counted_alloc( size_t size )
+{
+  void* p = malloc(size == 0 ? 1 : size);
+#if !defined(HEAP_HOOK_NEWLIB) && !defined(HEAP_HOOK_HOST)
+  count_alloc(size);
+#endif
+  return p;
+}
+static void counted_free( void* p )
+{
+  if ( p == nullptr ){ return; }
+#if !defined(HEAP_HOOK_NEWLIB) && !defined(HEAP_HOOK_HOST)
+  count_free();
+#endif
+  free(p);
+}
+void* operator new( size_t size ){ return counted_alloc(size); }
+void* operator new[]( size_t size ){ return counted_alloc(size); }
+void* operator new( size_t size, const std::nothrow_t& ) noexcept { return counted_alloc(size); }
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept { return counted_alloc(size); }
+void operator delete( void* p ) noexcept { counted_free(p); }
+void operator delete[]( void* p ) noexcept { counted_free(p); }
+void operator delete( void* p, size_t ) noexcept { counted_free(p); }
+void operator delete[]( void* p, size_t ) noexcept { counted_free(p); }
+/* [] END OF FILE */
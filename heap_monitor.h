@@ -0,0 +1,36 @@
+/* ========================================
+ *
+ *	heap_monitor.h
+ *		description: Heap use instrumentation
+ *
+ *	Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ * ========================================
+*/
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <cstdint>
+#include <cstddef>
+
+//  setup() 終了後の heap 使用を数える
+//  USE_HEAP_WRAP (constants.h) の時は newlib の _malloc_r / _free_r などを
+//  --wrap で置き換えて、malloc() や newlib の中の確保も数える。
+//  そうでない時は operator new/delete だけを数える。
+//  数は core ごとに持つ。heap 全体の使用量は mallinfo() で見る
+struct HeapStats {
+  uint32_t  allocs;       // arm 後の確保回数
+  uint32_t  frees;        // arm 後の解放回数
+  uint32_t  bytes;        // arm 後に確保したバイト数の合計
+  uint32_t  in_use;       // 現在の heap 使用量
+  uint32_t  peak;         // arm 後の最大 heap 使用量
+  bool      malloc_hooked;  // malloc/free も数えている (false なら operator new/delete だけ)
+};
+
+void heap_monitor_arm( void );          // setup() の最後で呼ぶ
+void heap_monitor_disarm( void );       // 数えるのをやめる
+void heap_monitor_sample( void );       // peak を更新する
+HeapStats heap_monitor_stats( void );
+
+#endif
@@ -0,0 +1,133 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// =========================================================
+//      Latency Constants
+// =========================================================
+// 2 のべき乗ごとに LAT_SUB_BUCKETS に分けた対数ヒストグラム
+// 誤差は最大でも 1/LAT_SUB_BUCKETS 程度
+constexpr uint8_t LAT_SUB_BITS = 3;
+constexpr uint8_t LAT_SUB_BUCKETS = 1 << LAT_SUB_BITS;
+constexpr uint8_t LAT_MAX_POW = 24;    // 2^24 - 2^25-1 usec (約 16-33 秒) までを分けて数える
+// 0-7 は一つずつ、2^3 から 2^LAT_MAX_POW までの各べきを LAT_SUB_BUCKETS に、最後の一つは 2^(LAT_MAX_POW+1) 以上
+constexpr size_t LAT_BUCKETS = LAT_SUB_BUCKETS + (LAT_MAX_POW - LAT_SUB_BITS + 1) * LAT_SUB_BUCKETS + 1;
+constexpr size_t LAT_OVERFLOW_BUCKET = LAT_BUCKETS - 1;
+
+// =========================================================
+//      LatencyHistogram Class
+// =========================================================
+class LatencyHistogram {
+    std::array<uint32_t, LAT_BUCKETS> buckets_;
+    uint32_t    count_;
+    uint32_t    min_;
+    uint32_t    max_;
+    uint64_t    sum_;
+
+// impl LatencyHistogram
+public:
+    LatencyHistogram() : buckets_{}, count_(0), min_(UINT32_MAX), max_(0), sum_(0) {}
+
+    void clear() {
+        buckets_.fill(0);
+        count_ = 0;
+        min_ = UINT32_MAX;
+        max_ = 0;
+        sum_ = 0;
+    }
+    void record(uint32_t us) {
+        buckets_[bucket_of(us)] += 1;
+        count_ += 1;
+        sum_ += us;
+        if (us < min_) {min_ = us;}
+        if (us > max_) {max_ = us;}
+    }
+    auto count() const -> uint32_t {return count_;}
+    auto min() const -> uint32_t {return count_ ? min_ : 0;}
+    auto max() const -> uint32_t {return max_;}
+    auto mean() const -> uint32_t {return count_ ? static_cast<uint32_t>(sum_ / count_) : 0;}
+    /// permille (0-1000) 番目の値。バケツの上限を返すので少し大きめに出る
+    auto percentile(uint16_t permille) const -> uint32_t {
+        if (count_ == 0) {return 0;}
+        uint64_t target = (static_cast<uint64_t>(count_) * permille + 999) / 1000;
+        if (target == 0) {target = 1;}
+        uint64_t acc = 0;
+        for (size_t i = 0; i < LAT_BUCKETS; ++i) {
+            acc += buckets_[i];
+            if (acc >= target) {
+                uint32_t upper = bucket_upper(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+    auto p50() const -> uint32_t {return percentile(500);}
+    auto p90() const -> uint32_t {return percentile(900);}
+    auto p99() const -> uint32_t {return percentile(990);}
+
+    /// 値の入るバケツ番号
+    static auto bucket_of(uint32_t us) -> size_t {
+        if (us < LAT_SUB_BUCKETS) {
+            return us;
+        }
+        uint8_t pow = 31 - static_cast<uint8_t>(__builtin_clz(us));
+        if (pow > LAT_MAX_POW) {
+            return LAT_OVERFLOW_BUCKET;
+        }
+        uint32_t sub = (us >> (pow - LAT_SUB_BITS)) & (LAT_SUB_BUCKETS - 1);
+        return static_cast<size_t>(pow - LAT_SUB_BITS + 1) * LAT_SUB_BUCKETS + sub;
+    }
+    /// バケツに入る最大の値
+    static auto bucket_upper(size_t idx) -> uint32_t {
+        if (idx < LAT_SUB_BUCKETS) {
+            return static_cast<uint32_t>(idx);
+        }
+        if (idx >= LAT_OVERFLOW_BUCKET) {
+            return UINT32_MAX;
+        }
+        uint8_t pow = static_cast<uint8_t>(idx / LAT_SUB_BUCKETS) + LAT_SUB_BITS - 1;
+        uint32_t sub = idx % LAT_SUB_BUCKETS;
+        uint32_t width = 1u << (pow - LAT_SUB_BITS);
+        return (1u << pow) + (sub + 1) * width - 1;
+    }
+};
+
+// =========================================================
+//      LatencyTrace
+// =========================================================
+// touch→MIDI / touch→光 の遅延を測る区間
+enum class LatencyStage : uint8_t {
+    SWEEP_TO_NOTE_QUEUED,   // sweep 開始 → Note On を出力待ちに入れた
+    NOTE_TO_USB,            // Note On 出力待ち → USB に渡した
+    SWEEP_TO_PIXELS,        // sweep 開始 → LED にデータを送り終えた
+    CLUSTER_LINK,           // follower の sweep 開始 → leader のタッチの処理に入った (USE_CLUSTER)
+    MAX
+};
+constexpr size_t LATENCY_STAGES = static_cast<size_t>(LatencyStage::MAX);
+
+struct LatencyTrace {
+    std::array<LatencyHistogram, LATENCY_STAGES> hist;
+
+    void record(LatencyStage stage, uint32_t us) {
+        hist[static_cast<size_t>(stage)].record(us);
+    }
+    auto get(LatencyStage stage) const -> const LatencyHistogram& {
+        return hist[static_cast<size_t>(stage)];
+    }
+    void clear() {
+        for (auto& h : hist) {h.clear();}
+    }
+    static auto name(size_t stage) -> const char* {
+        constexpr const char* NAMES[LATENCY_STAGES] = {"Sw>NoteQ", "NoteQ>USB", "Sw>Pixel", "Link"};
+        return stage < LATENCY_STAGES ? NAMES[stage] : "?";
+    }
+};
+#endif // LATENCY_H
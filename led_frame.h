@@ -0,0 +1,330 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef LED_FRAME_H
+#define LED_FRAME_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+#include "constants.h"
+#include "placement.h"
+#include "signal_kernels.h"
+
+// =========================================================
+//      LedFrame Class
+// =========================================================
+// タッチ位置・伴奏から、各 LED の RGBW を決める (ハードウェアには触らない)
+enum LED_STATUS : uint8_t { NO_STATUS, TOUCH_STATUS, ACCOMPANIMENT_STATUS };
+
+class LedFrame {
+    uint8_t     pixel_[MAX_LIGHT][4];   // red, green, blue, white
+    LED_STATUS  status_[MAX_LIGHT];     // Status of each sensor for LED control
+    uint16_t    light_count_;           // 実際につながっている LED の数 (ring はここで折り返す)
+
+// impl LedFrame
+public:
+    LedFrame() : pixel_{}, status_{}, light_count_(MAX_LIGHT) {}
+
+    auto pixel(size_t index) const -> const uint8_t* {
+        return pixel_[index];
+    }
+    auto status(size_t index) const -> LED_STATUS {
+        return status_[index];
+    }
+    /// つながっている LED の数を設定する (起動時の探索の結果)
+    void set_light_count(size_t count) {
+        if ((count == 0) || (count > MAX_LIGHT)) {count = MAX_LIGHT;}
+        light_count_ = static_cast<uint16_t>(count);
+    }
+    auto light_count() const -> size_t {
+        return static_cast<size_t>(light_count_);
+    }
+    void clear_all() {
+        for (int i = 0; i < MAX_LIGHT; i++) {
+            pixel_[i][0] = pixel_[i][1] = pixel_[i][2] = pixel_[i][3] = 0;
+            status_[i] = NO_STATUS;
+        }
+    }
+    /// RGB とタッチ状態を消す (白はそのまま)
+    void clear_touch() {
+        for (int i = 0; i < MAX_LIGHT; i++) {
+            pixel_[i][0] = 0; // red
+            pixel_[i][1] = 0; // green
+            pixel_[i][2] = 0; // blue
+            status_[i] = NO_STATUS;
+        }
+    }
+    /// 一つの LED の RGB とタッチ状態を消す
+    void clear_touch_at(int index) {
+        pixel_[index][0] = pixel_[index][1] = pixel_[index][2] = 0;
+        status_[index] = NO_STATUS;
+    }
+    void clear_white() {
+        for (int i = 0; i < MAX_LIGHT; i++) {
+            pixel_[i][3] = 0; // white
+        }
+    }
+    /// locate を中心に、強さに応じた幅で光らせる
+    void HOT_FUNC(set_by_touch)(float locate, int16_t sensor_value, bool touch) {
+        light_around(locate, sensor_value, touch, -1);
+    }
+    /// set_by_touch() と同じ光のうち、only の LED に当たる所だけを描く
+    void set_by_touch_at(float locate, int16_t sensor_value, bool touch, int only) {
+        light_around(locate, sensor_value, touch, only);
+    }
+    void set_for_note(int index, uint8_t intensity, bool touch) {
+        uint8_t red = 0;
+        uint8_t blue = 0;
+        uint8_t green = 0;
+
+        if (touch) {
+            // QUBIT Touch : Magenta
+            red = (intensity * 4) / 5;
+            blue = (intensity * 1) / 5;
+        } else {
+            // QUBIT Accompaniment : Cyan
+            blue = (intensity * 3) / 5;
+            green = (intensity * 2) / 5;
+        }
+        set_pixel(index, red, green, blue, -1); // Set only red and blue channels
+    }
+    void set_white(int index, uint8_t intensity) {
+        set_pixel(index, -1, -1, -1, intensity);
+    }
+    /// layer で伴奏が光っている所を、タッチで光っていなければ写す
+    void overlay(const LedFrame& layer, int index) {
+        if ((status_[index] == TOUCH_STATUS) || (layer.status_[index] != ACCOMPANIMENT_STATUS)) {
+            return;
+        }
+        pixel_[index][0] = layer.pixel_[index][0];
+        pixel_[index][1] = layer.pixel_[index][1];
+        pixel_[index][2] = layer.pixel_[index][2];
+        status_[index] = ACCOMPANIMENT_STATUS;
+    }
+    /// -1 の色は変えない
+    void set_pixel(int index, int16_t red, int16_t green, int16_t blue, int16_t white) {
+        index = wrap(index);
+        if (red != -1)    {pixel_[index][0] = static_cast<uint8_t>(red);}
+        if (green != -1)  {pixel_[index][1] = static_cast<uint8_t>(green);}
+        if (blue != -1)   {pixel_[index][2] = static_cast<uint8_t>(blue);}
+        if (white != -1)  {pixel_[index][3] = static_cast<uint8_t>(white);}
+    }
+
+private:
+    auto wrap(int index) const -> int {
+        while (index < 0) {
+            index += light_count_; // Wrap around if negative
+        }
+        return index % light_count_;
+    }
+    /// only が負なら全部、そうでなければ only の LED だけを変える
+    inline void light_around(float locate, int16_t sensor_value, bool touch, int only) {
+        if ((locate < 0.0f) || (locate >= static_cast<float>(light_count_))){
+            return; // Invalid location
+        }
+        if (sensor_value <= 1) {
+            sensor_value = 1;
+        }
+
+        const float SLOPE = 20000.0f / sensor_value; // 傾き:小さいほどたくさん光る
+        float nearest_lower = std::floor(locate);
+        float nearest_upper = std::ceil(locate);
+
+        while (1) {
+            int16_t this_val = falloff(locate - nearest_lower, SLOPE);
+            if (this_val < 0) {break;}
+            int index = static_cast<int>(nearest_lower);
+            nearest_lower -= 1.0f;
+            if ((only < 0) || (wrap(index) == only)) {put_note_light(index, this_val, touch);}
+        }
+        while (1) {
+            int16_t this_val = falloff(nearest_upper - locate, SLOPE);
+            if (this_val < 0) {break;}
+            int index = static_cast<int>(nearest_upper);
+            nearest_upper += 1.0f;
+            if ((only < 0) || (wrap(index) == only)) {put_note_light(index, this_val, touch);}
+        }
+    }
+    void put_note_light(int index, int16_t value, bool touch) {
+        int idx = wrap(index);
+        if (status_[idx] == TOUCH_STATUS && !touch) {
+            // すでにタッチセンサで点灯している場合、伴奏は表示しない
+            return;
+        }
+        set_for_note(index, static_cast<uint8_t>(value), touch);
+        status_[idx] = touch ? TOUCH_STATUS : ACCOMPANIMENT_STATUS;
+    }
+};
+
+static_assert(sizeof(LedFrame) <= MAX_LIGHT * 5 + 4, "LedFrame: RGBW and a 1-byte status per LED");
+
+// =========================================================
+//      AccompanimentLayer Class
+// =========================================================
+// 伴奏 (外から来た Note) の光は、Note が変わった時だけ計算しておき、毎フレーム重ねる
+// 変わった Note は ActiveNoteSet の変化の記録から拾い、その周りの LED だけを描き直す
+// (記録より遅れた時、clear_all() の後、一度に REPAINT_MAX を超える Note が変わった時だけ全部作り直す)
+class AccompanimentLayer {
+    static constexpr uint16_t NOT_LIT = 0xffff;
+    static constexpr int REACH = 3;             // velocity 255 でも falloff() が届くのは中心から 3 つ目まで
+    static constexpr size_t REPAINT_MAX = 8;    // これより多く変わったら作り直した方が速い
+
+    LedFrame    frame_;
+    uint16_t    lit_[MAX_LIGHT];        // 光っている LED の番号 (順番は不定)
+    uint16_t    lit_pos_[MAX_LIGHT];    // lit_ の中の位置 (光っていなければ NOT_LIT)
+    uint8_t     painted_[MAX_MIDI_NOTE];    // frame_ に描いてある velocity (0: 描いていない)
+    size_t      lit_count_;
+    uint32_t    revision_;
+    uint32_t    rebuilds_;
+    int         offset_;
+    bool        valid_;
+
+// impl AccompanimentLayer
+public:
+    AccompanimentLayer() : frame_(), lit_{}, lit_pos_{}, painted_{}, lit_count_(0), revision_(0), rebuilds_(0), offset_(0),
+                           valid_(false) {}
+
+    void set_light_count(size_t count) {
+        if (count != frame_.light_count()) {valid_ = false;}
+        frame_.set_light_count(count);
+    }
+
+    /// notes: ActiveNoteSet。offset は sensor 0 にあたる Note 番号
+    /// ZONE_PADS を超えるパッドがあれば、どの zone でも同じ Note の所を光らせる
+    template <typename NOTES>
+    auto update(const NOTES& notes, int offset) -> bool {
+        const uint32_t rev = notes.revision();
+        if (valid_ && (rev == revision_)) {return false;}
+        if (!valid_ || (offset != offset_) || (rev - revision_ > NOTES::CHANGE_LOG)) {
+            rebuild(notes, offset);
+            return true;
+        }
+        // 描いてある velocity と違う Note だけを拾う (同じフレームで On と Off が来た短い音は描かない)
+        uint8_t changed[REPAINT_MAX];
+        uint8_t reach[REPAINT_MAX];
+        size_t n = 0;
+        for (uint32_t r = revision_ + 1; r != rev + 1; r++) {
+            const uint8_t note = notes.changed_note(r);
+            if ((note != NOTES::ALL_CHANGED) && (note >= MAX_MIDI_NOTE)) {continue;}
+            if ((note != NOTES::ALL_CHANGED) && (notes.velocity(note) == painted_[note])) {continue;}
+            if ((note == NOTES::ALL_CHANGED) || (n == REPAINT_MAX)) {
+                rebuild(notes, offset);
+                return true;
+            }
+            const int before = light_reach(painted_[note]);
+            const int after = light_reach(notes.velocity(note));
+            changed[n] = note;
+            reach[n++] = static_cast<uint8_t>(before > after ? before : after);
+            painted_[note] = notes.velocity(note);
+        }
+        for (size_t k = 0; k < n; k++) {repaint_note(notes, changed[k], reach[k]);}
+        revision_ = rev;
+        return true;
+    }
+    void HOT_FUNC(apply)(LedFrame& dst) const {
+        for (size_t k = 0; k < lit_count_; k++) {
+            dst.overlay(frame_, lit_[k]);
+        }
+    }
+    auto lit_count() const -> size_t {return lit_count_;}
+    /// 全部作り直した回数 (ふだんは描き直しだけで済んでいるかを見る)
+    auto rebuilds() const -> uint32_t {return rebuilds_;}
+
+private:
+    template <typename NOTES>
+    void rebuild(const NOTES& notes, int offset) {
+        // 重なった所は高い音が勝つように、低い方から描く
+        uint8_t sorted[MAX_MIDI_NOTE];
+        size_t n = 0;
+        for (size_t k = 0; (k < notes.count()) && (n < MAX_MIDI_NOTE); k++) {
+            uint8_t note = notes.note_at(k);
+            size_t j = n++;
+            for (; (j > 0) && (sorted[j - 1] > note); j--) {sorted[j] = sorted[j - 1];}
+            sorted[j] = note;
+        }
+        frame_.clear_touch();
+        for (int i = 0; i < MAX_MIDI_NOTE; i++) {painted_[i] = notes.velocity(static_cast<uint8_t>(i));}
+        const int lights = static_cast<int>(frame_.light_count());
+        for (size_t k = 0; k < n; k++) {
+            int i = static_cast<int>(sorted[k]) - offset;
+            if ((i < 0) || (i >= ZONE_PADS)) {continue;}
+            for (; i < lights; i += ZONE_PADS) {
+                frame_.set_by_touch(static_cast<float>(i), notes.velocity(sorted[k]), false);
+            }
+        }
+        lit_count_ = 0;
+        for (int i = 0; i < MAX_LIGHT; i++) {
+            lit_pos_[i] = NOT_LIT;
+            if ((i < lights) && (frame_.status(i) == ACCOMPANIMENT_STATUS)) {
+                lit_pos_[i] = static_cast<uint16_t>(lit_count_);
+                lit_[lit_count_++] = static_cast<uint16_t>(i);
+            }
+        }
+        revision_ = notes.revision();
+        offset_ = offset;
+        rebuilds_ += 1;
+        valid_ = true;
+    }
+    auto wrap(int index) const -> int {
+        const int lights = static_cast<int>(frame_.light_count());
+        while (index < 0) {index += lights;}
+        return index % lights;
+    }
+    /// velocity の光が中心からいくつ目まで届くか (set_by_touch() と同じ falloff。0 は光らない)
+    static auto light_reach(uint8_t velocity) -> int {
+        if (velocity == 0) {return -1;}
+        const float slope = 20000.0f / (velocity <= 1 ? 1 : velocity);
+        int k = 0;
+        while ((k < REACH) && (falloff(static_cast<float>(k + 1), slope) >= 0)) {k++;}
+        return k;
+    }
+    /// note の光が届く LED を (どの zone でも) 描き直す。reach は前と今の光の届く幅の大きい方
+    template <typename NOTES>
+    void repaint_note(const NOTES& notes, uint8_t note, int reach) {
+        int i = static_cast<int>(note) - offset_;
+        if ((i < 0) || (i >= ZONE_PADS) || (reach < 0)) {return;}
+        const int lights = static_cast<int>(frame_.light_count());
+        for (; i < lights; i += ZONE_PADS) {
+            for (int d = -reach; d <= reach; d++) {repaint_led(notes, wrap(i + d));}
+        }
+    }
+    /// 一つの LED を、届きうる Note だけで rebuild() と同じ順に描き直す
+    template <typename NOTES>
+    void repaint_led(const NOTES& notes, int x) {
+        uint8_t near[REACH * 2 + 1];
+        size_t n = 0;
+        for (int d = -REACH; d <= REACH; d++) {
+            const int note = wrap(x + d) % ZONE_PADS + offset_;
+            if ((note < 0) || (note >= MAX_MIDI_NOTE) || !notes.is_on(static_cast<uint8_t>(note))) {continue;}
+            size_t j = n;
+            for (; (j > 0) && (near[j - 1] >= note); j--) {}
+            if ((j < n) && (near[j] == note)) {continue;}
+            for (size_t m = n++; m > j; m--) {near[m] = near[m - 1];}
+            near[j] = static_cast<uint8_t>(note);
+        }
+        frame_.clear_touch_at(x);
+        const int lights = static_cast<int>(frame_.light_count());
+        for (size_t k = 0; k < n; k++) {
+            for (int i = near[k] - offset_; i < lights; i += ZONE_PADS) {
+                frame_.set_by_touch_at(static_cast<float>(i), notes.velocity(near[k]), false, x);
+            }
+        }
+        // lit_ に出し入れする
+        const bool lit = frame_.status(x) == ACCOMPANIMENT_STATUS;
+        if (lit && (lit_pos_[x] == NOT_LIT)) {
+            lit_pos_[x] = static_cast<uint16_t>(lit_count_);
+            lit_[lit_count_++] = static_cast<uint16_t>(x);
+        } else if (!lit && (lit_pos_[x] != NOT_LIT)) {
+            const uint16_t p = lit_pos_[x];
+            const uint16_t last = lit_[--lit_count_];
+            lit_[p] = last;
+            lit_pos_[last] = p;
+            lit_pos_[x] = NOT_LIT;
+        }
+    }
+};
+#endif // LED_FRAME_H
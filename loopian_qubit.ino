@@ -3,29 +3,101 @@
 //  Released under the MIT license
 //  https://opensource.org/licenses/mit-license.php
 //
-#include <sstream>   // ostringstream
-#include <iomanip> 
-#include <format>
 #include <Adafruit_TinyUSB.h>
 #include <MIDI.h>
-#include <RPi_Pico_TimerInterrupt.h> //https://github.com/khoih-prog/RPI_PICO_TimerInterrupt
 
 #include "pico/multicore.h"
+#include "hardware/flash.h"
+#include "hardware/watchdog.h"
 #include "sk6812.h"
+#include "pca9685_leds.h"
 #include "peripheral.h"
 #include "global_timer.h"
+#include "timebase.h"
 #include "qtouch.h"
+#include "ambient.h"
+#include "scheduler.h"
+#include "governor.h"
+#include "text_buf.h"
+#include "heap_monitor.h"
+#include "latency.h"
+#include "profiler.h"
+#include "sensor_stream.h"
+#include "led_frame.h"
+#include "midi_queue.h"
+#include "mpe.h"
+#include "note_set.h"
+#include "topology.h"
+#include "calib_store.h"
+#include "tuning.h"
+#include "flight_recorder.h"
+#include "cluster.h"
+#include "placement.h"
+#include "board.h"
 #include "constants.h"
+#ifdef USE_HOT_BENCH
+#include "hardware/xip_cache.h"
+#include "hardware/structs/systick.h"
+#endif
+#if defined(USE_CLUSTER) && !defined(USE_PCA9685)
+#error "USE_CLUSTER uses D0 for the cluster UART, so the LEDs must be on PCA9685 (USE_PCA9685)"
+#endif
+
+/*----------------------------------------------------------------------------*/
+//     Hot path (placement.h: 起動時に SRAM へ写し、XIP cache を通さずに実行する)
+/*----------------------------------------------------------------------------*/
+// Core1: 毎 sweep
+void HOT_FUNC(scan_sweep)();
+void HOT_FUNC(select_kamaboko)(size_t num);
+std::tuple<int, uint16_t> HOT_FUNC(read_selected_AT42QT)(int sens, bool ref);
+uint16_t HOT_FUNC(get_sensor_values)(int sens);
+void HOT_FUNC(flight_record_sweep)(uint64_t sweep_start);
+#ifdef USE_PCA9685
+void HOT_FUNC(flush_led_i2c)(uint32_t gap_us);
+#endif
+// Core0: 毎 sweep / 毎フレーム
+void HOT_FUNC(touch_task)();
+void HOT_FUNC(callback_for_set_led)(float locate, int16_t sensor_value);
+void HOT_FUNC(update_neo_pixel)();
 
 /*----------------------------------------------------------------------------*/
 //     Constants
 /*----------------------------------------------------------------------------*/
-#define LED_HEARTBEAT   25    // LED RP2040: blue, RP2350: orange
-//#define LED_GREEN       16    // LED RP2040: green, RP2350: not connected（基板裏）
-//#define LED_RED         17    // LED RP2040: red, RP2350: not connected（基板裏）
-#define BOARD_NEO_POWER 23    // XIAO 上の NeoPixelの電源
-#define SWITCH_LEFT    D9    // 左のスイッチ
-#define SWITCH_RIGHT   D7     // 右のスイッチ
+// 足の割り当ては board.h
+// Core0 タスク周期 [usec]
+constexpr uint32_t TOUCH_TASK_PERIOD = 1000;     // 新しい sweep があるかを確認する周期
+constexpr uint32_t MIDI_TASK_PERIOD = 1000;
+constexpr uint32_t MIDI_READ_BUDGET_US = 300;   // 一回の midi_task で受信に使ってよい時間
+constexpr uint32_t MIDI_READ_MAX_MESSAGES = 64;
+constexpr uint32_t LED_TASK_PERIOD = 16667;      // 約 60Hz
+constexpr uint32_t DISPLAY_TASK_PERIOD = 250000; // 4Hz
+constexpr uint32_t SERIAL_TASK_PERIOD = 20000;
+constexpr uint32_t PROFILE_EXPORT_PERIOD = 1000000; // 1秒ごとに処理時間を書き出す
+
+// 温め起動: 保存した ref と合えば、移動平均が埋まるだけの sweep の後にタッチを受け付ける
+constexpr uint32_t CALIB_WARM_SWEEPS = 8;
+constexpr int CALIB_WARM_TRIES = 5;             // AT42QT が自分の較正を終えるのを待つ回数
+constexpr uint32_t CALIB_WARM_RETRY_MS = 20;
+
+#ifdef USE_PCA9685
+// PCA9685 の LED を sweep の合間に送る量: いつもは一つの chip の全 channel まで (400kHz で約 1.5msec)
+// scan_period で次の sweep まで待つ時は、その待ち時間に入る分まで
+constexpr size_t PCA9685_GAP_BYTES = PCA9685_MAX_WRITE;
+constexpr uint32_t PCA9685_US_PER_BYTE = 9 * 1000000 / TOUCH_I2C_CLOCK;  // 8bit + ACK
+#endif
+#ifdef USE_CLUSTER
+// 何台かをつなぐ UART を読み書きする周期。一周の長さ (cluster.h) はこれと返事の待ち時間で決まる
+constexpr uint32_t CLUSTER_TASK_PERIOD = 250;
+#endif
+
+// loop() が止まったら watchdog で再起動する。起動した後、RAM に残った flight recorder を flash に書く
+constexpr uint32_t WATCHDOG_TIMEOUT_MS = 2000;
+// flight recorder を止めるきっかけ (ほかに SysEx の freeze と 'f')
+constexpr uint32_t FLIGHT_COMBO_MS = 1500;      // 左右のスイッチを同時にこれだけ押し続ける
+constexpr uint32_t FLIGHT_STALL_MS = 1000;      // Core1 の sweep がこれだけ進まない
+// 止めてから flash に書くまで: Core1 が書きかけの sweep を終えるのを待つ
+constexpr uint32_t FLIGHT_DUMP_WAIT_SWEEPS = 2;
+constexpr uint32_t FLIGHT_DUMP_WAIT_MS = 200;
 
 /*----------------------------------------------------------------------------*/
 //     Variables
@@ -36,32 +108,111 @@ Adafruit_USBD_MIDI usb_midi;
 // Create a new instance of the Arduino MIDI Library,
 // and attach usb_midi as the transport.
 MIDI_CREATE_INSTANCE(Adafruit_USBD_MIDI, usb_midi, MIDI);
+// タッチ処理からの送信は一旦ここに積み、midi_task でまとめて送る
+MidiOutQueue midi_out;
+MpeOutput mpe;                // 'm' で切り替え。タッチごとに channel を分け、位置と強さも送る
+bool mpe_request = false;
 
 // Create a neopixel object
-SK6812 sk(MAX_LIGHT, D0);
-uint8_t external_note_status[MAX_MIDI_NOTE] = {0};
-
-// Init RPI_PICO_Timer
-RPI_PICO_Timer ITimer1(1);
+#ifdef USE_PCA9685
+// PCA9685 (I2C) の LED。SK6812 と同じ形なので update_neo_pixel() はそのまま
+// I2C はタッチと同じなので、送るのは Core1 が sweep の合間に (flush_led_i2c())
+Pca9685Leds<MAX_LIGHT> sk(MAX_LIGHT, Pca9685Bus{PCA9685_write_block});
+#else
+SK6812 sk(MAX_LIGHT, SK6812_DATA);
+#endif
+ActiveNoteSet<MAX_MIDI_NOTE> external_notes;  // ch16 で受けた、鳴っている伴奏の Note
+AccompanimentLayer accompaniment;             // external_notes の変わった Note の所だけ描き直す
+uint32_t midi_read_max_batch = 0;             // 一回でまとめて読んだ最大のメッセージ数
+uint32_t midi_read_budget_hits = 0;           // 時間切れで読み残した回数
+SysexTuner tuner;                             // SysEx で閾値や周期を読み書きする (tuning.h)
+uint32_t led_period_us = LED_TASK_PERIOD;     // tuner で変わる
+uint32_t sweep_rate_hz = 0;                   // 直近 1 秒の sweep 数
+// 直近の sweep・MIDI・タッチの記録 (flight_recorder.h)。再起動しても残るよう、起動時に 0 にしない RAM に置く
+QubitFlightRecorder NOINIT_DATA(flight_recorder);
+volatile bool flight_live = false;  // flight_service() が前の記録を片付けて arm してから書き始める
+uint32_t flight_frozen_ms = 0;      // 止めた時刻と、その時の sweep_count (flash に書くのを待つ)
+uint32_t flight_frozen_sweep = 0;
+uint32_t flight_dump_seq = 0;       // flash にある dump の番号
+bool flight_dump_ok = false;
+FlightUpload flight_upload;         // 'd': flash の dump を USB に送っている所
+#ifdef USE_CLUSTER
+// 何台かを UART でつなぐ (cluster.h)。役割は SysEx の cluster (0: 一台、1: leader、2-8: follower)
+SerialPIO cluster_uart(CLUSTER_UART_TX, CLUSTER_UART_RX, CLUSTER_UART_FIFO);
+const ClusterPort cluster_port = {
+  [](const uint8_t* data, size_t len) -> size_t {
+    // FIFO に入る分だけ (残りは ClusterTx が次の回に送る)
+    const int room = cluster_uart.availableForWrite();
+    if (room <= 0) {return 0;}
+    return cluster_uart.write(data, len < static_cast<size_t>(room) ? len : static_cast<size_t>(room));
+  },
+  []() -> int { return cluster_uart.available() > 0 ? cluster_uart.read() : -1; },
+  CLUSTER_BYTE_NS,
+};
+ClusterLeader cluster_leader(cluster_port);
+ClusterFollower cluster_follower(cluster_port);
+ClusterRole cluster_role = ClusterRole::STANDALONE;
+int cluster_task_id = -1;
+#endif
 
 GlobalTimer gt;
+AmbientAnimator ambient;
+CORE0_DATA("sched") FrameScheduler sched(Timebase::now_us);  // loop() が毎回触る
+CORE0_DATA("sched") OverloadGovernor governor;
+static_assert(sizeof(FrameScheduler) + sizeof(OverloadGovernor) <= CORE0_SCRATCH_BUDGET, "scratch Y is shared with the Core0 stack");
+int touch_task_id = -1;
+int led_task_id = -1;
 
 QubitTouch qt([](uint8_t status, uint8_t note, uint8_t intensity) {
-  // MIDI callback function
-  sendMidiMessage(status, note, intensity);
+  // MIDI callback function (どの sweep から出たイベントかを付ける)
+  sendMidiMessage(status, note, intensity, qt.frame_time_us());
 });
+LatencyTrace latency;
+#ifdef USE_PROFILER
+Profiler profiler;
+bool profile_export = false;      // 'p' で切り替え
+uint32_t profile_dropped = 0;     // USB が詰まっていて捨てたレコード数
+#endif
+uint64_t led_frame_sweep_us = 0; // LED に反映する sweep の時刻
 
 bool switch_left_state = false;
 bool switch_right_state = false;
 int debug_loop_counter = 0; // Debug
+bool touch_stable = false;  // 起動後しばらくはタッチを無視する
 /*------------------------------------------------------------------*/
 // Core 1
-volatile int sensor_values[MAX_SENS]; // Raw - Ref
+volatile uint16_t sensor_values[MAX_SENS]; // Raw - Ref (0 以上)
+volatile uint32_t sweep_count = 0;    // 全センサを読み終えた回数
+SharedTime sweep_time;                // 最後の sweep を読み始めた時刻 [usec] (Core1 が sweep_count より先に書く)
+volatile uint32_t scan_period_us = 0; // sweep の最短周期 (0: 待たない)。Core0 の tuner が書く
+volatile uint32_t i2c_errors = 0;     // 読み出しに失敗した回数
+// 全 sweep を USB CDC に流すモード ('s' で切り替え)
+volatile bool stream_enabled = false;
+volatile uint32_t stream_dropped = 0; // バッファが一杯か、USB の FIFO より大きくて捨てた sweep の数 (Core1 が数える)
+volatile uint32_t stream_oversize = 0; // USB の FIFO より大きくて Core0 が捨てたフレームの数 (Core0 だけが書く)
+SweepEncoder<MAX_SENS> stream_encoder;    // Core1 だけが使う
+ByteRing<STREAM_RING_SIZE> stream_ring;   // Core1 → Core0
+CORE1_DATA("sweep") Topology topology;  // setup1() で探す。つながっているかまぼこだけを読む
+// 起動時の探索と、温め起動の確かめに使う I2C の操作
+const TopologyBus topology_bus = {
+  [](uint8_t mux, uint8_t channel) { return pca9544_changeI2cBus(channel, mux); },
+  AT42QT_read_id,
+  AT42QT_init,
+};
 struct OneTouch {
-  int raw_value;  // Raw value from AT42QT1070
-  int ref_value;  // Reference value from AT42QT1070
-} tch[MAX_SENS];
+  uint16_t raw_value;  // Raw value from AT42QT1070 (10bit)
+  uint16_t ref_value;  // Reference value from AT42QT1070
+};
+static_assert(sizeof(OneTouch) == 4, "OneTouch: two 16bit values");
+CORE1_DATA("sweep") OneTouch tch[MAX_SENS];
+static_assert(sizeof(tch) + sizeof(Topology) <= CORE1_SCRATCH_BUDGET, "scratch X is shared with the Core1 stack");
 int sensor_adjust_counter;
+CalibStore calib_store;             // ref・noise・topology を flash に覚えておく
+CalibData calib_data;               // 起動時に読んだもの / 次に保存するもの
+volatile bool calib_loaded = false; // flash に record があった (ref が合わなくても tuning は使う)
+volatile bool calib_warm = false;   // Core1: 保存した値と合ったので、すぐにタッチを受け付ける
+bool calib_saved = false;
+uint32_t calib_gate_ms = 0;         // タッチを受け付け始めた時刻 (起動から)
 
 /*----------------------------------------------------------------------------*/
 //     setup
@@ -82,6 +233,8 @@ void setup() {
   MIDI.setHandleNoteOn(handleNoteOn);
   MIDI.setHandleNoteOff(handleNoteOff);
   MIDI.setHandleProgramChange(handleProgramChange);
+  MIDI.setHandleSystemExclusive(handleSystemExclusive);
+  tuner.begin(SysexHooks{read_perf_counters, save_tuning, freeze_flight_by_sysex});
 
   // wait until device mounted : 挿さないと起動しなくなるので削除
   //while( !TinyUSBDevice.mounted() ) delay(1);
@@ -105,45 +258,100 @@ void setup() {
 #endif
   SSD1331_init();
 
-  // Interval in unsigned long microseconds
-  if (!ITimer1.attachInterruptInterval(2000, TimerHandler)) { // 2ms
-#ifdef LED_RED
-    gpio_put(LED_RED, LOW);
-#endif
-    assert(false); // Timer initialization failed
-  }
+  // 時刻は Timebase (64bit usec タイマー) から作るので、周期割り込みは使わない
+  gt.advanceTo(Timebase::now_us());
 
   init_neo_pixel();
+
+  // Core0 tasks: 優先度は touch > MIDI > LED > display
+  touch_task_id = sched.add_task("Touch", touch_task, TOUCH_TASK_PERIOD, TOUCH_TASK_PERIOD, 0);
+  sched.add_task("MIDI", midi_task, MIDI_TASK_PERIOD, MIDI_TASK_PERIOD*2, 1);
+  led_task_id = sched.add_task("LED", led_task, LED_TASK_PERIOD, LED_TASK_PERIOD, 2);
+  sched.add_task("Disp", display_task, DISPLAY_TASK_PERIOD, DISPLAY_TASK_PERIOD, 3);
+  sched.add_task("Ser", serial_task, SERIAL_TASK_PERIOD, SERIAL_TASK_PERIOD, 4);
+#ifdef USE_CLUSTER
+  // 返事は待たずに届いた分だけ読むので MIDI と同じ優先度。一台で使う時は止めておく (apply_cluster())
+  cluster_uart.begin(CLUSTER_BAUD);
+  cluster_task_id = sched.add_task("Link", cluster_task, CLUSTER_TASK_PERIOD, CLUSTER_TASK_PERIOD*2, 1);
+  sched.set_enabled(cluster_task_id, false);
+#endif
   debug_setup_end();
+  heap_monitor_arm(); // ここから後の heap 使用を数える
+  rp2040.wdt_begin(WATCHDOG_TIMEOUT_MS);
 }
 /*------------------------------------------------------------------*/
 void setup1() {
   // I2C
   wireBegin();
-  AT42QT_init();
   debug_init();
 
   for (int i = 0; i < MAX_SENS; i++) {
-    uint8_t raw[2];
-    int err = AT42QT_read(i, raw, true);
-    int refval = static_cast<int>(raw[0]) * 256 + raw[1];
     tch[i].raw_value = 0;
-    tch[i].ref_value = refval;
+    tch[i].ref_value = 0;
     sensor_values[i] = 0;
   }
   sensor_adjust_counter = 0;
+
+  calib_store.begin(calib_flash());
+  if (warm_start()) {return;}
+
+  // つながっている mux / AT42QT を探す (見つかった AT42QT はここで設定する)
+  topology.discover(topology_bus);
+  if (topology.fallback()) {
+    AT42QT_init();
+  }
+  for (size_t i = 0; i < topology.pad_count(); i++) {
+    read_ref_sensor_values(i);
+  }
+  std::fill(calib_data.noise, calib_data.noise + MAX_SENS, 0); // touch_task が測り直す
+}
+bool warm_start() {
+  // 保存した topology のかまぼこだけを設定し、ref をまとめて読んで、保存した値と合えばそのまま使う
+  if (!calib_store.load(calib_data)) {
+    calib_data.tuning = Tuning::defaults();
+    return false;
+  }
+  calib_loaded = true;
+  topology.restore(calib_data.block, calib_data.block_count);
+  // かまぼこを足したり外したりしていたら、ref が合っても使わない
+  if (!topology.matches(topology_bus)) {return false;}
+  for (size_t b = 0; b < topology.block_count(); b++) {
+    select_kamaboko(b);
+    AT42QT_init();
+  }
+  static uint16_t ref[MAX_SENS];
+  for (int t = 0; t < CALIB_WARM_TRIES; t++) {
+    if (read_all_refs(ref) && calib_agrees(calib_data, ref, topology.pad_count())) {
+      for (size_t i = 0; i < topology.pad_count(); i++) {
+        tch[i].ref_value = ref[i];
+      }
+      calib_warm = true;
+      return true;
+    }
+    delay(CALIB_WARM_RETRY_MS);
+  }
+  return false;
+}
+bool read_all_refs(uint16_t* ref) {
+  for (size_t b = 0; b < topology.block_count(); b++) {
+    select_kamaboko(b);
+    if (AT42QT_read_refs(ref + topology.block(b).first_pad, MAX_EACH_SENS) != 0) {return false;}
+  }
+  return true;
 }
 /*----------------------------------------------------------------------------*/
 //     loop
 /*----------------------------------------------------------------------------*/
 void loop() {
+  rp2040.wdt_reset();
   debug_loop_counter++;
   check_usb_status();
 
   //  Global Timer 
   long difftm = generateTimer();
+  update_sweep_rate();
   int cnt = gt.timer100ms()%10;
-  bool stable = gt.timer1s() > 3; // 3 seconds after start
+  update_touch_gate();
   // Heartbeat LED
   if (cnt<5){
     gpio_put(LED_HEARTBEAT, LOW);
@@ -152,33 +360,294 @@ void loop() {
     gpio_put(LED_HEARTBEAT, HIGH);
   }
 
+
+  // 起動可能なタスクを一つずつ実行する。governor はタスクが走った時間だけを busy と数える
+  uint64_t loop_start = Timebase::now_us();
+  int task_id = sched.run();
+  if (task_id == touch_task_id) {
+    governor.account_touch_late(sched.task(task_id).last_jitter_us);
+  }
+  governor.account_loop(loop_start, Timebase::now_us(), task_id >= 0);
+  apply_load_level();
+
+  // OLED の変化した部分を DMA で送る (転送中ならすぐ戻る)
+  {
+    PROFILE_SCOPE(ProfRegion::OLED_FLUSH);
+    SSD1331_flush();
+  }
+  drain_sensor_stream();
+}
+void update_touch_gate() {
+  if (touch_stable) {return;}
+  // 保存した値と合った時は移動平均が埋まればよい。合わなければ以前と同じく 3 秒待つ
+  if (calib_warm) {
+    touch_stable = sweep_count >= CALIB_WARM_SWEEPS;
+  } else {
+    touch_stable = gt.timer1s() > 3; // 3 seconds after start
+  }
+  if (!touch_stable) {return;}
+  calib_gate_ms = static_cast<uint32_t>(Timebase::now_us() / 1000);
+  if (!calib_warm) {
+    save_calibration();
+  }
+}
+void apply_load_level() {
+  // 負荷が高い時は LED のフレームレートを半分にする
+  static bool led_slow = false;
+  if (governor.low_led_rate() != led_slow) {
+    led_slow = governor.low_led_rate();
+    sched.set_period(led_task_id, led_slow ? led_period_us*2 : led_period_us);
+  }
+}
+void update_sweep_rate() {
+  static uint64_t window_us = 0;
+  static uint32_t window_sweeps = 0;
+  uint64_t now_us = Timebase::now_us();
+  if (now_us - window_us < 1000000) {return;}
+  uint32_t sweeps = sweep_count;
+  sweep_rate_hz = static_cast<uint32_t>((static_cast<uint64_t>(sweeps - window_sweeps) * 1000000) / (now_us - window_us));
+  window_us = now_us;
+  window_sweeps = sweeps;
+}
+/*------------------------------------------------------------------*/
+void touch_task() {
+  static uint32_t last_sweep = 0;
+  uint32_t sweep = sweep_count;
+  if (sweep == last_sweep) {return;} // Core1 の sweep が終わっていない
+  last_sweep = sweep;
+  // SysEx で変えた値は、ここ (frame の頭) でまとめて使い始める
+  static bool tuning_restored = false;
+  if (!tuning_restored) {
+    tuning_restored = true; // 最初の sweep の時には Core1 の setup1() は終わっている
+    if (calib_loaded) {tuner.load(calib_data.tuning);}
+  }
+  Tuning tuning;
+  if (tuner.take_pending(tuning)) {
+    apply_tuning(tuning);
+  }
+  size_t pads = topology.pad_count();
+  const uint64_t sweep_us = sweep_time.load();
+#ifdef USE_CLUSTER
+  // follower: sweep を leader に渡すだけ (MIDI は出さない)
+  // leader: 自分のパッドの後ろに follower のパッドを並べ、一つの鍵盤として扱う
+  uint64_t frame_us = sweep_us;
+  if (cluster_role == ClusterRole::FOLLOWER) {
+    cluster_follower.capture(static_cast<uint32_t>(sweep_us), sensor_values, pads);
+  } else if (cluster_role == ClusterRole::LEADER) {
+    cluster_leader.set_local_pads(pads);
+    pads = cluster_leader.pad_count();
+  }
+#endif
+  if (qt.pad_count() != pads) {
+    qt.set_pad_count(pads);
+  }
+  for (size_t i = 0; i < topology.pad_count(); i++) {
+    // Read from Core 1
+    qt.set_value(i, sensor_values[i]);
+  }
+#ifdef USE_CLUSTER
+  if (cluster_role == ClusterRole::LEADER) {
+    cluster_leader.each_remote_pad([](size_t pad, uint16_t value) {qt.set_value(pad, value);});
+    // follower の新しい sweep の方が古ければ、そちらをこのフレームの時刻にする
+    const uint64_t remote_us = cluster_leader.take_fresh_us();
+    if (remote_us != 0) {
+      latency.record(LatencyStage::CLUSTER_LINK, Timebase::elapsed_us(remote_us));
+      if (remote_us < frame_us) {frame_us = remote_us;}
+    }
+  }
+#else
+  const uint64_t frame_us = sweep_us;
+#endif
+  if (!touch_stable && !calib_warm) {
+    track_noise_floor();
+  }
+  if (touch_stable) {
+    PROFILE_SCOPE(ProfRegion::TOUCH);
+    apply_mpe_request();
+    qt.set_frame_time(frame_us);
+    qt.seek_and_update_touch_point();
+    led_frame_sweep_us = sweep_us;
+    if (flight_live) {flight_record_tracks(static_cast<uint32_t>(sweep_us));}
+    if (mpe.enabled()) {
+      uint64_t now_us = Timebase::now_us();
+      for (size_t i = 0; i < MAX_TOUCH_POINTS; i++) {
+        const TouchPoint& tp = qt.touch_point(i);
+        mpe.update(i, tp.is_touched(), tp.pitch_offset(), tp.get_intensity(), now_us, send_mpe_message);
+      }
+    }
+  }
+}
+void apply_tuning(const Tuning& t) {
+  TouchParams params;
+  params.threshold = t.get(TuneParam::THRESHOLD);
+  params.close_range = t.get(TuneParam::CLOSE_RANGE) / 100.0f;
+  params.hysteresis = t.get(TuneParam::HYSTERESIS) / 100.0f;
+  params.release_hold = static_cast<uint8_t>(t.get(TuneParam::RELEASE_HOLD));
+  params.filter_len = static_cast<uint8_t>(t.get(TuneParam::FILTER_LEN));
+  qt.set_params(params);
+  scan_period_us = t.get(TuneParam::SCAN_PERIOD);
+  led_period_us = t.get(TuneParam::LED_PERIOD);
+  sched.set_period(led_task_id, governor.low_led_rate() ? led_period_us*2 : led_period_us);
+#ifdef USE_CLUSTER
+  apply_cluster(t.get(TuneParam::CLUSTER));
+#endif
+}
+#ifdef USE_CLUSTER
+void apply_cluster(uint16_t value) {
+  const ClusterRole role = cluster_role_of(value);
+  if ((role == cluster_role) && ((role != ClusterRole::FOLLOWER) || (cluster_follower.id() == value))) {return;}
+  cluster_role = role;
+  cluster_leader.reset();
+  cluster_follower = ClusterFollower(cluster_port);
+  if (role == ClusterRole::FOLLOWER) {cluster_follower.set_id(static_cast<uint8_t>(value));}
+  sched.set_enabled(cluster_task_id, role != ClusterRole::STANDALONE);
+}
+void cluster_task() {
+  PROFILE_SCOPE(ProfRegion::CLUSTER);
+  const uint64_t now_us = Timebase::now_us();
+  if (cluster_role == ClusterRole::LEADER) {
+    cluster_leader.service(now_us);
+  } else if (cluster_role == ClusterRole::FOLLOWER) {
+    cluster_follower.service(static_cast<uint32_t>(now_us));
+  }
+}
+#endif
+void send_mpe_message(uint8_t status, uint8_t data1, uint8_t data2) {
+  sendMidiMessage(status, data1, data2, qt.frame_time_us());
+}
+void apply_mpe_request() {
+  // 鳴っている途中で channel を変えると Note Off が届かないので、誰も触っていない時だけ切り替える
+  if (mpe_request == mpe.enabled()) {return;}
+  for (size_t i = 0; i < MAX_TOUCH_POINTS; i++) {
+    if (qt.touch_point(i).is_touched()) {return;}
+  }
+  mpe.enable(mpe_request, send_mpe_message);
+  for (size_t i = 0; i < MAX_TOUCH_POINTS; i++) {
+    if (mpe_request) {
+      qt.get_touch_point(i).set_channel(MpeOutput::channel_of(i), MPE_GLIDE_RANGE);
+    } else {
+      qt.get_touch_point(i).set_channel(TouchPoint::DEFAULT_CHANNEL, 0);
+    }
+  }
+}
+void midi_task() {
   // read any new MIDI messages
-  MIDI.read();
-  if (gt.timer10msecEvent()) {
-    for (int i = 0; i < MAX_SENS; i++) {
-      // Read from Core 1
-      qt.set_value(i, sensor_values[i]);
+  {
+    // 溜まっている分を、時間の許す限りまとめて読む
+    PROFILE_SCOPE(ProfRegion::MIDI_READ);
+    const Deadline budget = Deadline::in_us(MIDI_READ_BUDGET_US);
+    uint32_t count = 0;
+    while (MIDI.read()) {
+      count++;
+      if ((count >= MIDI_READ_MAX_MESSAGES) || budget.expired()) {
+        midi_read_budget_hits++;
+        break;
+      }
     }
-    if (stable) {
-      clear_touch_leds();
-      qt.seek_and_update_touch_point();
-      qt.lighten_leds(callback_for_set_led);
-      // Lighten LEDs (NeoPixel)
-      set_led_by_accompaniment();
-      set_led_for_wave(gt.globalTime());
-      update_neo_pixel();
+    if (count > midi_read_max_batch) {midi_read_max_batch = count;}
+  }
+  midi_out.drain(usb_midi_transport, Timebase::now_us(), [](const MidiOutEvent& ev, uint64_t sent_us) {
+    latency.record(LatencyStage::NOTE_TO_USB, Timebase::elapsed_us(ev.queued_us, sent_us));
+  });
+}
+void led_task() {
+  if (!touch_stable) {return;}
+  sync_light_count();
+  {
+    PROFILE_SCOPE(ProfRegion::LED_RENDER);
+    clear_touch_leds();
+    qt.lighten_leds(callback_for_set_led);
+    // Lighten LEDs (NeoPixel)
+    set_led_by_accompaniment();
+    if (governor.shed_ambient_frame()) {
+      clear_white_leds();
+    } else {
+      set_led_for_wave(Timebase::now_us());
     }
   }
-
-  if (gt.timer100msecEvent()) {
+  {
+    PROFILE_SCOPE(ProfRegion::LED_SHOW);
+    update_neo_pixel();
+  }
+  // 新しい sweep が最初に光になった時だけ測る
+  static uint64_t measured_sweep_us = 0;
+  if (led_frame_sweep_us != measured_sweep_us) {
+    measured_sweep_us = led_frame_sweep_us;
+    latency.record(LatencyStage::SWEEP_TO_PIXELS, Timebase::elapsed_us(led_frame_sweep_us));
+  }
+  if (governor.low_led_rate()) {
+    governor.count_shed_led_frames(1); // 半分のレートなので一フレーム分を捨てた
+  }
+}
+void display_task() {
+  heap_monitor_sample();
+  if (governor.shed_display_page()) {
+    debug_loop_counter = 0;
+    return;
+  }
+  {
+    PROFILE_SCOPE(ProfRegion::OLED_PAGE);
 #ifdef TEST_MODE
     show_one_kamaboko(0);
 #else
     show_debug_info();
 #endif
-    debug_loop_counter = 0; // Reset debug loop counter
   }
+  debug_loop_counter = 0; // Reset debug loop counter
+}
+void serial_task() {
+  // 'l': 遅延の統計を出力 / 'r': 統計をクリア / 'p': 処理時間の書き出しを切り替え
+  // 's': センサ値のストリームを切り替え / 'm': MPE 出力を切り替え
+  // 'f': flight recorder を止めて flash に書く / 'd': flash の dump を送る (telemetry_decode.py flight)
+  // 'x': HOT_FUNC の関数の実行 cycle 数 (USE_HOT_BENCH)
+  while (Serial.available() > 0) {
+    int cmd = Serial.read();
+    if (cmd == 'l') {
+      print_latency_report();
+    } else if (cmd == 'r') {
+      latency.clear();
+    } else if (cmd == 's') {
+      stream_enabled = !stream_enabled;
+    } else if (cmd == 'm') {
+      mpe_request = !mpe_request;
+    } else if (cmd == 'f') {
+      freeze_flight(FlightReason::SERIAL);
+    } else if (cmd == 'd') {
+      start_flight_upload();
+#ifdef USE_PROFILER
+    } else if (cmd == 'p') {
+      profile_export = !profile_export;
+#endif
+#ifdef USE_HOT_BENCH
+    } else if (cmd == 'x') {
+      hot_bench();
+#endif
+    }
+  }
+  flight_service();
+#ifdef USE_PROFILER
+  export_profile();
+#endif
+}
+#ifdef USE_PROFILER
+void export_profile() {
+  static uint64_t last_export_us = 0;
+  uint64_t now_us = Timebase::now_us();
+  if (now_us - last_export_us < PROFILE_EXPORT_PERIOD) {return;}
+  uint32_t period = Timebase::elapsed_us(last_export_us, now_us);
+  last_export_us = now_us;
+
+  static uint8_t frame[PROF_FRAME_BYTES];
+  size_t len = profiler.export_frame(frame, sizeof(frame), period);
+  if (!profile_export || (len == 0)) {return;}
+  // USB が詰まっている時は待たずに捨てる
+  if (Serial.availableForWrite() < static_cast<int>(len)) {
+    profile_dropped++;
+    return;
+  }
+  Serial.write(frame, len);
 }
+#endif
 void check_usb_status() {
   static bool usb_connected = false;
   if (usb_connected) {return;}
@@ -189,61 +658,346 @@ void check_usb_status() {
 }
 /*------------------------------------------------------------------*/
 void loop1() {
-  for (int i = 0; i < MAX_SENS; i++) {
-    sensor_values[i] = get_sensor_values(i);
+  uint64_t sweep_start = Timebase::now_us();
+  {
+    PROFILE_SCOPE(ProfRegion::SCAN);
+    scan_sweep();
+  }
+  sweep_time.store(sweep_start);
+  sweep_count++;
+  if (flight_live) {
+    flight_record_sweep(sweep_start);
+  }
+  if (stream_enabled) {
+    stream_sweep(sweep_start);
   }
 
   // Update sensor ref values
   read_ref_sensor_values(sensor_adjust_counter);
   sensor_adjust_counter++;
-  if (sensor_adjust_counter >= MAX_SENS) {
+  if (sensor_adjust_counter >= static_cast<int>(topology.pad_count())) {
     sensor_adjust_counter = 0;
   }
+
+  // 周期が決めてあれば、次の sweep まで待つ
+  const uint32_t period = scan_period_us;
+  const Deadline next_sweep{sweep_start + period};
+#ifdef USE_PCA9685
+  flush_led_i2c(period != 0 ? next_sweep.remaining_us() : 0);
+#endif
+  while ((period != 0) && !next_sweep.expired()) {}
+}
+void scan_sweep() {
+  // mux はかまぼこごとに一回だけ切り替える
+  for (size_t b = 0; b < topology.block_count(); b++) {
+    select_kamaboko(b);
+    uint16_t first = topology.block(b).first_pad;
+    for (int e = 0; e < MAX_EACH_SENS; e++) {
+      sensor_values[first + e] = get_sensor_values(first + e);
+    }
+  }
+}
+void stream_sweep(uint64_t sweep_start) {
+  // Core1: 差分で詰めて Core0 に渡す。入らなければ捨てて、次は keyframe にする
+  static uint8_t frame[SweepEncoder<MAX_SENS>::MAX_FRAME];
+  static uint32_t oversize_seen = 0;
+  const uint32_t oversize = stream_oversize;
+  if (oversize != oversize_seen) {
+    // Core0 が捨てた分: PC は次の keyframe まで値を持てない
+    stream_dropped = stream_dropped + (oversize - oversize_seen);
+    oversize_seen = oversize;
+    stream_encoder.force_keyframe();
+  }
+  size_t len = stream_encoder.encode(frame, sizeof(frame), static_cast<uint32_t>(sweep_start), sensor_values, topology.pad_count());
+  if ((len == 0) || !stream_ring.push(frame, len)) {
+    stream_dropped = stream_dropped + 1;
+    stream_encoder.force_keyframe();
+  }
+}
+#ifdef USE_PCA9685
+void flush_led_i2c(uint32_t gap_us) {
+  // Core1: sweep の合間 (次の sweep までの gap_us) に、変わった channel だけを送る
+  PROFILE_SCOPE(ProfRegion::LED_I2C);
+  size_t budget = std::max(PCA9685_GAP_BYTES, static_cast<size_t>(gap_us / PCA9685_US_PER_BYTE));
+  sk.flush(budget);
+}
+#endif
+void flight_record_sweep(uint64_t sweep_start) {
+  // Core1: 止めるまでは毎 sweep 書く (止めた後は何もしない)
+  PROFILE_SCOPE(ProfRegion::FLIGHT);
+  flight_recorder.record_sweep(static_cast<uint32_t>(sweep_start), sensor_values, topology.pad_count());
+}
+void drain_sensor_stream() {
+  // Core0: USB に丸ごと入るフレームだけを書き、待たない
+  // フレームの途中で止めると、次に書くまでの間に他の Serial 出力 ('l' のレポート、
+  // profile、flight の upload) が入り込んでフレームが壊れる
+  // 送信 FIFO より大きいフレーム (パッドが多い時の keyframe など) は捨て、Core1 に keyframe を頼む
+  static uint8_t frame[SweepEncoder<MAX_SENS>::MAX_FRAME];
+  uint32_t dropped = drain_frames(stream_ring, frame, sizeof(frame), TELEMETRY_TX_FIFO,
+    []() {
+      const int room = Serial.availableForWrite();
+      return room > 0 ? static_cast<size_t>(room) : 0;
+    },
+    [](const uint8_t* p, size_t len) {Serial.write(p, len);});
+  if (dropped != 0) {stream_oversize = stream_oversize + dropped;}
 }
 /*----------------------------------------------------------------------------*/
 //     Read AT42QT1070 raw/ref values
-//      num: 0-15 (which AT42QT1070 to read from)
+//      num: 0-(block_count-1) (which AT42QT1070 to read from, ring order)
 //      sens: 0-5 (which sensor to read from, 0-5)
 //      ref: true for reference value, false for raw value
 //      returns: tuple of error code and raw value
 /*----------------------------------------------------------------------------*/
-std::tuple<int, uint16_t> read_from_AT42QT(int num, int sens, bool ref) {
+void select_kamaboko(size_t num) {
+  const KamabokoInfo& info = topology.block(num);
+  pca9544_changeI2cBus(info.channel, info.mux);
+}
+std::tuple<int, uint16_t> read_selected_AT42QT(int sens, bool ref) {
   uint8_t raw[2];
-  constexpr uint8_t CONVERT_TO_DEV_NUM[4] = {3, 2, 1, 0};
-  constexpr uint8_t OFFSET_I2C_ADRS[4] = {0x00, 0x01, 0x02, 0x03};
-  pca9544_changeI2cBus(CONVERT_TO_DEV_NUM[num % 4], OFFSET_I2C_ADRS[num / 4]);
   int err = AT42QT_read(sens, raw, ref);
   uint16_t rawval = static_cast<uint16_t>(raw[0]) * 256 + raw[1];
   return {err, rawval};
 }
-int get_sensor_values(int sens) {
-  std::tuple<int, uint16_t> result = read_from_AT42QT(sens/6, sens%6, false);
-  int rawval = std::get<1>(result);
-  int diff = rawval - tch[sens].ref_value;
-  if (diff < 0) {diff = 0;}
+std::tuple<int, uint16_t> read_from_AT42QT(int num, int sens, bool ref) {
+  select_kamaboko(num);
+  return read_selected_AT42QT(sens, ref);
+}
+uint16_t get_sensor_values(int sens) {
+  // そのかまぼこは select_kamaboko() で選んである
+  std::tuple<int, uint16_t> result = read_selected_AT42QT(sens%6, false);
+  if (std::get<0>(result) != 0) {
+    i2c_errors = i2c_errors + 1;
+    return sensor_values[sens]; // 読めなかった時は前の値のまま
+  }
+  uint16_t rawval = std::get<1>(result);
   tch[sens].raw_value = rawval;
-  return diff;
+  return (rawval > tch[sens].ref_value) ? rawval - tch[sens].ref_value : 0;
 }
 void read_ref_sensor_values(int sens) {
   std::tuple<int, uint16_t> result = read_from_AT42QT(sens/6, sens%6, true);
+  if (std::get<0>(result) != 0) {
+    i2c_errors = i2c_errors + 1;
+    return;
+  }
   if (tch[sens].ref_value != std::get<1>(result)) {
     tch[sens].ref_value = std::get<1>(result);
   }
 }
 /*----------------------------------------------------------------------------*/
-//     Timer
+//     Calibration store
+//      EEPROM の sector (EEPROM ライブラリは使っていない) と、その下の sector に log で追記する
+//      下の sector は FS が無く、プログラムとも重ならない時だけ使える
+//      使えなければ一つだけになり、CalibStore は読むだけで書かない (消している間に電源が切れると全部なくなる)
 /*----------------------------------------------------------------------------*/
-bool TimerHandler(repeating_timer* rt)
-{
-  gt.incGlobalTime();
+extern uint8_t _EEPROM_start;
+extern uint8_t _FS_start;
+extern uint8_t _FS_end;
+extern "C" uint8_t __flash_binary_end;
+size_t calib_flash_offset = 0;  // XIP_BASE からの位置
+CalibFlash calib_flash() {
+  const uint8_t* eeprom = &_EEPROM_start;
+  const uint8_t* below = eeprom - FLASH_SECTOR_SIZE;
+  size_t sectors = ((&_FS_start == &_FS_end) && (&__flash_binary_end <= below)) ? 2 : 1;
+  const uint8_t* base = eeprom - (sectors - 1) * FLASH_SECTOR_SIZE;
+  calib_flash_offset = static_cast<size_t>(base - reinterpret_cast<const uint8_t*>(XIP_BASE));
+  return CalibFlash{base, sectors * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE, calib_flash_erase, calib_flash_program};
+}
+int calib_flash_erase(size_t offset) {
+  return flash_erase_sector(calib_flash_offset + offset);
+}
+int calib_flash_program(size_t offset, const uint8_t* data, size_t len) {
+  return flash_program_pages(calib_flash_offset + offset, data, len);
+}
+int flash_erase_sector(size_t flash_offset) {
+  // 書き換えている間は XIP が使えないので、もう一つの core と割り込みを止める
+  rp2040.idleOtherCore();
+  noInterrupts();
+  flash_range_erase(flash_offset, FLASH_SECTOR_SIZE);
+  interrupts();
+  rp2040.resumeOtherCore();
+  return 0;
+}
+int flash_program_pages(size_t flash_offset, const uint8_t* data, size_t len) {
+  rp2040.idleOtherCore();
+  noInterrupts();
+  flash_range_program(flash_offset, data, len);
+  interrupts();
+  rp2040.resumeOtherCore();
+  return 0;
+}
+void track_noise_floor() {
+  // タッチを受け付ける前の raw - ref の最大値
+  for (size_t i = 0; i < topology.pad_count(); i++) {
+    int v = sensor_values[i];
+    if (v > 255) {v = 255;}
+    if (v > calib_data.noise[i]) {calib_data.noise[i] = static_cast<uint8_t>(v);}
+  }
+}
+void save_calibration() {
+  // かまぼこが見つからず全部あるものとした時は覚えない
+  if (topology.fallback()) {return;}
+  calib_data.block_count = static_cast<uint8_t>(topology.block_count());
+  for (size_t b = 0; b < topology.block_count(); b++) {
+    calib_data.block[b] = topology.block(b);
+  }
+  for (size_t i = 0; i < topology.pad_count(); i++) {
+    calib_data.ref[i] = tch[i].ref_value;
+  }
+  calib_data.tuning = tuner.tuning();
+  calib_saved = calib_store.save(calib_data);
+}
+bool save_tuning(const Tuning& tuning) {
+  // SysEx の save: ref などは今の record のまま、tuning だけ変えて追記する
+  // (flash を書く間 Core1 は止まるので、数十 msec sweep が抜ける)
+  if (calib_data.block_count == 0) {return false;} // まだ一度も覚えていない (かまぼこが見つからない時も)
+  calib_data.tuning = tuning;
+  calib_saved = calib_store.save(calib_data);
+  return calib_saved;
+}
+/*----------------------------------------------------------------------------*/
+//     Flight recorder
+//      止めた記録は calib の領域のすぐ下に書く (FS が無く、プログラムとも重ならない時だけ)
+//      書いている間は Core1 も止まり、0.5 秒ほど sweep と MIDI が抜ける
+/*----------------------------------------------------------------------------*/
+size_t flight_flash_offset = 0;  // XIP_BASE からの位置
+CalibFlash flight_flash() {
+  // calib_flash() の後に呼ぶ (calib_flash_offset が決まってから)
+  const size_t bytes = ((FLIGHT_DUMP_BYTES + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+  const uint8_t* base = reinterpret_cast<const uint8_t*>(XIP_BASE) + calib_flash_offset - bytes;
+  if ((&_FS_start != &_FS_end) || (&__flash_binary_end > base)) {
+    return CalibFlash{nullptr, 0, FLASH_SECTOR_SIZE, flight_flash_erase, flight_flash_program};
+  }
+  flight_flash_offset = static_cast<size_t>(base - reinterpret_cast<const uint8_t*>(XIP_BASE));
+  return CalibFlash{base, bytes, FLASH_SECTOR_SIZE, flight_flash_erase, flight_flash_program};
+}
+int flight_flash_erase(size_t offset) {
+  rp2040.wdt_reset(); // 一 sector 数十 msec かかり、全部で watchdog の時間に近づく
+  return flash_erase_sector(flight_flash_offset + offset);
+}
+int flight_flash_program(size_t offset, const uint8_t* data, size_t len) {
+  rp2040.wdt_reset();
+  return flash_program_pages(flight_flash_offset + offset, data, len);
+}
+void flight_service() {
+  // serial_task から: 起動後の片付け、止めるきっかけ、flash への書き込み、'd' の送信
+  static bool booted = false;
+  if (!booted) {
+    // Core1 の setup1() が終わって (calib の領域が決まって) から
+    if (sweep_count == 0) {return;}
+    booted = true;
+    start_flight_recorder();
+    return;
+  }
+  uint32_t now_ms = static_cast<uint32_t>(Timebase::now_us() / 1000);
+  check_flight_triggers(now_ms);
+  if ((flight_recorder.state() == FlightState::FROZEN) &&
+      ((sweep_count - flight_frozen_sweep >= FLIGHT_DUMP_WAIT_SWEEPS) || (now_ms - flight_frozen_ms >= FLIGHT_DUMP_WAIT_MS))) {
+    dump_flight_recorder();
+    flight_recorder.arm(topology.pad_count());
+  }
+  send_flight_upload();
+}
+void start_flight_recorder() {
+  // 前の起動の記録が残っていれば先に書く: 止めてあったもの、記録中に watchdog で再起動したもの
+  CalibFlash flash = flight_flash();
+  FlightDumpInfo info;
+  if ((flash.base != nullptr) && flight_dump_read(flash.base, flash.size, info)) {
+    flight_dump_seq = info.seq;
+  }
+  if (flight_recorder.survived()) {
+    if ((flight_recorder.state() == FlightState::ARMED) && watchdog_enable_caused_reboot()) {
+      flight_recorder.freeze(FlightReason::WATCHDOG, flight_recorder.last_sweep_us());
+    }
+    if (flight_recorder.state() == FlightState::FROZEN) {
+      dump_flight_recorder();
+    }
+  }
+  flight_recorder.arm(topology.pad_count());
+  flight_live = true;
+}
+void dump_flight_recorder() {
+  // tuning は今の値 (止めた時に SysEx で変えたまま保存していなかった値は、再起動の後は分からない)
+  flight_dump_ok = flight_dump_write(flight_recorder, flight_flash(), tuner.tuning(), flight_dump_seq + 1);
+  if (flight_dump_ok) {flight_dump_seq++;}
+  flight_recorder.mark_dumped();
+}
+void check_flight_triggers(uint32_t now_ms) {
+  // 左右のスイッチの同時長押し (一度止めたら離すまで次は無い)
+  static uint32_t combo_start_ms = 0;
+  static bool combo_fired = false;
+  bool both = (gpio_get(SWITCH_LEFT) == LOW) && (gpio_get(SWITCH_RIGHT) == LOW);
+  if (!both) {
+    combo_start_ms = now_ms;
+    combo_fired = false;
+  } else if (!combo_fired && (now_ms - combo_start_ms >= FLIGHT_COMBO_MS)) {
+    combo_fired = true;
+    freeze_flight(FlightReason::SWITCH);
+  }
+  // タッチを受け付けてから、Core1 の sweep が進まなくなった
+  static uint32_t last_sweep = 0;
+  static uint32_t last_progress_ms = 0;
+  uint32_t sweep = sweep_count;
+  if ((sweep != last_sweep) || !touch_stable) {
+    last_sweep = sweep;
+    last_progress_ms = now_ms;
+  } else if (now_ms - last_progress_ms >= FLIGHT_STALL_MS) {
+    last_progress_ms = now_ms;
+    freeze_flight(FlightReason::STALL);
+  }
+}
+bool freeze_flight(FlightReason reason) {
+  if (!flight_live) {return false;}
+  uint64_t now_us = Timebase::now_us();
+  if (!flight_recorder.freeze(reason, static_cast<uint32_t>(now_us))) {return false;}
+  flight_frozen_ms = static_cast<uint32_t>(now_us / 1000);
+  flight_frozen_sweep = sweep_count;
   return true;
 }
+bool freeze_flight_by_sysex() {
+  return freeze_flight(FlightReason::SYSEX);
+}
+void flight_record_tracks(uint32_t sweep_us) {
+  // タッチが始まった / 終わった / Note が変わった時だけ
+  static bool touched[MAX_TOUCH_POINTS] = {};
+  static uint8_t notes[MAX_TOUCH_POINTS] = {};
+  for (size_t i = 0; i < MAX_TOUCH_POINTS; i++) {
+    const TouchPoint& tp = qt.touch_point(i);
+    bool t = tp.is_touched();
+    uint8_t note = t ? tp.note() : 0;
+    if ((t == touched[i]) && (note == notes[i])) {continue;}
+    touched[i] = t;
+    notes[i] = note;
+    int16_t location = t ? static_cast<int16_t>(tp.get_location() * 100) : -1;
+    flight_recorder.record_track(sweep_us, static_cast<uint8_t>(i), t, note, location, tp.get_intensity());
+  }
+}
+void start_flight_upload() {
+  // flash の dump を頭から送る (無ければ一行だけ)
+  CalibFlash flash = flight_flash();
+  FlightDumpInfo info;
+  if ((flash.base == nullptr) || !flight_dump_read(flash.base, flash.size, info)) {
+    Serial.println("flight no dump");
+    return;
+  }
+  flight_upload.start(flash.base, info.total_bytes());
+}
+void send_flight_upload() {
+  // USB の送信 FIFO に入る分だけ送り、残りは次の serial_task で
+  static uint8_t frame[FLIGHT_UPLOAD_FRAME];
+  while (flight_upload.active()) {
+    const int room = Serial.availableForWrite();
+    size_t len = flight_upload.next(frame, sizeof(frame), room > 0 ? static_cast<size_t>(room) : 0);
+    if (len == 0) {return;}
+    Serial.write(frame, len);
+  }
+}
+/*----------------------------------------------------------------------------*/
+//     Timer
+/*----------------------------------------------------------------------------*/
 long generateTimer( void )
 {
-  uint16_t  gTime = gt.globalTime();
-  long diff = gTime - gt.gtOld();
-  gt.setGtOld(gTime);
-  if ( diff < 0 ){ diff += 0x10000; }
+  long diff = gt.advanceTo(Timebase::now_us());
+  gt.setGtOld(gt.globalTime());
 
   gt.clearAllTimerEvent();
   gt.updateTimer(diff);
@@ -253,42 +1007,107 @@ long generateTimer( void )
 //     MIDI/Other Hardware
 /*----------------------------------------------------------------------------*/
 void handleNoteOn(byte channel, byte pitch, byte velocity) {
+  if (flight_live) {
+    flight_recorder.record_midi(FlightRec::MIDI_IN, static_cast<uint32_t>(Timebase::now_us()), 0x90 | ((channel - 1) & 0x0f), pitch, velocity);
+  }
   if (channel == 16) {
-    external_note_status[pitch] = velocity;
+    external_notes.set(pitch, velocity);
   }
 }
 void handleNoteOff(byte channel, byte pitch, byte velocity) {
+  if (flight_live) {
+    flight_recorder.record_midi(FlightRec::MIDI_IN, static_cast<uint32_t>(Timebase::now_us()), 0x80 | ((channel - 1) & 0x0f), pitch, velocity);
+  }
   if (channel == 16) {
-    external_note_status[pitch] = 0;
+    external_notes.clear(pitch);
   }
 }
 void handleProgramChange(byte channel , byte number) {
 }
-void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity) {
-  uint8_t channel = (status & 0x0F) + 1;
+void handleSystemExclusive(byte* array, unsigned size) {
+  static uint8_t reply[SYSEX_MAX_REPLY];
+  size_t len = tuner.handle(array, size, reply, sizeof(reply));
+  if (len > 0) {
+    MIDI.sendSysEx(len, reply, true);
+  }
+}
+void read_perf_counters(PerfSnapshot& out) {
+  auto set = [&out](PerfCounter c, uint32_t v) {out.value[static_cast<size_t>(c)] = v;};
+  set(PerfCounter::SWEEP_HZ, sweep_rate_hz);
+  set(PerfCounter::LOOP_SLACK_PCT, governor.slack_pct());
+  set(PerfCounter::LOAD_LEVEL, governor.level_num());
+  set(PerfCounter::I2C_ERRORS, i2c_errors);
+  set(PerfCounter::MIDI_DROPPED, midi_out.dropped());
+  const LatencyHistogram& note = latency.hist[static_cast<size_t>(LatencyStage::SWEEP_TO_NOTE_QUEUED)];
+  const LatencyHistogram& usb = latency.hist[static_cast<size_t>(LatencyStage::NOTE_TO_USB)];
+  const LatencyHistogram& pixel = latency.hist[static_cast<size_t>(LatencyStage::SWEEP_TO_PIXELS)];
+  set(PerfCounter::NOTE_P50_US, note.p50());
+  set(PerfCounter::NOTE_P99_US, note.p99());
+  set(PerfCounter::USB_P50_US, usb.p50());
+  set(PerfCounter::USB_P99_US, usb.p99());
+  set(PerfCounter::PIXEL_P50_US, pixel.p50());
+  set(PerfCounter::PIXEL_P99_US, pixel.p99());
+  set(PerfCounter::SHED_TOTAL, governor.shed_total());
+}
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us) {
+  // ここでは積むだけ。USB へは midi_task が送る
+#ifdef USE_CLUSTER
+  if (cluster_role == ClusterRole::FOLLOWER) {return;}  // 鳴らすのは leader だけ
+#endif
+  uint64_t queued_us = Timebase::now_us();
+  if (flight_live) {
+    // 時刻は元の sweep (qubit_replay の golden と同じ)。sweep の無いものは積んだ時刻
+    flight_recorder.record_midi(FlightRec::MIDI_OUT, static_cast<uint32_t>(sweep_us != 0 ? sweep_us : queued_us), status, note, velocity);
+  }
   switch(status & 0xF0) {
       case 0x90: // Note On
-          MIDI.sendNoteOn(note, velocity, channel);
+          if (sweep_us != 0) {
+            latency.record(LatencyStage::SWEEP_TO_NOTE_QUEUED, Timebase::elapsed_us(sweep_us, queued_us));
+          }
+          midi_out.enqueue(status, note, velocity, sweep_us, queued_us);
           break;
       case 0x80: // Note Off
-          MIDI.sendNoteOff(note, velocity, channel);
+          midi_out.enqueue(status, note, velocity, sweep_us, queued_us);
           break;
       case 0xB0: // Control Change
-          //MIDI.sendControlChange(note, velocity, channel);
+      case 0xD0: // Channel Pressure
+      case 0xE0: // Pitch Bend (note: LSB, velocity: MSB)
+          midi_out.enqueue(status, note, velocity, sweep_us, queued_us);
           break;
       case 0xC0: // Program Change
-          //MIDI.sendProgramChange(note, channel);
+          //midi_out.enqueue(status, note, 0, sweep_us, queued_us);
           break;
       default:
           break;
   }
 }
+size_t usb_midi_transport(const uint8_t* packets, size_t count) {
+  // 一転送分をまとめて TinyUSB の FIFO に書き、送り出すのは最後の一度だけ
+  // (writePacket() はパケットごとに送り出すので、最初の一つが単独の転送になってしまう)
+  if (!TinyUSBDevice.mounted()) {return 0;}
+  if (count > MIDI_PACKETS_PER_XFER) {count = MIDI_PACKETS_PER_XFER;}
+  uint8_t bytes[MIDI_PACKETS_PER_XFER * 3];
+  size_t end[MIDI_PACKETS_PER_XFER];  // n 番目のパケットまでの byte 数
+  size_t len = 0;
+  for (size_t n = 0; n < count; n++) {
+    len += MidiOutQueue::unpack(&packets[n * 4], &bytes[len]);
+    end[n] = len;
+  }
+  // FIFO が一杯になるとメッセージの切れ目で止まる。書けた byte 数から受け付けたパケット数を出す
+  const uint32_t written = tud_midi_stream_write(MIDI_CABLE, bytes, static_cast<uint32_t>(len));
+  size_t n = 0;
+  while ((n < count) && (end[n] <= written)) {
+    n++;
+  }
+  return n;
+}
 /*----------------------------------------------------------------------------*/
 //     Display for SSD1331
 /*----------------------------------------------------------------------------*/
 void show_one_kamaboko(int kamaboko) {
   SSD1331_display("Loopian::QUBIT", 0, SSD1331_COLORS::MAGENTA);
-  std::string kama = "Block No.: " + std::to_string(kamaboko);
+  TextBuf<24> kama;
+  kama.add("Block No.: ").add_int(kamaboko);
   SSD1331_display(kama.c_str(), 1, SSD1331_COLORS::CYAN);
   for (int i = 0; i < 3; i++) {
     uint16_t value1 = qt.get_value(kamaboko * 6 + i * 2);
@@ -297,26 +1116,20 @@ void show_one_kamaboko(int kamaboko) {
   }
 }
 void show_one_line(int line, int value1, int value2) {
-    std::string text_display;
-    size_t idx = 0;
+    TextBuf<24> text_display;
 
     for (int i=0; i<7; i++) {
       if (value1 > 4) {
-        text_display += 'o';
-        idx += 1;
+        text_display.add('o');
         value1 -= 4;
       } else {
         break;
       }
     }
-    for (int i=idx; i<8; i++) {
-      text_display += ' ';
-    }
-    idx = 8;
+    text_display.pad_to(8);
     for (int j=0; j<7; j++) {
       if (value2 > 4) {
-        text_display += 'x';
-        idx += 1;
+        text_display.add('x');
         value2 -= 4;
       } else {
         break;
@@ -324,9 +1137,10 @@ void show_one_line(int line, int value1, int value2) {
     }
     SSD1331_display(text_display.c_str(), line, SSD1331_COLORS::WHITE);
 }
-constexpr size_t MAX_PAGE = 17;
+constexpr size_t FIXED_PAGE = 4; // touch / scheduler / heap / latency
 auto page_detect() -> std::tuple<size_t, bool> {
   static size_t page = 0;
+  const size_t MAX_PAGE = FIXED_PAGE + topology.block_count(); // かまぼこのページは見つかった分だけ
   bool current_left = gpio_get(SWITCH_LEFT) == LOW;
   bool current_right = gpio_get(SWITCH_RIGHT) == LOW;
   bool changed = false;
@@ -354,23 +1168,156 @@ auto page_detect() -> std::tuple<size_t, bool> {
 void display_page1() {
   SSD1331_display("Loopian::QUBIT", 0, SSD1331_COLORS::MAGENTA);
   for (int i = 0; i < MAX_TOUCH_POINTS; i++) {
-    std::string disp_str = std::to_string(i) + "> ";
+    TextBuf<24> disp_str;
+    disp_str.add_int(i).add("> ");
     float disp_loc = qt.touch_point(i).get_location();
     if (disp_loc == TouchPoint::INIT_VAL) {
-      disp_str += " L:---";
+      disp_str.add(" L:---");
     } else {
-      auto loc = std::ostringstream();
-      loc << std::fixed << std::setprecision(1) << disp_loc;
-      disp_str += " L:" + loc.str();
+      disp_str.add(" L:").add_fixed(disp_loc, 1);
     }
-    auto loc2 = std::ostringstream();
-    loc2 << std::fixed << std::setprecision(1) << qt.touch_point(i).get_intensity();
-    disp_str += "/" + loc2.str();
+    disp_str.add('/').add_fixed(qt.touch_point(i).get_intensity(), 1);
     SSD1331_display(disp_str.c_str(), i+1, SSD1331_COLORS::WHITE);
   }
-  std::string loop_info = "LpCntr: " + std::to_string(debug_loop_counter);
+  TextBuf<24> loop_info;
+  loop_info.add("LpCntr: ").add_int(debug_loop_counter);
   SSD1331_display(loop_info.c_str(), 5, SSD1331_COLORS::YELLOW);
 }
+void display_page_sched() {
+  SSD1331_display("Scheduler", 0, SSD1331_COLORS::MAGENTA);
+  for (size_t i = 0; i < sched.task_count(); i++) {
+    const SchedTask& t = sched.task(i);
+    // 名前 / 最大ジッタ[usec] / 締め切り超過回数
+    TextBuf<24> disp_str;
+    disp_str.add(t.name).add(' ').add_uint(t.max_jitter_us).add('/').add_uint(t.overruns);
+    SSD1331_display(disp_str.c_str(), i+1, SSD1331_COLORS::WHITE);
+  }
+  // 負荷レベル / slack[%] / 減らしたフレーム数
+  TextBuf<24> gov_str;
+  gov_str.add("Lv").add_uint(governor.level_num()).add(' ').add_uint(governor.slack_pct()).add("% ").add_uint(governor.shed_total());
+  SSD1331_display(gov_str.c_str(), 5, SSD1331_COLORS::YELLOW);
+}
+void display_page_heap() {
+  // setup() 後の heap 使用 (定常状態では増えないこと)
+  HeapStats st = heap_monitor_stats();
+  // malloc/free まで数えているか (USE_HEAP_WRAP)、operator new/delete だけか
+  SSD1331_display(st.malloc_hooked ? "Heap (malloc)" : "Heap (new)", 0, SSD1331_COLORS::MAGENTA);
+  TextBuf<24> line;
+  line.add("Alloc: ").add_uint(st.allocs);
+  SSD1331_display(line.c_str(), 1, SSD1331_COLORS::WHITE);
+  line.clear();
+  line.add("Free : ").add_uint(st.frees);
+  SSD1331_display(line.c_str(), 2, SSD1331_COLORS::WHITE);
+  line.clear();
+  line.add("Bytes: ").add_uint(st.bytes);
+  SSD1331_display(line.c_str(), 3, SSD1331_COLORS::WHITE);
+  line.clear();
+  line.add("Use  : ").add_uint(st.in_use);
+  SSD1331_display(line.c_str(), 4, SSD1331_COLORS::WHITE);
+  line.clear();
+  line.add("Peak : ").add_uint(st.peak);
+  SSD1331_display(line.c_str(), 5, SSD1331_COLORS::YELLOW);
+}
+void display_page_latency() {
+  // 区間ごとの p50 / p99 [usec]
+  SSD1331_display("Latency p50/p99", 0, SSD1331_COLORS::MAGENTA);
+  for (size_t i = 0; i < LATENCY_STAGES; i++) {
+    const LatencyHistogram& h = latency.hist[i];
+    TextBuf<24> line;
+    line.add(LatencyTrace::name(i)).pad_to(10).add_uint(h.p50()).add('/').add_uint(h.p99());
+    SSD1331_display(line.c_str(), i+1, SSD1331_COLORS::WHITE);
+  }
+  // MIDI 送信待ち: 最大の深さ / 捨てた数 / USB が詰まった回数
+  TextBuf<24> queue;
+  queue.add("MIDIq ").add_uint(midi_out.max_depth()).add('/').add_uint(midi_out.dropped())
+       .add('/').add_uint(midi_out.stalls());
+  SSD1331_display(queue.c_str(), LATENCY_STAGES+1, SSD1331_COLORS::CYAN);
+}
+void print_latency_report() {
+  // stage count min p50 p90 p99 max [usec]
+  Serial.println("stage count min p50 p90 p99 max");
+  for (size_t i = 0; i < LATENCY_STAGES; i++) {
+    const LatencyHistogram& h = latency.hist[i];
+    TextBuf<80> line;
+    line.add(LatencyTrace::name(i)).add(' ').add_uint(h.count()).add(' ').add_uint(h.min())
+        .add(' ').add_uint(h.p50()).add(' ').add_uint(h.p90()).add(' ').add_uint(h.p99())
+        .add(' ').add_uint(h.max());
+    Serial.println(line.c_str());
+  }
+  TextBuf<80> queue;
+  queue.add("midi_out enq ").add_uint(midi_out.enqueued()).add(" sent ").add_uint(midi_out.sent())
+       .add(" coalesced ").add_uint(midi_out.coalesced()).add(" dropped ").add_uint(midi_out.dropped())
+       .add(" stalls ").add_uint(midi_out.stalls()).add(" max_depth ").add_uint(midi_out.max_depth());
+  Serial.println(queue.c_str());
+  TextBuf<64> mpe_line;
+  mpe_line.add("mpe ").add(mpe.enabled() ? "on" : "off").add(" sent ").add_uint(mpe.sent())
+          .add(" suppressed ").add_uint(mpe.suppressed());
+  Serial.println(mpe_line.c_str());
+  TextBuf<64> topo;
+  topo.add("topology blocks ").add_uint(topology.block_count()).add(" pads ").add_uint(topology.pad_count())
+      .add(" mux ").add_uint(topology.mux_found()).add(topology.fallback() ? " (not found, all)" : "");
+  Serial.println(topo.c_str());
+  TextBuf<80> calib;
+  calib.add("calib ").add(calib_warm ? "warm" : "cold").add(" gate_ms ").add_uint(calib_gate_ms)
+       .add(" seq ").add_uint(calib_store.seq()).add(" records ").add_uint(calib_store.records())
+       .add(" erases ").add_uint(calib_store.erases()).add(calib_saved ? " saved" : "")
+       .add(calib_store.writable() ? "" : " read-only (1 sector)");
+  Serial.println(calib.c_str());
+  TextBuf<64> midi_in;
+  midi_in.add("midi_in max_batch ").add_uint(midi_read_max_batch).add(" budget_hits ").add_uint(midi_read_budget_hits)
+         .add(" notes ").add_uint(external_notes.count());
+  Serial.println(midi_in.c_str());
+  static const char* const FLIGHT_STATES[] = {"off", "armed", "frozen", "dumped"};
+  TextBuf<112> flight;
+  flight.add("flight ").add(flight_live ? FLIGHT_STATES[static_cast<size_t>(flight_recorder.state())] : "off")
+        .add(" reason ").add(flight_reason_name(static_cast<uint8_t>(flight_recorder.reason())))
+        .add(" sweeps ").add_uint(flight_recorder.sweeps().records()).add('/').add_uint(flight_recorder.sweeps().used())
+        .add("B over ").add_uint(flight_recorder.sweeps().overwritten())
+        .add(" events ").add_uint(flight_recorder.events().records()).add(" over ").add_uint(flight_recorder.events().overwritten())
+        .add(" dump seq ").add_uint(flight_dump_seq).add(flight_dump_ok ? " ok" : "")
+        .add(" flash ").add_uint(flight_flash_offset);
+  Serial.println(flight.c_str());
+#ifdef USE_PCA9685
+  TextBuf<96> pca;
+  pca.add("pca9685 chips ").add_uint(sk.chips()).add(" writes ").add_uint(sk.writes()).add(" bytes ").add_uint(sk.bytes())
+     .add(" errors ").add_uint(sk.errors()).add(" skipped ").add_uint(sk.skipped());
+  Serial.println(pca.c_str());
+#endif
+#ifdef USE_CLUSTER
+  print_cluster_report();
+#endif
+}
+#ifdef USE_CLUSTER
+void print_cluster_report() {
+  static const char* const ROLES[] = {"standalone", "leader", "follower"};
+  TextBuf<112> head;
+  head.add("cluster ").add(ROLES[static_cast<size_t>(cluster_role)]);
+  if (cluster_role == ClusterRole::LEADER) {
+    head.add(" pads ").add_uint(cluster_leader.pad_count()).add(" cycles ").add_uint(cluster_leader.cycles())
+        .add(" cycle_us ").add_uint(cluster_leader.last_cycle_us()).add('/').add_uint(cluster_leader.max_cycle_us())
+        .add(" frames ").add_uint(cluster_leader.frames()).add(" errors ").add_uint(cluster_leader.errors())
+        .add(" stray ").add_uint(cluster_leader.stray()).add(cluster_leader.overflow() ? " overflow" : "");
+    cluster_leader.clear_max_cycle();
+  } else if (cluster_role == ClusterRole::FOLLOWER) {
+    head.add(" id ").add_uint(cluster_follower.id()).add(" polls ").add_uint(cluster_follower.polls())
+        .add(" replies ").add_uint(cluster_follower.replies()).add(" unchanged ").add_uint(cluster_follower.unchanged())
+        .add(" busy ").add_uint(cluster_follower.busy()).add(" truncated ").add_uint(cluster_follower.truncated())
+        .add(" errors ").add_uint(cluster_follower.errors());
+  }
+  Serial.println(head.c_str());
+  if (cluster_role != ClusterRole::LEADER) {return;}
+  // board ごと: 並び、時計のずれ (follower - leader) と往復の時間 [usec]
+  for (size_t id = CLUSTER_LEADER + 1; id <= CLUSTER_MAX_BOARDS; id++) {
+    const ClusterBoard& b = cluster_leader.board(id);
+    if (!b.known) {continue;}
+    TextBuf<112> line;
+    line.add("  board ").add_uint(id).add(b.present ? " up" : " down").add(" pads ").add_uint(b.base).add('+').add_uint(b.pads)
+        .add(" offset ").add_int(b.clock.offset_us()).add(" rtt ").add_uint(b.clock.rtt_us())
+        .add(" replies ").add_uint(b.replies).add(" timeouts ").add_uint(b.timeouts);
+    Serial.println(line.c_str());
+  }
+}
+#endif
 void show_debug_info() {
   std::tuple<size_t, bool> page = page_detect();
   if (std::get<1>(page)) {
@@ -378,133 +1325,140 @@ void show_debug_info() {
   }
   if (std::get<0>(page) == 0) {
     display_page1();
+  } else if (std::get<0>(page) == 1) {
+    display_page_sched();
+  } else if (std::get<0>(page) == 2) {
+    display_page_heap();
+  } else if (std::get<0>(page) == 3) {
+    display_page_latency();
   } else {
-    show_one_kamaboko(std::get<0>(page) - 1);
+    show_one_kamaboko(std::get<0>(page) - FIXED_PAGE);
   }
 }
 /*----------------------------------------------------------------------------*/
 //     NeoPixel
 /*----------------------------------------------------------------------------*/
-uint8_t neo_pixel[MAX_LIGHT][4];
-enum LED_STATUS { NO_STATUS, TOUCH_STATUS, ACCOMPANIMENT_STATUS };
-LED_STATUS led_status[MAX_LIGHT] = { NO_STATUS }; // Status of each sensor for LED control
+LedFrame led_frame;  // 色の計算は led_frame.h (ホストの再生ツールと共通)
 void init_neo_pixel() {
   // Set up the sk6812
   sk.begin();
-  for (int i = 0; i < MAX_LIGHT; i++) {
-    neo_pixel[i][0] = 0; // red
-    neo_pixel[i][1] = 0; // green
-    neo_pixel[i][2] = 0; // blue
-    neo_pixel[i][3] = 0; // white
-  }
+  led_frame.clear_all();
   update_neo_pixel();
 }
+void sync_light_count() {
+  // 見つかったかまぼこの分だけ送る (show() の時間は LED の数に比例する)
+  size_t lights = topology.block_count() * MAX_EACH_LIGHT;
+  if (led_frame.light_count() == lights) {return;}
+  sk.updateLength(static_cast<uint16_t>(lights));
+  led_frame.set_light_count(lights);
+  accompaniment.set_light_count(lights);
+}
 void clear_touch_leds() {
-    for (int i = 0; i < MAX_LIGHT; i++) {
-      neo_pixel[i][0] = 0; // red
-      neo_pixel[i][1] = 0; // green
-      neo_pixel[i][2] = 0; // blue
-      led_status[i] = NO_STATUS;
-  }
+  led_frame.clear_touch();
 }
 //-----------------------------------------------------------
 void callback_for_set_led(float locate, int16_t sensor_value) {
-  set_led_by_touch(locate, sensor_value, true);
+  led_frame.set_by_touch(locate, sensor_value, true);
 }
 void set_led_by_accompaniment() {
-  for (int i = 0; i < MAX_SENS; i++) {
-    int idx = i + KEYBD_LO - 4;
-    if (external_note_status[idx] > 0) {
-      set_led_by_touch(i, external_note_status[idx], false);
-    }
-  }
+  accompaniment.update(external_notes, TouchPoint::OFFSET_NOTE);
+  accompaniment.apply(led_frame);
 }
 //-----------------------------------------------------------
-void set_led_by_touch(float locate, int16_t sensor_value, bool touch) {
-  if ((locate < 0.0f) || (locate >= static_cast<float>(MAX_SENS))){
-    return; // Invalid location
-  }
-  if (sensor_value <= 1) {
-    sensor_value = 1;
-  }
-
-  const float SLOPE = 20000.0f / sensor_value; // 傾き:小さいほどたくさん光る
-  float nearest_lower = std::floor(locate);
-  float nearest_upper = std::ceil(locate);
-
-  while (1) {
-    int16_t this_val = static_cast<int16_t>(255 - (locate - nearest_lower)*SLOPE);
-    if (this_val < 0) {break;}
-    int index = static_cast<int>(nearest_lower);
-    nearest_lower -= 1.0f;
-    if (led_status[index%MAX_LIGHT] == TOUCH_STATUS && !touch) {
-      // すでにタッチセンサで点灯している場合、伴奏は表示しない
-      continue;
-    }
-    set_led_for_note(index, this_val, touch);
-    led_status[index%MAX_LIGHT] = touch ? TOUCH_STATUS : ACCOMPANIMENT_STATUS;
-  }
-  while (1) {
-    int16_t this_val = static_cast<int16_t>(255 - (nearest_upper - locate)*SLOPE);
-    if (this_val < 0) {break;}
-    int index = static_cast<int>(nearest_upper);
-    nearest_upper += 1.0f;
-    if (led_status[index%MAX_LIGHT] == TOUCH_STATUS && !touch) {
-      // すでにタッチセンサで点灯している場合、伴奏は表示しない
-      continue;
-    }
-    set_led_for_note(index, this_val, touch);
-    led_status[index%MAX_LIGHT] = touch ? TOUCH_STATUS : ACCOMPANIMENT_STATUS;
-  }
+void set_led_for_wave(uint64_t now_us) {
+  // 1秒周期、隣の LED と 1/10 周期ずらした 0-20 の白色
+  ambient.update(now_us);
+  ambient.render(led_frame.light_count(), [](size_t i, uint8_t intensity) {
+    led_frame.set_white(i, intensity);
+  });
 }
 //-----------------------------------------------------------
-void set_led_for_note(size_t index, uint8_t intensity, bool touch) {
-  uint8_t red = 0;
-  uint8_t blue = 0;
-  uint8_t green = 0;
-
-  if (touch) {
-    // QUBIT Touch : Magenta
-    red = (intensity * 4) / 5;
-    blue = (intensity * 1) / 5;
-  } else {
-    // QUBIT Accompaniment : Cyan
-    blue = (intensity * 3) / 5;
-    green = (intensity * 2) / 5;
-  }
-  set_neo_pixel(index, red, green, blue, -1); // Set only red and blue channels
+void clear_white_leds() {
+  led_frame.clear_white();
 }
 //-----------------------------------------------------------
-void set_led_for_wave(uint16_t global_time) {
-  float tm = static_cast<float>(global_time); // convert to seconds
-  for (int i = 0; i < MAX_LIGHT; i++) {
-    float phase = (tm * 0.002f + static_cast<float>(i) * 0.1f) * 2 * PI;
-    uint8_t intensity = static_cast<uint8_t>(10.0f * (std::sin(phase)) + 10.0f);
-    set_white_led(i, intensity);
+void update_neo_pixel() {
+  sk.clear();
+  for (size_t i = 0; i < led_frame.light_count(); i++) {
+    const uint8_t* px = led_frame.pixel(i);
+    sk.setPixelColor(i, px[0], px[1], px[2], px[3]);
   }
+  sk.show();
 }
-//-----------------------------------------------------------
-void set_white_led(int index, uint8_t intensity) {
-  set_neo_pixel(index, -1, -1, -1, intensity); // Set only red and blue channels
-}
-//-----------------------------------------------------------
-void set_neo_pixel(int index, int16_t red, int16_t green, int16_t blue, int16_t white) {
-  while (index < 0) {
-    index += MAX_LIGHT; // Wrap around if negative
+#ifdef USE_HOT_BENCH
+/*----------------------------------------------------------------------------*/
+//     Hot path bench ('x')
+//      XIP cache を空にした直後 (cold) と、続けてもう一度 (warm) の cycle 数を測る
+//      HOT_IN_FLASH を付けてビルドしたものと比べると、SRAM に置いた効果が分かる
+//      I2C は Core1 が使っているので、ここでは Core0 側の関数だけを測る
+/*----------------------------------------------------------------------------*/
+constexpr int HOT_BENCH_RUNS = 15;
+QubitTouch bench_qt([](uint8_t, uint8_t, uint8_t) {});  // MIDI は送らない
+LedFrame bench_frame;
+
+void bench_set_values() {
+  // 二本の指 (1 本はかまぼこの境目) が触っている sweep
+  for (size_t i = 0; i < bench_qt.pad_count(); i++) {
+    size_t d1 = (i > 20) ? i - 20 : 20 - i;
+    size_t d2 = (i > 41) ? i - 41 : 41 - i;
+    uint16_t v = (d1 < 3) ? static_cast<uint16_t>(300 - d1 * 80) : (d2 < 3) ? static_cast<uint16_t>(250 - d2 * 70) : 5;
+    bench_qt.set_value(i, v);
   }
-  index %= MAX_LIGHT;
-  if (red != -1)    {neo_pixel[index][0] = static_cast<uint8_t>(red);}
-  if (green != -1)  {neo_pixel[index][1] = static_cast<uint8_t>(green);}
-  if (blue != -1)   {neo_pixel[index][2] = static_cast<uint8_t>(blue);}
-  if (white != -1)  {neo_pixel[index][3] = static_cast<uint8_t>(white);}
 }
-void update_neo_pixel() {
-  sk.clear();
-  for (int i = 0; i < MAX_LIGHT; i++) {
-    sk.setPixelColor(i, neo_pixel[i][0], neo_pixel[i][1], neo_pixel[i][2], neo_pixel[i][3]);
+void bench_seek() {bench_qt.seek_and_update_touch_point();}
+void bench_set_by_touch() {bench_frame.set_by_touch(20.3f, 600, true);}
+void bench_accompaniment() {accompaniment.apply(bench_frame);}
+
+uint32_t hot_cycles(void (*fn)(), bool cold) {
+  // SysTick (24bit, core の clock で数え下がる) で一回分を測る
+  noInterrupts();
+  if (cold) {xip_cache_invalidate_all();}
+  uint32_t start = systick_hw->cvr;
+  fn();
+  uint32_t end = systick_hw->cvr;
+  interrupts();
+  return (start - end) & 0x00ffffff;
+}
+void hot_bench() {
+  struct Row {const char* name; void (*fn)();};
+  const Row rows[] = {
+    {"set_value x pads", bench_set_values},
+    {"seek_and_update", bench_seek},
+    {"set_by_touch", bench_set_by_touch},
+    {"accompaniment", bench_accompaniment},
+    {"update_neo_pixel", update_neo_pixel},   // sk.show() は LED の数 x 30usec の送信待ちを含む
+  };
+  const uint32_t csr = systick_hw->csr;
+  const uint32_t rvr = systick_hw->rvr;
+  systick_hw->rvr = 0x00ffffff;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5;  // enable, processor clock, 割り込みなし
+
+  bench_qt.set_pad_count(topology.pad_count());
+  bench_frame.set_light_count(led_frame.light_count());
+  // 全部が SRAM に入ったかは tools/hot_check.py で ELF から確かめる。ここでは代表だけ
+  bool in_ram = reinterpret_cast<uintptr_t>(touch_task) >= 0x20000000u;
+  Serial.println(in_ram ? "hot bench (SRAM) cycles: cold min/med/max  warm min/med/max"
+                        : "hot bench (flash) cycles: cold min/med/max  warm min/med/max");
+  for (const Row& r : rows) {
+    uint32_t cold[HOT_BENCH_RUNS], warm[HOT_BENCH_RUNS];
+    for (int n = 0; n < HOT_BENCH_RUNS; n++) {
+      cold[n] = hot_cycles(r.fn, true);
+      warm[n] = hot_cycles(r.fn, false);
+    }
+    std::sort(cold, cold + HOT_BENCH_RUNS);
+    std::sort(warm, warm + HOT_BENCH_RUNS);
+    TextBuf<96> line;
+    line.add(r.name).add(' ').add_uint(cold[0]).add('/').add_uint(cold[HOT_BENCH_RUNS/2]).add('/').add_uint(cold[HOT_BENCH_RUNS-1])
+        .add(' ').add_uint(warm[0]).add('/').add_uint(warm[HOT_BENCH_RUNS/2]).add('/').add_uint(warm[HOT_BENCH_RUNS-1]);
+    Serial.println(line.c_str());
   }
-  sk.show();
+  systick_hw->csr = 0;
+  systick_hw->rvr = rvr;
+  systick_hw->cvr = 0;
+  systick_hw->csr = csr;
 }
+#endif
 /*----------------------------------------------------------------------------*/
 //     for Realtime Debugging
 /*----------------------------------------------------------------------------*/
@@ -0,0 +1,184 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef MIDI_QUEUE_H
+#define MIDI_QUEUE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "board.h"
+
+// =========================================================
+//      MIDI Queue Constants
+// =========================================================
+constexpr size_t MIDI_QUEUE_SIZE = 64 * BOARD_HEADROOM; // Note Off とそれ以外、それぞれの待ち行列の長さ
+constexpr size_t MIDI_PACKETS_PER_XFER = 16; // USB-MIDI の一転送 (64byte) に入るパケット数
+constexpr uint8_t MIDI_CABLE = 0;
+
+struct MidiOutEvent {
+    uint8_t     status;     // 0 は取り消し済み
+    uint8_t     data1;
+    uint8_t     data2;
+    uint64_t    sweep_us;   // どの sweep から出たか (遅延計測用、0 は不明)
+    uint64_t    queued_us;
+};
+
+/// packets (4byte x count) を送り、受け付けたパケット数を返す
+using MidiTransport = size_t (*)(const uint8_t* packets, size_t count);
+/// 送った Note On ごとに呼ばれる (遅延の計測用)
+using MidiSentHook = void (*)(const MidiOutEvent& ev, uint64_t sent_us);
+
+// =========================================================
+//      MidiOutQueue Class
+// =========================================================
+// タッチ処理からは積むだけにして、tick ごとにまとめて USB に流す
+//  - Note Off は別の行列で先に送る (詰まっても音が残らないように)
+//  - まだ送っていない Note On に同じ音の Note Off が来たら、両方消す
+//  - pitch bend / channel pressure は、送っていない同じ channel のものを新しい値で上書きする
+//  - USB が受け取れない時は残しておき、溢れた数を数える
+class MidiOutQueue {
+    struct Ring {
+        MidiOutEvent    ev[MIDI_QUEUE_SIZE];
+        size_t          head = 0;
+        size_t          count = 0;
+
+        auto at(size_t i) -> MidiOutEvent& {return ev[(head + i) % MIDI_QUEUE_SIZE];}
+        auto push(const MidiOutEvent& e) -> bool {
+            if (count >= MIDI_QUEUE_SIZE) {return false;}
+            ev[(head + count) % MIDI_QUEUE_SIZE] = e;
+            count += 1;
+            return true;
+        }
+        void pop() {
+            head = (head + 1) % MIDI_QUEUE_SIZE;
+            count -= 1;
+        }
+    };
+    Ring        off_;       // Note Off
+    Ring        other_;     // Note On など
+
+    // 外から見るためのカウンタ
+    uint32_t    enqueued_;
+    uint32_t    sent_;
+    uint32_t    coalesced_; // 取り消した組・上書きした数
+    uint32_t    dropped_;   // 行列が一杯で捨てた数
+    uint32_t    stalls_;    // USB が全部は受け取らなかった回数
+    uint32_t    max_depth_;
+
+// impl MidiOutQueue
+public:
+    MidiOutQueue() :
+        enqueued_(0), sent_(0), coalesced_(0), dropped_(0), stalls_(0), max_depth_(0) {}
+
+    /// タッチ処理から呼ぶ。USB には触らない
+    auto enqueue(uint8_t status, uint8_t data1, uint8_t data2, uint64_t sweep_us, uint64_t now_us) -> bool {
+        enqueued_ += 1;
+        uint8_t kind = status & 0xf0;
+        if ((kind == 0x90) && (data2 == 0)) {
+            kind = 0x80;    // velocity 0 の Note On は Note Off
+        }
+        if (kind == 0x80) {
+            // 送っていない同じ音の Note On があれば、両方とも無かったことにする
+            uint8_t on_status = static_cast<uint8_t>(0x90 | (status & 0x0f));
+            for (size_t i = other_.count; i > 0; --i) {
+                MidiOutEvent& e = other_.at(i - 1);
+                if ((e.status == on_status) && (e.data1 == data1)) {
+                    e.status = 0;
+                    coalesced_ += 1;
+                    return true;
+                }
+            }
+        }
+        if ((kind == 0xe0) || (kind == 0xd0)) {
+            for (size_t i = other_.count; i > 0; --i) {
+                MidiOutEvent& e = other_.at(i - 1);
+                if (e.status == status) {
+                    e.data1 = data1;
+                    e.data2 = data2;
+                    coalesced_ += 1;
+                    return true;
+                }
+            }
+        }
+        MidiOutEvent ev = {status, data1, data2, sweep_us, now_us};
+        if (!(kind == 0x80 ? off_ : other_).push(ev)) {
+            dropped_ += 1;
+            return false;
+        }
+        uint32_t depth = static_cast<uint32_t>(off_.count + other_.count);
+        if (depth > max_depth_) {max_depth_ = depth;}
+        return true;
+    }
+    /// 溜まっているものを一転送分ずつ送る。送ったイベント数を返す
+    auto drain(MidiTransport transport, uint64_t now_us, MidiSentHook on_sent = nullptr) -> size_t {
+        size_t total = 0;
+        while ((off_.count + other_.count) > 0) {
+            uint8_t packets[MIDI_PACKETS_PER_XFER * 4];
+            MidiOutEvent* batch[MIDI_PACKETS_PER_XFER];
+            size_t n = 0;
+            // Note Off を先に、それから順番通りに (取り消したものは飛ばす)
+            for (size_t i = 0; (i < off_.count) && (n < MIDI_PACKETS_PER_XFER); ++i) {
+                batch[n] = &off_.at(i);
+                pack(*batch[n], &packets[n * 4]);
+                n += 1;
+            }
+            for (size_t i = 0; (i < other_.count) && (n < MIDI_PACKETS_PER_XFER); ++i) {
+                MidiOutEvent& e = other_.at(i);
+                if (e.status == 0) {continue;}
+                batch[n] = &e;
+                pack(e, &packets[n * 4]);
+                n += 1;
+            }
+            size_t accepted = (n > 0) ? transport(packets, n) : 0;
+            if (accepted > n) {accepted = n;}
+            for (size_t i = 0; i < accepted; ++i) {
+                if (on_sent && ((batch[i]->status & 0xf0) == 0x90) && (batch[i]->data2 != 0)) {
+                    on_sent(*batch[i], now_us);
+                }
+                batch[i]->status = 0;
+            }
+            sent_ += static_cast<uint32_t>(accepted);
+            total += accepted;
+            // 先頭から送り終わったもの・取り消したものを外す
+            while ((off_.count > 0) && (off_.at(0).status == 0)) {off_.pop();}
+            while ((other_.count > 0) && (other_.at(0).status == 0)) {other_.pop();}
+            if (accepted < n) {
+                stalls_ += 1;   // USB が一杯。残りは次の tick に
+                break;
+            }
+        }
+        return total;
+    }
+    void clear() {
+        off_ = Ring();
+        other_ = Ring();
+    }
+
+    auto depth() const -> size_t {return off_.count + other_.count;}
+    auto enqueued() const -> uint32_t {return enqueued_;}
+    auto sent() const -> uint32_t {return sent_;}
+    auto coalesced() const -> uint32_t {return coalesced_;}
+    auto dropped() const -> uint32_t {return dropped_;}
+    auto stalls() const -> uint32_t {return stalls_;}
+    auto max_depth() const -> uint32_t {return max_depth_;}
+
+    /// USB-MIDI の event packet: [cable<<4 | CIN][status][data1][data2]
+    static void pack(const MidiOutEvent& ev, uint8_t* p) {
+        uint8_t cin = ev.status >> 4;   // チャンネルメッセージは CIN = status の上位 4bit
+        p[0] = static_cast<uint8_t>((MIDI_CABLE << 4) | cin);
+        p[1] = ev.status;
+        p[2] = ev.data1;
+        p[3] = ((cin == 0xc) || (cin == 0xd)) ? 0 : ev.data2;   // 2byte のメッセージ
+    }
+    /// pack() したパケットを MIDI の byte 列に戻し、その長さを返す (tud_midi_stream_write() に渡す用)
+    static auto unpack(const uint8_t* p, uint8_t* bytes) -> size_t {
+        uint8_t cin = p[0] & 0x0f;
+        size_t len = ((cin == 0xc) || (cin == 0xd)) ? 2 : 3;
+        for (size_t i = 0; i < len; ++i) {bytes[i] = p[1 + i];}
+        return len;
+    }
+};
+#endif // MIDI_QUEUE_H
@@ -0,0 +1,146 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef MPE_H
+#define MPE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "constants.h"
+
+// =========================================================
+//      MPE Constants
+// =========================================================
+// Lower Zone: master は ch1、タッチごとに ch2 から一つずつ使う
+constexpr uint8_t MPE_MASTER_CHANNEL = 0;           // 0-15 (ch1)
+constexpr uint8_t MPE_FIRST_MEMBER = 1;             // 0-15 (ch2)
+constexpr uint8_t MPE_BEND_RANGE = 48;              // member channel の pitch bend 幅 (半音、MPE の既定値)
+constexpr uint8_t MPE_GLIDE_RANGE = MPE_BEND_RANGE - 1; // これを越えたら Note を変える
+constexpr uint16_t MPE_BEND_CENTER = 8192;
+constexpr uint16_t MPE_BEND_DELTA = 8;              // これ未満の変化は送らない (約 5 cent)
+constexpr uint8_t MPE_PRESSURE_DELTA = 2;
+constexpr uint8_t MPE_PRESSURE_SHIFT = 2;           // intensity → channel pressure (0-127)
+constexpr uint32_t MPE_MIN_INTERVAL_US = 5000;      // 一つのタッチから送る間隔の最小値
+constexpr uint32_t MPE_SETTLE_US = 30000;           // 小さな変化も、この時間が経ったら送る
+
+/// status, data1, data2 を送る (sendMidiMessage と同じ形)
+using MpeSend = void (*)(uint8_t status, uint8_t data1, uint8_t data2);
+
+// =========================================================
+//      MpeOutput Class
+// =========================================================
+// タッチごとの位置と強さを pitch bend / channel pressure にする
+// 変化が小さい時と、前に送ってから時間が経っていない時は送らない
+// (4 タッチが毎 sweep 動いても、一タッチあたり 200 回/秒 x 2 が上限)
+class MpeOutput {
+    struct Voice {
+        bool        active;
+        uint16_t    bend;       // 最後に送った値
+        uint8_t     pressure;
+        uint64_t    sent_us;
+    };
+    Voice       voice_[MAX_TOUCH_POINTS];
+    bool        enabled_;
+
+    // 外から見るためのカウンタ
+    uint32_t    sent_;
+    uint32_t    suppressed_;    // 変化が小さい・間隔が短いので送らなかった数
+
+// impl MpeOutput
+public:
+    MpeOutput() : voice_{}, enabled_(false), sent_(0), suppressed_(0) {}
+
+    auto enabled() const -> bool {return enabled_;}
+    static auto channel_of(size_t voice) -> uint8_t {
+        return static_cast<uint8_t>(MPE_FIRST_MEMBER + voice);
+    }
+    /// MPE Configuration Message と各 member の bend 幅を送る (off の時は zone を閉じる)
+    void enable(bool on, MpeSend send) {
+        enabled_ = on;
+        send_rpn(send, MPE_MASTER_CHANNEL, 6, on ? MAX_TOUCH_POINTS : 0);
+        if (on) {
+            for (size_t v = 0; v < MAX_TOUCH_POINTS; ++v) {
+                send_rpn(send, channel_of(v), 0, MPE_BEND_RANGE);
+            }
+        }
+        for (auto& vc : voice_) {vc = Voice{false, MPE_BEND_CENTER, 0, 0};}
+    }
+    /// sweep ごとに、タッチポイントごとに呼ぶ (Note On/Off は TouchPoint が送る)
+    void update(size_t voice, bool touched, float pitch_offset, int16_t intensity, uint64_t now_us, MpeSend send) {
+        if (!enabled_ || (voice >= MAX_TOUCH_POINTS)) {return;}
+        Voice& vc = voice_[voice];
+        uint8_t ch = channel_of(voice);
+        if (!touched) {
+            if (vc.active) {
+                // 離したら次の Note のために戻しておく
+                send(0xe0 | ch, MPE_BEND_CENTER & 0x7f, MPE_BEND_CENTER >> 7);
+                send(0xd0 | ch, 0, 0);
+                sent_ += 2;
+                vc = Voice{false, MPE_BEND_CENTER, 0, now_us};
+            }
+            return;
+        }
+        uint16_t bend = to_bend(pitch_offset);
+        uint8_t pressure = to_pressure(intensity);
+        if (!vc.active) {
+            vc.active = true;
+            vc.sent_us = now_us - MPE_MIN_INTERVAL_US;  // 最初の値はすぐ送る
+        }
+        uint64_t since = now_us - vc.sent_us;
+        if (since < MPE_MIN_INTERVAL_US) {
+            suppressed_ += 1;
+            return;
+        }
+        bool settle = since >= MPE_SETTLE_US;
+        bool sent = false;
+        if ((diff(bend, vc.bend) >= MPE_BEND_DELTA) || (settle && (bend != vc.bend))) {
+            send(0xe0 | ch, bend & 0x7f, bend >> 7);
+            vc.bend = bend;
+            sent = true;
+            sent_ += 1;
+        }
+        if ((diff(pressure, vc.pressure) >= MPE_PRESSURE_DELTA) || (settle && (pressure != vc.pressure))) {
+            send(0xd0 | ch, pressure, 0);
+            vc.pressure = pressure;
+            sent = true;
+            sent_ += 1;
+        }
+        if (sent) {
+            vc.sent_us = now_us;
+        } else {
+            suppressed_ += 1;
+        }
+    }
+    auto sent() const -> uint32_t {return sent_;}
+    auto suppressed() const -> uint32_t {return suppressed_;}
+
+    /// 半音単位のずれ → 14bit pitch bend
+    static auto to_bend(float semitones) -> uint16_t {
+        float v = MPE_BEND_CENTER + semitones * (MPE_BEND_CENTER / static_cast<float>(MPE_BEND_RANGE));
+        if (v < 0.0f) {return 0;}
+        if (v > 16383.0f) {return 16383;}
+        return static_cast<uint16_t>(v + 0.5f);
+    }
+    static auto to_pressure(int16_t intensity) -> uint8_t {
+        if (intensity <= 0) {return 0;}
+        int p = intensity >> MPE_PRESSURE_SHIFT;
+        return static_cast<uint8_t>(p > 127 ? 127 : p);
+    }
+
+private:
+    static auto diff(uint16_t a, uint16_t b) -> uint16_t {
+        return a > b ? a - b : b - a;
+    }
+    static void send_rpn(MpeSend send, uint8_t ch, uint8_t rpn, uint8_t value) {
+        send(0xb0 | ch, 101, 0);
+        send(0xb0 | ch, 100, rpn);
+        send(0xb0 | ch, 6, value);
+        send(0xb0 | ch, 38, 0);
+        send(0xb0 | ch, 101, 127);  // RPN null
+        send(0xb0 | ch, 100, 127);
+    }
+};
+#endif // MPE_H
@@ -0,0 +1,91 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef NOTE_SET_H
+#define NOTE_SET_H
+
+#include <cstdint>
+#include <cstddef>
+
+// =========================================================
+//      ActiveNoteSet Class
+// =========================================================
+// 鳴っている Note だけを詰めて持つ (順番は不定)
+// 変化があるたびに revision() が進むので、使う側は変わった時だけ作り直せばよい
+// 直近 CHANGE_LOG 回の変化はどの Note だったかを覚えているので、その Note だけ直すこともできる
+template <size_t N>
+class ActiveNoteSet {
+    static_assert(N <= 256, "note numbers are uint8_t");
+    static constexpr uint8_t NONE = 0xff;
+
+public:
+    static constexpr uint32_t CHANGE_LOG = 32;
+    static constexpr uint8_t ALL_CHANGED = NONE;  // clear_all(): 全部が変わった
+
+private:
+
+    uint8_t     velocity_[N];
+    uint8_t     pos_[N];        // list_ の中の位置 (鳴っていなければ NONE)
+    uint8_t     list_[N];
+    size_t      count_;
+    uint32_t    revision_;
+    uint8_t     changed_[CHANGE_LOG];   // revision r で変わった Note は changed_[r % CHANGE_LOG]
+
+// impl ActiveNoteSet
+public:
+    ActiveNoteSet() : velocity_{}, list_{}, count_(0), revision_(0), changed_{} {
+        for (auto& p : pos_) {p = NONE;}
+    }
+
+    /// velocity 0 は消す
+    void set(uint8_t note, uint8_t velocity) {
+        if (note >= N) {return;}
+        if (velocity == 0) {
+            clear(note);
+            return;
+        }
+        if (pos_[note] == NONE) {
+            pos_[note] = static_cast<uint8_t>(count_);
+            list_[count_++] = note;
+        } else if (velocity_[note] == velocity) {
+            return;     // 変化なし
+        }
+        velocity_[note] = velocity;
+        changed(note);
+    }
+    void clear(uint8_t note) {
+        if ((note >= N) || (pos_[note] == NONE)) {return;}
+        // 最後の要素を空いた所に移す
+        uint8_t p = pos_[note];
+        uint8_t last = list_[--count_];
+        list_[p] = last;
+        pos_[last] = p;
+        pos_[note] = NONE;
+        velocity_[note] = 0;
+        changed(note);
+    }
+    void clear_all() {
+        for (size_t i = 0; i < count_; ++i) {
+            pos_[list_[i]] = NONE;
+            velocity_[list_[i]] = 0;
+        }
+        if (count_ > 0) {changed(ALL_CHANGED);}
+        count_ = 0;
+    }
+    auto velocity(uint8_t note) const -> uint8_t {return note < N ? velocity_[note] : 0;}
+    auto is_on(uint8_t note) const -> bool {return (note < N) && (pos_[note] != NONE);}
+    auto count() const -> size_t {return count_;}
+    auto note_at(size_t i) const -> uint8_t {return list_[i];}
+    auto revision() const -> uint32_t {return revision_;}
+    /// revision rev で変わった Note (ALL_CHANGED なら全部)。revision() - rev < CHANGE_LOG の間だけ正しい
+    auto changed_note(uint32_t rev) const -> uint8_t {return changed_[rev % CHANGE_LOG];}
+
+private:
+    void changed(uint8_t note) {
+        revision_ += 1;
+        changed_[revision_ % CHANGE_LOG] = note;
+    }
+};
+#endif // NOTE_SET_H
@@ -0,0 +1,254 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef OLED_FB_H
+#define OLED_FB_H
+
+#include <cstdint>
+#include <cstddef>
+
+// =========================================================
+//      OLED Framebuffer Constants
+// =========================================================
+constexpr uint8_t OLED_WIDTH = 96;
+constexpr uint8_t OLED_HEIGHT = 64;
+constexpr uint8_t OLED_FONT_W = 5;      // 5x7 font
+constexpr uint8_t OLED_FONT_H = 7;
+constexpr uint8_t OLED_CELL_W = 6;      // 文字送り
+constexpr uint8_t OLED_LINE_H = 10;     // 一行の高さ (SSD1331_display() の line 単位)
+
+// 5x7 ASCII font (0x20-0x7e)、列ごとに 1byte、LSB が上
+constexpr uint8_t OLED_FONT_FIRST = 0x20;
+constexpr uint8_t OLED_FONT_LAST = 0x7e;
+constexpr uint8_t OLED_FONT[OLED_FONT_LAST - OLED_FONT_FIRST + 1][OLED_FONT_W] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5f,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7f,0x14,0x7f,0x14}, //  !"#
+    {0x24,0x2a,0x7f,0x2a,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, // $%&'
+    {0x00,0x1c,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1c,0x00}, {0x14,0x08,0x3e,0x08,0x14}, {0x08,0x08,0x3e,0x08,0x08}, // ()*+
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02}, // ,-./
+    {0x3e,0x51,0x49,0x45,0x3e}, {0x00,0x42,0x7f,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4b,0x31}, // 0123
+    {0x18,0x14,0x12,0x7f,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3c,0x4a,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03}, // 4567
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1e}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00}, // 89:;
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, // <=>?
+    {0x32,0x49,0x79,0x41,0x3e}, {0x7e,0x11,0x11,0x11,0x7e}, {0x7f,0x49,0x49,0x49,0x36}, {0x3e,0x41,0x41,0x41,0x22}, // @ABC
+    {0x7f,0x41,0x41,0x22,0x1c}, {0x7f,0x49,0x49,0x49,0x41}, {0x7f,0x09,0x09,0x09,0x01}, {0x3e,0x41,0x49,0x49,0x7a}, // DEFG
+    {0x7f,0x08,0x08,0x08,0x7f}, {0x00,0x41,0x7f,0x41,0x00}, {0x20,0x40,0x41,0x3f,0x01}, {0x7f,0x08,0x14,0x22,0x41}, // HIJK
+    {0x7f,0x40,0x40,0x40,0x40}, {0x7f,0x02,0x0c,0x02,0x7f}, {0x7f,0x04,0x08,0x10,0x7f}, {0x3e,0x41,0x41,0x41,0x3e}, // LMNO
+    {0x7f,0x09,0x09,0x09,0x06}, {0x3e,0x41,0x51,0x21,0x5e}, {0x7f,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31}, // PQRS
+    {0x01,0x01,0x7f,0x01,0x01}, {0x3f,0x40,0x40,0x40,0x3f}, {0x1f,0x20,0x40,0x20,0x1f}, {0x3f,0x40,0x38,0x40,0x3f}, // TUVW
+    {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7f,0x41,0x41,0x00}, // XYZ[
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7f,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40}, // \]^_
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, {0x7f,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20}, // `abc
+    {0x38,0x44,0x44,0x48,0x7f}, {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7e,0x09,0x01,0x02}, {0x0c,0x52,0x52,0x52,0x3e}, // defg
+    {0x7f,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7d,0x40,0x00}, {0x20,0x40,0x44,0x3d,0x00}, {0x7f,0x10,0x28,0x44,0x00}, // hijk
+    {0x00,0x41,0x7f,0x40,0x00}, {0x7c,0x04,0x18,0x04,0x78}, {0x7c,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, // lmno
+    {0x7c,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7c}, {0x7c,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20}, // pqrs
+    {0x04,0x3f,0x44,0x40,0x20}, {0x3c,0x40,0x40,0x20,0x7c}, {0x1c,0x20,0x40,0x20,0x1c}, {0x3c,0x40,0x30,0x40,0x3c}, // tuvw
+    {0x44,0x28,0x10,0x28,0x44}, {0x0c,0x50,0x50,0x50,0x3c}, {0x44,0x64,0x54,0x4c,0x44}, {0x00,0x08,0x36,0x41,0x00}, // xyz{
+    {0x00,0x00,0x7f,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, {0x10,0x08,0x08,0x10,0x08},                             // |}~
+};
+
+// =========================================================
+//      OledFrame Class
+// =========================================================
+// SSD1331 (96x64, RGB565) のオフスクリーンバッファ。
+// 画素は SPI でそのまま送れるように上位 byte を先に並べて持つ。
+// 値が変わった画素を行ごとの x の範囲で覚え、連続した dirty 行をまとめた
+// 矩形 (dirty rect) 単位で転送する。
+// draw_line() は行ごとに前回の文字列と色を覚えていて、同じなら何もしない
+constexpr uint8_t OLED_LINES = OLED_HEIGHT / OLED_LINE_H;      // draw_line() の行数
+constexpr uint8_t OLED_LINE_CHARS = OLED_WIDTH / OLED_CELL_W;  // 一行に見える文字数
+
+struct OledRect {
+    uint8_t x, y, w, h;
+};
+
+class OledFrame {
+    uint16_t    pixels_[OLED_HEIGHT][OLED_WIDTH];
+    uint64_t    dirty_rows_;            // bit n: n 行目が変化した
+    uint8_t     dirty_x0_[OLED_HEIGHT]; // n 行目の変化した x の範囲 [x0, x1)
+    uint8_t     dirty_x1_[OLED_HEIGHT];
+
+    // draw_line() の前回の内容 (見える文字だけ)。他の描画をしたら消す
+    struct LineCache {
+        char        text[OLED_LINE_CHARS + 1];
+        uint16_t    fg, bg;
+        bool        valid;
+    };
+    LineCache   lines_[OLED_LINES];
+    uint32_t    lines_drawn_;
+    uint32_t    lines_skipped_;
+
+// impl OledFrame
+public:
+    OledFrame() : pixels_{}, dirty_rows_(0), dirty_x0_{}, dirty_x1_{},
+                  lines_{}, lines_drawn_(0), lines_skipped_(0) {
+        mark_all_dirty();
+    }
+
+    static constexpr auto to_wire(uint16_t color) -> uint16_t {
+        return static_cast<uint16_t>((color >> 8) | (color << 8));
+    }
+    /// 画素を書く。値が変わった時だけ dirty にする
+    void set_pixel(int x, int y, uint16_t color) {
+        forget_lines();
+        put_pixel(x, y, color);
+    }
+    auto get_pixel(int x, int y) const -> uint16_t {
+        return to_wire(pixels_[y][x]);
+    }
+    void fill_rect(int x, int y, int w, int h, uint16_t color) {
+        forget_lines();
+        put_rect(x, y, w, h, color);
+    }
+    void fill(uint16_t color) {
+        fill_rect(0, 0, OLED_WIDTH, OLED_HEIGHT, color);
+    }
+    /// 一文字描く (背景色で 6x8 のセルを塗る)
+    void draw_char(int x, int y, char c, uint16_t fg, uint16_t bg) {
+        forget_lines();
+        put_char(x, y, c, fg, bg);
+    }
+    /// 文字列を描き、次の x 座標を返す (右端ではみ出た分は描かない)
+    auto draw_text(int x, int y, const char* str, uint16_t fg, uint16_t bg) -> int {
+        forget_lines();
+        return put_text(x, y, str, fg, bg);
+    }
+    /// line 行目 (10 dot 単位) を str で描き直す。残りは背景色で消す
+    /// 見える部分の文字列と色が前回と同じなら、画素には触らない
+    void draw_line(int line, const char* str, uint16_t fg, uint16_t bg) {
+        if ((line < 0) || (line >= OLED_LINES)) {
+            forget_lines();
+            put_line(line, str, fg, bg);
+            return;
+        }
+        LineCache& lc = lines_[line];
+        if (lc.valid && (lc.fg == fg) && (lc.bg == bg) && same_visible(lc.text, str)) {
+            lines_skipped_ += 1;
+            return;
+        }
+        put_line(line, str, fg, bg);
+        size_t n = 0;
+        while ((n < OLED_LINE_CHARS) && (str[n] != '\0')) {
+            lc.text[n] = str[n];
+            n++;
+        }
+        lc.text[n] = '\0';
+        lc.fg = fg;
+        lc.bg = bg;
+        lc.valid = true;
+        lines_drawn_ += 1;
+    }
+    auto lines_drawn() const -> uint32_t {return lines_drawn_;}
+    auto lines_skipped() const -> uint32_t {return lines_skipped_;}
+
+    auto is_dirty() const -> bool {return dirty_rows_ != 0;}
+    void mark_all_dirty() {
+        dirty_rows_ = ~0ULL;
+        for (int y = 0; y < OLED_HEIGHT; ++y) {
+            dirty_x0_[y] = 0;
+            dirty_x1_[y] = OLED_WIDTH;
+        }
+    }
+    /// 一番上の連続した dirty 行を、それらの x の範囲を合わせた矩形として取り出し、dirty を消す
+    auto take_dirty_rect(OledRect& r) -> bool {
+        if (dirty_rows_ == 0) {
+            return false;
+        }
+        uint8_t top = 0;
+        while ((dirty_rows_ & (1ULL << top)) == 0) {top++;}
+        uint8_t bottom = top;
+        uint8_t x0 = OLED_WIDTH;
+        uint8_t x1 = 0;
+        while ((bottom < OLED_HEIGHT) && (dirty_rows_ & (1ULL << bottom))) {
+            dirty_rows_ &= ~(1ULL << bottom);
+            if (dirty_x0_[bottom] < x0) {x0 = dirty_x0_[bottom];}
+            if (dirty_x1_[bottom] > x1) {x1 = dirty_x1_[bottom];}
+            bottom++;
+        }
+        r.x = x0;
+        r.y = top;
+        r.w = x1 - x0;
+        r.h = bottom - top;
+        return true;
+    }
+    /// y 行目の x から先の転送用データ。矩形は一行ずつ row_bytes(w) だけ送る
+    auto row_data(uint8_t x, uint8_t y) const -> const uint8_t* {
+        return reinterpret_cast<const uint8_t*>(&pixels_[y][x]);
+    }
+    static constexpr auto row_bytes(uint8_t w) -> size_t {
+        return static_cast<size_t>(w) * sizeof(uint16_t);
+    }
+    /// 幅いっぱいの矩形は y 行目から h 行分が続いているので、まとめて送れる
+    auto band_data(uint8_t y) const -> const uint8_t* {
+        return row_data(0, y);
+    }
+    static constexpr auto band_bytes(uint8_t h) -> size_t {
+        return static_cast<size_t>(h) * OLED_WIDTH * sizeof(uint16_t);
+    }
+
+private:
+    void forget_lines() {
+        for (auto& lc : lines_) {lc.valid = false;}
+    }
+    static auto same_visible(const char* cached, const char* str) -> bool {
+        for (size_t i = 0; i < OLED_LINE_CHARS; ++i) {
+            if (cached[i] != str[i]) {return false;}
+            if (str[i] == '\0') {return true;}
+        }
+        return true;
+    }
+    void put_pixel(int x, int y, uint16_t color) {
+        if ((x < 0) || (x >= OLED_WIDTH) || (y < 0) || (y >= OLED_HEIGHT)) {
+            return;
+        }
+        uint16_t wire = to_wire(color);
+        if (pixels_[y][x] != wire) {
+            pixels_[y][x] = wire;
+            const uint64_t bit = 1ULL << y;
+            if ((dirty_rows_ & bit) == 0) {
+                dirty_rows_ |= bit;
+                dirty_x0_[y] = static_cast<uint8_t>(x);
+                dirty_x1_[y] = static_cast<uint8_t>(x + 1);
+            } else {
+                if (x < dirty_x0_[y]) {dirty_x0_[y] = static_cast<uint8_t>(x);}
+                if (x >= dirty_x1_[y]) {dirty_x1_[y] = static_cast<uint8_t>(x + 1);}
+            }
+        }
+    }
+    void put_rect(int x, int y, int w, int h, uint16_t color) {
+        for (int j = y; j < y + h; ++j) {
+            for (int i = x; i < x + w; ++i) {
+                put_pixel(i, j, color);
+            }
+        }
+    }
+    void put_char(int x, int y, char c, uint16_t fg, uint16_t bg) {
+        uint8_t code = static_cast<uint8_t>(c);
+        if ((code < OLED_FONT_FIRST) || (code > OLED_FONT_LAST)) {
+            code = '?';
+        }
+        const uint8_t* glyph = OLED_FONT[code - OLED_FONT_FIRST];
+        for (int col = 0; col < OLED_CELL_W; ++col) {
+            uint8_t bits = (col < OLED_FONT_W) ? glyph[col] : 0;
+            for (int row = 0; row < OLED_FONT_H + 1; ++row) {
+                put_pixel(x + col, y + row, (bits & (1 << row)) ? fg : bg);
+            }
+        }
+    }
+    auto put_text(int x, int y, const char* str, uint16_t fg, uint16_t bg) -> int {
+        while ((*str != '\0') && (x < OLED_WIDTH)) {
+            put_char(x, y, *str++, fg, bg);
+            x += OLED_CELL_W;
+        }
+        return x;
+    }
+    void put_line(int line, const char* str, uint16_t fg, uint16_t bg) {
+        int y = line * OLED_LINE_H;
+        int x = put_text(0, y, str, fg, bg);
+        put_rect(x, y, OLED_WIDTH - x, OLED_LINE_H, bg);
+        put_rect(0, y + OLED_FONT_H + 1, x, OLED_LINE_H - (OLED_FONT_H + 1), bg);
+    }
+};
+#endif // OLED_FB_H
@@ -0,0 +1,230 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef PCA9685_LEDS_H
+#define PCA9685_LEDS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "placement.h"
+
+// =========================================================
+//      PCA9685 Constants
+// =========================================================
+// 一つの chip に 16 channel = 4 LED (R, G, B, W)。channel n の register は LED0_ON_L + 4n から
+//  [ON_L][ON_H][OFF_L][OFF_H]   ON から OFF までが点灯 (MODE2 の INVRT で反転)
+// MODE1 の AI を立てると、一回の書き込みで register が自動で進む (一つの chip を一回で書ける)
+constexpr uint8_t PCA9685_I2C_ADRS = 0x40;          // + chip 番号
+constexpr uint8_t PCA9685_MODE1 = 0x00;
+constexpr uint8_t PCA9685_MODE2 = 0x01;
+constexpr uint8_t PCA9685_LED0_ON_L = 0x06;
+constexpr uint8_t PCA9685_MODE1_AI = 0x20;          // auto-increment、SLEEP は解除
+constexpr uint8_t PCA9685_MODE2_INIT = 0x12;        // INVRT、OE=high で high-impedance (peripheral.cpp と同じ)
+constexpr size_t PCA9685_CHANNELS = 16;
+constexpr size_t PCA9685_CHANNELS_PER_LED = 4;
+constexpr size_t PCA9685_LEDS_PER_CHIP = PCA9685_CHANNELS / PCA9685_CHANNELS_PER_LED;
+constexpr size_t PCA9685_MAX_CHIPS = 62;            // address 0x40-0x7D
+// 一回の書き込みの余分 (address、register、start / stop、Wire の手間) は約 4byte = 1 channel
+// 変わっていない channel がこれ以下なら、間を空けずに続けて送る
+constexpr size_t PCA9685_MERGE_GAP = 1;
+constexpr size_t PCA9685_MAX_WRITE = 1 + PCA9685_CHANNELS * 4;  // register + 全 channel
+
+// I2C に書く (ホストでは偽物を渡す)。0: ACK あり
+struct Pca9685Bus {
+    int (*write)(uint8_t adrs, const uint8_t* buf, size_t len);
+};
+
+// =========================================================
+//      Pca9685Leds Class
+// =========================================================
+// SK6812 と同じ形 (setPixelColor / show) で、LED を PCA9685 につなぐ
+//  Core0: setPixelColor() で色を置き、show() で一フレームを Core1 に渡す (I2C は触らない)
+//  Core1: sweep の合間に flush() を呼ぶ。前に送った値と違う channel だけを、chip ごとにまとめて送る
+// タッチのセンサと同じ I2C なので、一回の flush() で送る量に上限を付ける。残りは次の合間に送る
+template <size_t MAX_PIXELS>
+class Pca9685Leds {
+    static constexpr size_t MAX_CHANNELS = ((MAX_PIXELS + PCA9685_LEDS_PER_CHIP - 1) / PCA9685_LEDS_PER_CHIP) * PCA9685_CHANNELS;
+    static constexpr size_t MAX_CHIPS = MAX_CHANNELS / PCA9685_CHANNELS;
+    static constexpr uint16_t UNKNOWN = 0xffff;     // chip に何が入っているか分からない (必ず送る)
+    static_assert(MAX_CHIPS <= PCA9685_MAX_CHIPS, "too many PCA9685 chips");
+
+    Pca9685Bus          bus_;
+    // Core0
+    uint8_t             pixels_[MAX_PIXELS * 4];    // R, G, B, W (0-255)
+    uint16_t            num_;
+    uint32_t            skipped_;                   // Core1 が受け取る前に次の show() が来た数
+    // Core0 → Core1
+    uint16_t            pending_[MAX_CHANNELS];     // PWM の値 (0-4095)
+    uint16_t            pending_num_;
+    std::atomic<bool>   ready_;
+    // Core1
+    uint16_t            target_[MAX_CHANNELS];      // 送りたい値
+    uint16_t            sent_[MAX_CHANNELS];        // chip に入っている値
+    bool                inited_[MAX_CHIPS];         // MODE1 / MODE2 を書いた
+    uint16_t            chips_;
+    uint16_t            cursor_;                    // 次に調べる chip (上限で止まった所から続ける)
+    uint32_t            writes_;
+    uint32_t            bytes_;
+    uint32_t            errors_;
+
+// impl Pca9685Leds
+public:
+    Pca9685Leds(uint16_t num, const Pca9685Bus& bus) :
+        bus_(bus), pixels_{}, num_(num < MAX_PIXELS ? num : MAX_PIXELS), skipped_(0),
+        pending_{}, pending_num_(0), ready_(false),
+        target_{}, sent_{}, inited_{}, chips_(0), cursor_(0), writes_(0), bytes_(0), errors_(0) {
+        // chip に何が入っているかは分からない。各 chip は最初の flush() で auto-increment にしてから全部送る
+        for (size_t i = 0; i < MAX_CHANNELS; ++i) {sent_[i] = UNKNOWN;}
+    }
+
+    /// SK6812 と同じ形のため (I2C は Core1 の flush() だけが触るので、ここでは何もしない)
+    void begin() {}
+
+    // --- Core0 (SK6812 と同じ形) ---
+    void setPixelColor(uint16_t led, uint8_t red, uint8_t green, uint8_t blue, uint8_t white) {
+        if (led >= num_) {return;}
+        uint8_t* px = &pixels_[led * 4];
+        px[0] = red;
+        px[1] = green;
+        px[2] = blue;
+        px[3] = white;
+    }
+    void clear() {
+        for (size_t i = 0; i < MAX_PIXELS * 4; ++i) {pixels_[i] = 0;}
+    }
+    void updateLength(uint16_t num) {num_ = (num < MAX_PIXELS) ? num : MAX_PIXELS;}
+    auto numPixels() const -> uint16_t {return num_;}
+    /// 一フレームを Core1 に渡す。前のフレームをまだ受け取っていなければ、このフレームは捨てる
+    void show() {
+        if (ready_.load(std::memory_order_acquire)) {
+            skipped_ += 1;
+            return;
+        }
+        const size_t channels = chip_count(num_) * PCA9685_CHANNELS;
+        for (size_t ch = 0; ch < channels; ++ch) {
+            const size_t led = ch / PCA9685_CHANNELS_PER_LED;
+            pending_[ch] = level((led < num_) ? pixels_[led * 4 + ch % PCA9685_CHANNELS_PER_LED] : 0);
+        }
+        pending_num_ = num_;
+        ready_.store(true, std::memory_order_release);
+    }
+
+    // --- Core1 ---
+    /// sweep の合間に呼ぶ。budget byte を超えない所まで送り、送った byte 数を返す
+    /// (一つの書き込みが budget より大きくても、その回の最初の一つは送る)
+    auto HOT_FUNC(flush)(size_t budget) -> size_t {
+        take_pending();
+        size_t used = 0;
+        for (size_t k = 0; k < chips_; ++k) {
+            const size_t chip = cursor_;
+            const Flushed r = flush_chip(chip, budget, used);
+            if (r == Flushed::BUDGET) {break;}
+            // 答えない chip で止まらないよう、失敗しても次の chip に進む (その回はそこまで)
+            cursor_ = static_cast<uint16_t>((chip + 1 < chips_) ? chip + 1 : 0);
+            if (r == Flushed::ERROR) {break;}
+        }
+        return used;
+    }
+    /// 送り残しがあるか
+    auto dirty() const -> bool {
+        for (size_t i = 0; i < static_cast<size_t>(chips_) * PCA9685_CHANNELS; ++i) {
+            if (target_[i] != sent_[i]) {return true;}
+        }
+        return ready_.load(std::memory_order_acquire);
+    }
+
+    auto writes() const -> uint32_t {return writes_;}
+    auto bytes() const -> uint32_t {return bytes_;}
+    auto errors() const -> uint32_t {return errors_;}
+    auto skipped() const -> uint32_t {return skipped_;}
+    auto chips() const -> size_t {return chips_;}
+
+    /// 8bit の明るさ → PWM (INVRT なので ON の位置、OFF は 0。peripheral.cpp と同じ)
+    static auto level(uint8_t v) -> uint16_t {
+        uint16_t cnt = static_cast<uint16_t>(4095 - (v * 4095 + 127) / 255);
+        return (cnt == 0) ? 1 : cnt;
+    }
+    static auto address(size_t chip) -> uint8_t {return static_cast<uint8_t>(PCA9685_I2C_ADRS + chip);}
+    static auto chip_count(size_t pixels) -> size_t {
+        return (pixels + PCA9685_LEDS_PER_CHIP - 1) / PCA9685_LEDS_PER_CHIP;
+    }
+
+private:
+    enum class Flushed : uint8_t {DONE, BUDGET, ERROR};
+
+    void take_pending() {
+        if (!ready_.load(std::memory_order_acquire)) {return;}
+        const size_t chips = chip_count(pending_num_);
+        for (size_t i = 0; i < chips * PCA9685_CHANNELS; ++i) {target_[i] = pending_[i];}
+        // 増えた chip は中身が分からないので全部送る
+        for (size_t i = static_cast<size_t>(chips_) * PCA9685_CHANNELS; i < chips * PCA9685_CHANNELS; ++i) {
+            sent_[i] = UNKNOWN;
+        }
+        chips_ = static_cast<uint16_t>(chips);
+        if (cursor_ >= chips_) {cursor_ = 0;}
+        ready_.store(false, std::memory_order_release);
+    }
+    /// 一つの chip の変わった channel を、続いている所ごとに送る
+    auto flush_chip(size_t chip, size_t budget, size_t& used) -> Flushed {
+        const size_t base = chip * PCA9685_CHANNELS;
+        bool first = (used == 0);   // その回の最初の書き込みは、上限を越えても送る
+        if (!inited_[chip]) {
+            const uint8_t mode1[2] = {PCA9685_MODE1, PCA9685_MODE1_AI};
+            const uint8_t mode2[2] = {PCA9685_MODE2, PCA9685_MODE2_INIT};
+            if (!first && (used + 4 + PCA9685_MAX_WRITE > budget)) {return Flushed::BUDGET;}
+            used += 4;
+            if ((bus_.write(address(chip), mode1, 2) != 0) || (bus_.write(address(chip), mode2, 2) != 0)) {
+                errors_ += 1;
+                return Flushed::ERROR;
+            }
+            writes_ += 2;
+            bytes_ += 4;
+            inited_[chip] = true;
+        }
+        size_t ch = 0;
+        while (ch < PCA9685_CHANNELS) {
+            if (target_[base + ch] == sent_[base + ch]) {
+                ch += 1;
+                continue;
+            }
+            // ch から、変わっていない channel が MERGE_GAP を超えて続く手前まで
+            size_t last = ch;
+            for (size_t n = ch + 1; n < PCA9685_CHANNELS; ++n) {
+                if (target_[base + n] != sent_[base + n]) {
+                    last = n;
+                } else if (n - last > PCA9685_MERGE_GAP) {
+                    break;
+                }
+            }
+            const size_t count = last - ch + 1;
+            const size_t len = 1 + count * 4;
+            if (!first && (used + len > budget)) {return Flushed::BUDGET;}
+            first = false;
+            uint8_t buf[PCA9685_MAX_WRITE];
+            buf[0] = static_cast<uint8_t>(PCA9685_LED0_ON_L + ch * 4);
+            for (size_t i = 0; i < count; ++i) {
+                const uint16_t v = target_[base + ch + i];
+                buf[1 + i * 4] = static_cast<uint8_t>(v);
+                buf[2 + i * 4] = static_cast<uint8_t>(v >> 8);
+                buf[3 + i * 4] = 0;
+                buf[4 + i * 4] = 0;
+            }
+            used += len;
+            if (bus_.write(address(chip), buf, len) != 0) {
+                // 届かなかった所は sent_ を変えずに、次の合間にもう一度
+                errors_ += 1;
+                return Flushed::ERROR;
+            }
+            writes_ += 1;
+            bytes_ += static_cast<uint32_t>(len);
+            for (size_t i = 0; i < count; ++i) {sent_[base + ch + i] = target_[base + ch + i];}
+            ch = last + 1;
+        }
+        return Flushed::DONE;
+    }
+};
+#endif // PCA9685_LEDS_H
@@ -14,19 +14,22 @@
 
 #include  "constants.h"
 #include	"peripheral.h"
+#include  "placement.h"
+#include  "board.h"
+#ifdef USE_PCA9685
+#include  "pca9685_leds.h"
+#endif
 
-// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-//  RP2040 を使う時は Wire. で、RP2350 を使う時は Wire1. にする
-// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+//  RP2040 は Wire、RP2350 は Wire1 (TOUCH_WIRE: board.h)
 //---------------------------------------------------------
 //		Initialize I2C Device
 //---------------------------------------------------------
 void wireBegin( void )
 {
-  Wire1.setClock(400000);
-  Wire1.setSDA(6);
-  Wire1.setSCL(7);
-	Wire1.begin();
+  TOUCH_WIRE.setClock(TOUCH_I2C_CLOCK);
+  TOUCH_WIRE.setSDA(TOUCH_I2C_SDA);
+  TOUCH_WIRE.setSCL(TOUCH_I2C_SCL);
+	TOUCH_WIRE.begin();
 }
 //---------------------------------------------------------
 //		Write I2C Device
@@ -37,11 +40,11 @@ void wireBegin( void )
 //      3:received NACK on transmit of data
 //      4:other error
 //---------------------------------------------------------
-int write_i2cDevice( unsigned char adrs, unsigned char* buf, int count )
+int HOT_FUNC(write_i2cDevice)( unsigned char adrs, unsigned char* buf, int count )
 {
-	Wire1.beginTransmission(adrs);
-  Wire1.write(buf,count);
-	return Wire1.endTransmission();
+	TOUCH_WIRE.beginTransmission(adrs);
+  TOUCH_WIRE.write(buf,count);
+	return TOUCH_WIRE.endTransmission();
 }
 //---------------------------------------------------------
 //		Read 1byte I2C Device
@@ -50,17 +53,17 @@ int read1byte_i2cDevice( unsigned char adrs, unsigned char* wrBuf, unsigned char
 {
 	unsigned char err;
 
-	Wire1.beginTransmission(adrs);
-  Wire1.write(wrBuf,wrCount);
-	err = Wire1.endTransmission(false);
+	TOUCH_WIRE.beginTransmission(adrs);
+  TOUCH_WIRE.write(wrBuf,wrCount);
+	err = TOUCH_WIRE.endTransmission(false);
 	if ( err != 0 ){ return err; }
 
-	err = Wire1.requestFrom(adrs,(uint8_t)1,(uint8_t)0);
-	while(Wire1.available()) {
-		*rdBuf = Wire1.read();
+	err = TOUCH_WIRE.requestFrom(adrs,(uint8_t)1,(uint8_t)0);
+	while(TOUCH_WIRE.available()) {
+		*rdBuf = TOUCH_WIRE.read();
 	}
 
-	//err = Wire1.endTransmission(true);
+	//err = TOUCH_WIRE.endTransmission(true);
 	//return err;
   return 0;
 }
@@ -78,37 +81,37 @@ int read_nbyte_i2cDevice( unsigned char adrs, unsigned char* wrBuf, unsigned cha
 {
 	unsigned char err;
 
-	Wire1.beginTransmission(adrs);
-  Wire1.write(wrBuf,wrCount);
-	err = Wire1.endTransmission(false);
+	TOUCH_WIRE.beginTransmission(adrs);
+  TOUCH_WIRE.write(wrBuf,wrCount);
+	err = TOUCH_WIRE.endTransmission(false);
 	if ( err != 0 ){ return err; }
 
-	err = Wire1.requestFrom(adrs,static_cast<uint8_t>(rdCount),(uint8_t)0);
+	err = TOUCH_WIRE.requestFrom(adrs,static_cast<uint8_t>(rdCount),(uint8_t)0);
 	int rdAv = 0;
-	while((rdAv = Wire1.available()) != 0) {
-		*(rdBuf+rdCount-rdAv) = Wire1.read();
+	while((rdAv = TOUCH_WIRE.available()) != 0) {
+		*(rdBuf+rdCount-rdAv) = TOUCH_WIRE.read();
 	}
 
-	//err = Wire1.endTransmission(true);
+	//err = TOUCH_WIRE.endTransmission(true);
 	//return err;
 
 	return 0;
 }
 // ハングしてはいけない本番用
-int read_nbyte_i2cDeviceX( unsigned char adrs, unsigned char* wrBuf, unsigned char* rdBuf, int wrCount, int rdCount )
+int HOT_FUNC(read_nbyte_i2cDeviceX)( unsigned char adrs, unsigned char* wrBuf, unsigned char* rdBuf, int wrCount, int rdCount )
 {
 	unsigned char err;
   volatile int cnt=0;
 
-	Wire1.beginTransmission(adrs);
-  Wire1.write(wrBuf,wrCount);
-	err = Wire1.endTransmission(false);
+	TOUCH_WIRE.beginTransmission(adrs);
+  TOUCH_WIRE.write(wrBuf,wrCount);
+	err = TOUCH_WIRE.endTransmission(false);
 	if ( err != 0 ){ return err; }
 
-	err = Wire1.requestFrom(adrs,static_cast<uint8_t>(rdCount),(uint8_t)0);
+	err = TOUCH_WIRE.requestFrom(adrs,static_cast<uint8_t>(rdCount),(uint8_t)0);
 	int rdAv = 0;
-	while(((rdAv = Wire1.available()) != 0) && (cnt < 10)){
-		*(rdBuf+rdCount-rdAv) = Wire1.read();
+	while(((rdAv = TOUCH_WIRE.available()) != 0) && (cnt < rdCount)){
+		*(rdBuf+rdCount-rdAv) = TOUCH_WIRE.read();
     cnt += 1;
 	}
 
@@ -127,14 +130,14 @@ int read_only_nbyte_i2cDevice( unsigned char adrs, unsigned char* rdBuf, int rdC
 {
   unsigned char err;
 
-  err = Wire1.requestFrom(adrs,static_cast<uint8_t>(rdCount),static_cast<uint8_t>(false));
-  int rdAv = Wire1.available();
+  err = TOUCH_WIRE.requestFrom(adrs,static_cast<uint8_t>(rdCount),static_cast<uint8_t>(false));
+  int rdAv = TOUCH_WIRE.available();
   while( rdAv ) {
-    *(rdBuf+rdCount-rdAv) = Wire1.read();
+    *(rdBuf+rdCount-rdAv) = TOUCH_WIRE.read();
     rdAv--;
   }
 
-  err = Wire1.endTransmission(true);
+  err = TOUCH_WIRE.endTransmission(true);
   return err;
 }
 
@@ -160,7 +163,7 @@ void AT42QT_init( void )
   if ( err != 0 ){ return; }
 }
 
-int AT42QT_read( size_t key, uint8_t (&rdraw)[2], bool ref )
+int HOT_FUNC(AT42QT_read)( size_t key, uint8_t (&rdraw)[2], bool ref )
 {
   uint8_t wd = 0;
   if (ref) {
@@ -170,6 +173,26 @@ int AT42QT_read( size_t key, uint8_t (&rdraw)[2], bool ref )
   }  
   return read_nbyte_i2cDeviceX(AT42QT_I2C_ADRS, &wd, rdraw, 1, 2);
 }
+//  reference 値を key 0 から count 個、一回の transaction でまとめて読む
+int AT42QT_read_refs( uint16_t* ref, size_t count )
+{
+  uint8_t wd = 18;
+  uint8_t raw[14];
+  if (count > 7) { count = 7; }
+  int err = read_nbyte_i2cDeviceX(AT42QT_I2C_ADRS, &wd, raw, 1, count*2);
+  if ( err != 0 ){ return err; }
+  for (size_t i = 0; i < count; i++) {
+    ref[i] = static_cast<uint16_t>(raw[i*2]) * 256 + raw[i*2+1];
+  }
+  return 0;
+}
+//  Chip ID (0x2E) を読む。つながっていなければ 0 以外を返す
+int AT42QT_read_id( uint8_t& id )
+{
+  uint8_t wd = 0;
+  id = 0;
+  return read_nbyte_i2cDeviceX(AT42QT_I2C_ADRS, &wd, &id, 1, 1);
+}
 #endif
 
 
@@ -482,51 +505,54 @@ void ada88_anime( int time )
 //			PCA9685 (LED Driver : I2c Device)
 //-------------------------------------------------------------------------
 #ifdef USE_PCA9685    //	for LED Driver
-constexpr unsigned char PCA9685_ADDRESS = 0x40;
+//  register の定義と、フレームをまとめて送る Pca9685Leds は pca9685_leds.h
 //-------------------------------------------------------------------------
 int PCA9685_write( uint8_t chipNumber, uint8_t cmd1, uint8_t cmd2 )
 {
 	unsigned char	i2cBuf[2];
 	i2cBuf[0] = cmd1; i2cBuf[1] = cmd2;
-	int err = write_i2cDevice( PCA9685_ADDRESS+chipNumber, i2cBuf, 2 );
+	int err = write_i2cDevice( PCA9685_I2C_ADRS+chipNumber, i2cBuf, 2 );
 	return err;
 }
 //-------------------------------------------------------------------------
+//    [register][data ...] を一回で書く (auto-increment で register が進む)
+//-------------------------------------------------------------------------
+int PCA9685_write_block( uint8_t adrs, const uint8_t* buf, size_t len )
+{
+  return write_i2cDevice( adrs, const_cast<unsigned char*>(buf), static_cast<int>(len) );
+}
+//-------------------------------------------------------------------------
 //		Initialize
 //-------------------------------------------------------------------------
 void PCA9685_init( uint8_t chipNumber )
 {
 	//	Init Parameter
-	PCA9685_write( chipNumber, 0x00, 0x00 );
-	PCA9685_write( chipNumber, 0x01, 0x12 );//	Invert, OE=high-impedance
+	PCA9685_write( chipNumber, PCA9685_MODE1, PCA9685_MODE1_AI );	//	Auto-Increment
+	PCA9685_write( chipNumber, PCA9685_MODE2, PCA9685_MODE2_INIT );//	Invert, OE=high-impedance
 }
 //-------------------------------------------------------------------------
 //		rNum, gNum, bNum : 0 - 4094  bigger, brighter
+//    一つの LED の 3 channel (12 register) を一回で書く
 //-------------------------------------------------------------------------
 int PCA9685_setFullColorLED( uint8_t chipNumber, int ledNum, unsigned short* color  )
 {
-  int err = 0;
-	int	i;
+  uint8_t i2cBuf[1 + 3*4];
 
   ledNum &= 0x03;
-	for ( i=0; i<3; i++ ){
+  i2cBuf[0] = static_cast<uint8_t>(PCA9685_LED0_ON_L + ledNum*16);
+	for ( int i=0; i<3; i++ ){
 		//	figure out PWM counter
 		unsigned short colorCnt = *(color+i);
 		colorCnt = 4095 - colorCnt;
 		if ( colorCnt <= 0 ){ colorCnt = 1;}
 
 		//	Set PWM On Timing
-		err = PCA9685_write( chipNumber, (uint8_t)(0x06 + i*4 + ledNum*16), (uint8_t)(colorCnt & 0x00ff) );
-        if ( err != 0 ){ return err; }
-		err = PCA9685_write( chipNumber, (uint8_t)(0x07 + i*4 + ledNum*16), (uint8_t)((colorCnt & 0xff00)>>8) );
-        if ( err != 0 ){ return err; }
-
-		err = PCA9685_write( chipNumber, (uint8_t)(0x08 + i*4 + ledNum*16), 0 );
-        if ( err != 0 ){ return err; }
-		err = PCA9685_write( chipNumber, (uint8_t)(0x09 + i*4 + ledNum*16), 0 );
-        if ( err != 0 ){ return err; }
+		i2cBuf[1 + i*4] = static_cast<uint8_t>(colorCnt & 0x00ff);
+		i2cBuf[2 + i*4] = static_cast<uint8_t>((colorCnt & 0xff00)>>8);
+		i2cBuf[3 + i*4] = 0;
+		i2cBuf[4 + i*4] = 0;
 	}
-  return err;
+  return PCA9685_write_block( PCA9685_I2C_ADRS+chipNumber, i2cBuf, sizeof(i2cBuf) );
 }
 #endif
 
@@ -542,7 +568,7 @@ static uint8_t old_dev_num = 0;
 //        i2c_num:  0..3 (which I2C bus to use)
 //        dev_num:  0..7 (which device to select)
 //-------------------------------------------------------------------------
-int pca9544_changeI2cBus(int i2c_num, int dev_num)
+int HOT_FUNC(pca9544_changeI2cBus)(int i2c_num, int dev_num)
 {
   uint8_t sub_i2c_num = i2c_num & 0x0003;
   if (dev_num != old_dev_num) { // 前回と違うデバイスなら、前のデバイスは接続を切る
@@ -565,19 +591,25 @@ int pca9544_changeI2cBus(int i2c_num, int dev_num)
 #include <SPI.h>
 #include <Adafruit_SSD1331.h>
 #include <Adafruit_GFX.h>
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "oled_fb.h"
 
-// Seeed XIAO displayピン設定
-#define DISPLAY_CS     D3
-#define DISPLAY_RST    D6
-#define DISPLAY_DC     D2
-#define DISPLAY_MOSI   D10
-#define DISPLAY_SCK    D8
+// Seeed XIAO displayピン設定は board.h
 
 // JPGの最大サイズ(バッファを静的に確保するようにしているため、決め打ち。取り扱う最大ファイルサイズで変えるようにする)
 #define JPG_SIZE_MAX (20 * 1024) //MAX 20KByteを想定
 
 Adafruit_SSD1331 display = Adafruit_SSD1331(&SPI, DISPLAY_CS, DISPLAY_DC, DISPLAY_RST);
 
+// 描画はすべて oled_frame に対して行い、変化した矩形だけを DMA で SPI に送る
+static OledFrame oled_frame;
+static int oled_dma_ch = -1;
+static dma_channel_config oled_dma_cfg;
+static bool oled_dma_busy = false;
+static OledRect oled_rect;          // 送っている矩形
+static uint8_t oled_rect_row = 0;   // 次に送る矩形内の行
+
 void SSD1331_init(void) {
     //SPIピン設定
     SPI.setTX(DISPLAY_MOSI);
@@ -586,18 +618,71 @@ void SSD1331_init(void) {
     //displayの初期化と初期設定
     display.begin();       
     display.fillScreen(static_cast<uint16_t>(SSD1331_COLORS::BLACK));                      //背景の塗りつぶし
+
+    // SPI0 TX に 1byte ずつ送る DMA
+    oled_dma_ch = dma_claim_unused_channel(true);
+    oled_dma_cfg = dma_channel_get_default_config(oled_dma_ch);
+    channel_config_set_transfer_data_size(&oled_dma_cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&oled_dma_cfg, true);
+    channel_config_set_write_increment(&oled_dma_cfg, false);
+    channel_config_set_dreq(&oled_dma_cfg, spi_get_dreq(spi0, true));
+
+    oled_frame.fill(static_cast<uint16_t>(SSD1331_COLORS::BLACK));
+    while (oled_frame.take_dirty_rect(oled_rect)) {} // 画面はすでに黒
 }
 void SSD1331_clear(void) {
-    display.fillScreen(static_cast<uint16_t>(SSD1331_COLORS::BLACK));                      //背景の塗りつぶし
+    oled_frame.fill(static_cast<uint16_t>(SSD1331_COLORS::BLACK));                        //背景の塗りつぶし
 }
 void SSD1331_display(const char* str, int line, SSD1331_COLORS color) {
-  display.fillRect(0, 10*line, 100, 10, static_cast<uint16_t>(SSD1331_COLORS::BLACK));
   // 0° (デフォルト) の向きで描画
-  display.setRotation(0);
-  display.setTextColor(static_cast<uint16_t>(color));
-  display.setTextSize(1);
-  display.setCursor(0, 10*line);
-  display.print(str);
-} 
+  oled_frame.draw_line(line, str, static_cast<uint16_t>(color), static_cast<uint16_t>(SSD1331_COLORS::BLACK));
+}
+//---------------------------------------------------------
+//    矩形の次の部分の DMA を始める
+//    幅いっぱいなら残りの行をまとめて、そうでなければ一行ずつ
+//---------------------------------------------------------
+static void SSD1331_start_rect_dma(void) {
+  const uint8_t y = oled_rect.y + oled_rect_row;
+  const uint8_t* src;
+  size_t bytes;
+  if (oled_rect.w == OLED_WIDTH) {
+    src = oled_frame.band_data(y);
+    bytes = OledFrame::band_bytes(oled_rect.h - oled_rect_row);
+    oled_rect_row = oled_rect.h;
+  } else {
+    src = oled_frame.row_data(oled_rect.x, y);
+    bytes = OledFrame::row_bytes(oled_rect.w);
+    oled_rect_row++;
+  }
+  dma_channel_configure(oled_dma_ch, &oled_dma_cfg, &spi_get_hw(spi0)->dr, src, bytes, true);
+  oled_dma_busy = true;
+}
+//---------------------------------------------------------
+//    変化した矩形を DMA で送る。転送中は何もせずに戻る
+//    loop() から毎回呼ぶ
+//---------------------------------------------------------
+void SSD1331_flush(void) {
+  if (oled_dma_ch < 0) { return; }
+  if (oled_dma_busy) {
+    if (dma_channel_is_busy(oled_dma_ch)) { return; }
+    oled_dma_busy = false;
+    if (oled_rect_row < oled_rect.h) {
+      // 同じアドレス窓の次の行 (SSD1331 は窓の中で次の行へ進む)
+      SSD1331_start_rect_dma();
+      return;
+    }
+    // 最後の byte が出ていくのを待ち、読まなかった RX を捨てる
+    while (spi_is_busy(spi0)) {}
+    while (spi_is_readable(spi0)) { (void)spi_get_hw(spi0)->dr; }
+    spi_get_hw(spi0)->icr = SPI_SSPICR_RORIC_BITS;
+    display.endWrite();
+  }
+
+  if (!oled_frame.take_dirty_rect(oled_rect)) { return; }
+  display.startWrite();
+  display.setAddrWindow(oled_rect.x, oled_rect.y, oled_rect.w, oled_rect.h);   // この後 DC は data 側
+  oled_rect_row = 0;
+  SSD1331_start_rect_dma();
+}
 #endif
 /* [] END OF FILE */
@@ -17,6 +17,8 @@ void initHardware( void );
 // AT42QT
 void AT42QT_init( void );
 int AT42QT_read( size_t key, uint8_t (&rdraw)[2], bool ref );
+int AT42QT_read_refs( uint16_t* ref, size_t count );
+int AT42QT_read_id( uint8_t& id );
 
 // USE_ADA88
 	void ada88_init( void );
@@ -34,6 +36,7 @@ int AT42QT_read( size_t key, uint8_t (&rdraw)[2], bool ref );
 // USE_PCA9685
 	void PCA9685_init( uint8_t chipNumber );
   int PCA9685_write( uint8_t chipNumber, uint8_t cmd1, uint8_t cmd2 );
+  int PCA9685_write_block( uint8_t adrs, const uint8_t* buf, size_t len );
 	int PCA9685_setFullColorLED( uint8_t chipNumber, int ledNum, unsigned short* color  );
 
 // USE_SSD1331
@@ -51,5 +54,6 @@ int AT42QT_read( size_t key, uint8_t (&rdraw)[2], bool ref );
   void SSD1331_init(void);
   void SSD1331_clear(void);
   void SSD1331_display(const char* str, int line, SSD1331_COLORS color);
+  void SSD1331_flush(void);
 
 #endif
@@ -0,0 +1,59 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <cstddef>
+
+#include "constants.h"
+
+// =========================================================
+//      Per-core SRAM Placement
+// =========================================================
+// RP2040/RP2350 の scratch X / Y (各 4KB) は、それぞれ Core1 / Core0 の stack がある bank
+// 各 core が毎回触るデータをそこに置くと、もう一方の core と bus で取り合わない
+//  CORE0_DATA: scratch Y (Core0 の loop() が毎回触るもの)
+//  CORE1_DATA: scratch X (Core1 の sweep が毎回触るもの)
+// stack と同じ bank なので、置いてよい大きさを決めておき、使う所で static_assert する
+// 足りなければリンク時に .stack_dummy が入らずエラーになる
+#if defined(ARDUINO_ARCH_RP2040)
+#include "pico/platform.h"
+#define CORE0_DATA(group)   __scratch_y(group)
+#define CORE1_DATA(group)   __scratch_x(group)
+#else
+#define CORE0_DATA(group)
+#define CORE1_DATA(group)
+#endif
+
+constexpr size_t CORE0_SCRATCH_BUDGET = 1024;   // 残りは Core0 の stack
+constexpr size_t CORE1_SCRATCH_BUDGET = 1024;   // 残りは Core1 の stack
+
+// =========================================================
+//      Execute-from-RAM Placement
+// =========================================================
+// XIP cache (16KB) を USB や GFX と取り合わないように、毎 sweep / 毎フレーム通る関数は
+// .time_critical に置く。起動時に crt0 が .data と一緒に SRAM へ写す
+//  void HOT_FUNC(scan_sweep)() { ... }       (SDK の __not_in_flash_func と同じ書き方)
+// どの関数が本当に SRAM に入ったかと大きさは tools/hot_check.py で ELF から確かめる
+// HOT_IN_FLASH を定義すると全部 flash に戻る (XIP との比較用)
+#if defined(ARDUINO_ARCH_RP2040) && !defined(HOT_IN_FLASH)
+#define HOT_FUNC(name)      __not_in_flash_func(name)
+#else
+#define HOT_FUNC(name)      name
+#endif
+
+// =========================================================
+//      Reset-surviving RAM
+// =========================================================
+// NOINIT_DATA に置いたものは、起動時に crt0 が 0 にしない (.uninitialized_data)
+// watchdog などで再起動しても前の中身が残る。電源を入れた直後はでたらめなので、使う前に必ず確かめる
+#if defined(ARDUINO_ARCH_RP2040)
+#define NOINIT_DATA(name)   __uninitialized_ram(name)
+#else
+#define NOINIT_DATA(name)   name
+#endif
+
+#endif // PLACEMENT_H
@@ -0,0 +1,114 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "constants.h"
+#include "telemetry.h"
+
+// =========================================================
+//      Profile Regions
+// =========================================================
+enum class ProfRegion : uint8_t {
+    SCAN,       // Core1: 全センサの読み込み (loop1)
+    TOUCH,      // seek_and_update_touch_point()
+    LED_RENDER, // LED の色の計算
+    LED_SHOW,   // update_neo_pixel()
+    MIDI_READ,  // MIDI.read()
+    OLED_PAGE,  // 表示ページの描画
+    OLED_FLUSH, // OLED への転送
+    FLIGHT,     // Core1: flight recorder への sweep の記録
+    LED_I2C,    // Core1: PCA9685 の LED を sweep の合間に送る (USE_PCA9685)
+    CLUSTER,    // 何台かをつなぐ UART の読み書き (USE_CLUSTER)
+    MAX
+};
+constexpr size_t PROF_REGIONS = static_cast<size_t>(ProfRegion::MAX);
+constexpr size_t PROF_CORES = 2;
+// 1 レコード: core, region, count, total, min, max
+constexpr size_t PROF_RECORD_BYTES = 2 + 4 * 4;
+constexpr size_t PROF_FRAME_BYTES = TELEMETRY_OVERHEAD + 4 + PROF_CORES * PROF_REGIONS * PROF_RECORD_BYTES;
+
+#ifdef USE_PROFILER
+#include <Arduino.h>  // time_us_32(), get_core_num()
+
+// =========================================================
+//      Profiler Class
+// =========================================================
+// 区間ごと・コアごとに usec 単位の処理時間を集計する
+// 各コアは自分の統計だけを書くので lock は要らない
+struct ProfStat {
+    uint32_t    count;
+    uint32_t    total_us;
+    uint32_t    min_us;
+    uint32_t    max_us;
+};
+
+class Profiler {
+    ProfStat        stats_[PROF_CORES][PROF_REGIONS];
+    volatile bool   reset_req_[PROF_CORES];
+
+// impl Profiler
+public:
+    Profiler() : stats_{}, reset_req_{true, true} {}
+
+    void record(uint8_t core, ProfRegion region, uint32_t us) {
+        if (reset_req_[core]) {
+            // 書き出し後のクリアは、そのコア自身が行う
+            for (auto& st : stats_[core]) {st = ProfStat{0, 0, UINT32_MAX, 0};}
+            reset_req_[core] = false;
+        }
+        ProfStat& st = stats_[core][static_cast<size_t>(region)];
+        st.count += 1;
+        st.total_us += us;
+        if (us < st.min_us) {st.min_us = us;}
+        if (us > st.max_us) {st.max_us = us;}
+    }
+    auto stat(uint8_t core, ProfRegion region) const -> const ProfStat& {
+        return stats_[core][static_cast<size_t>(region)];
+    }
+    /// 統計を一つのフレームにまとめ、次の期間のためにクリアを要求する
+    auto export_frame(uint8_t* buf, size_t cap, uint32_t period_us) -> size_t {
+        TelemetryWriter w(buf, cap, TelemetryType::PROFILE);
+        w.put32(period_us);
+        for (uint8_t core = 0; core < PROF_CORES; ++core) {
+            for (uint8_t r = 0; r < PROF_REGIONS; ++r) {
+                const ProfStat& st = stats_[core][r];
+                if (reset_req_[core] || (st.count == 0)) {continue;}
+                w.put(core);
+                w.put(r);
+                w.put32(st.count);
+                w.put32(st.total_us);
+                w.put32(st.min_us);
+                w.put32(st.max_us);
+            }
+            reset_req_[core] = true;
+        }
+        return w.finish();
+    }
+};
+extern Profiler profiler;
+
+// 区間の始めから終わりまでを測る
+class ProfScope {
+    ProfRegion  region_;
+    uint32_t    start_us_;
+public:
+    explicit ProfScope(ProfRegion region) : region_(region), start_us_(time_us_32()) {}
+    ~ProfScope() {
+        profiler.record(static_cast<uint8_t>(get_core_num()), region_, time_us_32() - start_us_);
+    }
+};
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROFILE_SCOPE(region) ProfScope PROF_CONCAT(prof_scope_, __LINE__)(region)
+
+#else
+#define PROFILE_SCOPE(region) do {} while (0)
+#endif // USE_PROFILER
+#endif // PROFILER_H
@@ -8,90 +8,112 @@
 
 #include <cstdint>
 #include <array>
-#include <functional>
+#include <tuple>
 #include <algorithm>
 #include <cmath>
 
 #include "constants.h"
+#include "placement.h"
+#include "signal_kernels.h"
 
 // =========================================================
 //      Touch Constants
 // =========================================================
 constexpr uint16_t MAX_PADS = MAX_SENS;
+constexpr size_t HOT_BLOCK_WORDS = (MAX_KAMABOKO_NUM + 31) / 32;
 constexpr uint16_t TOUCH_THRESHOLD = 30; // Example threshold for touch point detection
 constexpr float CLOSE_RANGE = 3.0f; // 同じタッチと見做される 10msec あたりの動作範囲
+#ifdef QUBIT_FINGER_RANGE
+constexpr size_t FINGER_RANGE = QUBIT_FINGER_RANGE; // ホストのベンチマークで窓の幅を変える
+#else
 constexpr size_t FINGER_RANGE = 3; // Maximum number of touch points
+#endif
 constexpr float HISTERESIS = 0.7f; // Hysteresis value for touch point detection
+constexpr uint8_t RELEASE_HOLD = 5; // この回数続けて更新がなければ、離れたとみなす
+constexpr uint8_t PAD_FILTER_MAX = 4; // 移動平均の sample 数の最大
 
+// 実行中に変えられる値 (tuning.h の SysEx で変える)。既定値は上の固定値
+struct TouchParams {
+    uint16_t    threshold = TOUCH_THRESHOLD;
+    float       close_range = CLOSE_RANGE;
+    float       hysteresis = HISTERESIS;
+    uint8_t     release_hold = RELEASE_HOLD;
+    uint8_t     filter_len = PAD_FILTER_MAX;    // 1-PAD_FILTER_MAX
+};
+
+// callback は関数ポインタで持つ (std::function のコピーで heap を使わないように)
+using MidiCallback = void (*)(uint8_t status, uint8_t note, uint8_t velocity);
+using LedCallback = void (*)(float location, int16_t intensity);
 
 // =========================================================
 //      Pad Class
 // =========================================================
 class Pad {
-    static constexpr size_t MAX_MOVING_AVERAGE = 4; // Number of samples for moving average
+    static constexpr size_t MAX_MOVING_AVERAGE = PAD_FILTER_MAX; // Number of samples for moving average
 
-    uint16_t    mv_avg_value_;  // 移動平均(MAX_MOVING_AVERAGEで割らない)
-    int16_t     diff_from_before_;
-    bool        top_flag_;
+    uint16_t    mv_avg_value_;  // 直近 len 個の合計 (len で割らない)
     uint16_t    past_value_[MAX_MOVING_AVERAGE];
-    size_t      past_index_;
+    uint8_t     past_index_;
+    bool        top_flag_;
 
 //impl Pad
 public:
     Pad() : mv_avg_value_(0), 
-            diff_from_before_(0),
-            top_flag_(false),
             past_value_{},
-            past_index_(0) {
+            past_index_(0),
+            top_flag_(false) {
         std::fill(past_value_, past_value_ + MAX_MOVING_AVERAGE, 0);
     }
 
-    void set_crnt(uint16_t value) {
-        uint16_t crnt_value = value;
-        past_value_[past_index_] = crnt_value;
+    void set_crnt(uint16_t value, size_t len = MAX_MOVING_AVERAGE) {
+        // len 個前の値を引いて新しい値を足す (全パッドで毎 sweep 呼ばれるので、足し直さない)
+        mv_avg_value_ = mv_avg_value_ - past_value_[(past_index_ + MAX_MOVING_AVERAGE - len) % MAX_MOVING_AVERAGE] + value;
+        past_value_[past_index_] = value;
         past_index_ = (past_index_ + 1) % MAX_MOVING_AVERAGE;
-        mv_avg_value_ = 0;
-        for (size_t i = 0; i < MAX_MOVING_AVERAGE; ++i) {
-            mv_avg_value_ += past_value_[i];
+    }
+    /// 移動平均の長さを変えた時に、合計を作り直す
+    void refilter(size_t len) {
+        uint16_t sum = 0;
+        for (size_t k = 1; k <= len; ++k) {
+            sum += past_value_[(past_index_ + MAX_MOVING_AVERAGE - k) % MAX_MOVING_AVERAGE];
         }
+        mv_avg_value_ = sum;
     }
     auto get_crnt() -> uint16_t const {
         return mv_avg_value_;
     }
-    auto set_diff_from_before(int16_t value_before) -> int16_t{
-        diff_from_before_ = value_before - mv_avg_value_;
-        return diff_from_before_;
-    }
-    auto diff_from_before() -> int16_t const {
-        return diff_from_before_;
-    }
     void note_top_flag() {top_flag_ = true;}
     auto is_top_flag() -> bool const {
         return top_flag_;
     }
 };
+// 全パッド分を毎 sweep 読むので、詰めておく
+static_assert(sizeof(Pad) == 12, "Pad: 2 + 2*4 + 1 + 1 bytes");
 
 // =========================================================
 //      TouchPoint Class
 // =========================================================
 // センサーの生値から、実際にどのあたりをタッチしているかを判断し、保持する
 class TouchPoint {
-    static constexpr uint8_t NEW_NOTE = 0xff;
-    static constexpr uint8_t TOUCH_POINT_ERROR = 0xfe;
+    static constexpr uint16_t NEW_NOTE = 0xffff;
+    static constexpr uint16_t TOUCH_POINT_ERROR = 0xfffe;
 
     float       center_location_;
     int16_t     intensity_;
-    uint8_t     real_crnt_note_; // MIDI Note number
+    uint16_t    real_crnt_note_; // 鳴らしているパッドの番号 (MIDI Note/channel は zone から決める)
     bool        is_updated_;
     bool        is_touched_;
     uint16_t    touching_time_;
     uint16_t    no_update_time_;
-    std::function<void(uint8_t, uint8_t, uint8_t)> midi_callback_; // MIDI callback function
+    uint8_t     channel_;       // MIDI channel (0-15)
+    uint8_t     glide_range_;   // 0 以外: この半音数までは Note を変えず pitch bend で動かす (MPE)
+    MidiCallback midi_callback_; // MIDI callback function
 
 // impl TouchPoint
 public:
-    static constexpr float INIT_VAL = 100.0f;
+    static constexpr float INIT_VAL = 1000.0f;  // どのパッドの位置でもない値
     static constexpr uint8_t OFFSET_NOTE = KEYBD_LO - 4;
+    static constexpr uint8_t DEFAULT_CHANNEL = 0x0c;
 
     /// Constructor は起動時に最大数分呼ばれる
     TouchPoint() :
@@ -102,11 +124,13 @@ public:
         is_touched_(false),
         touching_time_(0),
         no_update_time_(0),
+        channel_(DEFAULT_CHANNEL),
+        glide_range_(0),
         midi_callback_(nullptr) {}
 
-    /// 新しいタッチポイントを作成する
-    void new_touch(float location, int16_t intensity, std::function<void(uint8_t, uint8_t, uint8_t)> callback) {
-        uint8_t crnt_note = new_location(NEW_NOTE, location);
+    /// 新しいタッチポイントを作成する。pad_count はつながっているパッドの数 (ring はここで折り返す)
+    void new_touch(float location, int16_t intensity, uint16_t pad_count, MidiCallback callback) {
+        uint16_t crnt_note = new_location(NEW_NOTE, location, pad_count);
         if (crnt_note == TOUCH_POINT_ERROR) {
             return;
         }
@@ -119,44 +143,53 @@ public:
         midi_callback_ = callback;
         // MIDI Note On
         if (midi_callback_) {
-            midi_callback_(0x9c, real_crnt_note_ + OFFSET_NOTE, intensity_to_velocity(intensity_));
+            midi_callback_(0x90 | midi_channel(real_crnt_note_), midi_note(real_crnt_note_), intensity_to_velocity(intensity_));
         }
     }
+    /// 送信する MIDI channel と、pitch bend で動かす範囲を決める (触っていない時に呼ぶ)
+    void set_channel(uint8_t channel, uint8_t glide_range) {
+        channel_ = channel & 0x0f;
+        glide_range_ = glide_range;
+    }
     /// タッチポイントが近いかどうかを判断する
-    auto is_near_here(float location) const -> bool {
+    auto is_near_here(float location, float close_range = CLOSE_RANGE) const -> bool {
         if (!is_touched_) { return false;}
-        if ((center_location_ >= location - CLOSE_RANGE) && (center_location_ <= location + CLOSE_RANGE)) {
+        if ((center_location_ >= location - close_range) && (center_location_ <= location + close_range)) {
             return true;
         }
         return false;
     }
     /// タッチポイントを更新する
-    void update_touch(float location, uint16_t intensity) {
+    void HOT_FUNC(update_touch)(float location, uint16_t intensity, uint16_t pad_count, float hysteresis = HISTERESIS) {
         center_location_ = location;
         intensity_ = intensity;
         is_updated_ = true;
         is_touched_ = true;
-        uint8_t updated_note = new_location(real_crnt_note_, location);
+        if ((glide_range_ != 0) &&
+            (std::abs(location - static_cast<float>(real_crnt_note_)) < static_cast<float>(glide_range_))) {
+            return; // Note はそのまま、pitch bend で追う
+        }
+        uint16_t updated_note = new_location(real_crnt_note_, location, pad_count, hysteresis);
         if (updated_note == TOUCH_POINT_ERROR) {
             return;
         }
         // MIDI Note On & Off
         if ((midi_callback_) && (updated_note != real_crnt_note_)) {
-            midi_callback_(0x9c, updated_note + OFFSET_NOTE, intensity_to_velocity(intensity_));
-            midi_callback_(0x8c, real_crnt_note_ + OFFSET_NOTE, 0x40);
+            midi_callback_(0x90 | midi_channel(updated_note), midi_note(updated_note), intensity_to_velocity(intensity_));
+            midi_callback_(0x80 | midi_channel(real_crnt_note_), midi_note(real_crnt_note_), 0x40);
             real_crnt_note_ = updated_note; // Update the current note
         }
     }
     /// タッチポイントが離れたときの処理
-    void maybe_released() {
-        if ( no_update_time_ + 5 > touching_time_ ) {
-            // 5回以上更新がなかったら、タッチポイントを離れたとみなす
+    void maybe_released(uint8_t hold = RELEASE_HOLD) {
+        if ( no_update_time_ + hold > touching_time_ ) {
+            // hold 回以上更新がなかったら、タッチポイントを離れたとみなす
             touching_time_ += 1;
             return;
         }
         // MIDI Note Off
         if (midi_callback_) {
-            midi_callback_(0x8c, real_crnt_note_ + OFFSET_NOTE, 0x40);
+            midi_callback_(0x80 | midi_channel(real_crnt_note_), midi_note(real_crnt_note_), 0x40);
         }
         is_touched_ = false;
         center_location_ = INIT_VAL;
@@ -174,6 +207,18 @@ public:
     auto get_intensity() const -> int16_t {
         return intensity_;
     }
+    /// 鳴らしている MIDI Note 番号
+    auto note() const -> uint8_t {
+        return midi_note(real_crnt_note_);
+    }
+    /// 鳴らしている Note から見た、実際の位置 (半音単位)
+    auto pitch_offset() const -> float {
+        return center_location_ - static_cast<float>(real_crnt_note_);
+    }
+    /// 鳴らしている MIDI channel
+    auto channel() const -> uint8_t {
+        return midi_channel(real_crnt_note_);
+    }
     void clear_updated_flag() {
         touching_time_ += 1;
         no_update_time_ = touching_time_;
@@ -181,20 +226,35 @@ public:
     }
 
 private:
-    /// crnt_note : 0-(MAX_SENS-1) 現在の位置、NEW_NOTE は新規ノート
-    auto new_location(uint8_t crnt_note, float location) -> uint8_t {
-        if (location < 0.0f) {
-            location = 0.0f; // Ensure location is non-negative
-        } else if (location >= static_cast<float>(MAX_SENS - 1)) {
-            location = static_cast<float>(MAX_SENS - 1); // Ensure location is within bounds
+    /// ZONE_PADS ごとに同じ音域を繰り返す。MPE の時は一つのタッチに一つの channel なので、zone で channel は変えない
+    auto midi_note(uint16_t pad) const -> uint8_t {
+        return static_cast<uint8_t>(pad % ZONE_PADS + OFFSET_NOTE);
+    }
+    auto midi_channel(uint16_t pad) const -> uint8_t {
+        if (glide_range_ != 0) {return channel_;}
+        return static_cast<uint8_t>((channel_ + pad / ZONE_PADS) & 0x0f);
+    }
+    /// crnt_note : 0-(pad_count-1) 現在の位置、NEW_NOTE は新規ノート
+    /// location は ring の両端を少しはみ出すことがある (-0.6 は最後のパッド、pad_count - 0.4 は 0)
+    auto new_location(uint16_t crnt_note, float location, uint16_t pad_count, float hysteresis = HISTERESIS) -> uint16_t {
+        if ((pad_count == 0) || (pad_count > MAX_PADS)) {pad_count = MAX_PADS;}
+        const float count = static_cast<float>(pad_count);
+        if (!(location >= -count) || !(location < count * 2.0f)) {
+            return TOUCH_POINT_ERROR; // ring の一周以上外 (NaN も)
         }
         if (crnt_note == NEW_NOTE) {
-            return static_cast<uint8_t>(std::round(location)); // Round to nearest integer for MIDI note
-        } else if (crnt_note < MAX_SENS) {
-            if ((location > static_cast<float>(crnt_note) + HISTERESIS) ||
-                (location < static_cast<float>(crnt_note) - HISTERESIS)) {
+            return wrap_pad(location, pad_count); // Round to nearest integer for MIDI note
+        } else if (crnt_note < pad_count) {
+            // ring の上で近い向きに測る
+            float diff = location - static_cast<float>(crnt_note);
+            if (diff >= count * 0.5f) {
+                diff -= count;
+            } else if (diff < -count * 0.5f) {
+                diff += count;
+            }
+            if ((diff > hysteresis) || (diff < -hysteresis)) {
                 // histeresis
-                return static_cast<uint8_t>(std::round(location));
+                return wrap_pad(location, pad_count);
             } else {
                 return crnt_note; // No change in note
             }
@@ -203,6 +263,12 @@ private:
             return TOUCH_POINT_ERROR;
         }
     }
+    /// 一番近いパッドの番号を 0-(pad_count-1) に折り返す
+    static auto wrap_pad(float location, uint16_t pad_count) -> uint16_t {
+        int pad = static_cast<int>(std::round(location)) % static_cast<int>(pad_count);
+        if (pad < 0) {pad += pad_count;}
+        return static_cast<uint16_t>(pad);
+    }
     auto intensity_to_velocity(int16_t intensity) const -> uint8_t {
         // Convert intensity to MIDI velocity (0-127)
         if (intensity < 0) {
@@ -214,6 +280,8 @@ private:
     }
 };
 
+static_assert(sizeof(TouchPoint) <= 16 + sizeof(MidiCallback), "TouchPoint: keep the fields at their real widths");
+
 // =========================================================
 //      QubitTouch Class
 // =========================================================
@@ -221,13 +289,17 @@ private:
 class QubitTouch {
     std::array<Pad, MAX_PADS> pads_;    // パッドの状態を保持する配列
     std::array<TouchPoint, MAX_TOUCH_POINTS> touch_points_; // Store detected touch points
-    std::function<void(uint8_t, uint8_t, uint8_t)> midi_callback_; // MIDI callback function
+    MidiCallback midi_callback_; // MIDI callback function
     size_t touch_count_ = 0; // Current number of touch points
+    uint16_t pad_count_ = MAX_PADS; // 実際につながっているパッドの数 (ring はここで折り返す)
+    TouchParams params_;                // SysEx で変えられる値 (frame の間でだけ変わる)
+    std::array<uint32_t, HOT_BLOCK_WORDS> hot_block_{}; // 閾値を超えたパッドがあるかまぼこの bit
+    uint64_t frame_time_us_ = 0; // 今処理している sweep の時刻 (MIDI/LED の遅延計測用)
     int16_t debug = 0;
 
 // impl QubitTouch
 public:
-    QubitTouch(std::function<void(uint8_t, uint8_t, uint8_t)> cb) : 
+    QubitTouch(MidiCallback cb) : 
         pads_{},
         touch_points_{},
         midi_callback_(cb),
@@ -238,9 +310,40 @@ public:
     auto deb_val() const -> int16_t {
         return debug;
     }
+    /// これから処理する sweep の時刻を設定する
+    void set_frame_time(uint64_t sweep_us) {
+        frame_time_us_ = sweep_us;
+    }
+    auto frame_time_us() const -> uint64_t {
+        return frame_time_us_;
+    }
+    /// つながっているパッドの数を設定する (起動時の探索の結果)
+    void set_pad_count(size_t count) {
+        if ((count == 0) || (count > MAX_PADS)) {count = MAX_PADS;}
+        pad_count_ = static_cast<uint16_t>(count);
+    }
+    auto pad_count() const -> size_t {
+        return pad_count_;
+    }
+    /// 閾値などを変える (frame と frame の間で呼ぶ)。移動平均の長さが変われば合計を作り直す
+    void set_params(const TouchParams& params) {
+        const bool refilter = (params.filter_len != params_.filter_len);
+        params_ = params;
+        if ((params_.filter_len == 0) || (params_.filter_len > PAD_FILTER_MAX)) {params_.filter_len = PAD_FILTER_MAX;}
+        if (refilter) {
+            for (auto& pad : pads_) {pad.refilter(params_.filter_len);}
+        }
+    }
+    auto params() const -> const TouchParams& {
+        return params_;
+    }
     /// パッドの値を設定する
-    void set_value(size_t pad_num, uint16_t value) {
-        pads_[pad_num].set_crnt(value);
+    void HOT_FUNC(set_value)(size_t pad_num, uint16_t value) {
+        pads_[pad_num].set_crnt(value, params_.filter_len);
+        if (pads_[pad_num].get_crnt() > params_.threshold) {
+            size_t block = pad_num / MAX_EACH_SENS;
+            hot_block_[block / 32] |= 1u << (block % 32);
+        }
     }
     /// パッドの値を取得する
     auto get_value(size_t pad_num) -> uint16_t const {
@@ -258,54 +361,55 @@ public:
     auto touch_point(size_t index) const -> const TouchPoint& {
         return touch_points_[index];
     }
-    /// 指定されたパッドの参照を取得する(マイナス値からMAX_PADSを超えた値を考慮)
+    /// 指定されたパッドの参照を取得する(マイナス値から pad_count_ を超えた値を考慮)
     auto proper_pad(int pad_num) -> Pad& {
         while (pad_num < 0) {
-            pad_num += MAX_PADS; // Wrap around to ensure valid index
+            pad_num += pad_count_; // Wrap around to ensure valid index
         }
         size_t index = static_cast<size_t>(pad_num);
-        return pads_[(pad_num + MAX_PADS) % MAX_PADS]; // Wrap around to ensure valid index
+        return pads_[(pad_num + pad_count_) % pad_count_]; // Wrap around to ensure valid index
     }
     /// 差分の符号が変化した時、その位置の値がある一定の値以上なら、そこをタッチポイントとする
-    void seek_and_update_touch_point() {
+    void HOT_FUNC(seek_and_update_touch_point)() {
         std::array<std::tuple<size_t, float, int16_t>, MAX_TOUCH_POINTS> temp_touch_point;
         temp_touch_point.fill(std::make_tuple(TouchPoint::INIT_VAL, TouchPoint::INIT_VAL, 0));
         size_t temp_index = 0;
 
-        // 1: 全パッドを走査し、差分の符号が変化した箇所をタッチポイントとみなし、temp_touch_point に保存
-        int16_t diff_before = 0;
-        for (size_t i = 0; i <= MAX_PADS; ++i) {
-            Pad& prev_pad = proper_pad(i-1);
-            int16_t diff_after = proper_pad(i).set_diff_from_before(prev_pad.get_crnt());
-            if ((diff_after > 0 ) && (diff_before < 0)) { // - -> + 変化時
-                int16_t value = prev_pad.get_crnt(); // Note the top flag
-                if (value > TOUCH_THRESHOLD) { // Example threshold for touch point
-                    prev_pad.note_top_flag();
-                    std::get<0>(temp_touch_point[temp_index++]) = (i >= 1) ? i - 1 : i - 1 + MAX_PADS;
+        // 1: 差分の符号が - -> + に変化した箇所 (両隣より大きい所) をタッチポイントとみなし、temp_touch_point に保存
+        //    閾値を超えたパッドがあるかまぼこだけを、パッドの番号の順に調べる
+        const size_t blocks = (pad_count_ + MAX_EACH_SENS - 1) / MAX_EACH_SENS;
+        for (size_t w = 0; (w < HOT_BLOCK_WORDS) && (temp_index < MAX_TOUCH_POINTS); ++w) {
+            uint32_t bits = hot_block_[w];
+            while ((bits != 0) && (temp_index < MAX_TOUCH_POINTS)) {
+                size_t block = w * 32 + static_cast<size_t>(__builtin_ctz(bits));
+                bits &= bits - 1;
+                if (block >= blocks) {break;}
+                size_t end = std::min<size_t>((block + 1) * MAX_EACH_SENS, pad_count_);
+                for (size_t p = block * MAX_EACH_SENS; p < end; ++p) {
+                    if (!is_peak(p)) {continue;}
+                    pads_[p].note_top_flag();
+                    std::get<0>(temp_touch_point[temp_index++]) = p;
                     if (temp_index >= MAX_TOUCH_POINTS) {
                         break; // Prevent overflow of touch points
                     }
                 }
             }
-            diff_before = diff_after;
         }
+        hot_block_.fill(0); // 次の sweep の set_value() で作り直す
         touch_count_ = temp_index; // Update the touch count
 
         // 2: タッチポイントの前後のパッドの値を足し、平均をとってパッドの位置と強度を確定する
+        //    合計と重みつきの合計は signal_kernels.h (RP2350 では DSP 命令で二つずつ)
         for (int i = 0; i < temp_index; ++i) {
-            int16_t sum = 0;
-            float locate = 0.0f;
             auto &tpi = temp_touch_point[i];
             int tp = static_cast<int>(std::get<0>(tpi));
-            int window_idx = 0; // Initialize window index for averaging
+            alignas(4) int16_t window[FINGER_RANGE*2 + 1];
             for (int j = 0; j < FINGER_RANGE*2 + 1; ++j) {
-                window_idx = static_cast<int>(j - FINGER_RANGE);
-                Pad& neighbor_pad = proper_pad(tp + window_idx);
-                int16_t tp_value = neighbor_pad.get_crnt();
-                sum += tp_value;
-                locate += (tp + window_idx) * tp_value; // Wrap around to ensure valid index
+                window[j] = static_cast<int16_t>(proper_pad(tp + j - static_cast<int>(FINGER_RANGE)).get_crnt());
             }
-            locate /= sum; // Calculate the average location based on intensity
+            WindowMoments m = window_moments(window, static_cast<int>(FINGER_RANGE));
+            int16_t sum = static_cast<int16_t>(m.sum);
+            float locate = static_cast<float>(tp * m.sum + m.moment) / sum; // Calculate the average location based on intensity
             std::get<1>(tpi) = locate;
             std::get<2>(tpi) = sum;
         }
@@ -329,9 +433,9 @@ public:
                     nearest_tp = &tp;
                 }
             }
-            if (nearest_tp && nearest_tp->is_near_here(location)) {
+            if (nearest_tp && nearest_tp->is_near_here(location, params_.close_range)) {
                 // 一番近いタッチポイントが、現在のタッチポイントに近い場合
-                nearest_tp->update_touch(location, intensity);
+                nearest_tp->update_touch(location, intensity, pad_count_, params_.hysteresis);
             } else {
                 new_touch_point(location, intensity, midi_callback_);
             }
@@ -341,7 +445,7 @@ public:
         erase_touch_point();
     }
     /// LEDを点灯させるためのコールバック関数をコールする
-    void lighten_leds(std::function<void(float, int16_t)> led_callback) {
+    void lighten_leds(LedCallback led_callback) {
         bool empty = true;
         for (auto& tp : touch_points_) {
             if (tp.is_touched()) {
@@ -358,18 +462,27 @@ public:
     }
 
 private:
-    void new_touch_point(float location, uint16_t intensity, std::function<void(uint8_t, uint8_t, uint8_t)> callback) {
+    /// 両隣 (ring で折り返す) より大きく、閾値を超えている
+    auto HOT_FUNC(is_peak)(size_t pad_num) -> bool {
+        int p = static_cast<int>(pad_num);
+        int16_t value = static_cast<int16_t>(pads_[pad_num].get_crnt());
+        if (value <= static_cast<int16_t>(params_.threshold)) {return false;}
+        int16_t diff_before = proper_pad(p - 1).get_crnt() - value;
+        int16_t diff_after = value - proper_pad(p + 1).get_crnt();
+        return (diff_before < 0) && (diff_after > 0);
+    }
+    void HOT_FUNC(new_touch_point)(float location, uint16_t intensity, MidiCallback callback) {
         for (auto& tp : touch_points_) {
             if (!tp.is_touched()) {
-                tp.new_touch(location, intensity, callback);
+                tp.new_touch(location, intensity, pad_count_, callback);
                 return;
             }
         }
     }
-    void erase_touch_point() {
+    void HOT_FUNC(erase_touch_point)() {
         for (auto& tp : touch_points_) {
             if (!tp.is_updated() && tp.is_touched()) {
-                tp.maybe_released();
+                tp.maybe_released(params_.release_hold);
             } else {
                 tp.clear_updated_flag(); // Clear the updated flag for the next cycle
             }
@@ -0,0 +1,170 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// =========================================================
+//      Scheduler Constants
+// =========================================================
+constexpr size_t MAX_SCHED_TASKS = 8;
+
+// =========================================================
+//      SchedTask Struct
+// =========================================================
+// 一つの周期タスクの設定と統計
+struct SchedTask {
+    using Func = void (*)();
+
+    const char* name;
+    Func        func;
+    uint32_t    period_us;      // 起動周期
+    uint32_t    deadline_us;    // 起動時刻からの締め切り
+    uint8_t     priority;       // 小さいほど優先
+    bool        enabled;
+    uint64_t    release_us;     // 次の起動時刻
+
+    // 統計
+    uint32_t    runs;
+    uint32_t    overruns;       // 締め切りまでに終わらなかった回数
+    uint32_t    skipped;        // 一周期以上遅れて飛ばした回数
+    uint32_t    max_jitter_us;  // 起動時刻からの遅れの最大
+    uint64_t    sum_jitter_us;
+    uint32_t    max_exec_us;
+    uint32_t    last_exec_us;
+    uint32_t    last_jitter_us;
+
+    void clear_stats() {
+        runs = overruns = skipped = 0;
+        max_jitter_us = max_exec_us = last_exec_us = last_jitter_us = 0;
+        sum_jitter_us = 0;
+    }
+    auto avg_jitter_us() const -> uint32_t {
+        return runs ? static_cast<uint32_t>(sum_jitter_us / runs) : 0;
+    }
+};
+
+// =========================================================
+//      FrameScheduler Class
+// =========================================================
+// Core0 の協調型スケジューラ。loop() から run() を呼ぶと、
+// 起動時刻を過ぎたタスクのうち優先度が最も高いものを一つだけ実行する
+// (同じ優先度なら締め切りの早いもの)
+class FrameScheduler {
+public:
+    using Clock = uint64_t (*)();
+
+private:
+    std::array<SchedTask, MAX_SCHED_TASKS> tasks_;
+    size_t  task_count_;
+    Clock   clock_;
+
+// impl FrameScheduler
+public:
+    /// clock は usec を返す関数 (ホスト上では偽の時計を渡せる)
+    explicit FrameScheduler(Clock clock) :
+        tasks_{},
+        task_count_(0),
+        clock_(clock) {}
+
+    /// タスクを登録し、その番号を返す
+    auto add_task(const char* name, SchedTask::Func func, uint32_t period_us,
+                  uint32_t deadline_us, uint8_t priority) -> int {
+        if (task_count_ >= MAX_SCHED_TASKS) {
+            return -1;
+        }
+        SchedTask& t = tasks_[task_count_];
+        t.name = name;
+        t.func = func;
+        t.period_us = period_us;
+        t.deadline_us = deadline_us;
+        t.priority = priority;
+        t.enabled = true;
+        t.release_us = clock_();
+        t.clear_stats();
+        return static_cast<int>(task_count_++);
+    }
+    void set_period(size_t id, uint32_t period_us) {
+        if (id < task_count_) {tasks_[id].period_us = period_us;}
+    }
+    void set_enabled(size_t id, bool en) {
+        if (id < task_count_) {tasks_[id].enabled = en;}
+    }
+    auto task(size_t id) const -> const SchedTask& {
+        return tasks_[id];
+    }
+    auto task_count() const -> size_t {
+        return task_count_;
+    }
+    auto now() const -> uint64_t {
+        return clock_();
+    }
+    /// 次に起動するタスクまでの時間 (すでに起動可能なら 0)
+    auto slack_us() const -> uint32_t {
+        uint64_t now_us = clock_();
+        uint64_t nearest = UINT64_MAX;
+        for (size_t i = 0; i < task_count_; ++i) {
+            const SchedTask& t = tasks_[i];
+            if (t.enabled && t.release_us < nearest) {nearest = t.release_us;}
+        }
+        if (nearest <= now_us) {return 0;}
+        uint64_t diff = nearest - now_us;
+        return diff > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(diff);
+    }
+    /// 起動可能なタスクを一つ実行する。実行したタスクの番号、なければ -1
+    auto run() -> int {
+        uint64_t now_us = clock_();
+        int best_id = -1;
+        SchedTask* best = nullptr;
+        for (size_t i = 0; i < task_count_; ++i) {
+            SchedTask& t = tasks_[i];
+            if (!t.enabled || (t.release_us > now_us)) {
+                continue;
+            }
+            if ((best == nullptr) ||
+                (t.priority < best->priority) ||
+                ((t.priority == best->priority) &&
+                 (t.release_us + t.deadline_us < best->release_us + best->deadline_us))) {
+                best = &t;
+                best_id = static_cast<int>(i);
+            }
+        }
+        if (best == nullptr) {
+            return -1;
+        }
+        execute(*best, now_us);
+        return best_id;
+    }
+
+private:
+    void execute(SchedTask& t, uint64_t start_us) {
+        uint32_t jitter = static_cast<uint32_t>(start_us - t.release_us);
+        t.func();
+        uint64_t end_us = clock_();
+        uint32_t exec = static_cast<uint32_t>(end_us - start_us);
+
+        t.runs += 1;
+        t.sum_jitter_us += jitter;
+        t.last_jitter_us = jitter;
+        if (jitter > t.max_jitter_us) {t.max_jitter_us = jitter;}
+        t.last_exec_us = exec;
+        if (exec > t.max_exec_us) {t.max_exec_us = exec;}
+        if (end_us > t.release_us + t.deadline_us) {
+            t.overruns += 1;
+        }
+
+        // 次の起動時刻。一周期以上遅れていたら、溜めずに今から数え直す
+        t.release_us += t.period_us;
+        if (t.release_us + t.period_us <= end_us) {
+            t.skipped += 1;
+            t.release_us = end_us;
+        }
+    }
+};
+#endif // SCHEDULER_H
@@ -0,0 +1,240 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef SENSOR_STREAM_H
+#define SENSOR_STREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "telemetry.h"
+#include "board.h"
+
+// =========================================================
+//      Sensor Stream Constants
+// =========================================================
+constexpr uint8_t STREAM_KEYFRAME_INTERVAL = 64; // この回数ごとに差分でない値を送る
+constexpr size_t STREAM_RING_SIZE = 4096 * BOARD_HEADROOM; // Core1 → Core0 のバッファ (2 のべき乗)
+
+// =========================================================
+//      Varint
+// =========================================================
+// 7bit ずつ、続きがあれば MSB を立てる (LEB128)
+inline auto varint_put(uint8_t* p, uint32_t v) -> size_t {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+inline auto varint_get(const uint8_t* p, const uint8_t* end, uint32_t& v) -> size_t {
+    v = 0;
+    size_t n = 0;
+    for (uint8_t shift = 0; (p + n < end) && (shift < 35); shift += 7) {
+        uint8_t b = p[n++];
+        v |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {return n;}
+    }
+    return 0; // 途中で切れている
+}
+inline auto zigzag(int32_t v) -> uint32_t {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+inline auto unzigzag(uint32_t v) -> int32_t {
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+// =========================================================
+//      SweepCodec
+// =========================================================
+// 一回の sweep (全パッドの raw - ref) を差分 + varint で詰める
+//  payload: [flags][seq varint][time varint][pad_count varint][value varint ...]
+//   flags bit0: keyframe (time は絶対値の下位 32bit、値は差分なし)
+//   それ以外は time も値も前の sweep からの差分 (zigzag)
+constexpr uint8_t STREAM_FLAG_KEYFRAME = 0x01;
+
+template <size_t PADS>
+class SweepEncoder {
+    uint16_t    prev_[PADS];
+    uint32_t    prev_time_us_;
+    uint32_t    seq_;
+    uint8_t     since_key_;
+    bool        force_key_;
+
+// impl SweepEncoder
+public:
+    static constexpr size_t MAX_FRAME = TELEMETRY_OVERHEAD + 1 + 5 * 3 + PADS * 3;
+
+    SweepEncoder() : prev_{}, prev_time_us_(0), seq_(0), since_key_(0), force_key_(true) {}
+
+    /// 次は必ず keyframe にする (フレームを捨てた後など)
+    void force_keyframe() {force_key_ = true;}
+    /// 一回分の sweep を buf に telemetry フレームとして書き、長さを返す
+    template <typename VALUES>
+    auto encode(uint8_t* buf, size_t cap, uint32_t time_us, const VALUES& values, size_t pads) -> size_t {
+        if (pads > PADS) {pads = PADS;}
+        bool key = force_key_ || (since_key_ + 1 >= STREAM_KEYFRAME_INTERVAL);
+        TelemetryWriter w(buf, cap, TelemetryType::SWEEP);
+        uint8_t tmp[5];
+        w.put(key ? STREAM_FLAG_KEYFRAME : 0);
+        put_varint(w, tmp, seq_++);
+        put_varint(w, tmp, key ? time_us : time_us - prev_time_us_);
+        put_varint(w, tmp, static_cast<uint32_t>(pads));
+        for (size_t i = 0; i < pads; ++i) {
+            uint16_t v = static_cast<uint16_t>(values[i]);
+            put_varint(w, tmp, key ? v : zigzag(static_cast<int32_t>(v) - prev_[i]));
+            prev_[i] = v;
+        }
+        prev_time_us_ = time_us;
+        since_key_ = key ? 0 : since_key_ + 1;
+        force_key_ = false;
+        return w.finish();
+    }
+
+private:
+    static void put_varint(TelemetryWriter& w, uint8_t* tmp, uint32_t v) {
+        size_t n = varint_put(tmp, v);
+        for (size_t i = 0; i < n; ++i) {w.put(tmp[i]);}
+    }
+};
+
+template <size_t PADS>
+class SweepDecoder {
+    uint16_t    values_[PADS];
+    uint32_t    time_us_;
+    uint32_t    seq_;
+    size_t      pads_;
+    bool        synced_;    // keyframe を受け取るまでは値が決まらない
+    uint32_t    lost_;
+
+// impl SweepDecoder
+public:
+    SweepDecoder() : values_{}, time_us_(0), seq_(0), pads_(0), synced_(false), lost_(0) {}
+
+    /// telemetry フレームの payload を一つ読む。値が確定したら true
+    auto decode(const uint8_t* p, size_t len) -> bool {
+        const uint8_t* end = p + len;
+        if (len < 1) {return false;}
+        bool key = (*p++ & STREAM_FLAG_KEYFRAME) != 0;
+        uint32_t seq, t, pads;
+        size_t n;
+        if ((n = varint_get(p, end, seq)) == 0) {return false;}
+        p += n;
+        if ((n = varint_get(p, end, t)) == 0) {return false;}
+        p += n;
+        if ((n = varint_get(p, end, pads)) == 0) {return false;}
+        p += n;
+        if (synced_ && (seq != seq_ + 1)) {
+            lost_ += seq - seq_ - 1;
+            synced_ = false;    // 抜けがあったら次の keyframe まで待つ
+        }
+        seq_ = seq;
+        if (!key && !synced_) {return false;}
+        if (pads > PADS) {return false;}
+        for (size_t i = 0; i < pads; ++i) {
+            uint32_t v;
+            if ((n = varint_get(p, end, v)) == 0) {return false;}
+            p += n;
+            values_[i] = key ? static_cast<uint16_t>(v) : static_cast<uint16_t>(values_[i] + unzigzag(v));
+        }
+        time_us_ = key ? t : time_us_ + t;
+        pads_ = pads;
+        synced_ = true;
+        return true;
+    }
+    auto value(size_t pad) const -> uint16_t {return values_[pad];}
+    auto time_us() const -> uint32_t {return time_us_;}
+    auto seq() const -> uint32_t {return seq_;}
+    auto pads() const -> size_t {return pads_;}
+    auto lost() const -> uint32_t {return lost_;}
+};
+
+// =========================================================
+//      ByteRing Class
+// =========================================================
+// 一方が書き、もう一方が読む (Core1 → Core0) ための lock なしリングバッファ
+template <size_t N>
+class ByteRing {
+    static_assert((N & (N - 1)) == 0, "ByteRing size must be a power of two");
+
+    uint8_t                 buf_[N];
+    std::atomic<uint32_t>   head_;  // 書く側だけが進める
+    std::atomic<uint32_t>   tail_;  // 読む側だけが進める
+
+// impl ByteRing
+public:
+    ByteRing() : buf_{}, head_(0), tail_(0) {}
+
+    auto used() const -> size_t {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    auto free_space() const -> size_t {return N - used();}
+    /// 全部入る時だけ書く
+    auto push(const uint8_t* data, size_t len) -> bool {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (N - (head - tail_.load(std::memory_order_acquire)) < len) {
+            return false;
+        }
+        for (size_t i = 0; i < len; ++i) {
+            buf_[(head + i) & (N - 1)] = data[i];
+        }
+        head_.store(head + static_cast<uint32_t>(len), std::memory_order_release);
+        return true;
+    }
+    /// 連続して読める部分を返す (折り返しの手前まで)
+    auto peek(const uint8_t*& data) const -> size_t {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        size_t avail = head_.load(std::memory_order_acquire) - tail;
+        size_t idx = tail & (N - 1);
+        size_t contiguous = N - idx;
+        data = &buf_[idx];
+        return avail < contiguous ? avail : contiguous;
+    }
+    /// 先頭から len byte を折り返しをまたいで dst に写す (読んだことにはしない)
+    auto copy_out(uint8_t* dst, size_t len) const -> bool {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) - tail < len) {
+            return false;
+        }
+        for (size_t i = 0; i < len; ++i) {
+            dst[i] = buf_[(tail + i) & (N - 1)];
+        }
+        return true;
+    }
+    void consume(size_t len) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + static_cast<uint32_t>(len), std::memory_order_release);
+    }
+};
+
+/// ring の先頭から、今 room() byte に丸ごと入るフレームだけを write(frame, len) に渡す (待たない)
+/// fifo より大きいフレームはいつまでも入らず後ろを全部止めてしまうので、読み捨てる
+/// frame は cap byte の作業場所。返り値は読み捨てたフレームの数
+template <size_t N, typename ROOM, typename WRITE>
+auto drain_frames(ByteRing<N>& ring, uint8_t* frame, size_t cap, size_t fifo, ROOM room, WRITE write) -> uint32_t {
+    uint32_t dropped = 0;
+    while (ring.copy_out(frame, TELEMETRY_OVERHEAD - 1)) {
+        size_t len = TELEMETRY_OVERHEAD + (frame[2] | (static_cast<size_t>(frame[3]) << 8));
+        if ((frame[0] != TELEMETRY_SYNC) || (len > cap)) {
+            // 書く側は丸ごとのフレームしか入れないので、ここには来ないはず
+            ring.consume(ring.used());
+            return dropped + 1;
+        }
+        if (ring.used() < len) {break;}
+        if (len > fifo) {
+            ring.consume(len);
+            dropped += 1;
+            continue;
+        }
+        if (room() < len) {break;}
+        if (!ring.copy_out(frame, len)) {break;}
+        write(frame, len);
+        ring.consume(len);
+    }
+    return dropped;
+}
+#endif // SENSOR_STREAM_H
@@ -0,0 +1,91 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef SIGNAL_KERNELS_H
+#define SIGNAL_KERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
+
+// =========================================================
+//      Signal Kernels
+// =========================================================
+// タッチの重心と LED の減衰の計算
+//  *_ref:    portable な基準 (RP2040 とホスト)
+//  *_dual16: 16bit 二つを 32bit に詰めて積和する版。Cortex-M33 (RP2350) では SMLAD 一命令になる
+// どちらを使うかはコンパイル時に決まる。ホストでは SMLAD を C で真似て、両方を tools/kernel_check で比べる
+//
+// 減衰は float のままにしてある。RP2350 では FPU の命令になり、RP2040 では ROM の float 関数になる
+
+/// 窓の値の合計と、窓の中心からの距離で重みをつけた合計
+struct WindowMoments {
+    int32_t     sum;
+    int32_t     moment;
+};
+
+/// 窓 (2 * radius + 1 個) の moments: portable
+inline auto window_moments_ref(const int16_t* v, int radius) -> WindowMoments {
+    WindowMoments m{0, 0};
+    for (int j = -radius; j <= radius; ++j) {
+        m.sum += v[j + radius];
+        m.moment += j * v[j + radius];
+    }
+    return m;
+}
+
+/// 下位に lo、上位に hi を詰める
+inline auto dual16(int lo, int hi) -> uint32_t {
+    return static_cast<uint32_t>(static_cast<uint16_t>(lo)) | (static_cast<uint32_t>(static_cast<uint16_t>(hi)) << 16);
+}
+/// acc + x.lo * y.lo + x.hi * y.hi (符号付き 16bit)
+inline auto dual16_mac(uint32_t x, uint32_t y, int32_t acc) -> int32_t {
+#if defined(__ARM_FEATURE_DSP)
+    return __smlad(x, y, acc);
+#else
+    int32_t lo = static_cast<int16_t>(x) * static_cast<int16_t>(y);
+    int32_t hi = static_cast<int16_t>(x >> 16) * static_cast<int16_t>(y >> 16);
+    return static_cast<int32_t>(static_cast<uint32_t>(acc) + static_cast<uint32_t>(lo) + static_cast<uint32_t>(hi));
+#endif
+}
+
+/// 窓 (2 * radius + 1 個) の moments: 二つずつ積和する
+inline auto window_moments_dual16(const int16_t* v, int radius) -> WindowMoments {
+    const int n = 2 * radius + 1;
+    const uint32_t ones = dual16(1, 1);
+    int32_t sum = 0;
+    int32_t moment = 0;
+    int j = 0;
+    for (; j + 1 < n; j += 2) {
+        uint32_t pair;
+        std::memcpy(&pair, v + j, sizeof(pair));    // little endian: v[j] が下位
+        sum = dual16_mac(pair, ones, sum);
+        moment = dual16_mac(pair, dual16(j - radius, j + 1 - radius), moment);
+    }
+    if (j < n) {
+        sum += v[j];
+        moment += (j - radius) * v[j];
+    }
+    return WindowMoments{sum, moment};
+}
+
+inline auto window_moments(const int16_t* v, int radius) -> WindowMoments {
+#if defined(__ARM_FEATURE_DSP)
+    return window_moments_dual16(v, radius);
+#else
+    return window_moments_ref(v, radius);
+#endif
+}
+
+/// 重心から dist 離れた LED の明るさ (0 未満なら、そこから先は光らない)
+inline auto falloff(float dist, float slope) -> int16_t {
+    return static_cast<int16_t>(255 - dist * slope);
+}
+
+#endif // SIGNAL_KERNELS_H
@@ -15,6 +15,7 @@
  * GNU LESSER GENERAL PUBLIC LICENSE, V3.0
  */
 #include "sk6812.h"
+#include "placement.h"
 
 SK6812::SK6812(uint16_t num, uint8_t pin, PIO pio, int sm) {
     alloc(num);
@@ -95,7 +96,7 @@ void SK6812::clear()
 }
 
 // Update the SK6812 pixels
-void SK6812::show(void) {
+void HOT_FUNC(SK6812::show)(void) {
     for (uint16_t i = 0; i < numLEDs; i++) 
     {
         uint8_t redPtr = this->pixels[i*4];
@@ -0,0 +1,152 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstdint>
+#include <cstddef>
+
+// =========================================================
+//      Telemetry Frame
+// =========================================================
+// USB CDC (Serial) とクラスタの UART (cluster.h) に流すバイナリレコードの枠
+//  [SYNC][type][len lo][len hi][payload ...][checksum]
+//  checksum: type から payload 最後までの和を 0 にする 1byte
+constexpr uint8_t TELEMETRY_SYNC = 0xA5;
+constexpr size_t TELEMETRY_OVERHEAD = 5;
+// rp2040 の TinyUSB の CDC 送信 FIFO (CFG_TUD_CDC_TX_BUFSIZE)。Serial.availableForWrite() はこれを超えない
+// 一度に Serial.write() するフレームはこれ以下にする (大きいと、いつまでも空きが足りない)
+constexpr size_t TELEMETRY_TX_FIFO = 256;
+
+enum class TelemetryType : uint8_t {
+    PROFILE = 'P',  // 区間ごとの処理時間
+    SWEEP = 'S',    // センサ値のストリーム
+    FLIGHT = 'F',   // flight recorder の dump ([offset u32][data ...] を頭から順に)
+    CLUSTER_POLL = 'C',     // クラスタ: leader → follower (UART)
+    CLUSTER_REPLY = 'c',    // クラスタ: follower → leader (UART)
+};
+
+class TelemetryWriter {
+    uint8_t*    buf_;
+    size_t      cap_;
+    size_t      len_;
+    bool        overflow_;
+
+// impl TelemetryWriter
+public:
+    /// buf に一つのフレームを組み立てる
+    TelemetryWriter(uint8_t* buf, size_t cap, TelemetryType type) :
+        buf_(buf), cap_(cap), len_(0), overflow_(false) {
+        put(TELEMETRY_SYNC);
+        put(static_cast<uint8_t>(type));
+        put(0);
+        put(0);
+    }
+    void put(uint8_t b) {
+        if (len_ < cap_) {
+            buf_[len_++] = b;
+        } else {
+            overflow_ = true;
+        }
+    }
+    void put16(uint16_t v) {
+        put(static_cast<uint8_t>(v));
+        put(static_cast<uint8_t>(v >> 8));
+    }
+    void put32(uint32_t v) {
+        put16(static_cast<uint16_t>(v));
+        put16(static_cast<uint16_t>(v >> 16));
+    }
+    /// 長さと checksum を書き込み、フレーム全体の長さを返す (入りきらなければ 0)
+    auto finish() -> size_t {
+        if (cap_ < TELEMETRY_OVERHEAD) {return 0;}
+        size_t payload = len_ - 4;
+        buf_[2] = static_cast<uint8_t>(payload);
+        buf_[3] = static_cast<uint8_t>(payload >> 8);
+        uint8_t sum = 0;
+        for (size_t i = 1; i < len_; ++i) {
+            sum += buf_[i];
+        }
+        put(static_cast<uint8_t>(-sum));
+        return overflow_ ? 0 : len_;
+    }
+    auto room() const -> size_t {
+        return (cap_ > len_ + 1) ? cap_ - len_ - 1 : 0;
+    }
+};
+
+// 一 byte ずつ受け取り、checksum の合ったフレームを取り出す
+// 長すぎる / checksum の合わないものは捨てて、次の SYNC から探し直す
+template <size_t MAX_PAYLOAD>
+class TelemetryReader {
+    enum class Step : uint8_t {SYNC, TYPE, LEN_LO, LEN_HI, PAYLOAD, SUM};
+
+    uint8_t     buf_[MAX_PAYLOAD];
+    Step        step_;
+    uint8_t     type_;
+    uint16_t    len_;
+    uint16_t    pos_;
+    uint8_t     sum_;
+    uint32_t    frames_;
+    uint32_t    errors_;
+
+// impl TelemetryReader
+public:
+    TelemetryReader() : buf_{}, step_(Step::SYNC), type_(0), len_(0), pos_(0), sum_(0), frames_(0), errors_(0) {}
+
+    /// 一 byte 入れる。フレームが揃ったら true (次の feed() までは type() / payload() で読める)
+    auto feed(uint8_t b) -> bool {
+        switch (step_) {
+        case Step::SYNC:
+            if (b == TELEMETRY_SYNC) {step_ = Step::TYPE;}
+            return false;
+        case Step::TYPE:
+            type_ = b;
+            sum_ = b;
+            step_ = Step::LEN_LO;
+            return false;
+        case Step::LEN_LO:
+            len_ = b;
+            sum_ += b;
+            step_ = Step::LEN_HI;
+            return false;
+        case Step::LEN_HI:
+            len_ |= static_cast<uint16_t>(b << 8);
+            sum_ += b;
+            pos_ = 0;
+            if (len_ > MAX_PAYLOAD) {
+                errors_ += 1;
+                step_ = Step::SYNC;
+            } else {
+                step_ = (len_ == 0) ? Step::SUM : Step::PAYLOAD;
+            }
+            return false;
+        case Step::PAYLOAD:
+            buf_[pos_++] = b;
+            sum_ += b;
+            if (pos_ >= len_) {step_ = Step::SUM;}
+            return false;
+        case Step::SUM:
+            step_ = Step::SYNC;
+            if (static_cast<uint8_t>(sum_ + b) != 0) {
+                errors_ += 1;
+                return false;
+            }
+            frames_ += 1;
+            return true;
+        }
+        return false;
+    }
+    /// 途中まで読んだものを捨てる
+    void reset() {step_ = Step::SYNC;}
+
+    auto type() const -> TelemetryType {return static_cast<TelemetryType>(type_);}
+    auto payload() const -> const uint8_t* {return buf_;}
+    auto length() const -> size_t {return len_;}
+    auto frames() const -> uint32_t {return frames_;}
+    auto errors() const -> uint32_t {return errors_;}
+};
+#endif // TELEMETRY_H
@@ -0,0 +1,97 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef TEXT_BUF_H
+#define TEXT_BUF_H
+
+#include <cstdint>
+#include <cstddef>
+
+// =========================================================
+//      TextBuf Class
+// =========================================================
+// 表示・テレメトリ用の固定長文字列。heap を使わない
+// 入りきらない分は切り捨てる
+template <size_t N>
+class TextBuf {
+    static_assert(N >= 2, "TextBuf needs room for a terminator");
+
+    char    buf_[N];
+    size_t  len_;
+
+// impl TextBuf
+public:
+    TextBuf() : buf_{}, len_(0) {}
+
+    void clear() {
+        len_ = 0;
+        buf_[0] = '\0';
+    }
+    auto c_str() const -> const char* {return buf_;}
+    auto length() const -> size_t {return len_;}
+    static constexpr auto capacity() -> size_t {return N - 1;}
+
+    auto add(char c) -> TextBuf& {
+        if (len_ < N - 1) {
+            buf_[len_++] = c;
+            buf_[len_] = '\0';
+        }
+        return *this;
+    }
+    auto add(const char* str) -> TextBuf& {
+        while (*str != '\0') {
+            add(*str++);
+        }
+        return *this;
+    }
+    /// 符号なし整数。width を指定すると右詰め
+    auto add_uint(uint32_t value, size_t width = 0, char fill = ' ') -> TextBuf& {
+        char digits[10];
+        size_t n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        for (size_t i = n; i < width; ++i) {
+            add(fill);
+        }
+        while (n > 0) {
+            add(digits[--n]);
+        }
+        return *this;
+    }
+    auto add_int(int32_t value, size_t width = 0) -> TextBuf& {
+        if (value < 0) {
+            add('-');
+            return add_uint(static_cast<uint32_t>(-(value + 1)) + 1, width > 0 ? width - 1 : 0);
+        }
+        return add_uint(static_cast<uint32_t>(value), width);
+    }
+    /// 小数点以下 decimals 桁の固定小数点表記 (四捨五入)
+    auto add_fixed(float value, uint8_t decimals = 1) -> TextBuf& {
+        uint32_t scale = 1;
+        for (uint8_t i = 0; i < decimals; ++i) {scale *= 10;}
+        if (value < 0.0f) {
+            add('-');
+            value = -value;
+        }
+        uint32_t scaled = static_cast<uint32_t>(value * scale + 0.5f);
+        add_uint(scaled / scale);
+        if (decimals > 0) {
+            add('.');
+            add_uint(scaled % scale, decimals, '0');
+        }
+        return *this;
+    }
+    /// 長さが width になるまで c を足す
+    auto pad_to(size_t width, char c = ' ') -> TextBuf& {
+        while (len_ < width) {
+            if (len_ >= N - 1) {break;}
+            add(c);
+        }
+        return *this;
+    }
+};
+#endif // TEXT_BUF_H
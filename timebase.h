@@ -0,0 +1,112 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <cstdint>
+#include <atomic>
+#ifdef ARDUINO
+#include <Arduino.h>  // time_us_64()
+#endif
+
+// =========================================================
+//      Timebase Class
+// =========================================================
+// ハードウェアの 64bit usec タイマーを元にした時刻。ラップアラウンドしない
+// clock は差し替えられる (ホスト上では偽の時計を入れる)
+class Timebase {
+public:
+    using Clock = uint64_t (*)();
+
+    static void set_clock(Clock clock) {clock_ref() = clock;}
+    static auto clock() -> Clock {return clock_ref();}
+
+    /// 現在時刻 [usec]
+    static auto now_us() -> uint64_t {
+        Clock c = clock_ref();
+        return c ? c() : 0;
+    }
+    /// since からの経過時間 [usec] (32bit に収まらなければ飽和、since が先なら 0)
+    static auto elapsed_us(uint64_t since) -> uint32_t {
+        return elapsed_us(since, now_us());
+    }
+    static auto elapsed_us(uint64_t since, uint64_t until) -> uint32_t {
+        return saturate(until - since);
+    }
+
+private:
+    /// 差は符号付きで見る (64bit の折り返しをまたいでも正しい)
+    static auto saturate(uint64_t diff) -> uint32_t {
+        if (static_cast<int64_t>(diff) < 0) {return 0;}
+        return (diff > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(diff);
+    }
+    static auto clock_ref() -> Clock& {
+#ifdef ARDUINO
+        static Clock clock = time_us_64;
+#else
+        static Clock clock = nullptr;
+#endif
+        return clock;
+    }
+};
+
+// =========================================================
+//      Deadline Struct
+// =========================================================
+// ある時刻までの締め切り (loop1 の sweep の周期、MIDI の読み込みの持ち時間)
+struct Deadline {
+    uint64_t    at_us;
+
+    static auto in_us(uint32_t us) -> Deadline {
+        return Deadline{Timebase::now_us() + us};
+    }
+    auto expired() const -> bool {
+        return static_cast<int64_t>(Timebase::now_us() - at_us) >= 0;
+    }
+    /// 残り時間 [usec]、過ぎていたら 0
+    auto remaining_us() const -> uint32_t {
+        return Timebase::elapsed_us(Timebase::now_us(), at_us);
+    }
+    /// 締め切りを period だけ先に進める (遅れても周期はずれない)
+    void advance(uint32_t period_us) {
+        at_us += period_us;
+    }
+};
+
+// =========================================================
+//      SharedTime Class
+// =========================================================
+// 一方の core が書き、もう一方が読む 64bit の時刻 (RP2040 では 64bit の読み書きが二回に分かれる)
+// 書いている間は seq を奇数にする。読む側は、前後で同じ偶数の seq が読めた時の値だけを使う
+class SharedTime {
+    volatile uint64_t       us_;
+    std::atomic<uint32_t>   seq_;
+
+// impl SharedTime
+public:
+    SharedTime() : us_(0), seq_(0) {}
+
+    /// 書く側 (一つの core だけ)
+    void store(uint64_t us) {
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        us_ = us;
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+    /// 読む側。書いている途中なら読み直す
+    auto load() const -> uint64_t {
+        for (;;) {
+            uint32_t before = seq_.load(std::memory_order_acquire);
+            uint64_t us = us_;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (((before & 1) == 0) && (seq_.load(std::memory_order_relaxed) == before)) {
+                return us;
+            }
+        }
+    }
+};
+#endif // TIMEBASE_H
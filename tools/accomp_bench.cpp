@@ -0,0 +1,165 @@
+/* ========================================
+ *
+ *  accomp_bench.cpp
+ *    description: 伴奏 (ch16 で受けた Note) の LED 計算の処理時間を比べる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  合成した MIDI ストリーム (和音の打鍵と、短い音の連打) を流しながら、
+ *   scan   : 128 個の配列に velocity を書き、毎フレーム全センサを調べて光らせる (以前の方法)
+ *   sparse : ActiveNoteSet に入れ、変わった Note の所だけ AccompanimentLayer を描き直して重ねる
+ *  の一 LED フレームあたりの時間を測る。出力が同じであることも確かめる
+ *  出力が違うか、dense (和音 + 短い音の連打) で sparse の p50 が scan より遅ければ終了コード 1
+ *
+ *  build / run:
+ *    make -C tools accomp_bench && tools/accomp_bench [-n frames] [-s seed]
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "../qtouch.h"
+#include "../led_frame.h"
+#include "../note_set.h"
+#include "../constants.h"
+
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us) {
+  (void)status; (void)note; (void)velocity; (void)sweep_us;
+}
+void debug_pt(int pt) {
+  (void)pt;
+}
+
+/*----------------------------------------------------------------------------*/
+//     Synthetic MIDI stream
+/*----------------------------------------------------------------------------*/
+struct NoteEvent {
+  uint8_t note;
+  uint8_t velocity;   // 0: Note Off
+};
+
+class Rng {
+  uint32_t s_;
+public:
+  explicit Rng(uint32_t seed) : s_(seed * 2654435761u + 1) {}
+  auto next() -> uint32_t {
+    s_ ^= s_ << 13;
+    s_ ^= s_ >> 17;
+    s_ ^= s_ << 5;
+    return s_;
+  }
+  auto below(uint32_t n) -> uint32_t {return next() % n;}
+};
+
+/// LED フレームごとのイベント列。voices: 同時に鳴らす音数、burst: 一フレームに届く短い音の数
+void make_stream(std::vector<std::vector<NoteEvent>>& frames, int count, int voices, int burst, uint32_t seed) {
+  Rng rng(seed);
+  std::vector<uint8_t> sounding;
+  frames.assign(count, {});
+  const int lo = TouchPoint::OFFSET_NOTE;
+  for (int f = 0; f < count; f++) {
+    auto& ev = frames[f];
+    // 和音は 30 フレームくらいで入れ替える
+    if (rng.below(30) == 0) {
+      for (uint8_t n : sounding) {ev.push_back({n, 0});}
+      sounding.clear();
+      int root = lo + static_cast<int>(rng.below(ZONE_PADS - 24));
+      for (int v = 0; v < voices; v++) {
+        uint8_t n = static_cast<uint8_t>(root + rng.below(24));
+        ev.push_back({n, static_cast<uint8_t>(40 + rng.below(80))});
+        sounding.push_back(n);
+      }
+    }
+    for (int b = 0; b < burst; b++) {
+      uint8_t n = static_cast<uint8_t>(lo + rng.below(ZONE_PADS));
+      ev.push_back({n, static_cast<uint8_t>(30 + rng.below(60))});
+      ev.push_back({n, 0});
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+//     Benchmark
+/*----------------------------------------------------------------------------*/
+struct Stats {
+  uint32_t p50, p99;
+  double mean;
+};
+
+auto summarize(std::vector<uint32_t>& v) -> Stats {
+  std::sort(v.begin(), v.end());
+  double sum = 0.0;
+  for (uint32_t x : v) {sum += x;}
+  return {v[v.size() / 2], v[std::min(v.size() - 1, v.size() * 99 / 100)], sum / v.size()};
+}
+
+int main(int argc, char* argv[]) {
+  int frames = 20000;
+  uint32_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {frames = std::atoi(argv[i + 1]);}
+    else if (std::strcmp(argv[i], "-s") == 0) {seed = static_cast<uint32_t>(std::atoi(argv[i + 1]));}
+  }
+  if (frames < 100) {frames = 100;}
+
+  struct Case {const char* name; int voices; int burst;};
+  const Case CASES[] = {{"idle", 0, 0}, {"3-note", 3, 0}, {"12-note", 12, 0}, {"dense", 12, 8}};
+  bool ok = true;
+  std::printf("%-8s %7s  %8s %8s %9s  %8s %8s %9s  %8s  %s\n", "stream", "ev/frm",
+              "scan p50", "p99", "mean[ns]", "sparse50", "p99", "mean[ns]", "rebuilds", "same");
+  for (const Case& c : CASES) {
+    std::vector<std::vector<NoteEvent>> stream;
+    make_stream(stream, frames, c.voices, c.burst, seed);
+    size_t events = 0;
+    for (auto& ev : stream) {events += ev.size();}
+
+    uint8_t status[MAX_MIDI_NOTE] = {};
+    ActiveNoteSet<MAX_MIDI_NOTE> notes;
+    AccompanimentLayer layer;
+    LedFrame a, b;
+    std::vector<uint32_t> scan_ns, sparse_ns;
+    scan_ns.reserve(frames);
+    sparse_ns.reserve(frames);
+    bool same = true;
+    using clock = std::chrono::steady_clock;
+    for (int f = 0; f < frames; f++) {
+      auto t0 = clock::now();
+      for (const NoteEvent& e : stream[f]) {status[e.note] = e.velocity;}
+      a.clear_touch();
+      for (int i = 0; i < MAX_SENS; i++) {
+        int idx = i % ZONE_PADS + TouchPoint::OFFSET_NOTE;
+        if (status[idx] > 0) {a.set_by_touch(i, status[idx], false);}
+      }
+      auto t1 = clock::now();
+      for (const NoteEvent& e : stream[f]) {notes.set(e.note, e.velocity);}
+      b.clear_touch();
+      layer.update(notes, TouchPoint::OFFSET_NOTE);
+      layer.apply(b);
+      auto t2 = clock::now();
+      scan_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+      sparse_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()));
+      for (int i = 0; i < MAX_LIGHT; i++) {
+        if (std::memcmp(a.pixel(i), b.pixel(i), 3) != 0) {same = false;}
+      }
+    }
+    Stats s1 = summarize(scan_ns);
+    Stats s2 = summarize(sparse_ns);
+    std::printf("%-8s %7.2f  %8u %8u %9.1f  %8u %8u %9.1f  %8u  %s\n", c.name,
+                static_cast<double>(events) / frames,
+                s1.p50, s1.p99, s1.mean, s2.p50, s2.p99, s2.mean, layer.rebuilds(), same ? "yes" : "NO");
+    if (!same) {ok = false;}
+    if ((std::strcmp(c.name, "dense") == 0) && (s2.p50 > s1.p50)) {
+      std::printf("dense: sparse p50 %u ns is slower than scan %u ns\n", s2.p50, s1.p50);
+      ok = false;
+    }
+  }
+  std::printf("%s\n", ok ? "all ok" : "FAILED");
+  return ok ? 0 : 1;
+}
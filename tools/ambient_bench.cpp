@@ -0,0 +1,143 @@
+/* ========================================
+ *
+ *  ambient_bench.cpp
+ *    description: 白色 LED の背景放射 (ambient.h) の一フレームの時間を、以前の sin() と比べる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  16 / 32 かまぼこ (96 / 192 LED) について
+ *   sin : LED ごとに float の std::sin を呼ぶ (以前の set_led_for_wave())
+ *   lut : AmbientAnimator の位相アキュムレータとテーブル
+ *  の一 LED フレームあたりの時間を測る
+ *  初期値の AmbientAnimator が、以前の 1 秒周期・隣と 1/10 周期ずれ・0-20 の波と
+ *  どの LED・どの時刻でも AMBIENT_TOLERANCE 以内で同じになることも確かめる
+ *
+ *  build / run:
+ *    make -C tools ambient_bench && tools/ambient_bench [-n frames]
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "../ambient.h"
+#include "../constants.h"
+
+namespace {
+constexpr int AMBIENT_TOLERANCE = 1;        // 明るさ (0-255) の差
+constexpr uint32_t OLD_TICK_US = 2000;      // 以前の globalTime は 2msec ごとに一つ進む
+constexpr float PI_F = 3.14159265358979f;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+/// 以前の set_led_for_wave() (global_time は 2msec 単位)
+void old_wave(uint16_t global_time, size_t num, uint8_t* out) {
+  float tm = static_cast<float>(global_time);
+  for (size_t i = 0; i < num; i++) {
+    float phase = (tm * 0.002f + static_cast<float>(i) * 0.1f) * 2 * PI_F;
+    out[i] = static_cast<uint8_t>(10.0f * (std::sin(phase)) + 10.0f);
+  }
+}
+
+struct Stats {
+  uint32_t p50, p99;
+  double mean;
+};
+auto summarize(std::vector<uint32_t>& v) -> Stats {
+  std::sort(v.begin(), v.end());
+  double sum = 0.0;
+  for (uint32_t x : v) {sum += x;}
+  return {v[v.size() / 2], v[std::min(v.size() - 1, v.size() * 99 / 100)], sum / v.size()};
+}
+
+/// 以前の波との違い (5 秒分、2msec ごと、全 LED)
+void compare_defaults() {
+  AmbientAnimator ambient;
+  uint8_t old_px[MAX_LIGHT];
+  int max_diff = 0;
+  uint64_t diff_sum = 0;
+  uint64_t samples = 0;
+  for (uint16_t tick = 0; tick < 2500; tick++) {
+    old_wave(tick, MAX_LIGHT, old_px);
+    ambient.update(static_cast<uint64_t>(tick) * OLD_TICK_US);
+    for (size_t i = 0; i < static_cast<size_t>(MAX_LIGHT); i++) {
+      int d = std::abs(static_cast<int>(ambient.level(i)) - static_cast<int>(old_px[i]));
+      max_diff = std::max(max_diff, d);
+      diff_sum += d;
+      samples += 1;
+    }
+  }
+  std::printf("defaults vs old sin(): max diff %d, mean diff %.3f (%llu samples)\n", max_diff,
+              static_cast<double>(diff_sum) / samples, static_cast<unsigned long long>(samples));
+  check(max_diff <= AMBIENT_TOLERANCE, "default ambient matches the old 1 Hz / 0.1-cycle / 0-20 wave");
+
+  // 一周期後に同じ所へ戻る (位相アキュムレータの端数で遅れない)
+  AmbientAnimator a;
+  a.update(0);
+  const uint32_t p0 = a.phase();
+  a.update(3600ull * 1000000);     // 一時間
+  const int32_t drift = static_cast<int32_t>(a.phase() - p0);
+  std::printf("phase drift after one hour: %d / 2^32 cycle\n", drift);
+  check(std::abs(drift) < (1 << 24), "one hour of 1 Hz stays within one table step");
+}
+}
+
+int main(int argc, char* argv[]) {
+  int frames = 20000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {frames = std::atoi(argv[i + 1]);}
+  }
+  if (frames < 100) {frames = 100;}
+
+  compare_defaults();
+
+  std::printf("%-6s %5s  %8s %8s %9s  %8s %8s %9s  %s\n", "blocks", "leds",
+              "sin p50", "p99", "mean[ns]", "lut p50", "p99", "mean[ns]", "speedup");
+  const int BLOCKS[] = {16, 32};
+  for (int blocks : BLOCKS) {
+    const size_t leds = static_cast<size_t>(blocks) * MAX_EACH_LIGHT;
+    AmbientAnimator ambient;
+    uint8_t px[MAX_LIGHT];
+    volatile uint32_t sink = 0;
+    std::vector<uint32_t> sin_ns, lut_ns;
+    sin_ns.reserve(frames);
+    lut_ns.reserve(frames);
+    using clock = std::chrono::steady_clock;
+    for (int f = 0; f < frames; f++) {
+      // LED のフレームは約 60Hz
+      const uint64_t now_us = static_cast<uint64_t>(f) * 16667;
+      auto t0 = clock::now();
+      old_wave(static_cast<uint16_t>(now_us / OLD_TICK_US), leds, px);
+      auto t1 = clock::now();
+      sink = sink + px[f % leds];
+      ambient.update(now_us);
+      ambient.render(leds, [&px](size_t i, uint8_t level) {px[i] = level;});
+      auto t2 = clock::now();
+      sink = sink + px[f % leds];
+      sin_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+      lut_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()));
+    }
+    Stats s1 = summarize(sin_ns);
+    Stats s2 = summarize(lut_ns);
+    std::printf("%-6d %5zu  %8u %8u %9.1f  %8u %8u %9.1f  %6.1fx\n", blocks, leds,
+                s1.p50, s1.p99, s1.mean, s2.p50, s2.p99, s2.mean, s1.mean / s2.mean);
+    char what[64];
+    std::snprintf(what, sizeof(what), "%d blocks: table lookup is faster than sin()", blocks);
+    check(s2.mean < s1.mean, what);
+  }
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+/* ========================================
+ *
+ *  calib_sim.cpp
+ *    description: 偽の flash で calibration store の書き込みと読み出しを確かめる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  RAM の上に flash (消すと 0xff、書くと 1 → 0 だけ) を作り、
+ *  CalibStore の encode / decode / load / save と calib_agrees() を
+ *  電源断・壊れた record・違う version・sector の使い回しの場面で動かす
+ *  sector が一つしかない時 (FS がある時) は書かず、電源断でも前の record が残ることも確かめる
+ *  温め起動の前に、保存した topology と今つながっているかまぼこを Topology::matches() で比べることも確かめる
+ *
+ *  build / run:
+ *    make -C tools calib_sim && tools/calib_sim [-n saves]
+ *  全部通れば終了コード 0、どれかが違えば 1
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../calib_store.h"
+
+/*----------------------------------------------------------------------------*/
+//     Mock flash
+/*----------------------------------------------------------------------------*/
+namespace {
+constexpr size_t SECTOR = 4096;
+constexpr size_t MAX_SECTORS = 4;
+uint8_t flash[SECTOR * MAX_SECTORS];
+size_t flash_size = SECTOR * 2;
+uint32_t sector_erases[MAX_SECTORS];
+long program_budget = -1;   // 0 以上: ここまで書いたところで電源が切れる
+int failures = 0;
+
+int mock_erase(size_t offset) {
+  if ((offset % SECTOR) != 0) {return 1;}
+  std::memset(flash + offset, 0xff, SECTOR);
+  sector_erases[offset / SECTOR] += 1;
+  return 0;
+}
+int mock_program(size_t offset, const uint8_t* data, size_t len) {
+  if (((offset % CALIB_PAGE_SIZE) != 0) || ((len % CALIB_PAGE_SIZE) != 0) || (offset + len > flash_size)) {return 1;}
+  for (size_t i = 0; i < len; i++) {
+    if (program_budget == 0) {return 0;}    // 電源断 (本体ではここで止まる)
+    if (program_budget > 0) {program_budget -= 1;}
+    flash[offset + i] &= data[i];           // 1 → 0 しか書けない
+  }
+  return 0;
+}
+auto mock_flash(size_t sectors) -> CalibFlash {
+  flash_size = SECTOR * sectors;
+  return CalibFlash{flash, flash_size, SECTOR, mock_erase, mock_program};
+}
+void wipe() {
+  std::memset(flash, 0xff, sizeof(flash));
+  std::memset(sector_erases, 0, sizeof(sector_erases));
+  program_budget = -1;
+}
+
+void check(bool ok, const char* what) {
+  std::printf("  %-52s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+/// blocks 個のかまぼこ、ref は seed から作る
+void make_data(CalibData& d, size_t blocks, uint32_t seed) {
+  std::memset(&d, 0, sizeof(d));
+  d.block_count = static_cast<uint8_t>(blocks);
+  for (size_t b = 0; b < blocks; b++) {
+    d.block[b] = KamabokoInfo{static_cast<uint8_t>(b / TOPO_MUX_CHANNELS),
+                              TOPO_RING_CHANNEL[b % TOPO_MUX_CHANNELS],
+                              static_cast<uint16_t>(b * MAX_EACH_SENS)};
+  }
+  for (size_t i = 0; i < d.pad_count(); i++) {
+    d.ref[i] = static_cast<uint16_t>(600 + (i * 37 + seed * 11) % 200);
+    d.noise[i] = static_cast<uint8_t>((i + seed) % 7);
+  }
+  d.tuning = Tuning::defaults();
+  d.tuning.value[static_cast<size_t>(TuneParam::THRESHOLD)] = static_cast<uint16_t>(20 + seed % 50);
+}
+auto same(const CalibData& a, const CalibData& b) -> bool {
+  if (a.block_count != b.block_count) {return false;}
+  for (size_t k = 0; k < a.block_count; k++) {
+    if ((a.block[k].mux != b.block[k].mux) || (a.block[k].channel != b.block[k].channel) ||
+        (a.block[k].first_pad != b.block[k].first_pad)) {return false;}
+  }
+  return (std::memcmp(a.ref, b.ref, a.pad_count() * sizeof(uint16_t)) == 0) &&
+         (std::memcmp(a.noise, b.noise, a.pad_count()) == 0) &&
+         (std::memcmp(a.tuning.value, b.tuning.value, sizeof(a.tuning.value)) == 0);
+}
+}
+
+/*----------------------------------------------------------------------------*/
+//     Scenarios
+/*----------------------------------------------------------------------------*/
+void codec() {
+  std::printf("== encode / decode\n");
+  static CalibData a, b;
+  static uint8_t buf[CALIB_MAX_RECORD];
+  for (size_t blocks : {size_t(1), size_t(16), size_t(MAX_KAMABOKO_NUM)}) {
+    make_data(a, blocks, 3);
+    size_t len = CalibStore::encode(a, 42, buf, sizeof(buf));
+    uint32_t seq = 0;
+    bool ok = (len == CALIB_HEADER_SIZE + blocks * 2 + blocks * MAX_EACH_SENS * 3 + CALIB_TUNING_SIZE) &&
+              (CalibStore::decode(buf, len, &b, seq) == len) && (seq == 42) && same(a, b);
+    char name[64];
+    std::snprintf(name, sizeof(name), "round trip %zu blocks (%zu bytes)", blocks, len);
+    check(ok, name);
+  }
+  make_data(a, 16, 3);
+  size_t len = CalibStore::encode(a, 1, buf, sizeof(buf));
+  uint32_t seq = 0;
+  buf[CALIB_HEADER_SIZE + 40] ^= 0x01;
+  check(CalibStore::decode(buf, len, nullptr, seq) == 0, "one flipped bit is rejected");
+  buf[CALIB_HEADER_SIZE + 40] ^= 0x01;
+  buf[4] = CALIB_VERSION + 1;
+  check(CalibStore::decode(buf, len, nullptr, seq) == 0, "other version is rejected");
+  buf[4] = CALIB_VERSION;
+  check(CalibStore::decode(buf, len - 1, nullptr, seq) == 0, "truncated record is rejected");
+  check(CalibStore::encode(a, 1, buf, 100) == 0, "encode refuses a small buffer");
+  a.tuning.value[static_cast<size_t>(TuneParam::FILTER_LEN)] = 9;
+  len = CalibStore::encode(a, 1, buf, sizeof(buf));
+  check((CalibStore::decode(buf, len, &b, seq) == len) &&
+        (b.tuning.get(TuneParam::FILTER_LEN) == TUNE_INFO[static_cast<size_t>(TuneParam::FILTER_LEN)].def) &&
+        (b.tuning.get(TuneParam::THRESHOLD) == a.tuning.get(TuneParam::THRESHOLD)), "out-of-range tuning falls back to default");
+}
+
+void agree() {
+  std::printf("== calib_agrees\n");
+  static CalibData d;
+  static uint16_t ref[MAX_SENS];
+  make_data(d, 16, 5);
+  std::memcpy(ref, d.ref, sizeof(ref));
+  check(calib_agrees(d, ref, d.pad_count()), "same values agree");
+  ref[10] = static_cast<uint16_t>(d.ref[10] + CALIB_REF_TOLERANCE + d.noise[10]);
+  check(calib_agrees(d, ref, d.pad_count()), "drift within tolerance + noise agrees");
+  ref[10] += 1;
+  check(!calib_agrees(d, ref, d.pad_count()), "one pad beyond tolerance disagrees");
+  ref[10] = d.ref[10];
+  check(!calib_agrees(d, ref, d.pad_count() - MAX_EACH_SENS), "different pad count disagrees");
+}
+
+/*----------------------------------------------------------------------------*/
+//     Mock I2C bus (温め起動の確かめ)
+/*----------------------------------------------------------------------------*/
+enum class Chip : uint8_t { NONE, AT42QT, OTHER };
+bool mux_present[TOPO_MAX_MUX];
+Chip chips[TOPO_MAX_MUX][TOPO_MUX_CHANNELS];
+int selected_mux = -1;
+int selected_ch = -1;
+int chip_inits = 0;
+
+int mock_select(uint8_t mux, uint8_t channel) {
+  if (!mux_present[mux]) {return 2;}
+  selected_mux = mux;
+  selected_ch = channel;
+  return 0;
+}
+int mock_read_chip_id(uint8_t& id) {
+  if (selected_mux < 0) {return 2;}
+  switch (chips[selected_mux][selected_ch]) {
+    case Chip::AT42QT: id = AT42QT_CHIP_ID; return 0;
+    case Chip::OTHER:  id = 0x55; return 0;
+    default:           return 2;
+  }
+}
+void mock_init_chip() {chip_inits += 1;}
+
+/// mux を muxes 個、全部の channel にかまぼこがある
+void wire_bus(uint8_t muxes) {
+  std::memset(mux_present, 0, sizeof(mux_present));
+  std::memset(chips, 0, sizeof(chips));
+  for (uint8_t m = 0; m < muxes; m++) {
+    mux_present[m] = true;
+    for (uint8_t c = 0; c < TOPO_MUX_CHANNELS; c++) {chips[m][c] = Chip::AT42QT;}
+  }
+  selected_mux = selected_ch = -1;
+}
+
+void warm_topology() {
+  std::printf("== warm start: saved topology against the bus\n");
+  const TopologyBus bus = {mock_select, mock_read_chip_id, mock_init_chip};
+  // 8 ブロックで保存した
+  wire_bus(2);
+  Topology found;
+  found.discover(bus);
+  static CalibData d;
+  make_data(d, found.block_count(), 9);
+  for (size_t b = 0; b < found.block_count(); b++) {d.block[b] = found.block(b);}
+  Topology saved;
+  saved.restore(d.block, d.block_count);
+  chip_inits = 0;
+  check(saved.matches(bus), "same kamaboko: the saved topology is used");
+  check(chip_inits == 0, "probing sets up no chip");
+  chips[2][3] = Chip::AT42QT;
+  mux_present[2] = true;
+  check(!saved.matches(bus), "a kamaboko added on an unused mux: full discovery");
+  wire_bus(2);
+  chips[0][1] = Chip::NONE;
+  check(!saved.matches(bus), "one kamaboko removed: full discovery");
+  wire_bus(2);
+  chips[0][1] = Chip::NONE;
+  mux_present[3] = true;
+  chips[3][3] = Chip::AT42QT;
+  check(!saved.matches(bus), "a kamaboko moved to another mux: full discovery");
+  wire_bus(2);
+  mux_present[2] = true;
+  chips[2][2] = Chip::OTHER;
+  check(saved.matches(bus), "a foreign chip on an unused channel does not count");
+  wire_bus(0);
+  check(!saved.matches(bus), "nothing answers: full discovery (fallback)");
+}
+
+void log_behaviour() {
+  std::printf("== load / save\n");
+  static CalibData a, b, c;
+  wipe();
+  CalibStore store;
+  store.begin(mock_flash(2));
+  check(!store.load(a), "blank flash has nothing");
+
+  make_data(a, 16, 1);
+  check(store.save(a), "save to blank flash");
+  CalibStore boot1;
+  boot1.begin(mock_flash(2));
+  check(boot1.load(b) && same(a, b) && (boot1.seq() == 1), "reload after reset");
+
+  make_data(c, 15, 2);
+  check(boot1.save(c), "save a second record");
+  CalibStore boot2;
+  boot2.begin(mock_flash(2));
+  check(boot2.load(b) && same(c, b) && (boot2.seq() == 2) && (boot2.records() == 2), "newest of two wins");
+
+  // 三つ目を書いている途中で電源が切れる
+  make_data(a, 16, 3);
+  program_budget = 300;
+  boot2.save(a);
+  program_budget = -1;
+  CalibStore boot3;
+  boot3.begin(mock_flash(2));
+  check(boot3.load(b) && same(c, b), "power loss while writing keeps the previous one");
+  check(boot3.save(a), "save after power loss skips the torn pages");
+  CalibStore boot4;
+  boot4.begin(mock_flash(2));
+  check(boot4.load(b) && same(a, b) && (boot4.seq() == 3), "record after the torn one is found");
+
+  // 最新の record が壊れた (flash の bit 化け)
+  size_t newest = ((boot4.next_page() + (flash_size / CALIB_PAGE_SIZE)) - 2) % (flash_size / CALIB_PAGE_SIZE);
+  flash[newest * CALIB_PAGE_SIZE + CALIB_HEADER_SIZE + 5] ^= 0x10;
+  CalibStore boot5;
+  boot5.begin(mock_flash(2));
+  check(boot5.load(b) && same(c, b), "corrupt newest record falls back to the one before");
+}
+
+/// 消した直後 (書く前) に電源が切れても、保存してあった record が残るか
+void power_loss_at_erase() {
+  std::printf("== power loss right after an erase\n");
+  static CalibData a, b, c;
+  // 1 sector: 一杯になった sector に次を書くには、その sector を消すしかない
+  wipe();
+  CalibStore two;
+  two.begin(mock_flash(2));
+  bool filled = true;
+  for (uint32_t n = 0; n < SECTOR / (2 * CALIB_PAGE_SIZE); n++) {
+    make_data(a, 16, 11 + n);   // 16 ブロックは 2 page
+    filled = filled && two.save(a);
+  }
+  check(filled && (two.next_page() == SECTOR / CALIB_PAGE_SIZE), "fill the first sector");
+  CalibStore one;
+  one.begin(mock_flash(1));
+  check(one.load(b) && same(a, b) && (one.next_page() == 0), "one sector: newest is read, the next save would erase");
+  check(!one.writable(), "one sector is not writable");
+  make_data(c, 16, 12);
+  program_budget = 0;     // 書き始めたところで電源が切れる
+  check(!one.save(c), "one sector: save is refused");
+  program_budget = -1;
+  CalibStore one_boot;
+  one_boot.begin(mock_flash(1));
+  check((sector_erases[0] == 0) && one_boot.load(b) && same(a, b), "one sector: nothing erased, the record survives");
+
+  // 2 sector: 次の save が sector を消すところまで書き、消した直後に電源を切る
+  wipe();
+  CalibStore store;
+  store.begin(mock_flash(2));
+  static uint8_t before[sizeof(flash)];
+  uint32_t erases_before[MAX_SECTORS];
+  for (uint32_t n = 0; n < 1000; n++) {
+    make_data(a, MAX_KAMABOKO_NUM, 100 + n);
+    // 試しに書いてみて、消すことになるかを見る (flash は元に戻す)
+    std::memcpy(before, flash, sizeof(flash));
+    std::memcpy(erases_before, sector_erases, sizeof(sector_erases));
+    CalibStore probe = store;
+    probe.save(a);
+    const bool erased = probe.erases() != store.erases();
+    std::memcpy(flash, before, sizeof(flash));
+    std::memcpy(sector_erases, erases_before, sizeof(sector_erases));
+    if (erased) {break;}
+    store.save(a);
+    c = a;
+  }
+  program_budget = 0;
+  store.save(a);
+  program_budget = -1;
+  check(sector_erases[0] + sector_erases[1] > 0, "two sectors: the save erased a sector");
+  CalibStore boot;
+  boot.begin(mock_flash(2));
+  check(boot.load(b) && same(c, b) && (boot.seq() == store.seq()), "two sectors: the newest record survives the erase");
+}
+
+void wear(int saves) {
+  std::printf("== wear (%d saves)\n", saves);
+  static CalibData a, b;
+  for (size_t sectors : {size_t(2), size_t(4)}) {
+    for (size_t blocks : {size_t(16), size_t(MAX_KAMABOKO_NUM)}) {
+      wipe();
+      bool ok = true;
+      for (int n = 0; n < saves; n++) {
+        // 毎回リセットしてから書く (本体と同じく、起動ごとに load → save)
+        CalibStore store;
+        store.begin(mock_flash(sectors));
+        store.load(b);
+        make_data(a, blocks, static_cast<uint32_t>(n));
+        if (!store.save(a)) {ok = false; break;}
+        CalibStore check_store;
+        check_store.begin(mock_flash(sectors));
+        if (!check_store.load(b) || !same(a, b) || (check_store.seq() != static_cast<uint32_t>(n + 1))) {
+          ok = false;
+          break;
+        }
+      }
+      uint32_t total = 0, worst = 0;
+      for (size_t s = 0; s < sectors; s++) {
+        total += sector_erases[s];
+        if (sector_erases[s] > worst) {worst = sector_erases[s];}
+      }
+      char name[80];
+      std::snprintf(name, sizeof(name), "%zu sector(s), %2zu blocks: erases %u, worst sector %u",
+                    sectors, blocks, total, worst);
+      check(ok, name);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int saves = 200;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {saves = std::atoi(argv[i + 1]);}
+  }
+  codec();
+  agree();
+  warm_topology();
+  log_behaviour();
+  power_loss_at_erase();
+  wear(saves);
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,516 @@
+/* ========================================
+ *
+ *  cluster_sim.cpp
+ *    description: 何台かの QUBIT を UART でつないだ時 (cluster.h) を PC 上で動かす
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  leader 1 台と follower 2 台 (各 4 かまぼこ = 24 パッド、ring で 72 パッド) に、
+ *  一本の指が ring を一周するセンサ値を与え、leader の QubitTouch が出す MIDI を調べる
+ *  - 偽の時間と偽の線: 1Mbaud の byte の時間、follower の TX を束ねた線での衝突、時計のずれと進み方の違い
+ *    (32bit で回る所を含む)、task の遅れ、byte の化け、follower が一時いなくなる
+ *  - process: leader と follower を別々の process にし、pipe でつないで本当の時間で動かす
+ *  どちらも、継ぎ目で Note が途切れず一つずつ進むこと、時計のずれの見積もり、届くまでの時間を見る
+ *
+ *  build / run:
+ *    make -C tools cluster_sim && tools/cluster_sim [--no-proc]
+ *  全部通れば終了コード 0、どれかが違えば 1
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cluster.h"
+#include "../qtouch.h"
+
+namespace {
+/*----------------------------------------------------------------------------*/
+//     Scenario (両方のモードで同じ)
+/*----------------------------------------------------------------------------*/
+constexpr size_t FOLLOWERS = 2;
+constexpr size_t BOARDS = FOLLOWERS + 1;
+constexpr size_t BOARD_PADS = 4 * MAX_EACH_SENS;
+constexpr size_t RING_PADS = BOARDS * BOARD_PADS;
+constexpr uint32_t SWEEP_US = 2000;         // 各 board の sweep の周期
+constexpr uint32_t FRAME_US = 2000;         // leader のタッチの処理の周期
+constexpr uint64_t FINGER_DOWN_US = 300000; // それまでに時計のずれが決まる
+constexpr double FINGER_SPEED = 40.0;       // pad / sec (72 パッドを 1.8 秒)
+constexpr double FINGER_START = 2.0;        // leader の 3 番目のパッドから
+constexpr double FINGER_TRAVEL = RING_PADS - 4.0;   // 二つの継ぎ目を越えて、最後の board の端の手前まで
+constexpr uint64_t FINGER_UP_US = FINGER_DOWN_US + static_cast<uint64_t>(FINGER_TRAVEL / FINGER_SPEED * 1e6);
+constexpr uint64_t END_US = FINGER_UP_US + 200000;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+/// t に指がどこにあるか (無ければ false)
+bool finger_at(uint64_t t, double& x) {
+  if ((t < FINGER_DOWN_US) || (t >= FINGER_UP_US)) {return false;}
+  x = FINGER_START + (t - FINGER_DOWN_US) * 1e-6 * FINGER_SPEED;
+  return true;
+}
+/// ring のパッド pad の raw - ref
+uint16_t pad_value(size_t pad, uint64_t t) {
+  double x;
+  if (!finger_at(t, x)) {return 1;}  // 少しの雑音
+  const double d = static_cast<double>(pad) - x;
+  return static_cast<uint16_t>(1 + std::lround(120.0 * std::exp(-d * d / (2 * 0.9 * 0.9))));
+}
+
+// 時計: board ごとに起動した時刻 (ずれ) と進み方が違う
+struct SimClock {
+  double    ppm;
+  uint64_t  offset;
+  uint64_t at(uint64_t t) const {return static_cast<uint64_t>(t * (1.0 + ppm * 1e-6)) + offset;}
+};
+// leader、follower 2、follower 3。follower 2 は 32bit の時刻がすぐ回る
+const SimClock CLOCKS[BOARDS] = {
+  {0.0, 5000000},
+  {80.0, 0xFFFF0000ull},
+  {-60.0, 123456789ull},
+};
+
+/*----------------------------------------------------------------------------*/
+//     Leader の QubitTouch と MIDI の記録
+/*----------------------------------------------------------------------------*/
+struct NoteLog {
+  std::set<int> sounding;
+  std::set<int> visited;
+  int last_pad = -1;
+  int ons = 0;
+  int offs = 0;
+  int bad_steps = 0;    // 前の Note の隣でないパッドに移った
+  int doubles = 0;      // 一本の指なのに二つ鳴っていたフレーム
+  int gaps = 0;         // 指が乗っているのに何も鳴っていないフレーム
+
+  void reset() {*this = NoteLog();}
+  void midi(uint8_t status, uint8_t note) {
+    const int pad = note - TouchPoint::OFFSET_NOTE;
+    if ((status & 0xf0) == 0x90) {
+      ons += 1;
+      if ((last_pad >= 0) && (pad != last_pad + 1)) {bad_steps += 1;}
+      last_pad = pad;
+      sounding.insert(pad);
+      visited.insert(pad);
+    } else if ((status & 0xf0) == 0x80) {
+      offs += 1;
+      sounding.erase(pad);
+    }
+  }
+  void end_frame(bool finger_settled) {
+    if (sounding.size() > 1) {doubles += 1;}
+    if (finger_settled && sounding.empty()) {gaps += 1;}
+  }
+};
+NoteLog notes;
+QubitTouch leader_touch([](uint8_t status, uint8_t note, uint8_t) {notes.midi(status, note);});
+
+/// leader のタッチの処理一回 (本体の touch_task と同じ順)
+void leader_frame(ClusterLeader& leader, uint64_t t) {
+  leader.set_local_pads(BOARD_PADS);
+  if (leader_touch.pad_count() != leader.pad_count()) {leader_touch.set_pad_count(leader.pad_count());}
+  for (size_t i = 0; i < BOARD_PADS; i++) {leader_touch.set_value(i, pad_value(i, t));}
+  leader.each_remote_pad([](size_t pad, uint16_t v) {leader_touch.set_value(pad, v);});
+  leader_touch.seek_and_update_touch_point();
+  notes.end_frame((t >= FINGER_DOWN_US + 20000) && (t < FINGER_UP_US));
+}
+
+struct Stats {
+  std::vector<uint32_t> v;
+  void add(uint32_t x) {v.push_back(x);}
+  uint32_t pct(double p) {
+    if (v.empty()) {return 0;}
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+  }
+};
+
+/*----------------------------------------------------------------------------*/
+//     偽の時間と偽の線
+/*----------------------------------------------------------------------------*/
+// leader の TX は全 follower に同じ byte が届き、follower の TX は一本に束ねてある
+// 一 byte は 10usec (1Mbaud)。束ねた線で二台が同時に送ったら衝突として数える
+struct Wire {
+  uint64_t free_at = 0;
+  int owner = -1;
+};
+struct SimNode {
+  std::deque<std::pair<uint64_t, uint8_t>> rx;    // 届く時刻と byte
+  uint64_t next_service = 0;
+  uint64_t next_sweep = 0;
+};
+SimNode nodes[BOARDS];
+Wire down_wire;
+Wire up_wire;
+int current = 0;            // 今 service() を呼んでいる board
+uint64_t world_us = 0;
+uint32_t collisions = 0;
+uint64_t up_bytes = 0;
+double corrupt_rate = 0.0;
+uint32_t corrupted = 0;
+std::mt19937 rng(1);
+constexpr uint32_t BYTE_US = CLUSTER_BYTE_NS / 1000;
+
+uint8_t maybe_corrupt(uint8_t b) {
+  if ((corrupt_rate > 0.0) && (std::uniform_real_distribution<double>(0.0, 1.0)(rng) < corrupt_rate)) {
+    corrupted += 1;
+    return static_cast<uint8_t>(b ^ (1u << (rng() % 8)));
+  }
+  return b;
+}
+size_t sim_write(const uint8_t* data, size_t len) {
+  Wire& w = (current == 0) ? down_wire : up_wire;
+  uint64_t t = std::max(world_us, w.free_at);
+  if ((current != 0) && (w.owner >= 0) && (w.owner != current) && (w.free_at > world_us)) {collisions += 1;}
+  w.owner = current;
+  for (size_t i = 0; i < len; i++) {
+    t += BYTE_US;
+    if (current == 0) {
+      for (size_t k = 1; k < BOARDS; k++) {nodes[k].rx.push_back({t, maybe_corrupt(data[i])});}
+    } else {
+      nodes[0].rx.push_back({t, maybe_corrupt(data[i])});
+      up_bytes += 1;
+    }
+  }
+  w.free_at = t;
+  return len;
+}
+int sim_read() {
+  auto& rx = nodes[current].rx;
+  if (rx.empty() || (rx.front().first > world_us)) {return -1;}
+  uint8_t b = rx.front().second;
+  rx.pop_front();
+  return b;
+}
+const ClusterPort SIM_PORT{sim_write, sim_read, CLUSTER_BYTE_NS};
+
+struct VirtualResult {
+  int32_t max_offset_err = 0;       // 時計のずれの見積もりの誤差 [usec]
+  int32_t max_stamp_err = 0;        // 届いた sweep の時刻 (leader の時計に直したもの) の誤差
+  uint32_t age_p50 = 0;             // follower の sweep → leader のタッチの処理
+  uint32_t age_max = 0;
+  uint32_t max_cycle_us = 0;
+  double idle_unchanged = 0;         // 指が無い間の返事のうち、中身を送らなかったもの
+  double idle_reply_bytes = 0;       // follower の返事一つの平均 (指が無い時 / 動いている時)
+  double touch_reply_bytes = 0;
+  uint32_t unchanged = 0;
+  uint32_t replies = 0;
+  uint32_t errors = 0;
+  bool all_present = false;
+  size_t pad_count = 0;
+};
+
+/// pause_board を pause_from から pause_until まで止める (0: 止めない)
+VirtualResult run_virtual(double corrupt, int pause_board, uint64_t pause_from, uint64_t pause_until,
+                          bool (*probe)(ClusterLeader&, uint64_t) = nullptr) {
+  static ClusterLeader leader(SIM_PORT);
+  static ClusterFollower follower_a(SIM_PORT);
+  static ClusterFollower follower_b(SIM_PORT);
+  ClusterFollower* followers[BOARDS] = {nullptr, &follower_a, &follower_b};
+  follower_a = ClusterFollower(SIM_PORT);
+  follower_b = ClusterFollower(SIM_PORT);
+  follower_a.set_id(CLUSTER_LEADER + 1);
+  follower_b.set_id(CLUSTER_LEADER + 2);
+  leader.reset();
+  leader_touch = QubitTouch([](uint8_t status, uint8_t note, uint8_t) {notes.midi(status, note);});
+  notes.reset();
+  for (auto& n : nodes) {n = SimNode();}
+  down_wire = up_wire = Wire();
+  collisions = 0;
+  up_bytes = 0;
+  corrupt_rate = corrupt;
+  corrupted = 0;
+  rng.seed(7);
+
+  // follower の snapshot の番号 → 本当の sweep の時刻
+  std::map<uint8_t, uint64_t> truth[BOARDS];
+  VirtualResult r;
+  Stats age;
+  uint64_t next_frame = 0;
+  uint64_t bytes_at[3] = {};
+  uint32_t replies_at[3] = {};
+  uint32_t unchanged_at[3] = {};
+  std::uniform_int_distribution<uint32_t> jitter(0, 300);
+  for (world_us = 0; world_us < END_US; world_us++) {
+    const uint64_t t = world_us;
+    for (size_t k = 0; k < BOARDS; k++) {
+      const bool paused = (static_cast<int>(k) == pause_board) && (t >= pause_from) && (t < pause_until);
+      SimNode& n = nodes[k];
+      if (paused) {
+        n.rx.clear();   // 止まっている間に来たものは捨てる (UART の FIFO も溢れる)
+        continue;
+      }
+      current = static_cast<int>(k);
+      if ((k > 0) && (t >= n.next_sweep)) {
+        uint16_t values[BOARD_PADS];
+        for (size_t i = 0; i < BOARD_PADS; i++) {values[i] = pad_value(k * BOARD_PADS + i, t);}
+        const uint8_t seq = followers[k]->snapshot_seq();
+        followers[k]->capture(static_cast<uint32_t>(CLOCKS[k].at(t)), values, BOARD_PADS);
+        if (followers[k]->snapshot_seq() != seq) {truth[k][followers[k]->snapshot_seq()] = t;}
+        n.next_sweep = t + SWEEP_US - 200 + jitter(rng) % 400;
+      }
+      if (t >= n.next_service) {
+        // Link タスク: 250usec ごと、ほかのタスクで 0-300usec 遅れる
+        if (k == 0) {
+          leader.service(CLOCKS[0].at(t));
+        } else {
+          followers[k]->service(static_cast<uint32_t>(CLOCKS[k].at(t)));
+        }
+        n.next_service = t + 250 + jitter(rng);
+      }
+    }
+    if (t >= next_frame) {
+      current = 0;
+      const uint64_t leader_now = CLOCKS[0].at(t);
+      // 時刻の確かめ: fresh の board の sweep の時刻と、本当の時刻
+      for (size_t k = 1; k < BOARDS; k++) {
+        const ClusterBoard& b = leader.board(CLUSTER_LEADER + k);
+        if (!b.fresh || (t < 200000)) {continue;}
+        auto it = truth[k].find(static_cast<uint8_t>(b.have));
+        if (it == truth[k].end()) {continue;}
+        const int32_t err = static_cast<int32_t>(b.sweep_us - CLOCKS[0].at(it->second));
+        r.max_stamp_err = std::max(r.max_stamp_err, std::abs(err));
+      }
+      const uint64_t fresh = leader.take_fresh_us();
+      double x;
+      if ((fresh != 0) && finger_at(t, x)) {age.add(static_cast<uint32_t>(leader_now - fresh));}
+      leader_frame(leader, t);
+      if (t >= 200000) {
+        for (size_t k = 1; k < BOARDS; k++) {
+          const ClusterBoard& b = leader.board(CLUSTER_LEADER + k);
+          if (!b.present) {continue;}
+          const uint32_t truth_offset = static_cast<uint32_t>(CLOCKS[k].at(t)) - static_cast<uint32_t>(leader_now);
+          const int32_t err = static_cast<int32_t>(static_cast<uint32_t>(b.clock.offset_us()) - truth_offset);
+          r.max_offset_err = std::max(r.max_offset_err, std::abs(err));
+        }
+      }
+      if (probe && !probe(leader, t)) {break;}
+      next_frame = t + FRAME_US;
+    }
+    // 最初の探索の分は除く
+    const int phase = (t == 100000) ? 0 : (t == FINGER_DOWN_US) ? 1 : (t == FINGER_UP_US) ? 2 : -1;
+    if (phase >= 0) {
+      bytes_at[phase] = up_bytes;
+      replies_at[phase] = follower_a.replies() + follower_b.replies();
+      unchanged_at[phase] = follower_a.unchanged() + follower_b.unchanged();
+    }
+    if (phase == 0) {leader.clear_max_cycle();}
+  }
+  r.age_p50 = age.pct(0.5);
+  r.age_max = age.pct(1.0);
+  r.max_cycle_us = leader.max_cycle_us();
+  r.idle_unchanged = static_cast<double>(unchanged_at[1] - unchanged_at[0]) / std::max(1u, replies_at[1] - replies_at[0]);
+  r.idle_reply_bytes = static_cast<double>(bytes_at[1] - bytes_at[0]) / std::max(1u, replies_at[1] - replies_at[0]);
+  r.touch_reply_bytes = static_cast<double>(bytes_at[2] - bytes_at[1]) / std::max(1u, replies_at[2] - replies_at[1]);
+  r.unchanged = follower_a.unchanged() + follower_b.unchanged();
+  r.replies = follower_a.replies() + follower_b.replies();
+  r.errors = leader.errors() + follower_a.errors() + follower_b.errors();
+  r.all_present = leader.board(CLUSTER_LEADER + 1).present && leader.board(CLUSTER_LEADER + 2).present;
+  r.pad_count = leader.pad_count();
+  return r;
+}
+
+bool notes_continuous() {
+  return (notes.bad_steps == 0) && (notes.doubles == 0) && (notes.gaps == 0) && notes.sounding.empty() &&
+         (notes.ons == static_cast<int>(notes.visited.size())) &&
+         (notes.visited.size() >= static_cast<size_t>(FINGER_TRAVEL));
+}
+
+void virtual_wire() {
+  std::printf("== simulated wire: 3 boards, 1 Mbaud, drifting clocks\n");
+  VirtualResult r = run_virtual(0.0, -1, 0, 0);
+  std::printf("  ring %zu pads, notes on %d off %d, %zu pads visited\n", r.pad_count, notes.ons, notes.offs, notes.visited.size());
+  std::printf("  clock offset error max %d us, sweep stamp error max %d us\n", r.max_offset_err, r.max_stamp_err);
+  std::printf("  follower sweep -> leader frame p50 %u us max %u us, poll cycle max %u us\n", r.age_p50, r.age_max, r.max_cycle_us);
+  std::printf("  reply %.1f bytes idle, %.1f bytes touching (%u of %u replies unchanged)\n",
+              r.idle_reply_bytes, r.touch_reply_bytes, r.unchanged, r.replies);
+  check(r.all_present && (r.pad_count == RING_PADS), "both followers join the ring after the leader");
+  check(notes_continuous(), "one finger around the ring: one note at a time, +1 across seams");
+  check(r.max_offset_err <= 250, "clock offset tracks drift and 32-bit wrap within 250 us");
+  check(r.max_stamp_err <= 150, "remote sweep times line up with the leader clock");
+  check(collisions == 0, "followers never talk over each other");
+  check(r.age_max <= r.max_cycle_us + SWEEP_US + FRAME_US + 600, "remote data age is bounded by one poll cycle");
+  check(r.max_cycle_us <= FOLLOWERS * CLUSTER_REPLY_TIMEOUT_US, "poll cycle stays within the reply timeouts");
+  check((r.idle_unchanged > 0.99) && (r.idle_reply_bytes < r.touch_reply_bytes), "idle replies skip the unchanged snapshot");
+}
+
+void virtual_faults() {
+  std::printf("== simulated wire: corrupted bytes and a follower that drops out\n");
+  VirtualResult r = run_virtual(1.0 / 3000, -1, 0, 0);
+  std::printf("  %u bytes corrupted, %u frames rejected, notes on %d off %d\n", corrupted, r.errors, notes.ons, notes.offs);
+  check((corrupted > 0) && (r.errors > 0), "corrupted frames are rejected by the checksum");
+  check(notes_continuous(), "the finger still walks the ring without a gap");
+  check(r.all_present, "a lost reply does not drop the board");
+
+  // follower 3 を指が来ない間 (leader の上にいる間) だけ止める
+  static bool absent_seen;
+  static bool base_kept;
+  static bool count_kept;
+  absent_seen = false;
+  base_kept = count_kept = true;
+  r = run_virtual(0.0, 2, 100000, 200000, [](ClusterLeader& leader, uint64_t t) {
+    const ClusterBoard& b = leader.board(CLUSTER_LEADER + 2);
+    if ((t > 100000) && (t < 200000) && !b.present) {absent_seen = true;}
+    if (b.known && (b.base != 2 * BOARD_PADS)) {base_kept = false;}
+    if (b.known && (leader.pad_count() != RING_PADS)) {count_kept = false;}
+    return true;
+  });
+  check(absent_seen, "a silent follower is marked absent");
+  check(base_kept && count_kept, "its place in the ring is kept while it is away");
+  check(r.all_present && notes_continuous(), "it comes back and the ring is whole again");
+}
+
+/*----------------------------------------------------------------------------*/
+//     process: leader と follower を別々の process にし、pipe でつなぐ
+/*----------------------------------------------------------------------------*/
+uint64_t mono_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+int down_fd[BOARDS][2];     // leader → follower k (leader は全部に同じものを書く)
+int up_fd[2];               // follower → leader (全員が同じ pipe に書く。PIPE_BUF 以下は混ざらない)
+int my_board = 0;
+uint8_t rx_buf[512];
+size_t rx_len = 0;
+size_t rx_pos = 0;
+
+size_t pipe_write(const uint8_t* data, size_t len) {
+  if (my_board == 0) {
+    for (size_t k = 1; k < BOARDS; k++) {
+      if (write(down_fd[k][1], data, len) != static_cast<ssize_t>(len)) {return 0;}
+    }
+    return len;
+  }
+  ssize_t n = write(up_fd[1], data, len);
+  return (n > 0) ? static_cast<size_t>(n) : 0;
+}
+int pipe_read() {
+  if (rx_pos >= rx_len) {
+    ssize_t n = read((my_board == 0) ? up_fd[0] : down_fd[my_board][0], rx_buf, sizeof(rx_buf));
+    if (n <= 0) {return -1;}
+    rx_len = static_cast<size_t>(n);
+    rx_pos = 0;
+  }
+  return rx_buf[rx_pos++];
+}
+const ClusterPort PIPE_PORT{pipe_write, pipe_read, 0};  // pipe は一度に届くので線の時間は無い
+
+int follower_process(size_t k, uint64_t start) {
+  ClusterFollower follower(PIPE_PORT);
+  follower.set_id(static_cast<uint8_t>(CLUSTER_LEADER + k));
+  uint64_t next_sweep = 0;
+  for (;;) {
+    const uint64_t t = mono_us() - start;
+    if (t >= END_US) {break;}
+    if (t >= next_sweep) {
+      uint16_t values[BOARD_PADS];
+      for (size_t i = 0; i < BOARD_PADS; i++) {values[i] = pad_value(k * BOARD_PADS + i, t);}
+      follower.capture(static_cast<uint32_t>(CLOCKS[k].at(t)), values, BOARD_PADS);
+      next_sweep = t + SWEEP_US;
+    }
+    follower.service(static_cast<uint32_t>(CLOCKS[k].at(t)));
+    usleep(100);
+  }
+  return 0;
+}
+
+int leader_process(uint64_t start) {
+  static ClusterLeader leader(PIPE_PORT);
+  notes.reset();
+  leader_touch = QubitTouch([](uint8_t status, uint8_t note, uint8_t) {notes.midi(status, note);});
+  uint64_t next_frame = 0;
+  int32_t max_offset_err = 0;
+  Stats age;
+  for (;;) {
+    const uint64_t t = mono_us() - start;
+    if (t >= END_US) {break;}
+    leader.service(CLOCKS[0].at(t));
+    if (t >= next_frame) {
+      const uint64_t leader_now = CLOCKS[0].at(t);
+      const uint64_t fresh = leader.take_fresh_us();
+      double x;
+      if ((fresh != 0) && finger_at(t, x)) {age.add(static_cast<uint32_t>(leader_now - fresh));}
+      leader_frame(leader, t);
+      for (size_t k = 1; (k < BOARDS) && (t >= 200000); k++) {
+        const ClusterBoard& b = leader.board(CLUSTER_LEADER + k);
+        if (!b.present) {continue;}
+        const uint32_t truth_offset = static_cast<uint32_t>(CLOCKS[k].at(t)) - static_cast<uint32_t>(leader_now);
+        max_offset_err = std::max(max_offset_err, std::abs(static_cast<int32_t>(static_cast<uint32_t>(b.clock.offset_us()) - truth_offset)));
+      }
+      next_frame = t + FRAME_US;
+    }
+    usleep(100);
+  }
+  const bool present = leader.board(CLUSTER_LEADER + 1).present && leader.board(CLUSTER_LEADER + 2).present;
+  std::printf("  ring %zu pads, notes on %d off %d, %zu pads visited, %u poll cycles (max %u us)\n", leader.pad_count(),
+              notes.ons, notes.offs, notes.visited.size(), leader.cycles(), leader.max_cycle_us());
+  std::printf("  clock offset error max %d us, follower sweep -> leader frame p50 %u us max %u us\n",
+              max_offset_err, age.pct(0.5), age.pct(1.0));
+  check(present && (leader.pad_count() == RING_PADS), "followers in other processes join over pipes");
+  check(notes_continuous(), "the merged stream walks the ring one note at a time");
+  check(max_offset_err <= 1000, "clock offsets line up within 1 ms under OS scheduling");
+  std::fflush(stdout);
+  return failures == 0 ? 0 : 1;
+}
+
+void processes() {
+  std::printf("== processes joined by pipes (real time, %.1f s)\n", END_US * 1e-6);
+  std::fflush(stdout);
+  for (size_t k = 1; k < BOARDS; k++) {
+    if (pipe(down_fd[k]) != 0) {std::perror("pipe");}
+    fcntl(down_fd[k][0], F_SETFL, O_NONBLOCK);
+  }
+  if (pipe(up_fd) != 0) {std::perror("pipe");}
+  fcntl(up_fd[0], F_SETFL, O_NONBLOCK);
+  const uint64_t start = mono_us() + 50000;
+  pid_t pids[BOARDS];
+  for (size_t k = 0; k < BOARDS; k++) {
+    pids[k] = fork();
+    if (pids[k] == 0) {
+      my_board = static_cast<int>(k);
+      while (mono_us() < start) {usleep(1000);}
+      _exit((k == 0) ? leader_process(start) : follower_process(k, start));
+    }
+  }
+  bool ok = true;
+  for (size_t k = 0; k < BOARDS; k++) {
+    int status = 0;
+    waitpid(pids[k], &status, 0);
+    ok = ok && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+  }
+  if (!ok) {failures += 1;}
+}
+}
+
+int main(int argc, char* argv[]) {
+  bool proc = true;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--no-proc") == 0) {proc = false;}
+  }
+  virtual_wire();
+  virtual_faults();
+  if (proc) {processes();}
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/* ========================================
+ *
+ *  flight_decode.cpp
+ *    description: flight recorder の dump を qubit_replay で再生できる trace に直す
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  dump (flight_recorder.h の形) は、本体の 'd' を telemetry_decode.py flight で受けるか、
+ *  picotool で flash の領域をそのまま読んで作る ('l' の flight 行に番地が出る)
+ *
+ *  使い方:
+ *    flight_decode dump.qfd out
+ *      out.sweeps  sweep (qubit-sweeps v1)。最初の keyframe から
+ *      out.midi    本体が送った Note On / Off (qubit_replay の golden と同じ形)
+ *      out.events  header、タッチの状態、受けた MIDI、その他の送信、止めた所 (時刻順)
+ *    qubit_replay -c out.midi out.sweeps で、本体と同じ判断になったかを比べられる
+ *    (記録より前から触っていた指、tuning を既定から変えていた時は、最初のところが違いうる)
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../flight_recorder.h"
+
+namespace {
+/// 32bit の時刻を、ref に一番近い 64bit の時刻に戻す
+uint64_t unwrap(uint64_t ref, uint32_t t) {
+  return ref + static_cast<int64_t>(static_cast<int32_t>(t - static_cast<uint32_t>(ref)));
+}
+
+bool read_file(const char* path, std::vector<uint8_t>& out) {
+  FILE* fp = std::fopen(path, "rb");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0) {out.insert(out.end(), buf, buf + n);}
+  std::fclose(fp);
+  return true;
+}
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: flight_decode <dump.qfd> <out>\n");
+    return 2;
+  }
+  std::vector<uint8_t> image;
+  if (!read_file(argv[1], image)) {return 1;}
+  FlightDumpInfo info;
+  if (!flight_dump_read(image.data(), image.size(), info)) {
+    std::fprintf(stderr, "%s: not a flight dump (or broken)\n", argv[1]);
+    return 1;
+  }
+  const std::string out = argv[2];
+  FILE* sweeps_fp = std::fopen((out + ".sweeps").c_str(), "w");
+  FILE* midi_fp = std::fopen((out + ".midi").c_str(), "w");
+  FILE* events_fp = std::fopen((out + ".events").c_str(), "w");
+  if ((sweeps_fp == nullptr) || (midi_fp == nullptr) || (events_fp == nullptr)) {
+    std::fprintf(stderr, "cannot write %s.*\n", argv[2]);
+    return 1;
+  }
+  const char* reason = flight_reason_name(info.reason);
+  std::fprintf(events_fp, "# flight dump seq %u reason %s pads %u frozen_us %u\n", info.seq, reason, info.pads, info.frozen_us);
+  std::fprintf(events_fp, "# sweeps %u records (%u overwritten)  events %u records (%u overwritten)\n",
+               info.sweep_records, info.sweep_overwritten, info.event_records, info.event_overwritten);
+  std::fprintf(events_fp, "# tuning");
+  bool tuned = false;
+  for (size_t i = 0; i < TUNE_PARAMS; i++) {
+    std::fprintf(events_fp, " %s=%u", TUNE_INFO[i].name, info.tuning.value[i]);
+    tuned = tuned || (info.tuning.value[i] != TUNE_INFO[i].def);
+  }
+  std::fprintf(events_fp, "%s\n", tuned ? "  (not the defaults: qubit_replay uses the defaults)" : "");
+
+  // sweep: 最初の keyframe から
+  const uint8_t* body = image.data() + FLIGHT_PAGE_SIZE;
+  FlightSweepDecoder<MAX_SENS> decoder;
+  size_t sweeps = 0;
+  size_t skipped = 0;
+  uint64_t time_us = 0;
+  uint64_t first_us = 0;
+  bool ok = flight_each_record(body, info.sweep_bytes, [&](const uint8_t* rec, size_t len) {
+    if (!decoder.decode(rec, len)) {
+      skipped += 1;
+      return;
+    }
+    if (sweeps == 0) {
+      time_us = decoder.time_us();
+      first_us = time_us;
+      std::fprintf(sweeps_fp, "# qubit-sweeps v1 pads=%zu\n", decoder.pads());
+    } else {
+      time_us = unwrap(time_us, decoder.time_us());
+    }
+    std::fprintf(sweeps_fp, "%llu", static_cast<unsigned long long>(time_us));
+    for (size_t i = 0; i < decoder.pads(); i++) {std::fprintf(sweeps_fp, " %u", decoder.value(i));}
+    std::fprintf(sweeps_fp, "\n");
+    sweeps += 1;
+  });
+  if (!ok) {std::fprintf(stderr, "sweep records are truncated; decoded what was readable\n");}
+
+  // event: 時刻は sweep と同じ 64bit に戻す
+  std::fprintf(midi_fp, "# from %s: qubit_replay -c %s.midi %s.sweeps\n", argv[1], argv[2], argv[2]);
+  size_t notes = 0;
+  size_t events = 0;
+  uint64_t ref_us = first_us;
+  ok = flight_each_record(body + info.sweep_bytes, info.event_bytes, [&](const uint8_t* rec, size_t len) {
+    if (len < 6) {return;}
+    const FlightRec type = static_cast<FlightRec>(rec[0]);
+    const uint64_t t = unwrap(ref_us, flight_get32(rec + 1));
+    events += 1;
+    if ((type == FlightRec::MIDI_OUT) && (len >= 8)) {
+      const uint8_t kind = rec[5] & 0xf0;
+      if (((kind == 0x90) || (kind == 0x80)) && (sweeps > 0) && (t >= first_us)) {
+        std::fprintf(midi_fp, "midi %llu %02x %u %u\n", static_cast<unsigned long long>(t), rec[5], rec[6], rec[7]);
+        notes += 1;
+      } else {
+        std::fprintf(events_fp, "%llu out %02x %u %u\n", static_cast<unsigned long long>(t), rec[5], rec[6], rec[7]);
+      }
+    } else if ((type == FlightRec::MIDI_IN) && (len >= 8)) {
+      std::fprintf(events_fp, "%llu in %02x %u %u\n", static_cast<unsigned long long>(t), rec[5], rec[6], rec[7]);
+    } else if ((type == FlightRec::TRACK) && (len >= 12)) {
+      int16_t loc = static_cast<int16_t>(rec[8] | (rec[9] << 8));
+      int16_t intensity = static_cast<int16_t>(rec[10] | (rec[11] << 8));
+      if (rec[6] & 1) {
+        std::fprintf(events_fp, "%llu track %u on note %u loc %.2f intensity %d\n",
+                     static_cast<unsigned long long>(t), rec[5], rec[7], loc / 100.0, intensity);
+      } else {
+        std::fprintf(events_fp, "%llu track %u off\n", static_cast<unsigned long long>(t), rec[5]);
+      }
+    } else if (type == FlightRec::FREEZE) {
+      std::fprintf(events_fp, "%llu freeze %s\n", static_cast<unsigned long long>(t), flight_reason_name(rec[5]));
+    }
+  });
+  if (!ok) {std::fprintf(stderr, "event records are truncated; decoded what was readable\n");}
+  std::fclose(sweeps_fp);
+  std::fclose(midi_fp);
+  std::fclose(events_fp);
+
+  const double span_s = (sweeps > 1) ? (time_us - first_us) / 1e6 : 0.0;
+  std::printf("%s: %s, %zu sweeps (%.2f s, %zu before the first keyframe), %zu events, %zu notes\n",
+              argv[1], reason, sweeps, span_s, skipped, events, notes);
+  return sweeps > 0 ? 0 : 1;
+}
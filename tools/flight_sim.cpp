@@ -0,0 +1,538 @@
+/* ========================================
+ *
+ *  flight_sim.cpp
+ *    description: flight recorder (flight_recorder.h) の ring・圧縮・dump を PC 上で確かめ、速さを測る
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  - ring: 上書きしても record の境目が崩れない、再起動後の valid() がでたらめな RAM を弾く
+ *  - 圧縮: 書いた sweep が、最初の keyframe から後は全部そのまま戻る
+ *  - dump: 偽の flash に書いて読み戻す。header を最後に書くので、途中で電源が切れたら dump は無い
+ *  - upload ('d'): 256 byte の CDC 送信 FIFO の偽物に送り、PC 側 (C++ と telemetry_decode.py flight) で
+ *    dump が元の通りに揃うこと
+ *  - 固定の大きさ: 記録している間に heap を使わない、本体と同じ大きさの recorder で何秒残るか
+ *  - 速さ: 一回の record_sweep (圧縮 + ring) の p50 / p99 / max
+ *
+ *  build / run:
+ *    make -C tools flight_sim && tools/flight_sim [-n sweeps] [trace.sweeps ...]
+ *      trace を渡すと、その sweep でも大きさと速さを測る
+ *    tools/flight_sim -o dump.qfd trace.sweeps
+ *      trace を QubitTouch に流して (qubit_replay と同じ)、sweep と MIDI とタッチを記録した dump を作る
+ *      tools/flight_decode dump.qfd out && tools/qubit_replay -q -c out.midi out.sweeps で一周確かめられる
+ *  全部通れば終了コード 0、どれかが違えば 1
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "../flight_recorder.h"
+#include "../qtouch.h"
+
+/*----------------------------------------------------------------------------*/
+//     Heap counter / mock flash
+/*----------------------------------------------------------------------------*/
+namespace {
+size_t heap_allocs = 0;
+}
+void* operator new(size_t n) {
+  heap_allocs += 1;
+  void* p = std::malloc(n ? n : 1);
+  if (p == nullptr) {throw std::bad_alloc();}
+  return p;
+}
+void operator delete(void* p) noexcept {std::free(p);}
+void operator delete(void* p, size_t) noexcept {std::free(p);}
+
+namespace {
+constexpr size_t SECTOR = 4096;
+constexpr size_t FLASH_BYTES = ((FLIGHT_DUMP_BYTES + SECTOR - 1) / SECTOR) * SECTOR;
+uint8_t flash[FLASH_BYTES];
+size_t flash_size = FLASH_BYTES;
+long program_budget = -1;   // 0 以上: ここまで書いたところで電源が切れる
+int failures = 0;
+std::string tools_dir = "tools";
+
+int mock_erase(size_t offset) {
+  if (((offset % SECTOR) != 0) || (offset >= flash_size)) {return 1;}
+  std::memset(flash + offset, 0xff, SECTOR);
+  return 0;
+}
+int mock_program(size_t offset, const uint8_t* data, size_t len) {
+  if (((offset % FLIGHT_PAGE_SIZE) != 0) || ((len % FLIGHT_PAGE_SIZE) != 0) || (offset + len > flash_size)) {return 1;}
+  for (size_t i = 0; i < len; i++) {
+    if (program_budget == 0) {return 0;}
+    if (program_budget > 0) {program_budget -= 1;}
+    flash[offset + i] &= data[i];
+  }
+  return 0;
+}
+auto mock_flash(size_t bytes) -> CalibFlash {
+  flash_size = bytes;
+  std::memset(flash, 0xff, sizeof(flash));
+  program_budget = -1;
+  return CalibFlash{flash, flash_size, SECTOR, mock_erase, mock_program};
+}
+
+void check(bool ok, const char* what) {
+  std::printf("  %-52s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+struct Sweep {
+  uint32_t  time_us;
+  uint16_t  values[MAX_SENS];
+};
+
+/// 触っていない所はノイズ (0 か noise_sd の幅)、fingers 本の指が動く
+std::vector<Sweep> synthetic(size_t count, size_t pads, double noise_sd, int fingers, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, noise_sd);
+  std::vector<Sweep> out(count);
+  for (size_t n = 0; n < count; n++) {
+    Sweep& sw = out[n];
+    sw.time_us = static_cast<uint32_t>(0xfffff000u + n * 4000);   // 途中で 32bit が折り返す
+    for (size_t i = 0; i < pads; i++) {
+      double v = (noise_sd > 0) ? std::abs(noise(rng)) : 0.0;
+      for (int f = 0; f < fingers; f++) {
+        double loc = std::fmod(10.0 + 30.0 * f + n * 0.05, static_cast<double>(pads));
+        double d = std::abs(static_cast<double>(i) - loc);
+        if (d < 1.6) {v += 300.0 * (1.0 - (d / 1.6) * (d / 1.6));}
+      }
+      sw.values[i] = static_cast<uint16_t>(std::min(1023.0, v));
+    }
+  }
+  return out;
+}
+
+bool read_trace(const char* path, std::vector<Sweep>& sweeps, size_t& pads) {
+  FILE* fp = std::fopen(path, "r");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  char line[4096];
+  if ((std::fgets(line, sizeof(line), fp) == nullptr) || (std::sscanf(line, "# qubit-sweeps v1 pads=%zu", &pads) != 1)) {
+    std::fprintf(stderr, "%s: not a qubit-sweeps v1 file\n", path);
+    std::fclose(fp);
+    return false;
+  }
+  if (pads > MAX_SENS) {pads = MAX_SENS;}
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    if ((line[0] == '#') || (line[0] == '\n')) {continue;}
+    Sweep sw = {};
+    char* end = nullptr;
+    sw.time_us = static_cast<uint32_t>(std::strtoull(line, &end, 10));
+    for (size_t i = 0; i < pads; i++) {sw.values[i] = static_cast<uint16_t>(std::strtol(end, &end, 10));}
+    sweeps.push_back(sw);
+  }
+  std::fclose(fp);
+  return true;
+}
+
+uint32_t percentile(std::vector<uint32_t>& v, uint32_t permille) {
+  if (v.empty()) {return 0;}
+  std::sort(v.begin(), v.end());
+  size_t idx = (v.size() * permille + 999) / 1000;
+  return v[std::min(idx > 0 ? idx - 1 : 0, v.size() - 1)];
+}
+
+QubitFlightRecorder recorder;   // 本体と同じ大きさ (静的に置く)
+}
+
+/*----------------------------------------------------------------------------*/
+//     Hardware stand-in (qtouch.h から呼ばれる)
+/*----------------------------------------------------------------------------*/
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us) {
+  recorder.record_midi(FlightRec::MIDI_OUT, static_cast<uint32_t>(sweep_us), status, note, velocity);
+}
+void debug_pt(int pt) {
+  (void)pt;
+}
+
+/*----------------------------------------------------------------------------*/
+//     Scenarios
+/*----------------------------------------------------------------------------*/
+void ring() {
+  std::printf("== ring\n");
+  static FlightRing<256> r;
+  r.reset();
+  uint8_t rec[64];
+  bool ok = true;
+  uint32_t pushed = 0;
+  for (uint32_t n = 0; n < 1000; n++) {
+    size_t len = 1 + n % 40;
+    for (size_t i = 0; i < len; i++) {rec[i] = static_cast<uint8_t>(n + i);}
+    ok = ok && r.push(rec, len);
+    pushed += 1;
+    ok = ok && (r.used() <= 256) && r.valid() && (r.records() + r.overwritten() == pushed);
+  }
+  check(ok, "overwrite keeps record boundaries and counts");
+  // 古い順に読むと、最後に入れた record で終わる
+  std::vector<uint8_t> lin(r.used());
+  for (size_t i = 0; i < lin.size(); i++) {lin[i] = r.byte_at(i);}
+  std::vector<size_t> lens;
+  bool each = flight_each_record(lin.data(), lin.size(), [&](const uint8_t* p, size_t len) {
+    (void)p;
+    lens.push_back(len);
+  });
+  check(each && (lens.size() == r.records()) && (lens.back() == 1 + 999 % 40) && (lin.back() == static_cast<uint8_t>(999 + 39)),
+        "linear read ends with the newest record");
+  check(!r.push(rec, 0) && !r.push(lin.data(), 255), "empty and oversized records are refused");
+  // 電源投入直後の RAM (でたらめ) は弾く
+  std::mt19937 rng(7);
+  int accepted = 0;
+  for (int n = 0; n < 2000; n++) {
+    uint8_t* raw = reinterpret_cast<uint8_t*>(&r);
+    for (size_t i = 0; i < sizeof(r); i++) {raw[i] = static_cast<uint8_t>(rng());}
+    if (r.valid()) {accepted += 1;}
+  }
+  check(accepted == 0, "random RAM is not taken as a surviving ring");
+}
+
+void codec(int count) {
+  std::printf("== sweep codec\n");
+  const double noises[] = {0.0, 1.5, 40.0};
+  for (double noise : noises) {
+    for (size_t pads : {static_cast<size_t>(6), static_cast<size_t>(96), static_cast<size_t>(MAX_SENS)}) {
+      static FlightSweepEncoder<MAX_SENS> enc;
+      FlightSweepDecoder<MAX_SENS> dec;
+      enc.reset();
+      std::vector<Sweep> sweeps = synthetic(count, pads, noise, 2, 3);
+      uint8_t buf[FlightSweepEncoder<MAX_SENS>::MAX_RECORD];
+      bool ok = true;
+      size_t bytes = 0;
+      for (const Sweep& sw : sweeps) {
+        size_t len = enc.encode(buf, sw.time_us, sw.values, pads);
+        bytes += len;
+        ok = ok && (len <= sizeof(buf)) && dec.decode(buf, len) && (dec.time_us() == sw.time_us) && (dec.pads() == pads) &&
+             (std::memcmp(sw.values, [&]() {
+                static uint16_t v[MAX_SENS];
+                for (size_t i = 0; i < pads; i++) {v[i] = dec.value(i);}
+                return v;
+              }(), pads * 2) == 0);
+      }
+      char name[80];
+      std::snprintf(name, sizeof(name), "pads %3zu noise %4.1f: lossless, %5.1f bytes/sweep", pads, noise,
+                    static_cast<double>(bytes) / sweeps.size());
+      check(ok, name);
+    }
+  }
+  // 最悪: 全部のパッドが毎回大きく動く
+  static FlightSweepEncoder<MAX_SENS> enc;
+  enc.reset();
+  uint8_t buf[FlightSweepEncoder<MAX_SENS>::MAX_RECORD];
+  uint16_t v[MAX_SENS];
+  size_t worst = 0;
+  for (int n = 0; n < 200; n++) {
+    for (size_t i = 0; i < MAX_SENS; i++) {v[i] = static_cast<uint16_t>((n & 1) ? 65535 - i : i);}
+    worst = std::max(worst, enc.encode(buf, n, v, MAX_SENS));
+  }
+  check(worst <= FlightSweepEncoder<MAX_SENS>::MAX_RECORD, "worst case fits MAX_RECORD");
+}
+
+void recorder_dump() {
+  std::printf("== recorder and dump\n");
+  recorder.arm(96);
+  check(recorder.recording() && recorder.survived(), "armed recorder is recognised after a reset");
+  std::vector<Sweep> sweeps = synthetic(6000, 96, 1.5, 2, 11);
+  size_t events = 0;
+  for (size_t n = 0; n < sweeps.size(); n++) {
+    recorder.record_sweep(sweeps[n].time_us, sweeps[n].values, 96);
+    if (n % 50 == 0) {
+      recorder.record_midi(FlightRec::MIDI_OUT, sweeps[n].time_us, 0x9c, static_cast<uint8_t>(n / 50 % 128), 100);
+      events += 1;
+    }
+  }
+  check(recorder.sweeps().overwritten() > 0, "old sweeps were overwritten");
+  check(recorder.freeze(FlightReason::SYSEX, 1234) && !recorder.recording(), "freeze stops recording");
+  check(!recorder.freeze(FlightReason::SWITCH, 99) && (recorder.reason() == FlightReason::SYSEX), "second freeze is ignored");
+  const size_t used = recorder.sweeps().used();
+  recorder.record_sweep(1, sweeps[0].values, 96);
+  check(recorder.sweeps().used() == used, "frozen recorder does not change");
+
+  // RAM に残ったものとして別の場所に写しても読める (再起動の真似)
+  static QubitFlightRecorder copy;
+  std::memcpy(static_cast<void*>(&copy), &recorder, sizeof(copy));
+  check(copy.survived() && (copy.state() == FlightState::FROZEN), "copied RAM survives");
+
+  Tuning tuning = Tuning::defaults();
+  tuning.value[0] = 55;
+  CalibFlash f = mock_flash(FLASH_BYTES);
+  check(flight_dump_write(recorder, f, tuning, 7), "dump written");
+  FlightDumpInfo info;
+  check(flight_dump_read(flash, flash_size, info) && (info.seq == 7) && (info.reason == static_cast<uint8_t>(FlightReason::SYSEX)) &&
+        (info.pads == 96) && (info.tuning.value[0] == 55) && (info.sweep_records == recorder.sweeps().records()),
+        "dump header reads back");
+
+  // 読み戻した sweep は、入れた sweep の最後の部分と全く同じ
+  FlightSweepDecoder<MAX_SENS> dec;
+  std::vector<Sweep> got;
+  bool each = flight_each_record(flash + FLIGHT_PAGE_SIZE, info.sweep_bytes, [&](const uint8_t* p, size_t len) {
+    if (!dec.decode(p, len)) {return;}
+    Sweep sw = {};
+    sw.time_us = dec.time_us();
+    for (size_t i = 0; i < dec.pads(); i++) {sw.values[i] = dec.value(i);}
+    got.push_back(sw);
+  });
+  bool same = each && !got.empty() && (got.size() <= sweeps.size());
+  for (size_t k = 0; same && (k < got.size()); k++) {
+    const Sweep& want = sweeps[sweeps.size() - got.size() + k];
+    same = (want.time_us == got[k].time_us) && (std::memcmp(want.values, got[k].values, 96 * 2) == 0);
+  }
+  char name[80];
+  std::snprintf(name, sizeof(name), "last %zu sweeps decode exactly", got.size());
+  check(same, name);
+  size_t midi = 0;
+  bool freeze_mark = false;
+  each = flight_each_record(flash + FLIGHT_PAGE_SIZE + info.sweep_bytes, info.event_bytes, [&](const uint8_t* p, size_t len) {
+    if ((p[0] == static_cast<uint8_t>(FlightRec::MIDI_OUT)) && (len == 8)) {midi += 1;}
+    if (p[0] == static_cast<uint8_t>(FlightRec::FREEZE)) {freeze_mark = (p[5] == static_cast<uint8_t>(FlightReason::SYSEX));}
+  });
+  check(each && (midi == events) && freeze_mark, "events and the freeze mark read back");
+
+  // 壊れた dump / 入らない領域 / 書いている途中の電源断
+  flash[FLIGHT_PAGE_SIZE + 100] ^= 0x01;
+  check(!flight_dump_read(flash, flash_size, info), "a flipped body bit is detected");
+  f = mock_flash(SECTOR * 2);
+  check(!flight_dump_write(recorder, f, tuning, 8), "too small a region is refused");
+  f = mock_flash(FLASH_BYTES);
+  program_budget = static_cast<long>(used / 2);
+  flight_dump_write(recorder, f, tuning, 9);
+  check(!flight_dump_read(flash, flash_size, info), "power loss while dumping leaves no dump");
+
+  recorder.arm(96);
+  check((recorder.sweeps().used() == 0) && recorder.recording(), "re-armed after the dump");
+}
+
+void footprint(const std::vector<const char*>& traces) {
+  std::printf("== fixed memory and speed (recorder %zu bytes, dump %zu bytes)\n", sizeof(QubitFlightRecorder),
+              static_cast<size_t>(FLIGHT_DUMP_BYTES));
+  struct Source {const char* name; std::vector<Sweep> sweeps; size_t pads;};
+  std::vector<Source> sources;
+  sources.push_back({"quiet, 96 pads", synthetic(4000, 96, 0.0, 2, 5), 96});
+  sources.push_back({"noise 1.5, 96 pads", synthetic(4000, 96, 1.5, 2, 5), 96});
+  sources.push_back({"noise 1.5, 192 pads", synthetic(4000, MAX_SENS, 1.5, 2, 5), MAX_SENS});
+  for (const char* path : traces) {
+    Source s{path, {}, 0};
+    if (read_trace(path, s.sweeps, s.pads) && !s.sweeps.empty()) {sources.push_back(s);}
+  }
+  std::printf("  %-28s %8s %9s %7s %7s %7s\n", "source", "B/sweep", "sec@250Hz", "p50_ns", "p99_ns", "max_ns");
+  using clock = std::chrono::steady_clock;
+  bool no_heap = true;
+  for (Source& s : sources) {
+    recorder.arm(s.pads);
+    std::vector<uint32_t> ns;
+    ns.reserve(s.sweeps.size() * 4);
+    uint32_t t = 0;
+    size_t rounds = 0;
+    // 短い trace は何度か回して ring を一周させる
+    while ((rounds == 0) || (recorder.sweeps().overwritten() == 0 && rounds < 64)) {
+      for (const Sweep& sw : s.sweeps) {
+        const size_t before = heap_allocs;
+        auto t0 = clock::now();
+        recorder.record_sweep(t, sw.values, s.pads);
+        auto t1 = clock::now();
+        no_heap = no_heap && (heap_allocs == before);
+        ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+        t += 4000;
+      }
+      rounds += 1;
+    }
+    const double per_sweep = static_cast<double>(recorder.sweeps().used()) / recorder.sweeps().records();
+    const double seconds = recorder.sweeps().records() / 250.0;
+    const uint32_t p50 = percentile(ns, 500);
+    const uint32_t p99 = percentile(ns, 990);
+    std::printf("  %-28.28s %8.1f %9.2f %7u %7u %7u\n", s.name, per_sweep, seconds, p50, p99, ns.back());
+  }
+  check(no_heap, "record_sweep never touches the heap");
+  check(sizeof(QubitFlightRecorder) < FLIGHT_SWEEP_BYTES + FLIGHT_EVENT_BYTES + 2048, "recorder size is the two rings plus a fixed header");
+}
+
+/// trace を QubitTouch に流して記録し、dump を書く
+int make_dump(const char* out_path, const char* trace) {
+  std::vector<Sweep> sweeps;
+  size_t pads = 0;
+  if (!read_trace(trace, sweeps, pads) || sweeps.empty()) {return 1;}
+  static QubitTouch qt([](uint8_t status, uint8_t note, uint8_t velocity) {
+    sendMidiMessage(status, note, velocity, qt.frame_time_us());
+  });
+  qt.set_pad_count(pads);
+  recorder.arm(pads);
+  bool touched[MAX_TOUCH_POINTS] = {};
+  for (const Sweep& sw : sweeps) {
+    recorder.record_sweep(sw.time_us, sw.values, pads);
+    for (size_t i = 0; i < pads; i++) {qt.set_value(i, sw.values[i]);}
+    qt.set_frame_time(sw.time_us);
+    qt.seek_and_update_touch_point();
+    for (size_t i = 0; i < MAX_TOUCH_POINTS; i++) {
+      const TouchPoint& tp = qt.touch_point(i);
+      if (tp.is_touched() == touched[i]) {continue;}
+      touched[i] = tp.is_touched();
+      recorder.record_track(sw.time_us, static_cast<uint8_t>(i), touched[i], tp.note(),
+                            touched[i] ? static_cast<int16_t>(tp.get_location() * 100) : -1, tp.get_intensity());
+    }
+  }
+  recorder.freeze(FlightReason::SERIAL, sweeps.back().time_us);
+  CalibFlash f = mock_flash(FLASH_BYTES);
+  if (!flight_dump_write(recorder, f, Tuning::defaults(), 1)) {
+    std::fprintf(stderr, "dump failed\n");
+    return 1;
+  }
+  FlightDumpInfo info;
+  flight_dump_read(flash, flash_size, info);
+  FILE* fp = std::fopen(out_path, "wb");
+  if ((fp == nullptr) || (std::fwrite(flash, 1, info.total_bytes(), fp) != info.total_bytes())) {
+    std::fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+  std::fclose(fp);
+  std::printf("%s: %zu sweeps, %u sweep records, %u events, %zu bytes\n", out_path, sweeps.size(),
+              info.sweep_records, info.event_records, info.total_bytes());
+  return 0;
+}
+
+/// TinyUSB の CDC 送信 FIFO の真似: TELEMETRY_TX_FIFO byte まで溜まり、USB の frame ごとに PC へ出ていく
+class FifoSerial {
+  size_t used_ = 0;
+  bool overflow_ = false;
+
+public:
+  std::vector<uint8_t> host;    // PC が受け取ったもの
+
+  auto availableForWrite() const -> int {return static_cast<int>(TELEMETRY_TX_FIFO - used_);}
+  void write(const uint8_t* p, size_t n) {
+    if (used_ + n > TELEMETRY_TX_FIFO) {
+      overflow_ = true;
+      return;
+    }
+    host.insert(host.end(), p, p + n);
+    used_ += n;
+  }
+  /// USB の一 frame で bytes だけ PC へ出る
+  void usb_frame(size_t bytes) {used_ -= std::min(bytes, used_);}
+  auto overflow() const -> bool {return overflow_;}
+};
+
+// 本体の send_flight_upload() と同じ
+void send_flight_upload(FlightUpload& upload, FifoSerial& serial) {
+  static uint8_t frame[FLIGHT_UPLOAD_FRAME];
+  while (upload.active()) {
+    const int room = serial.availableForWrite();
+    size_t len = upload.next(frame, sizeof(frame), room > 0 ? static_cast<size_t>(room) : 0);
+    if (len == 0) {return;}
+    serial.write(frame, len);
+  }
+}
+
+void upload() {
+  std::printf("== upload ('d') through a %zu-byte CDC FIFO\n", TELEMETRY_TX_FIFO);
+  check(TELEMETRY_OVERHEAD + 4 + FLIGHT_PAGE_SIZE > TELEMETRY_TX_FIFO, "a whole-page frame would never fit the FIFO");
+  recorder.arm(96);
+  std::vector<Sweep> sweeps = synthetic(3000, 96, 1.5, 2, 21);
+  for (const Sweep& sw : sweeps) {recorder.record_sweep(sw.time_us, sw.values, 96);}
+  recorder.freeze(FlightReason::SWITCH, 77);
+  CalibFlash f = mock_flash(FLASH_BYTES);
+  FlightDumpInfo info;
+  if (!flight_dump_write(recorder, f, Tuning::defaults(), 3) || !flight_dump_read(flash, flash_size, info)) {
+    check(false, "dump written");
+    return;
+  }
+  const size_t total = info.total_bytes();
+
+  // serial_task() ごとに送り、その間に USB が 64 byte の frame をいくつか運ぶ (時々 PC が読まない)
+  FlightUpload up;
+  FifoSerial serial;
+  up.start(flash, total);
+  uint32_t tasks = 0;
+  while (up.active() && (tasks < 100000)) {
+    send_flight_upload(up, serial);
+    serial.usb_frame((tasks % 7 == 3) ? 0 : 64 * (1 + tasks % 3));
+    tasks += 1;
+  }
+  char name[96];
+  std::snprintf(name, sizeof(name), "%zu bytes sent in %u serial tasks", total, tasks);
+  check(!up.active() && !serial.overflow(), name);
+
+  // PC 側: telemetry_decode.py flight と同じく offset の順に並べる
+  TelemetryReader<FLIGHT_UPLOAD_FRAME> reader;
+  std::vector<uint8_t> image;
+  bool in_order = true;
+  for (uint8_t b : serial.host) {
+    if (!reader.feed(b) || (reader.type() != TelemetryType::FLIGHT) || (reader.length() < 4)) {continue;}
+    const uint8_t* p = reader.payload();
+    const uint32_t offset = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    if (offset != image.size()) {in_order = false;}
+    image.insert(image.end(), p + 4, p + reader.length());
+  }
+  check(in_order && (reader.errors() == 0), "frames arrive in order with good checksums");
+  check((image.size() == total) && (std::memcmp(image.data(), flash, total) == 0), "C++: the dump is reassembled exactly");
+
+  const std::string stream_path = "/tmp/flight_sim_upload.bin";
+  const std::string out_path = "/tmp/flight_sim_upload.qfd";
+  FILE* fp = std::fopen(stream_path.c_str(), "wb");
+  if (fp == nullptr) {
+    check(false, "write the upload stream");
+    return;
+  }
+  std::fwrite(serial.host.data(), 1, serial.host.size(), fp);
+  std::fclose(fp);
+  std::remove(out_path.c_str());
+  const std::string cmd = "python3 " + tools_dir + "/telemetry_decode.py flight " + stream_path + " " + out_path + " 2>/dev/null";
+  const int rc = std::system(cmd.c_str());
+  std::vector<uint8_t> py;
+  fp = std::fopen(out_path.c_str(), "rb");
+  if (fp != nullptr) {
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0) {py.insert(py.end(), buf, buf + n);}
+    std::fclose(fp);
+  }
+  check((rc == 0) && (py.size() == total) && (std::memcmp(py.data(), flash, total) == 0),
+        "telemetry_decode.py flight writes the same dump");
+  std::remove(stream_path.c_str());
+  std::remove(out_path.c_str());
+  recorder.arm(96);
+}
+
+int main(int argc, char* argv[]) {
+  // telemetry_decode.py はこの実行ファイルの隣
+  const std::string self = argv[0];
+  const size_t slash = self.find_last_of('/');
+  tools_dir = (slash == std::string::npos) ? "." : self.substr(0, slash);
+  int count = 3000;
+  const char* out_path = nullptr;
+  std::vector<const char*> traces;
+  for (int i = 1; i < argc; i++) {
+    if ((std::strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+      count = std::atoi(argv[++i]);
+    } else if ((std::strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+      out_path = argv[++i];
+    } else {
+      traces.push_back(argv[i]);
+    }
+  }
+  if (out_path != nullptr) {
+    if (traces.empty()) {
+      std::fprintf(stderr, "usage: flight_sim -o dump.qfd <trace.sweeps>\n");
+      return 2;
+    }
+    return make_dump(out_path, traces.front());
+  }
+  ring();
+  codec(count);
+  recorder_dump();
+  upload();
+  footprint(traces);
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+/* ========================================
+ *
+ *  governor_sim.cpp
+ *    description: OverloadGovernor (governor.h) を偽の時計と決めた負荷で動かす
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  - 窓ごとの slack と touch の遅れを直接与え、段階の上がる順 (SKIP_DISPLAY → NO_AMBIENT → LOW_LED_RATE)、
+ *    余裕が GOV_RECOVER_WINDOWS 続いた時に一段ずつ戻ること、減らした数を確かめる
+ *  - slack はタスクの走った時間だけを引く: run() の外の仕事や loop() の呼ばれる間は空き時間
+ *  - FrameScheduler と本体の loop() と同じ形で組み (run() の外の仕事も毎回入れる)、途中の 2 秒だけ重い負荷を入れる
+ *    段階が順に上がって戻ること、減らした数が各段階で走ったタスクの数と合うこと、
+ *    Touch と MIDI は一度も減らされないことを確かめる
+ *
+ *  build / run:
+ *    make -C tools governor_sim && tools/governor_sim
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "../governor.h"
+#include "../scheduler.h"
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+/*----------------------------------------------------------------------------*/
+//     窓を直接与える
+/*----------------------------------------------------------------------------*/
+/// 一つの窓 (GOV_WINDOW_US) を slack_pct の空き時間と touch の遅れ late_us で閉じる
+void window(OverloadGovernor& gov, uint64_t& t, uint32_t slack_pct, uint32_t late_us) {
+  const uint64_t idle = static_cast<uint64_t>(GOV_WINDOW_US) * slack_pct / 100;
+  gov.account_touch_late(late_us);
+  gov.account_loop(t, t + idle, false);
+  gov.account_loop(t + idle, t + GOV_WINDOW_US, true);
+  t += GOV_WINDOW_US;
+}
+
+void scripted_windows() {
+  std::printf("== scripted slack and lateness\n");
+  OverloadGovernor gov;
+  uint64_t t = 1000;
+  window(gov, t, 50, 100);      // 最初の窓の頭を決める
+  check(gov.level() == LoadLevel::NORMAL, "plenty of slack: normal");
+  check(!gov.shed_display_page() && !gov.shed_ambient_frame() && !gov.low_led_rate(), "normal sheds nothing");
+
+  std::vector<LoadLevel> seen;
+  for (int i = 0; i < 4; i++) {
+    window(gov, t, GOV_LOW_SLACK_PCT - 5, 100);
+    seen.push_back(gov.level());
+  }
+  check((seen == std::vector<LoadLevel>{LoadLevel::SKIP_DISPLAY, LoadLevel::NO_AMBIENT, LoadLevel::LOW_LED_RATE,
+                                         LoadLevel::LOW_LED_RATE}),
+        "low slack escalates display, then ambient, then LED rate");
+  check(gov.slack_pct() == GOV_LOW_SLACK_PCT - 5, "slack of the last window is reported");
+  check(gov.level_changes() == 3, "level stops at LOW_LED_RATE");
+
+  // 戻る: 余裕のある窓が GOV_RECOVER_WINDOWS 続くごとに一段
+  for (uint32_t i = 0; i < GOV_RECOVER_WINDOWS - 1; i++) {window(gov, t, 80, 100);}
+  check(gov.level() == LoadLevel::LOW_LED_RATE, "no step down before enough relaxed windows");
+  window(gov, t, 80, 100);
+  check(gov.level() == LoadLevel::NO_AMBIENT, "step down after relaxed windows");
+  // 間の窓 (slack が低くも高くもない) が入ると数え直す
+  for (uint32_t i = 0; i < GOV_RECOVER_WINDOWS - 1; i++) {window(gov, t, 80, 100);}
+  window(gov, t, (GOV_LOW_SLACK_PCT + GOV_HIGH_SLACK_PCT) / 2, 100);
+  window(gov, t, 80, 100);
+  check(gov.level() == LoadLevel::NO_AMBIENT, "an in-between window restarts the count");
+  // slack があっても touch が遅れていれば余裕とは見ない
+  for (uint32_t i = 0; i < GOV_RECOVER_WINDOWS; i++) {window(gov, t, 80, GOV_TOUCH_LATE_US / 2);}
+  check(gov.level() == LoadLevel::NO_AMBIENT, "late touch is not relaxed even with slack");
+  for (uint32_t i = 0; i < GOV_RECOVER_WINDOWS * 2; i++) {window(gov, t, 80, 100);}
+  check(gov.level() == LoadLevel::NORMAL, "back to normal one level at a time");
+
+  // touch の遅れだけでも上がる
+  window(gov, t, 80, GOV_TOUCH_LATE_US + 1);
+  check(gov.level() == LoadLevel::SKIP_DISPLAY, "touch lateness alone escalates");
+
+  // 減らした数
+  OverloadGovernor g2;
+  uint64_t t2 = 1000;
+  window(g2, t2, 0, 0);
+  check(g2.shed_display_page() && !g2.shed_ambient_frame(), "SKIP_DISPLAY sheds only the display");
+  window(g2, t2, 0, 0);
+  check(g2.shed_display_page() && g2.shed_ambient_frame() && !g2.low_led_rate(), "NO_AMBIENT also sheds ambient");
+  window(g2, t2, 0, 0);
+  check(g2.low_led_rate(), "LOW_LED_RATE halves the LED rate");
+
+  // run() の外の仕事と loop() の呼ばれる間: タスクは 1msec ごとに 200usec、残りは run() の外
+  OverloadGovernor g3;
+  uint64_t t3 = 1000;
+  while (t3 < 1000 + 2 * GOV_WINDOW_US) {
+    g3.account_loop(t3, t3 + 200, true);
+    g3.account_loop(t3 + 600, t3 + 610, false);
+    t3 += 1000;
+  }
+  check(g3.slack_pct() == 80, "time outside task runs counts as slack");
+  g2.count_shed_led_frames(3);
+  check((g2.shed_display() == 2) && (g2.shed_ambient() == 1) && (g2.shed_led() == 3) && (g2.shed_total() == 6),
+        "shed counters add up");
+}
+
+/*----------------------------------------------------------------------------*/
+//     FrameScheduler と組んで、決めた負荷を入れる
+/*----------------------------------------------------------------------------*/
+uint64_t fake_us = 0;
+uint64_t fake_clock() {return fake_us;}
+
+constexpr uint64_t HEAVY_FROM_US = 1000000;
+constexpr uint64_t HEAVY_UNTIL_US = 3000000;
+constexpr uint64_t END_US = 5000000;
+constexpr uint32_t LED_TASK_PERIOD = 16667;
+constexpr uint32_t LOOP_US = 10;
+
+OverloadGovernor governor;
+FrameScheduler sched(fake_clock);
+int led_task_id = -1;
+
+bool heavy() {return (fake_us >= HEAVY_FROM_US) && (fake_us < HEAVY_UNTIL_US);}
+
+// 走った数 (段階ごと) と、減らされた数
+uint32_t touch_runs = 0;
+uint32_t midi_runs = 0;
+uint32_t disp_runs_at[MAX_LOAD_LEVEL + 1] = {};
+uint32_t led_runs_at[MAX_LOAD_LEVEL + 1] = {};
+uint64_t last_touch_us = 0;
+uint32_t max_touch_gap_us = 0;
+
+void touch_task() {
+  touch_runs += 1;
+  max_touch_gap_us = std::max(max_touch_gap_us, static_cast<uint32_t>(fake_us - last_touch_us));
+  last_touch_us = fake_us;
+  fake_us += 150;
+}
+void midi_task() {
+  midi_runs += 1;
+  fake_us += 80;
+}
+// 本体の led_task() / display_task() と同じ所で governor に聞く。重い間は描くのに時間がかかる
+void led_task() {
+  led_runs_at[governor.level_num()] += 1;
+  fake_us += heavy() ? 2500 : 250;
+  if (!governor.shed_ambient_frame()) {fake_us += heavy() ? 2600 : 150;}
+  if (governor.low_led_rate()) {governor.count_shed_led_frames(1);}
+}
+void display_task() {
+  disp_runs_at[governor.level_num()] += 1;
+  if (governor.shed_display_page()) {return;}
+  fake_us += heavy() ? 3000 : 400;
+}
+// 重い間だけ外から入る仕事 (2msec ごとに 1msec)
+void load_task() {
+  if (heavy()) {fake_us += 1000;}
+}
+
+void scheduled_load() {
+  std::printf("== scheduler with injected load (heavy %.1f-%.1f s)\n", HEAVY_FROM_US * 1e-6, HEAVY_UNTIL_US * 1e-6);
+  fake_us = 0;
+  const int touch_id = sched.add_task("Touch", touch_task, 1000, 1000, 0);
+  const int midi_id = sched.add_task("MIDI", midi_task, 1000, 2000, 1);
+  led_task_id = sched.add_task("LED", led_task, LED_TASK_PERIOD, LED_TASK_PERIOD, 2);
+  sched.add_task("Disp", display_task, 250000, 250000, 3);
+  sched.add_task("Load", load_task, 2000, 2000, 4);
+  if ((touch_id < 0) || (midi_id < 0)) {return;}
+
+  std::vector<std::pair<uint64_t, uint8_t>> changes;
+  bool led_slow = false;
+  while (fake_us < END_US) {
+    // 本体の loop() と同じ
+    const uint64_t loop_start = fake_us;
+    const int task_id = sched.run();
+    if (task_id == touch_id) {governor.account_touch_late(sched.task(task_id).last_jitter_us);}
+    const uint8_t before = governor.level_num();
+    governor.account_loop(loop_start, fake_us, task_id >= 0);
+    // run() の外の仕事 (heartbeat、OLED の flush、stream の drain)。governor は空き時間とみなす
+    fake_us += LOOP_US;
+    if (governor.level_num() != before) {changes.push_back({fake_us, governor.level_num()});}
+    if (governor.low_led_rate() != led_slow) {
+      led_slow = governor.low_led_rate();
+      sched.set_period(led_task_id, led_slow ? LED_TASK_PERIOD * 2 : LED_TASK_PERIOD);
+    }
+  }
+  for (auto& c : changes) {std::printf("  %.2f s -> level %u\n", c.first * 1e-6, c.second);}
+  std::vector<uint8_t> levels;
+  for (auto& c : changes) {levels.push_back(c.second);}
+  check((levels == std::vector<uint8_t>{1, 2, 3, 2, 1, 0}), "load escalates 1, 2, 3 and recovers 2, 1, 0");
+  check(!changes.empty() && (changes.front().first >= HEAVY_FROM_US) && (changes.front().first <= HEAVY_FROM_US + 2 * GOV_WINDOW_US),
+        "escalation starts within two windows of the load");
+  check((changes.size() >= 4) && (changes[3].first >= HEAVY_UNTIL_US + GOV_RECOVER_WINDOWS * GOV_WINDOW_US),
+        "recovery waits for relaxed windows");
+  check(governor.level() == LoadLevel::NORMAL, "ends at normal");
+
+  const uint32_t disp_shed = disp_runs_at[1] + disp_runs_at[2] + disp_runs_at[3];
+  const uint32_t ambient_shed = led_runs_at[2] + led_runs_at[3];
+  std::printf("  shed display %u ambient %u led %u (display runs by level %u/%u/%u/%u, LED %u/%u/%u/%u)\n",
+              governor.shed_display(), governor.shed_ambient(), governor.shed_led(),
+              disp_runs_at[0], disp_runs_at[1], disp_runs_at[2], disp_runs_at[3],
+              led_runs_at[0], led_runs_at[1], led_runs_at[2], led_runs_at[3]);
+  check(governor.shed_display() == disp_shed, "shed display pages = display runs at SKIP_DISPLAY or above");
+  check(governor.shed_ambient() == ambient_shed, "shed ambient frames = LED runs at NO_AMBIENT or above");
+  check((governor.shed_led() == led_runs_at[3]) && (led_runs_at[3] > 0), "shed LED frames = LED runs at LOW_LED_RATE");
+
+  const SchedTask& touch = sched.task(touch_id);
+  std::printf("  touch runs %u (skipped %u) max gap %u us, midi runs %u\n", touch_runs, touch.skipped, max_touch_gap_us, midi_runs);
+  check((touch_runs == touch.runs) && (midi_runs == sched.task(midi_id).runs), "touch and MIDI run every time they are picked");
+  check(touch_runs + touch.skipped >= END_US / 1000 * 95 / 100, "touch keeps its rate through the load");
+  check(midi_runs >= END_US / 1000 * 90 / 100, "MIDI keeps its rate through the load");
+}
+}
+
+int main() {
+  scripted_windows();
+  scheduled_load();
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
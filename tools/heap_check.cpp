@@ -0,0 +1,233 @@
+/* ========================================
+ *
+ *  heap_check.cpp
+ *    description: 定常状態の一周で heap を使わないことを heap_monitor.cpp の数で確かめる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  heap_monitor.cpp をそのままリンクし、malloc / free / calloc / realloc を --wrap で数える
+ *  (本体で USE_HEAP_WRAP の時と同じ数え方。operator new も malloc を通るので数に入る)
+ *  - 数える仕組みが生きていること (malloc, new, std::vector の伸び)
+ *  - 本体の Core0 の一周と同じ仕事を arm した後に何千回も回し、一周ごとの確保・解放が 0 であること
+ *      touch     : QubitTouch に指が滑る sweep を流し、MIDI と LED (LedFrame) を出す
+ *      display   : display_page1() と同じ並びで TextBuf を作り OledFrame に描き、dirty rect を取り出す
+ *      telemetry : SweepEncoder → ByteRing → 読み出し、遅延の 'l' レポートの行、TelemetryWriter のフレーム
+ *
+ *  build / run:
+ *    make -C tools heap_check && tools/heap_check [-n iterations]
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "../heap_monitor.h"
+#include "../qtouch.h"
+#include "../led_frame.h"
+#include "../oled_fb.h"
+#include "../text_buf.h"
+#include "../telemetry.h"
+#include "../sensor_stream.h"
+#include "../latency.h"
+#include "../constants.h"
+
+/*----------------------------------------------------------------------------*/
+//     Hardware stand-in (本体では loopian_qubit.ino が定義する)
+/*----------------------------------------------------------------------------*/
+uint32_t midi_messages = 0;
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us) {
+  (void)status;
+  (void)note;
+  (void)velocity;
+  (void)sweep_us;
+  midi_messages += 1;
+}
+void debug_pt(int pt) {
+  (void)pt;
+}
+
+namespace {
+constexpr size_t PADS = 48;
+constexpr uint32_t SWEEP_US = 4000;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+QubitTouch qt([](uint8_t status, uint8_t note, uint8_t intensity) {
+  sendMidiMessage(status, note, intensity, qt.frame_time_us());
+});
+LedFrame led_frame;
+OledFrame oled;
+LatencyTrace latency;
+SweepEncoder<MAX_SENS> encoder;
+ByteRing<4096> ring;
+uint16_t sensor_values[MAX_SENS];
+uint32_t telemetry_bytes = 0;
+uint32_t oled_bytes = 0;
+
+/// 一本の指が PADS を一周する間に、ときどき離れる sweep
+void make_sweep(uint32_t n) {
+  const bool lifted = (n % 200) >= 170;
+  const float pos = std::fmod(static_cast<float>(n) * 0.05f, static_cast<float>(PADS));
+  for (size_t p = 0; p < PADS; p++) {
+    float d = std::fabs(static_cast<float>(p) - pos);
+    d = std::fmin(d, static_cast<float>(PADS) - d);
+    float v = (!lifted && (d < 1.6f)) ? 300.0f * (1.0f - (d / 1.6f) * (d / 1.6f)) : 0.0f;
+    sensor_values[p] = static_cast<uint16_t>(v + static_cast<float>((n * 7 + p * 13) % 3));
+  }
+}
+
+// touch_task() + led_task() の LED 部分
+void touch_step(uint32_t n) {
+  make_sweep(n);
+  for (size_t i = 0; i < PADS; i++) {qt.set_value(i, sensor_values[i]);}
+  qt.set_frame_time(static_cast<uint64_t>(n) * SWEEP_US);
+  qt.seek_and_update_touch_point();
+  led_frame.clear_touch();
+  qt.lighten_leds([](float locate, int16_t sensor_value) {
+    led_frame.set_by_touch(locate, sensor_value, true);
+  });
+  latency.record(LatencyStage::SWEEP_TO_NOTE_QUEUED, 100 + n % 50);
+}
+
+// display_task(): display_page1() と同じ並び、SSD1331_flush() と同じ取り出し方
+void display_step(uint32_t n) {
+  oled.draw_line(0, "Loopian::QUBIT", 0xF81F, 0);
+  for (size_t i = 0; i < MAX_TOUCH_POINTS; i++) {
+    TextBuf<24> disp_str;
+    disp_str.add_int(static_cast<int32_t>(i)).add("> ");
+    float disp_loc = qt.touch_point(i).get_location();
+    if (disp_loc == TouchPoint::INIT_VAL) {
+      disp_str.add(" L:---");
+    } else {
+      disp_str.add(" L:").add_fixed(disp_loc, 1);
+    }
+    disp_str.add('/').add_fixed(qt.touch_point(i).get_intensity(), 1);
+    oled.draw_line(static_cast<int>(i) + 1, disp_str.c_str(), 0xFFFF, 0);
+  }
+  TextBuf<24> loop_info;
+  loop_info.add("LpCntr: ").add_int(static_cast<int32_t>(n));
+  oled.draw_line(5, loop_info.c_str(), 0xFFE0, 0);
+  OledRect r;
+  while (oled.take_dirty_rect(r)) {oled_bytes += static_cast<uint32_t>(OledFrame::row_bytes(r.w) * r.h);}
+}
+
+// stream_sweep() / drain_sensor_stream() と、print_latency_report() の一行、export_profile() の枠
+void telemetry_step(uint32_t n) {
+  uint8_t frame[SweepEncoder<MAX_SENS>::MAX_FRAME];
+  size_t len = encoder.encode(frame, sizeof(frame), n * SWEEP_US, sensor_values, PADS);
+  if ((len == 0) || !ring.push(frame, len)) {encoder.force_keyframe();}
+  const uint8_t* data;
+  while ((len = ring.peek(data)) > 0) {
+    telemetry_bytes += static_cast<uint32_t>(len);
+    ring.consume(len);
+  }
+  for (size_t i = 0; i < LATENCY_STAGES; i++) {
+    const LatencyHistogram& h = latency.hist[i];
+    TextBuf<80> line;
+    line.add(LatencyTrace::name(i)).add(' ').add_uint(h.count()).add(' ').add_uint(h.min())
+        .add(' ').add_uint(h.p50()).add(' ').add_uint(h.p90()).add(' ').add_uint(h.p99())
+        .add(' ').add_uint(h.max());
+    telemetry_bytes += static_cast<uint32_t>(line.length());
+  }
+  uint8_t prof[64];
+  TelemetryWriter w(prof, sizeof(prof), TelemetryType::PROFILE);
+  w.put32(n);
+  for (uint8_t i = 0; i < 8; i++) {w.put16(static_cast<uint16_t>(n + i));}
+  telemetry_bytes += static_cast<uint32_t>(w.finish());
+}
+
+void one_loop(uint32_t n) {
+  touch_step(n);
+  display_step(n);
+  telemetry_step(n);
+}
+
+// 組になった確保と解放をコンパイラが消さないように、一度外へ出す
+void* volatile sink = nullptr;
+
+void hooks_are_live() {
+  std::printf("== counting works\n");
+  heap_monitor_arm();
+  sink = std::malloc(100);
+  std::free(sink);
+  HeapStats st = heap_monitor_stats();
+  check(st.malloc_hooked, "malloc/free are hooked");
+  check((st.allocs == 1) && (st.frees == 1) && (st.bytes == 100), "malloc/free are counted");
+
+  heap_monitor_arm();
+  sink = new int[8];
+  delete[] static_cast<int*>(sink);
+  st = heap_monitor_stats();
+  check((st.allocs == 1) && (st.frees == 1), "new[]/delete[] are counted once each");
+
+  heap_monitor_arm();
+  {
+    std::vector<int> v;
+    for (int i = 0; i < 100; i++) {v.push_back(i);}
+  }
+  st = heap_monitor_stats();
+  check((st.allocs > 1) && (st.allocs == st.frees), "a growing vector is seen");
+
+  heap_monitor_arm();
+  void* r = std::realloc(nullptr, 10);
+  r = std::realloc(r, 20);
+  std::free(r);
+  st = heap_monitor_stats();
+  check((st.allocs == 2) && (st.frees == 2), "realloc counts as alloc (+ free when it moves)");
+  heap_monitor_disarm();
+}
+
+void steady_state(uint32_t iterations) {
+  std::printf("== steady-state loop (%u iterations after warm-up)\n", iterations);
+  qt.set_pad_count(PADS);
+  led_frame.set_light_count(PADS);
+  // 最初の一周目 (static の初期化など) は数えない
+  for (uint32_t n = 0; n < 200; n++) {one_loop(n);}
+
+  heap_monitor_arm();
+  uint32_t worst = 0;
+  uint32_t worst_at = 0;
+  uint32_t before = 0;
+  const uint32_t midi_before = midi_messages;
+  for (uint32_t n = 200; n < 200 + iterations; n++) {
+    one_loop(n);
+    const HeapStats st = heap_monitor_stats();
+    const uint32_t ops = st.allocs + st.frees;
+    if (ops - before > worst) {
+      worst = ops - before;
+      worst_at = n;
+    }
+    before = ops;
+  }
+  const HeapStats st = heap_monitor_stats();
+  heap_monitor_disarm();
+  std::printf("  allocs %u frees %u bytes %u (worst iteration %u ops at %u)\n", st.allocs, st.frees, st.bytes,
+              worst, worst_at);
+  std::printf("  midi %u, oled %u bytes, telemetry %u bytes\n", midi_messages - midi_before, oled_bytes, telemetry_bytes);
+  check(midi_messages > midi_before, "the loop produced MIDI (touches came and went)");
+  check((oled_bytes > 0) && (telemetry_bytes > 0), "the loop drew the display and formatted telemetry");
+  check((st.allocs == 0) && (st.frees == 0), "no allocation or free in any steady-state iteration");
+}
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t iterations = 5000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {iterations = static_cast<uint32_t>(std::atoi(argv[i + 1]));}
+  }
+  hooks_are_live();
+  steady_state(iterations);
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#  Created by Hasebe Masahiko on 2025/10/19.
+#  Copyright (c) 2025 Hasebe Masahiko.
+#  Released under the MIT license
+#  https://opensource.org/licenses/mit-license.php
+#
+#  HOT_FUNC (placement.h) を付けた関数が、本当に SRAM で実行される場所に置かれたかを ELF で確かめる
+#  大きさをグループごとに出し、flash に残っているものがあれば終了コード 1
+#
+#  使い方:
+#    arduino-cli compile --fqbn rp2040:rp2040:seeed_xiao_rp2040 --output-dir build .
+#    python3 tools/hot_check.py build/loopian_qubit.ino.elf [-v] [--readelf arm-none-eabi-readelf] [--require a,b]
+#      -v         HOT_FUNC 以外で SRAM にある関数 (SDK の __not_in_flash_func など) も出す
+#      --require  この関数は symbol として有ること (無ければ終了コード 1)
+#
+#  リンク前の .o を渡した時は、.time_critical.* section にあるかで判断する
+#  inline 展開されて symbol が無い関数は、呼んでいる側と一緒に置かれるので "inlined" とだけ出す
+#  (.o では、その .o に無いだけのこともある)
+#
+#  ARM の toolchain が無くても、ヘッダの関数はホストで確かめられる (hot_units.cpp を .o にして渡す):
+#    make -C tools hot_check
+#
+import re
+import subprocess
+import sys
+
+# グループ → HOT_FUNC を付けた関数 (demangle 後の名前、引数は見ない)
+HOT_SET = [
+    ("scan (core1)", [
+        "scan_sweep", "select_kamaboko", "read_selected_AT42QT", "get_sensor_values",
+        "pca9544_changeI2cBus", "write_i2cDevice", "AT42QT_read", "read_nbyte_i2cDeviceX",
+        "flight_record_sweep", "flush_led_i2c",
+    ]),
+    ("touch (core0)", [
+        "touch_task", "QubitTouch::set_value", "QubitTouch::seek_and_update_touch_point",
+        "QubitTouch::is_peak", "QubitTouch::new_touch_point", "QubitTouch::erase_touch_point",
+        "TouchPoint::update_touch",
+    ]),
+    ("led (core0)", [
+        "callback_for_set_led", "update_neo_pixel", "LedFrame::set_by_touch",
+        "AccompanimentLayer::apply", "SK6812::show",
+    ]),
+]
+SRAM_BASE = 0x20000000
+
+
+def run(cmd):
+    return subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+
+
+def sections(readelf, elf):
+    """section 番号 → 名前"""
+    table = {}
+    for line in run([readelf, "-W", "-S", elf]).splitlines():
+        m = re.match(r"\s*\[\s*(\d+)\]\s+(\S+)", line)
+        if m:
+            table[m.group(1)] = m.group(2)
+    return table
+
+
+def functions(readelf, elf):
+    """(名前, 大きさ, RAM にあるか) の関数シンボル"""
+    relocatable = "REL (" in run([readelf, "-h", elf])
+    secs = sections(readelf, elf)
+    for line in run([readelf, "-W", "-s", "-C", elf]).splitlines():
+        f = line.split(None, 7)
+        if len(f) < 8 or not f[0].endswith(":") or f[3] != "FUNC":
+            continue
+        if relocatable:
+            in_ram = secs.get(f[6], "").startswith(".time_critical")
+        else:
+            in_ram = (int(f[1], 16) & ~1) >= SRAM_BASE
+        name = f[7].split("(")[0]
+        yield name, int(f[2], 0), in_ram
+
+
+def main():
+    args = sys.argv[1:]
+    verbose = "-v" in args
+    readelf = "arm-none-eabi-readelf"
+    if "--readelf" in args:
+        readelf = args[args.index("--readelf") + 1]
+    required = []
+    if "--require" in args:
+        required = [n for n in args[args.index("--require") + 1].split(",") if n]
+    files = [a for a in args if a.endswith((".elf", ".o"))]
+    if not files:
+        print("usage: hot_check.py <file.elf> [-v] [--readelf path]")
+        sys.exit(1)
+
+    found = {}
+    others = []
+    for name, size, in_ram in functions(readelf, files[0]):
+        # 同じ名前が複数あれば (多重定義、複製) flash のものを優先して残す
+        if name not in found or not in_ram:
+            found[name] = (size, in_ram)
+    expected = {n for _, names in HOT_SET for n in names}
+    for name, (size, in_ram) in found.items():
+        if in_ram and name not in expected:
+            others.append((size, name))
+
+    in_flash = 0
+    total = 0
+    for group, names in HOT_SET:
+        ram_bytes = 0
+        print(f"== {group}")
+        for n in names:
+            if n not in found:
+                print(f"    {'-':>6s}  inlined    {n}")
+                continue
+            size, in_ram = found[n]
+            print(f"    {size:6d}  {'ram' if in_ram else 'FLASH':9s}  {n}")
+            if in_ram:
+                ram_bytes += size
+            else:
+                in_flash += 1
+        print(f"    {ram_bytes:6d}  bytes in SRAM")
+        total += ram_bytes
+    print(f"hot set total {total} bytes in SRAM")
+    if verbose and others:
+        print(f"== other functions in SRAM ({sum(s for s, _ in others)} bytes)")
+        for size, name in sorted(others, reverse=True):
+            print(f"    {size:6d}  {name}")
+    missing = [n for n in required if n not in found]
+    for n in missing:
+        print(f"{n}: no symbol (required)")
+    if in_flash:
+        print(f"{in_flash} hot function(s) still in flash")
+    if in_flash or missing:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,19 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+//  ホストで placement.h の RP2040 側を通すための pico/platform.h の代わり (make -C tools hot_check)
+//  section の名前の付け方は pico-sdk (src/rp2_common/pico_platform) と同じ
+//
+#ifndef HOT_STUB_PICO_PLATFORM_H
+#define HOT_STUB_PICO_PLATFORM_H
+
+#define __STRING(x) #x
+#define __not_in_flash(group)           __attribute__((section(".time_critical." group)))
+#define __not_in_flash_func(func_name)  __not_in_flash(__STRING(func_name)) func_name
+#define __scratch_x(group)              __attribute__((section(".scratch_x." group)))
+#define __scratch_y(group)              __attribute__((section(".scratch_y." group)))
+#define __uninitialized_ram(group)      __attribute__((section(".uninitialized_data." #group))) group
+
+#endif // HOT_STUB_PICO_PLATFORM_H
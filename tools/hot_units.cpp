@@ -0,0 +1,24 @@
+/* ========================================
+ *
+ *  hot_units.cpp
+ *    description: HOT_FUNC を付けたヘッダの関数を、ホストの g++ で .o に出す (make -C tools hot_check)
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  ARDUINO_ARCH_RP2040 を定義し、pico/platform.h は hot_stub/ のものを使って placement.h の
+ *  RP2040 側 (HOT_FUNC → .time_critical.*) を通す。public な関数は address を取って、inline でも symbol を残す
+ *  (private な is_peak() などは、呼んでいる側に展開されなければ一緒に出てくる)
+ *  hot_check.py はこの .o の section を見て、ヘッダの hot な関数が .time_critical にあるかを確かめる
+ *  (.ino / peripheral.cpp / sk6812.cpp の関数は Arduino の環境が要るので、ここには無い)
+ *
+ * ========================================
+*/
+#include "../qtouch.h"
+#include "../led_frame.h"
+
+void (QubitTouch::*hot_set_value)(size_t, uint16_t) = &QubitTouch::set_value;
+void (QubitTouch::*hot_seek)() = &QubitTouch::seek_and_update_touch_point;
+void (TouchPoint::*hot_update_touch)(float, uint16_t, uint16_t, float) = &TouchPoint::update_touch;
+void (LedFrame::*hot_set_by_touch)(float, int16_t, bool) = &LedFrame::set_by_touch;
+void (AccompanimentLayer::*hot_apply)(LedFrame&) const = &AccompanimentLayer::apply;
@@ -0,0 +1,138 @@
+/* ========================================
+ *
+ *  kernel_check.cpp
+ *    description: signal_kernels.h の各版を portable な基準と比べる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  window_moments_dual16 (RP2350 では SMLAD、ここでは C で真似たもの) が
+ *  window_moments_ref と全部の窓の幅・値の範囲で一致すること、
+ *  重心と減衰が以前の float で足していく計算と同じ値になることを確かめる
+ *
+ *  build / run:
+ *    make -C tools kernel_check && tools/kernel_check [-n cases]
+ *  全部通れば終了コード 0、どれかが違えば 1
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "../signal_kernels.h"
+
+namespace {
+constexpr int MAX_RADIUS = 7;
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-52s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+}
+
+/*----------------------------------------------------------------------------*/
+//     Scenarios
+/*----------------------------------------------------------------------------*/
+void moments(int cases) {
+  std::printf("== window_moments (ref / dual16)\n");
+  std::mt19937 rng(1);
+  // 触っていない所 / 普通のタッチ / int16 の端 (mv_avg は 4 sample の合計なので大きくなりうる)
+  const int ranges[][2] = {{0, 40}, {0, 4 * 1023}, {-32768, 32767}};
+  for (const auto& r : ranges) {
+    std::uniform_int_distribution<int> value(r[0], r[1]);
+    for (int radius = 0; radius <= MAX_RADIUS; radius++) {
+      bool ok = true;
+      alignas(4) int16_t v[2 * MAX_RADIUS + 2];
+      for (int n = 0; (n < cases) && ok; n++) {
+        for (int j = 0; j < 2 * radius + 1; j++) {v[j] = static_cast<int16_t>(value(rng));}
+        WindowMoments a = window_moments_ref(v, radius);
+        WindowMoments b = window_moments_dual16(v, radius);
+        WindowMoments c = window_moments(v, radius);
+        ok = (a.sum == b.sum) && (a.moment == b.moment) && (a.sum == c.sum) && (a.moment == c.moment);
+      }
+      char name[80];
+      std::snprintf(name, sizeof(name), "radius %d, values %d..%d", radius, r[0], r[1]);
+      check(ok, name);
+    }
+  }
+  // 奇数個の窓が 4byte 境界にない時も同じ (memcpy で読む)
+  alignas(4) int16_t buf[2 * MAX_RADIUS + 3];
+  for (int j = 0; j < 2 * MAX_RADIUS + 3; j++) {buf[j] = static_cast<int16_t>(j * 300 - 2000);}
+  bool ok = true;
+  for (int radius = 0; radius <= MAX_RADIUS; radius++) {
+    WindowMoments a = window_moments_ref(buf + 1, radius);
+    WindowMoments b = window_moments_dual16(buf + 1, radius);
+    ok = ok && (a.sum == b.sum) && (a.moment == b.moment);
+  }
+  check(ok, "unaligned window");
+}
+
+void centroid(int cases) {
+  std::printf("== centroid (qtouch.h step 2)\n");
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int> value(0, 4 * 1023);
+  std::uniform_int_distribution<int> pad(0, 191);
+  for (int radius = 1; radius <= 4; radius++) {
+    bool ok = true;
+    for (int n = 0; (n < cases) && ok; n++) {
+      int16_t v[2 * MAX_RADIUS + 1];
+      int tp = pad(rng);
+      // 以前の計算: int16 の合計と、float に足していく位置
+      int16_t old_sum = 0;
+      float old_locate = 0.0f;
+      for (int j = 0; j < 2 * radius + 1; j++) {
+        v[j] = static_cast<int16_t>(value(rng));
+        old_sum += v[j];
+        old_locate += (tp + j - radius) * v[j];
+      }
+      old_locate /= old_sum;
+      WindowMoments m = window_moments(v, radius);
+      int16_t sum = static_cast<int16_t>(m.sum);
+      float locate = static_cast<float>(tp * m.sum + m.moment) / sum;
+      ok = (sum == old_sum) && (std::memcmp(&locate, &old_locate, sizeof(float)) == 0);
+    }
+    char name[80];
+    std::snprintf(name, sizeof(name), "radius %d: same intensity and location bits", radius);
+    check(ok, name);
+  }
+}
+
+void falloffs(int cases) {
+  std::printf("== falloff (led_frame.h set_by_touch)\n");
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> loc(0.0f, 192.0f);
+  std::uniform_int_distribution<int> intensity(1, 32767);
+  bool ok = true;
+  for (int n = 0; (n < cases) && ok; n++) {
+    float locate = loc(rng);
+    const float SLOPE = 20000.0f / intensity(rng);
+    float lower = static_cast<float>(static_cast<int>(locate));
+    for (int k = 0; k < 600; k++, lower -= 1.0f) {
+      int16_t old_val = static_cast<int16_t>(255 - (locate - lower) * SLOPE);
+      if (falloff(locate - lower, SLOPE) != old_val) {ok = false; break;}
+      if (old_val < 0) {break;}
+    }
+  }
+  check(ok, "same values as the inline expression");
+}
+
+int main(int argc, char* argv[]) {
+  int cases = 20000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {cases = std::atoi(argv[i + 1]);}
+  }
+#if defined(__ARM_FEATURE_DSP)
+  std::printf("window_moments: dual16 (SMLAD)\n");
+#else
+  std::printf("window_moments: ref (dual16 is emulated for the comparison)\n");
+#endif
+  moments(cases);
+  centroid(cases);
+  falloffs(cases);
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/* ========================================
+ *
+ *  latency_check.cpp
+ *    description: LatencyHistogram (latency.h) の p50 / p99 を、並べ替えた正確な値と比べる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  - bucket_of() / bucket_upper(): 端の値 (0-7、2^k-1 / 2^k / 2^k+1、UINT32_MAX) が
+ *    自分のバケツの範囲に入り、バケツ番号が値の順に並ぶこと。2^25 以上は溢れのバケツだけに入ること
+ *  - percentile(): 決めた乱数 (小さな値、対数に広い値、溢れを含む値) と端の値の列で、
+ *    p50 / p90 / p99 が正確な値を含むバケツの上限 (max で頭打ち) と一致し、
+ *    誤差が 1/LAT_SUB_BUCKETS 以内であること
+ *
+ *  build / run:
+ *    make -C tools latency_check && tools/latency_check
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "../latency.h"
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+// 決まった乱数 (xorshift)
+uint32_t rng_state = 2463534242u;
+uint32_t rnd() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+auto edge_values() -> std::vector<uint32_t> {
+  std::vector<uint32_t> v;
+  for (uint32_t i = 0; i < 8; i++) {v.push_back(i);}
+  for (int k = 1; k < 32; k++) {
+    v.push_back((1u << k) - 1);
+    v.push_back(1u << k);
+    v.push_back((1u << k) + 1);
+  }
+  v.push_back(UINT32_MAX - 1);
+  v.push_back(UINT32_MAX);
+  std::sort(v.begin(), v.end());
+  v.erase(std::unique(v.begin(), v.end()), v.end());
+  return v;
+}
+
+/// 一つ下のバケツに入る最大の値 + 1 (= このバケツの最小の値)
+auto bucket_lower(size_t idx) -> uint64_t {
+  return idx == 0 ? 0 : static_cast<uint64_t>(LatencyHistogram::bucket_upper(idx - 1)) + 1;
+}
+
+void buckets() {
+  std::printf("== bucket_of / bucket_upper (%zu buckets)\n", LAT_BUCKETS);
+  const std::vector<uint32_t> edges = edge_values();
+  bool inside = true, ordered = true, exact_small = true;
+  size_t prev = 0;
+  for (uint32_t v : edges) {
+    const size_t b = LatencyHistogram::bucket_of(v);
+    if ((b >= LAT_BUCKETS) || (v < bucket_lower(b)) || (v > LatencyHistogram::bucket_upper(b))) {
+      inside = false;
+      std::printf("  %u -> bucket %zu [%llu, %u]\n", v, b, static_cast<unsigned long long>(bucket_lower(b)),
+                  LatencyHistogram::bucket_upper(b));
+    }
+    if (b < prev) {ordered = false;}
+    prev = b;
+    if ((v < LAT_SUB_BUCKETS) && (b != v)) {exact_small = false;}
+  }
+  check(inside, "every edge value lies inside its bucket's range");
+  check(ordered, "bucket numbers rise with the value");
+  check(exact_small, "0-7 have one bucket each");
+  bool contiguous = true;
+  for (size_t i = 1; i < LAT_BUCKETS; i++) {
+    if (LatencyHistogram::bucket_upper(i) <= LatencyHistogram::bucket_upper(i - 1)) {contiguous = false;}
+  }
+  check(contiguous, "bucket ranges are contiguous and strictly increasing");
+  const uint32_t top = (1u << (LAT_MAX_POW + 1)) - 1;
+  check((LatencyHistogram::bucket_of(top) == LAT_OVERFLOW_BUCKET - 1) && (LatencyHistogram::bucket_upper(LAT_OVERFLOW_BUCKET - 1) == top),
+        "2^25-1 is the top of the last regular bucket");
+  check((LatencyHistogram::bucket_of(top + 1) == LAT_OVERFLOW_BUCKET) && (LatencyHistogram::bucket_of(UINT32_MAX) == LAT_OVERFLOW_BUCKET) &&
+        (LatencyHistogram::bucket_upper(LAT_OVERFLOW_BUCKET) == UINT32_MAX),
+        "2^25 and above go only to the overflow bucket");
+}
+
+/// values の正確な permille 番目 (percentile() と同じく、切り上げた順位の値)
+auto exact(std::vector<uint32_t> values, uint16_t permille) -> uint32_t {
+  std::sort(values.begin(), values.end());
+  uint64_t rank = (static_cast<uint64_t>(values.size()) * permille + 999) / 1000;
+  if (rank == 0) {rank = 1;}
+  return values[rank - 1];
+}
+
+/// p50 / p90 / p99 を正確な値と比べる。違えば false
+auto compare(const char* name, const std::vector<uint32_t>& values) -> bool {
+  LatencyHistogram h;
+  for (uint32_t v : values) {h.record(v);}
+  bool ok = (h.count() == values.size());
+  for (uint16_t permille : {500, 900, 990}) {
+    const uint32_t want = exact(values, permille);
+    const uint32_t got = h.percentile(permille);
+    const uint32_t expect = std::min(LatencyHistogram::bucket_upper(LatencyHistogram::bucket_of(want)), h.max());
+    // 溢れのバケツ以外は 1/8 以内 (0-7 は正確)
+    const bool close = (LatencyHistogram::bucket_of(want) == LAT_OVERFLOW_BUCKET) ||
+                       (static_cast<uint64_t>(got - want) * LAT_SUB_BUCKETS <= want);
+    if ((got != expect) || (got < want) || !close) {
+      std::printf("  %s p%.1f: exact %u histogram %u (expected %u)\n", name, permille / 10.0, want, got, expect);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void percentiles() {
+  std::printf("== p50 / p90 / p99 against sorted values\n");
+  bool small = true, wide = true, over = true, edge = true, sizes = true;
+  for (int round = 0; round < 50; round++) {
+    std::vector<uint32_t> v;
+    const size_t n = 1 + rnd() % 3000;
+    for (size_t i = 0; i < n; i++) {v.push_back(rnd() % 12);}
+    small = compare("small", v) && small;
+
+    v.clear();
+    for (size_t i = 0; i < n; i++) {v.push_back(rnd() >> (rnd() % 32));}   // 対数に広い
+    wide = compare("wide", v) && wide;
+
+    v.clear();
+    for (size_t i = 0; i < n; i++) {
+      v.push_back((rnd() % 4 == 0) ? (1u << (LAT_MAX_POW + 1)) + rnd() % (1u << 30) : 100 + rnd() % 5000);
+    }
+    over = compare("overflow", v) && over;
+  }
+  const std::vector<uint32_t> edges = edge_values();
+  for (size_t start = 0; start < edges.size(); start++) {
+    // 端の値の一部分だけ (小さい方から / 大きい方から) と、全部
+    std::vector<uint32_t> head(edges.begin(), edges.begin() + start + 1);
+    std::vector<uint32_t> tail(edges.begin() + start, edges.end());
+    edge = compare("edges head", head) && edge;
+    edge = compare("edges tail", tail) && edge;
+  }
+  for (size_t n = 1; n <= 201; n++) {
+    // 順位の切り上げ: 数が少ない時の p99 は一番大きい値
+    std::vector<uint32_t> v;
+    for (size_t i = 0; i < n; i++) {v.push_back(static_cast<uint32_t>(1000 + i * 37));}
+    sizes = compare("sizes", v) && sizes;
+  }
+  check(small, "small values (0-11) are exact");
+  check(wide, "log-spread values: bucket top of the exact value, within 1/8");
+  check(over, "values in the overflow bucket report max, not 2^25-1");
+  check(edge, "0-7, 2^k-1, 2^k, 2^k+1 and UINT32_MAX");
+  check(sizes, "1 to 201 samples: rank rounds up as for sorted values");
+
+  LatencyHistogram h;
+  check((h.p50() == 0) && (h.p99() == 0) && (h.min() == 0) && (h.max() == 0), "empty histogram reports 0");
+  h.record(1u << (LAT_MAX_POW + 2));
+  h.record(7);
+  check((h.p99() == (1u << (LAT_MAX_POW + 2))) && (h.p50() == 7), "one 2^26 sample: p99 is that sample");
+}
+}
+
+int main() {
+  buckets();
+  percentiles();
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
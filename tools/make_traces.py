@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#  Created by Hasebe Masahiko on 2025/10/19.
+#  Copyright (c) 2025 Hasebe Masahiko.
+#  Released under the MIT license
+#  https://opensource.org/licenses/mit-license.php
+#
+#  qubit_replay 用の決まった sweep trace を作る (毎回同じ内容になる)
+#
+#  使い方:
+#    python3 make_traces.py [out_dir] [pads]
+#    out_dir を省くと tools/traces に作る (repo に入っている trace と golden の置き場所)
+#
+#  作る trace:
+#    tap         一本指で一回タッチ
+#    glide_wrap  MAX_PADS の折り返し (最後のパッド → 0) を越えて滑らせる
+#    chord       両手で 3 音ずつの和音
+#    crossing    二本の指が近づいて、すれ違う
+#    noisy_idle  タッチなし、しきい値近くのノイズだけ
+#    wrap_4blk   4 ブロック (24 パッド) の ring の継ぎ目: 23.5 あたりに置いた指と、継ぎ目を越えて滑る指
+#    wrap_8blk   8 ブロック (48 パッド) で同じこと
+#    (wrap_* は pads の指定によらずそのパッド数で作る)
+#
+#  tools/traces には各 trace と、その qubit_replay の MIDI 出力 (golden, .midi) が入っている
+#  タッチ処理を変えたら、全部の trace を流して golden と比べる:
+#    make -C tools check
+#  MIDI が変わるのが意図した変更なら、golden を作り直して一緒にコミットする:
+#    make -C tools goldens
+#
+import os
+import random
+import sys
+
+SWEEP_US = 4000         # 本体の一回の sweep にかかる時間くらい
+SPREAD = 1.6            # 指一本が反応させるパッドの半径
+CROSSTALK = 0.05        # 隣のパッドへの漏れ
+NOISE_SD = 1.5
+
+
+class Finger:
+    """start_frame から frames の間、位置と強さを関数で与える指"""
+
+    def __init__(self, start, frames, position, peak, attack=6, release=6):
+        self.start = start
+        self.frames = frames
+        self.position = position    # t (0.0-1.0) -> pad 位置
+        self.peak = peak
+        self.attack = attack
+        self.release = release
+
+    def state(self, frame):
+        n = frame - self.start
+        if n < 0 or n >= self.frames:
+            return None
+        env = 1.0
+        if n < self.attack:
+            env = (n + 1) / self.attack
+        elif n >= self.frames - self.release:
+            env = (self.frames - n) / self.release
+        return self.position(n / max(1, self.frames - 1)), self.peak * env
+
+
+def render(fingers, frames, pads, rng, noise_sd=NOISE_SD):
+    rows = []
+    for f in range(frames):
+        values = [0.0] * pads
+        for finger in fingers:
+            st = finger.state(f)
+            if st is None:
+                continue
+            loc, level = st
+            for p in range(pads):
+                d = abs(p - loc) % pads
+                d = min(d, pads - d)
+                if d < SPREAD:
+                    values[p] += level * (1.0 - (d / SPREAD) ** 2)
+        mixed = []
+        for p in range(pads):
+            v = values[p] + CROSSTALK * (values[p - 1] + values[(p + 1) % pads])
+            v += abs(rng.gauss(0.0, noise_sd))
+            mixed.append(max(0, min(1023, int(v))))
+        rows.append((f * SWEEP_US + 1, mixed))
+    return rows
+
+
+def linear(a, b):
+    return lambda t: a + (b - a) * t
+
+
+def seam(pads):
+    """ring の継ぎ目のすぐ手前に置いた指 (重心が pads - 0.5 を越える) と、継ぎ目を両向きに越えて滑る指"""
+    return [Finger(10, 70, lambda t: pads - 0.495, 320),
+            Finger(90, 120, lambda t: (pads - 3 + 6 * t) % pads, 300),
+            Finger(220, 120, lambda t: (pads + 3 - 6 * t) % pads, 280)]
+
+
+def traces(pads):
+    yield "tap", [Finger(20, 80, lambda t: 20.3, 320)], 140, NOISE_SD, pads
+    yield "glide_wrap", [Finger(10, 200, lambda t: (pads - 6 + 12 * t) % pads, 300)], 240, NOISE_SD, pads
+    left = [Finger(10, 120, lambda t, c=c: c, 280 + 20 * i) for i, c in enumerate((10.0, 14.2, 17.1))]
+    right = [Finger(14, 110, lambda t, c=c: c, 260 + 30 * i) for i, c in enumerate((40.0, 43.8, 47.0))]
+    yield "chord", left + right, 160, NOISE_SD, pads
+    yield "crossing", [Finger(10, 150, linear(30.0, 42.0), 300),
+                       Finger(12, 150, linear(42.0, 30.0), 260)], 180, NOISE_SD, pads
+    yield "noisy_idle", [], 300, 3.0, pads
+    yield "wrap_4blk", seam(24), 360, NOISE_SD, 24
+    yield "wrap_8blk", seam(48), 360, NOISE_SD, 48
+
+
+def main():
+    if len(sys.argv) > 1 and sys.argv[1].startswith("-"):
+        print("usage: make_traces.py [out_dir] [pads]")
+        return 1
+    if len(sys.argv) > 1:
+        out_dir = sys.argv[1]
+    else:
+        out_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "traces")
+    pads = int(sys.argv[2]) if len(sys.argv) > 2 else 96
+    os.makedirs(out_dir, exist_ok=True)
+    for name, fingers, frames, noise, trace_pads in traces(pads):
+        rng = random.Random(name)   # trace ごとに固定
+        path = os.path.join(out_dir, name + ".sweeps")
+        with open(path, "w") as out:
+            out.write("# qubit-sweeps v1 pads=%d\n" % trace_pads)
+            for t, values in render(fingers, frames, trace_pads, rng, noise):
+                out.write("%d %s\n" % (t, " ".join(str(v) for v in values)))
+        print(path)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#  Created by Hasebe Masahiko on 2025/10/19.
+#  Copyright (c) 2025 Hasebe Masahiko.
+#  Released under the MIT license
+#  https://opensource.org/licenses/mit-license.php
+#
+#  ビルドした ELF の RAM の使い方を、サブシステムごと・置き場所 (scratch Y / X / SRAM) ごとに集計する
+#
+#  使い方:
+#    arduino-cli compile --fqbn rp2040:rp2040:seeed_xiao_rp2040 --output-dir build .
+#    python3 tools/mem_report.py build/loopian_qubit.ino.elf [-v] [--readelf arm-none-eabi-readelf]
+#      -v   サブシステムごとに大きいシンボルも出す
+#
+#  Arduino IDE でビルドのたびに出すには、platform.local.txt に
+#    recipe.hooks.objcopy.postobjcopy.99.pattern=python3 "{build.source.path}/tools/mem_report.py" "{build.path}/{build.project_name}.elf"
+#
+import re
+import subprocess
+import sys
+
+# シンボル名 (demangle 後) → サブシステム。上から順に調べる
+SUBSYSTEMS = [
+    ("touch",    r"^(qt$|QubitTouch|TouchPoint|Pad)"),
+    ("sensor",   r"^(tch$|sensor_|sweep_|stream_|topology$)"),
+    ("calib",    r"^(calib_|warm_start)"),
+    ("flight",   r"^(flight_)"),
+    ("cluster",  r"^(cluster_|Cluster)"),
+    ("led",      r"^(sk$|led_|accompaniment|ambient|SK6812)"),
+    ("midi",     r"^(midi_|mpe|external_notes|MIDI|usb_midi)"),
+    ("sched",    r"^(sched$|governor$|touch_task_id|led_task_id|gt$)"),
+    ("trace",    r"^(latency|profiler|profile_|export_profile)"),
+    ("display",  r"^(SSD1331|oled|display|show_|page_|switch_)"),
+    ("usb",      r"(TinyUSB|tud_|_usbd_|Adafruit_USBD)"),
+]
+RAM_SECTIONS = [
+    ("scratch Y (core0)", r"^\.scratch_y"),
+    ("scratch X (core1)", r"^\.scratch_x"),
+    ("SRAM",              r"^\.(data|bss|uninitialized_data|ram_vector_table|heap|noinit)"),
+]
+
+
+def run(cmd):
+    return subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+
+
+def sections(readelf, elf):
+    """section 番号 → 名前"""
+    table = {}
+    for line in run([readelf, "-W", "-S", elf]).splitlines():
+        m = re.match(r"\s*\[\s*(\d+)\]\s+(\S+)", line)
+        if m:
+            table[m.group(1)] = m.group(2)
+    return table
+
+
+def symbols(readelf, elf):
+    """(名前, 大きさ, section 名) のデータシンボル"""
+    secs = sections(readelf, elf)
+    for line in run([readelf, "-W", "-s", "-C", elf]).splitlines():
+        f = line.split(None, 7)
+        if len(f) < 8 or not f[0].endswith(":") or f[3] != "OBJECT":
+            continue
+        size = int(f[2], 0)
+        if size == 0 or f[6] not in secs:
+            continue
+        yield f[7], size, secs[f[6]]
+
+
+def classify(name, table):
+    for label, pattern in table:
+        if re.search(pattern, name):
+            return label
+    return "other"
+
+
+def main():
+    args = sys.argv[1:]
+    verbose = "-v" in args
+    readelf = "arm-none-eabi-readelf"
+    if "--readelf" in args:
+        readelf = args[args.index("--readelf") + 1]
+    files = [a for a in args if a.endswith((".elf", ".o"))]
+    if not files:
+        print("usage: mem_report.py <file.elf> [-v] [--readelf path]")
+        sys.exit(1)
+
+    places = [label for label, _ in RAM_SECTIONS]
+    totals = {}
+    biggest = {}
+    for name, size, sec in symbols(readelf, files[0]):
+        place = classify(sec, RAM_SECTIONS)
+        if place == "other":
+            continue    # flash (text / rodata)
+        sub = classify(name, SUBSYSTEMS)
+        row = totals.setdefault(sub, {p: 0 for p in places})
+        row[place] += size
+        biggest.setdefault(sub, []).append((size, name, place))
+
+    print(f"{'subsystem':10s}" + "".join(f"{p:>20s}" for p in places) + f"{'total':>10s}")
+    col = {p: 0 for p in places}
+    for sub in sorted(totals, key=lambda s: -sum(totals[s].values())):
+        row = totals[sub]
+        print(f"{sub:10s}" + "".join(f"{row[p]:20d}" for p in places) + f"{sum(row.values()):10d}")
+        for p in places:
+            col[p] += row[p]
+        if verbose:
+            for size, name, place in sorted(biggest[sub], reverse=True)[:5]:
+                print(f"    {size:7d}  {place:18s} {name}")
+    print(f"{'total':10s}" + "".join(f"{col[p]:20d}" for p in places) + f"{sum(col.values()):10d}")
+
+
+if __name__ == "__main__":
+    main()
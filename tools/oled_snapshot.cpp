@@ -0,0 +1,299 @@
+/* ========================================
+ *
+ *  oled_snapshot.cpp
+ *    description: OledFrame (oled_fb.h) に決めた文字とページを描き、保存してある画像と比べる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  - フォント表と、本体の display_page1() / show_one_kamaboko() / display_page_latency() と
+ *    同じ並びのページを決めた値で描き、tools/snapshots/ の .pbm (背景以外の画素が 1) と一画素ずつ比べる
+ *  - 一文字だけ変えた時の dirty rect がその文字のセルだけになること
+ *  - 同じ内容の draw_line() は画素に触らず dirty にもならないこと、他の描画の後は描き直すこと
+ *
+ *  build / run:
+ *    make -C tools oled_snapshot && tools/oled_snapshot [-u] [-d snapshot_dir]
+ *    -u : 画像を書き直す (描画を意図して変えた時だけ)
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../oled_fb.h"
+#include "../text_buf.h"
+
+namespace {
+// peripheral.h の SSD1331_COLORS と同じ値
+constexpr uint16_t BLACK = 0x0000;
+constexpr uint16_t CYAN = 0x07FF;
+constexpr uint16_t MAGENTA = 0xF81F;
+constexpr uint16_t YELLOW = 0xFFE0;
+constexpr uint16_t WHITE = 0xFFFF;
+
+int failures = 0;
+bool update = false;
+std::string snapshot_dir = "tools/snapshots";
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+/*----------------------------------------------------------------------------*/
+//     PBM (P1): 背景以外の画素を 1
+/*----------------------------------------------------------------------------*/
+auto to_bits(const OledFrame& fb) -> std::vector<uint8_t> {
+  std::vector<uint8_t> bits(OLED_WIDTH * OLED_HEIGHT);
+  for (int y = 0; y < OLED_HEIGHT; y++) {
+    for (int x = 0; x < OLED_WIDTH; x++) {
+      bits[y * OLED_WIDTH + x] = (fb.get_pixel(x, y) != BLACK) ? 1 : 0;
+    }
+  }
+  return bits;
+}
+auto write_pbm(const std::string& path, const std::vector<uint8_t>& bits) -> bool {
+  FILE* fp = std::fopen(path.c_str(), "w");
+  if (fp == nullptr) {return false;}
+  std::fprintf(fp, "P1\n%d %d\n", OLED_WIDTH, OLED_HEIGHT);
+  for (int y = 0; y < OLED_HEIGHT; y++) {
+    for (int x = 0; x < OLED_WIDTH; x++) {std::fputc(bits[y * OLED_WIDTH + x] ? '1' : '0', fp);}
+    std::fputc('\n', fp);
+  }
+  std::fclose(fp);
+  return true;
+}
+auto read_pbm(const std::string& path, std::vector<uint8_t>& bits) -> bool {
+  FILE* fp = std::fopen(path.c_str(), "r");
+  if (fp == nullptr) {return false;}
+  char magic[3] = {};
+  int w = 0, h = 0;
+  bool ok = (std::fscanf(fp, "%2s %d %d", magic, &w, &h) == 3) && (std::strcmp(magic, "P1") == 0) &&
+            (w == OLED_WIDTH) && (h == OLED_HEIGHT);
+  bits.clear();
+  int c;
+  while (ok && ((c = std::fgetc(fp)) != EOF)) {
+    if ((c == '0') || (c == '1')) {bits.push_back(static_cast<uint8_t>(c - '0'));}
+  }
+  std::fclose(fp);
+  return ok && (bits.size() == static_cast<size_t>(OLED_WIDTH * OLED_HEIGHT));
+}
+
+void compare_snapshot(const char* name, const OledFrame& fb) {
+  const std::string path = snapshot_dir + "/" + name + ".pbm";
+  const std::vector<uint8_t> bits = to_bits(fb);
+  char what[96];
+  if (update) {
+    std::snprintf(what, sizeof(what), "%s: snapshot written", name);
+    check(write_pbm(path, bits), what);
+    return;
+  }
+  std::vector<uint8_t> expected;
+  if (!read_pbm(path, expected)) {
+    std::snprintf(what, sizeof(what), "%s: %s readable", name, path.c_str());
+    check(false, what);
+    return;
+  }
+  int diff = 0, first = -1;
+  for (size_t i = 0; i < bits.size(); i++) {
+    if (bits[i] != expected[i]) {
+      diff += 1;
+      if (first < 0) {first = static_cast<int>(i);}
+    }
+  }
+  if (diff > 0) {
+    std::printf("  %s: %d pixels differ, first at (%d,%d)\n", name, diff, first % OLED_WIDTH, first / OLED_WIDTH);
+  }
+  std::snprintf(what, sizeof(what), "%s matches the snapshot", name);
+  check(diff == 0, what);
+}
+
+/*----------------------------------------------------------------------------*/
+//     本体のページと同じ並び (値は決め打ち)
+/*----------------------------------------------------------------------------*/
+void draw_font_chart(OledFrame& fb) {
+  for (int line = 0; line < OLED_LINES; line++) {
+    char str[OLED_LINE_CHARS + 1] = {};
+    for (int i = 0; i < OLED_LINE_CHARS; i++) {
+      const int code = OLED_FONT_FIRST + line * OLED_LINE_CHARS + i;
+      str[i] = (code <= OLED_FONT_LAST) ? static_cast<char>(code) : '\0';
+    }
+    fb.draw_line(line, str, WHITE, BLACK);
+  }
+}
+// display_page1(): タッチ点 4 つと loop の回数
+void draw_touch_page(OledFrame& fb, uint32_t loop_counter) {
+  const float LOC[4] = {12.3f, -1.0f, 40.0f, -1.0f};
+  const float INTENSITY[4] = {87.5f, 0.0f, 3.2f, 0.0f};
+  fb.draw_line(0, "Loopian::QUBIT", MAGENTA, BLACK);
+  for (int i = 0; i < 4; i++) {
+    TextBuf<24> disp_str;
+    disp_str.add_int(i).add("> ");
+    if (LOC[i] < 0) {
+      disp_str.add(" L:---");
+    } else {
+      disp_str.add(" L:").add_fixed(LOC[i], 1);
+    }
+    disp_str.add('/').add_fixed(INTENSITY[i], 1);
+    fb.draw_line(i + 1, disp_str.c_str(), WHITE, BLACK);
+  }
+  TextBuf<24> loop_info;
+  loop_info.add("LpCntr: ").add_int(static_cast<int32_t>(loop_counter));
+  fb.draw_line(5, loop_info.c_str(), YELLOW, BLACK);
+}
+// show_one_kamaboko() / show_one_line(): センサ値を o / x の棒で
+void draw_kamaboko_page(OledFrame& fb) {
+  const int VALUES[6] = {30, 2, 12, 28, 5, 17};
+  fb.draw_line(0, "Loopian::QUBIT", MAGENTA, BLACK);
+  TextBuf<24> kama;
+  kama.add("Block No.: ").add_int(3);
+  fb.draw_line(1, kama.c_str(), CYAN, BLACK);
+  for (int i = 0; i < 3; i++) {
+    int value1 = VALUES[i * 2];
+    int value2 = VALUES[i * 2 + 1];
+    TextBuf<24> text_display;
+    for (int j = 0; (j < 7) && (value1 > 4); j++) {
+      text_display.add('o');
+      value1 -= 4;
+    }
+    text_display.pad_to(8);
+    for (int j = 0; (j < 7) && (value2 > 4); j++) {
+      text_display.add('x');
+      value2 -= 4;
+    }
+    fb.draw_line(i + 2, text_display.c_str(), WHITE, BLACK);
+  }
+}
+// display_page_latency(): 区間ごとの p50 / p99 と MIDI 送信待ち
+void draw_latency_page(OledFrame& fb) {
+  const char* STAGE[4] = {"sweep", "detect", "midi", "usb"};
+  const uint32_t P50[4] = {412, 35, 8, 120};
+  const uint32_t P99[4] = {980, 71, 22, 1450};
+  fb.draw_line(0, "Latency p50/p99", MAGENTA, BLACK);
+  for (int i = 0; i < 4; i++) {
+    TextBuf<24> line;
+    line.add(STAGE[i]).pad_to(10).add_uint(P50[i]).add('/').add_uint(P99[i]);
+    fb.draw_line(i + 1, line.c_str(), WHITE, BLACK);
+  }
+  TextBuf<24> queue;
+  queue.add("MIDIq ").add_uint(6).add('/').add_uint(0).add('/').add_uint(2);
+  fb.draw_line(5, queue.c_str(), CYAN, BLACK);
+}
+
+void drain(OledFrame& fb) {
+  OledRect r;
+  while (fb.take_dirty_rect(r)) {}
+}
+
+void snapshots() {
+  std::printf("== snapshots in %s%s\n", snapshot_dir.c_str(), update ? " (update)" : "");
+  OledFrame fb;
+  fb.fill(BLACK);
+  draw_font_chart(fb);
+  compare_snapshot("font", fb);
+
+  fb.fill(BLACK);
+  draw_touch_page(fb, 12345);
+  compare_snapshot("touch_page", fb);
+  check((fb.get_pixel(0, 0) == MAGENTA) && (fb.get_pixel(5, 0) == BLACK), "title is drawn in magenta");
+
+  fb.fill(BLACK);
+  draw_kamaboko_page(fb);
+  compare_snapshot("kamaboko_page", fb);
+
+  fb.fill(BLACK);
+  draw_latency_page(fb);
+  compare_snapshot("latency_page", fb);
+}
+
+/*----------------------------------------------------------------------------*/
+//     dirty rect と描き直しの省略
+/*----------------------------------------------------------------------------*/
+void dirty_rects() {
+  std::printf("== dirty rects and skipped lines\n");
+  OledFrame fb;
+  OledRect r{};
+  check(fb.take_dirty_rect(r) && (r.x == 0) && (r.y == 0) && (r.w == OLED_WIDTH) && (r.h == OLED_HEIGHT),
+        "a new frame is one full-screen rect");
+  check(!fb.is_dirty(), "taking the rect clears it");
+
+  fb.fill(BLACK);
+  check(!fb.is_dirty(), "filling black over black changes nothing");
+  draw_touch_page(fb, 12345);
+  drain(fb);
+
+  // 同じ内容をもう一度: 行はすべて省略され、何も送らない
+  const uint32_t drawn = fb.lines_drawn();
+  draw_touch_page(fb, 12345);
+  check((fb.lines_drawn() == drawn) && (fb.lines_skipped() == 6), "an unchanged page skips all six lines");
+  check(!fb.is_dirty(), "an unchanged page sends nothing");
+
+  // LpCntr の最後の一桁だけ変える ("LpCntr: 12345" の 13 文字目)
+  draw_touch_page(fb, 12346);
+  check(fb.lines_drawn() == drawn + 1, "only the changed line is redrawn");
+  check(fb.take_dirty_rect(r), "the changed digit is dirty");
+  std::printf("  rect x %u y %u w %u h %u (%zu bytes, a band would be %zu)\n", r.x, r.y, r.w, r.h,
+              OledFrame::row_bytes(r.w) * r.h, OledFrame::band_bytes(r.h));
+  check((r.x >= 12 * OLED_CELL_W) && (r.x + r.w <= 13 * OLED_CELL_W), "the rect stays inside the changed cell");
+  check((r.y >= 5 * OLED_LINE_H) && (r.y + r.h <= 5 * OLED_LINE_H + OLED_FONT_H + 1), "the rect stays inside the text row");
+  check(!fb.is_dirty(), "nothing else is dirty");
+
+  // 見えない所 (右端より先) だけ違う文字列は描き直さない
+  fb.draw_line(2, "0123456789abcdefXYZ", WHITE, BLACK);
+  drain(fb);
+  const uint32_t drawn2 = fb.lines_drawn();
+  fb.draw_line(2, "0123456789abcdef---", WHITE, BLACK);
+  check((fb.lines_drawn() == drawn2) && !fb.is_dirty(), "a difference past the right edge is not drawn");
+  // 色が違えば描き直す
+  fb.draw_line(2, "0123456789abcdef", YELLOW, BLACK);
+  check((fb.lines_drawn() == drawn2 + 1) && fb.is_dirty(), "a color change redraws the line");
+  drain(fb);
+
+  // 他の描画の後は、同じ文字列でも描き直す (SSD1331_clear() でページが変わった時)
+  fb.fill(BLACK);
+  drain(fb);
+  draw_touch_page(fb, 12346);
+  OledFrame ref;
+  ref.fill(BLACK);
+  draw_touch_page(ref, 12346);
+  bool same = true;
+  for (int y = 0; y < OLED_HEIGHT; y++) {
+    for (int x = 0; x < OLED_WIDTH; x++) {same = same && (fb.get_pixel(x, y) == ref.get_pixel(x, y));}
+  }
+  check(same, "after a clear the page is drawn again in full");
+
+  // 離れた二行の変化は別々の rect、隣り合う行は一つの rect にまとまる
+  OledFrame two;
+  drain(two);
+  two.set_pixel(3, 10, WHITE);
+  two.set_pixel(90, 40, WHITE);
+  OledRect a{}, b{};
+  check(two.take_dirty_rect(a) && two.take_dirty_rect(b) && !two.is_dirty(), "separate rows give separate rects");
+  check((a.x == 3) && (a.y == 10) && (a.w == 1) && (a.h == 1) && (b.x == 90) && (b.y == 40), "each rect covers only its pixel");
+  two.set_pixel(5, 20, WHITE);
+  two.set_pixel(9, 21, WHITE);
+  check(two.take_dirty_rect(a) && (a.x == 5) && (a.y == 20) && (a.w == 5) && (a.h == 2), "adjacent rows merge into one rect");
+}
+}
+
+int main(int argc, char* argv[]) {
+  // 既定の画像の場所はこの実行ファイルの隣の snapshots/
+  const std::string self = argv[0];
+  const size_t slash = self.find_last_of('/');
+  snapshot_dir = (slash == std::string::npos) ? "snapshots" : self.substr(0, slash) + "/snapshots";
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-u") == 0) {
+      update = true;
+    } else if ((std::strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+      snapshot_dir = argv[++i];
+    }
+  }
+  snapshots();
+  dirty_rects();
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+/* ========================================
+ *
+ *  pca9685_sim.cpp
+ *    description: 偽の I2C bus で PCA9685 の LED (pca9685_leds.h) の差分とまとめ送りを確かめる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  bus の先に PCA9685 の register を真似たものを置き (MODE1 の AI が無ければ register は進まない)、
+ *  flush() の後で chip の中身がフレームと同じになるか、何回・何 byte 書いたかを調べる
+ *  - 最初のフレーム: chip ごとに MODE1 / MODE2 と、全 channel を一回で
+ *  - 変わった channel だけ、続いている所ごとに一回 (変わっていない channel が MERGE_GAP 以下ならつなぐ)
+ *  - 一回の flush() の上限、上限で止まっても全部の chip に順番が回る、答えない chip があっても止まらない
+ *  - 最後に LedFrame と AmbientAnimator で本体と同じフレームを作り、前の一 register ずつの書き方と bus の量を比べる
+ *
+ *  build / run:
+ *    make -C tools pca9685_sim && tools/pca9685_sim [-n frames]
+ *  全部通れば終了コード 0、どれかが違えば 1
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "../pca9685_leds.h"
+#include "../led_frame.h"
+#include "../ambient.h"
+
+/*----------------------------------------------------------------------------*/
+//     Mock bus
+/*----------------------------------------------------------------------------*/
+namespace {
+struct Chip {
+  uint8_t reg[256];
+};
+struct Write {
+  uint8_t adrs;
+  std::vector<uint8_t> data;
+};
+Chip chips[PCA9685_MAX_CHIPS];
+std::vector<Write> writes;
+int nack_chip = -1;     // この chip は答えない
+int failures = 0;
+constexpr unsigned I2C_CLOCK = 400000;  // board.h の TOUCH_I2C_CLOCK
+
+int mock_write(uint8_t adrs, const uint8_t* buf, size_t len) {
+  const int chip = adrs - PCA9685_I2C_ADRS;
+  if ((chip < 0) || (chip >= static_cast<int>(PCA9685_MAX_CHIPS)) || (chip == nack_chip) || (len == 0)) {return 2;}
+  writes.push_back({adrs, std::vector<uint8_t>(buf, buf + len)});
+  Chip& c = chips[chip];
+  uint8_t reg = buf[0];
+  for (size_t i = 1; i < len; i++) {
+    c.reg[reg] = buf[i];
+    if (c.reg[PCA9685_MODE1] & PCA9685_MODE1_AI) {reg = static_cast<uint8_t>(reg + 1);}
+  }
+  return 0;
+}
+void reset_bus() {
+  std::memset(chips, 0, sizeof(chips));
+  writes.clear();
+  nack_chip = -1;
+}
+size_t written_bytes() {
+  size_t n = 0;
+  for (const Write& w : writes) {n += w.data.size();}
+  return n;
+}
+
+void check(bool ok, const char* what) {
+  std::printf("  %-56s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+constexpr size_t PIXELS = 24;   // 6 chip
+using Leds = Pca9685Leds<PIXELS>;
+
+/// chip の register が、その画素の色になっているか
+bool chip_matches(const uint8_t (&rgbw)[PIXELS][4], size_t pixels) {
+  for (size_t led = 0; led < pixels; led++) {
+    const Chip& c = chips[led / PCA9685_LEDS_PER_CHIP];
+    for (size_t k = 0; k < 4; k++) {
+      const size_t ch = (led % PCA9685_LEDS_PER_CHIP) * 4 + k;
+      const uint8_t* r = &c.reg[PCA9685_LED0_ON_L + ch * 4];
+      const uint16_t on = static_cast<uint16_t>(r[0] | (r[1] << 8));
+      if ((on != Leds::level(rgbw[led][k])) || (r[2] != 0) || (r[3] != 0)) {return false;}
+    }
+  }
+  return true;
+}
+void show(Leds& leds, const uint8_t (&rgbw)[PIXELS][4]) {
+  leds.clear();
+  for (size_t i = 0; i < leds.numPixels(); i++) {leds.setPixelColor(i, rgbw[i][0], rgbw[i][1], rgbw[i][2], rgbw[i][3]);}
+  leds.show();
+}
+void flush_all(Leds& leds) {
+  for (int n = 0; (n < 1000) && leds.dirty(); n++) {leds.flush(1 << 20);}
+}
+}
+
+/*----------------------------------------------------------------------------*/
+//     Scenarios
+/*----------------------------------------------------------------------------*/
+void diff_and_batch() {
+  std::printf("== diff and auto-increment batching\n");
+  reset_bus();
+  static Leds leds(PIXELS, Pca9685Bus{mock_write});
+  uint8_t rgbw[PIXELS][4] = {};
+  for (size_t i = 0; i < PIXELS; i++) {
+    for (size_t k = 0; k < 4; k++) {rgbw[i][k] = static_cast<uint8_t>(i * 10 + k * 50);}
+  }
+  check(leds.flush(1 << 20) == 0, "nothing is sent before the first frame");
+  show(leds, rgbw);
+  leds.flush(1 << 20);
+  const size_t chip_count = Leds::chip_count(PIXELS);
+  bool shape = writes.size() == chip_count * 3;
+  for (size_t c = 0; shape && (c < chip_count); c++) {
+    const Write* w = &writes[c * 3];
+    shape = (w[0].data.size() == 2) && (w[0].data[0] == PCA9685_MODE1) && (w[0].data[1] == PCA9685_MODE1_AI) &&
+            (w[1].data.size() == 2) && (w[1].data[0] == PCA9685_MODE2) && (w[1].data[1] == PCA9685_MODE2_INIT) &&
+            (w[2].data.size() == PCA9685_MAX_WRITE) && (w[2].data[0] == PCA9685_LED0_ON_L) &&
+            (w[0].adrs == Leds::address(c)) && (w[2].adrs == Leds::address(c));
+  }
+  check(shape, "first frame: mode, then every channel in one burst per chip");
+  check(chip_matches(rgbw, PIXELS) && !leds.dirty(), "chips hold the frame");
+
+  writes.clear();
+  show(leds, rgbw);
+  leds.flush(1 << 20);
+  check(writes.empty(), "an unchanged frame sends nothing");
+
+  rgbw[5][1] = 200;     // chip 1、LED 1 の G だけ
+  show(leds, rgbw);
+  leds.flush(1 << 20);
+  check((writes.size() == 1) && (writes[0].adrs == Leds::address(1)) && (writes[0].data.size() == 5) &&
+        (writes[0].data[0] == PCA9685_LED0_ON_L + (1 * 4 + 1) * 4) && chip_matches(rgbw, PIXELS),
+        "one changed channel: one 4-byte write at its register");
+
+  writes.clear();
+  rgbw[8][0] = 1;       // chip 2、channel 0 と 2 (間に 1 つ)
+  rgbw[8][2] = 1;
+  show(leds, rgbw);
+  leds.flush(1 << 20);
+  check((writes.size() == 1) && (writes[0].data.size() == 1 + 3 * 4) && chip_matches(rgbw, PIXELS),
+        "a one-channel gap is sent through");
+
+  writes.clear();
+  rgbw[12][0] = 3;      // chip 3、channel 0 と 3 (間に 2 つ)
+  rgbw[12][3] = 3;
+  show(leds, rgbw);
+  leds.flush(1 << 20);
+  check((writes.size() == 2) && (writes[0].data.size() == 5) && (writes[1].data.size() == 5) && chip_matches(rgbw, PIXELS),
+        "a wider gap is split into two writes");
+
+  // 受け取る前の show() は捨てる。その次の show() で最新になる
+  uint8_t next[PIXELS][4];
+  std::memcpy(next, rgbw, sizeof(next));
+  next[0][0] = 77;
+  show(leds, next);
+  next[0][0] = 78;
+  show(leds, next);
+  check(leds.skipped() == 1, "a frame shown before the last was taken is skipped");
+  leds.flush(1 << 20);
+  show(leds, next);
+  leds.flush(1 << 20);
+  check(chip_matches(next, PIXELS), "the next show carries the newest colours");
+}
+
+void budget_and_faults() {
+  std::printf("== budget, fairness and faults\n");
+  reset_bus();
+  static Leds leds(PIXELS, Pca9685Bus{mock_write});
+  uint8_t rgbw[PIXELS][4] = {};
+  for (size_t i = 0; i < PIXELS; i++) {rgbw[i][0] = static_cast<uint8_t>(i + 1);}
+  show(leds, rgbw);
+  const size_t budget = PCA9685_MAX_WRITE;
+  bool bounded = true;
+  int flushes = 0;
+  while (leds.dirty() && (flushes < 100)) {
+    size_t sent = leds.flush(budget);
+    // 最初の一つ (mode + burst) だけは上限を越えてよい
+    bounded = bounded && (sent <= budget + 4);
+    flushes += 1;
+  }
+  check(bounded && chip_matches(rgbw, PIXELS), "each flush stays within the budget and the frame completes");
+  check(flushes == static_cast<int>(Leds::chip_count(PIXELS)), "one chip per gap with a one-chip budget");
+
+  // chip 0 が毎フレーム変わっても、他の chip にも順番が回る
+  for (size_t i = 0; i < PIXELS; i++) {rgbw[i][2] = 100;}
+  for (int frame = 0; frame < 20; frame++) {
+    rgbw[0][0] = static_cast<uint8_t>(frame * 7);
+    show(leds, rgbw);
+    leds.flush(budget);
+  }
+  check(!leds.dirty() || (leds.flush(1 << 20), chip_matches(rgbw, PIXELS)), "a busy chip does not starve the others");
+  bool all = true;
+  for (size_t led = 4; led < PIXELS; led++) {
+    const Chip& c = chips[led / 4];
+    all = all && (c.reg[PCA9685_LED0_ON_L + ((led % 4) * 4 + 2) * 4] == (Leds::level(100) & 0xff));
+  }
+  check(all, "every chip got its update within the frames");
+
+  // chip 2 が答えなくても他は送り、戻ったら送り直す
+  nack_chip = 2;
+  for (size_t i = 0; i < PIXELS; i++) {rgbw[i][3] = 33;}
+  show(leds, rgbw);
+  const uint32_t errors = leds.errors();
+  for (int n = 0; n < 20; n++) {leds.flush(1 << 20);}
+  bool others = true;
+  for (size_t led = 0; led < PIXELS; led++) {
+    if (led / 4 == 2) {continue;}
+    others = others && (chips[led / 4].reg[PCA9685_LED0_ON_L + ((led % 4) * 4 + 3) * 4] == (Leds::level(33) & 0xff));
+  }
+  check(others && leds.dirty() && (leds.errors() > errors), "a silent chip is skipped, the others are sent");
+  nack_chip = -1;
+  flush_all(leds);
+  check(chip_matches(rgbw, PIXELS), "the silent chip is caught up when it answers again");
+
+  // 長さが増えたら、増えた chip は mode から全部
+  static Leds grow(8, Pca9685Bus{mock_write});
+  reset_bus();
+  show(grow, rgbw);
+  flush_all(grow);
+  grow.updateLength(16);
+  writes.clear();
+  show(grow, rgbw);
+  flush_all(grow);
+  check((writes.size() == 6) && (writes[2].data.size() == PCA9685_MAX_WRITE) && chip_matches(rgbw, 16),
+        "added chips are initialised and sent in full");
+}
+
+/// 本体と同じフレーム (指一本が動く + 白の背景の波) を 60Hz で作り、bus の量を比べる
+void traffic(int frames) {
+  std::printf("== bus traffic, %zu LEDs at 60 fps (%d frames, I2C %u Hz)\n", static_cast<size_t>(MAX_LIGHT), frames, I2C_CLOCK);
+  static Pca9685Leds<MAX_LIGHT> leds(MAX_LIGHT, Pca9685Bus{mock_write});
+  static LedFrame frame;
+  static uint8_t last[MAX_LIGHT][4];
+  AmbientAnimator ambient;
+  reset_bus();
+  const size_t lights = MAX_LIGHT;
+  const size_t chip_count = Leds::chip_count(lights);
+  frame.set_light_count(lights);
+  size_t legacy_writes = 0;
+  size_t legacy_bytes = 0;
+  size_t diff_writes = 0;
+  size_t diff_bytes = 0;
+  bool match = true;
+  uint64_t now_us = 0;
+  for (int n = 0; n < frames; n++) {
+    now_us += 16667;
+    frame.clear_touch();
+    frame.set_by_touch(static_cast<float>(std::fmod(n * 0.1, static_cast<double>(MAX_NOTE))), 400, true);
+    ambient.update(now_us);
+    ambient.render(lights, [](size_t i, uint8_t intensity) {frame.set_white(i, intensity);});
+    leds.clear();
+    for (size_t i = 0; i < lights; i++) {
+      const uint8_t* px = frame.pixel(i);
+      leds.setPixelColor(i, px[0], px[1], px[2], px[3]);
+      // 前の書き方: 変わった LED ごとに 3 色 x 4 register を一つずつ (address + register + data)
+      if (std::memcmp(last[i], px, 4) != 0) {
+        legacy_writes += 12;
+        legacy_bytes += 12 * 3;
+        std::memcpy(last[i], px, 4);
+      }
+    }
+    leds.show();
+    writes.clear();
+    while (leds.dirty()) {leds.flush(PCA9685_MAX_WRITE);}
+    diff_writes += writes.size();
+    diff_bytes += writes.size() + written_bytes();  // address も数える
+    for (size_t led = 0; match && (led < lights); led++) {
+      const Chip& c = chips[led / PCA9685_LEDS_PER_CHIP];
+      for (size_t k = 0; k < 4; k++) {
+        const uint8_t* r = &c.reg[PCA9685_LED0_ON_L + ((led % PCA9685_LEDS_PER_CHIP) * 4 + k) * 4];
+        match = match && (static_cast<uint16_t>(r[0] | (r[1] << 8)) == Leds::level(frame.pixel(led)[k]));
+      }
+    }
+  }
+  const double us_per_byte = 9.0 * 1e6 / I2C_CLOCK;
+  auto row = [&](const char* name, size_t w, size_t b) {
+    const double per_frame = static_cast<double>(b) / frames;
+    std::printf("  %-28s %7.1f writes %7.1f bytes %6.2f ms/frame %5.1f%% of the bus\n", name,
+                static_cast<double>(w) / frames, per_frame, per_frame * us_per_byte / 1000, per_frame * us_per_byte * 60 / 1e4);
+  };
+  row("register at a time (before)", legacy_writes, legacy_bytes);
+  row("every chip, one burst", chip_count * frames, chip_count * (1 + PCA9685_MAX_WRITE) * frames);
+  row("changed channels (this)", diff_writes, diff_bytes);
+  check(match, "chips follow every frame");
+  check(diff_bytes * 3 < legacy_bytes, "diffed bursts use under a third of the old bus time");
+}
+
+int main(int argc, char* argv[]) {
+  int frames = 600;
+  for (int i = 1; i < argc; i++) {
+    if ((std::strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {frames = std::atoi(argv[++i]);}
+  }
+  diff_and_batch();
+  budget_and_faults();
+  traffic(frames);
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
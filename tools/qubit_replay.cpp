@@ -0,0 +1,300 @@
+/* ========================================
+ *
+ *  qubit_replay.cpp
+ *    description: capture した sweep を PC 上で QubitTouch に流し込む
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  telemetry_decode.py capture で取った sweep ファイルを読み、
+ *  本体と同じ順番 (set_value → seek_and_update_touch_point → LED 計算) で処理して
+ *  MIDI イベントと LED フレームを標準出力に、処理時間を標準エラーに出す
+ *
+ *  build: make -C tools
+ *  使い方:
+ *    qubit_replay [-l] [-q] [-w warmup_us] [-c expected.midi [-t tol]] out.sweeps
+ *      -l  LED が変わったフレームを出力する
+ *      -q  MIDI イベントを出力しない (処理時間だけ見る)
+ *      -w  最初の warmup_us の間はタッチ検出をしない (本体の touch_stable 相当、既定 0)
+ *      -c  MIDI イベントを、以前に -q なしで出力したもの (golden) と比べる
+ *          時刻・status・note・順番は完全一致、velocity は ±tol まで許す (既定 0)
+ *          一致しなければ最初の違いを表示して終了コード 1
+ *  -c の有無によらず、trace のパッド数の外の Note を出したら終了コード 1
+ *
+ *  tools/traces に make_traces.py で作った trace と golden (.midi) が入っている
+ *  タッチ処理を変えたら make -C tools check で全部を -c で比べる
+ *
+ *  出力:
+ *    midi <t_us> <status hex> <note> <velocity>
+ *    led <t_us> <rrggbbww x pads>
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "../qtouch.h"
+#include "../led_frame.h"
+#include "../constants.h"
+
+struct MidiEvent {
+  uint64_t  time_us;
+  uint8_t   status;
+  uint8_t   note;
+  uint8_t   velocity;
+};
+
+namespace {
+bool print_midi = true;
+bool print_led = false;
+std::vector<MidiEvent> midi_events;  // 計測中は printf しないよう、溜めておいて最後に出す
+LedFrame led_frame;
+}
+
+/*----------------------------------------------------------------------------*/
+//     Hardware stand-in (本体では loopian_qubit.ino が定義する)
+/*----------------------------------------------------------------------------*/
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us) {
+  midi_events.push_back({sweep_us, status, note, velocity});
+}
+void debug_pt(int pt) {
+  (void)pt;
+}
+
+QubitTouch qt([](uint8_t status, uint8_t note, uint8_t intensity) {
+  sendMidiMessage(status, note, intensity, qt.frame_time_us());
+});
+
+/*----------------------------------------------------------------------------*/
+//     Capture file
+/*----------------------------------------------------------------------------*/
+struct Sweep {
+  uint64_t  time_us;
+  uint16_t  values[MAX_SENS];
+};
+
+bool read_sweeps(const char* path, std::vector<Sweep>& sweeps, size_t& pads) {
+  FILE* fp = std::fopen(path, "r");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  char line[4096];
+  pads = MAX_SENS;
+  if ((std::fgets(line, sizeof(line), fp) == nullptr) ||
+      (std::sscanf(line, "# qubit-sweeps v1 pads=%zu", &pads) != 1)) {
+    std::fprintf(stderr, "%s: not a qubit-sweeps v1 file\n", path);
+    std::fclose(fp);
+    return false;
+  }
+  if (pads > MAX_SENS) {
+    std::fprintf(stderr, "%s: %zu pads, only the first %d are used\n", path, pads, MAX_SENS);
+  }
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    if (line[0] == '#' || line[0] == '\n') {continue;}
+    Sweep sw = {};
+    char* p = line;
+    char* end = nullptr;
+    sw.time_us = std::strtoull(p, &end, 10);
+    if (end == p) {continue;}
+    for (size_t i = 0; i < pads; i++) {
+      p = end;
+      long v = std::strtol(p, &end, 10);
+      if (end == p) {break;}
+      if (i < MAX_SENS) {sw.values[i] = static_cast<uint16_t>(v);}
+    }
+    sweeps.push_back(sw);
+  }
+  std::fclose(fp);
+  return true;
+}
+
+/*----------------------------------------------------------------------------*/
+//     Golden MIDI
+/*----------------------------------------------------------------------------*/
+void print_midi_event(const MidiEvent& ev) {
+  std::printf("midi %llu %02x %u %u\n", static_cast<unsigned long long>(ev.time_us), ev.status, ev.note, ev.velocity);
+}
+
+bool read_midi_events(const char* path, std::vector<MidiEvent>& events) {
+  FILE* fp = std::fopen(path, "r");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  char line[256];
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    unsigned long long t;
+    unsigned status, note, vel;
+    if (std::sscanf(line, "midi %llu %x %u %u", &t, &status, &note, &vel) == 4) {
+      events.push_back({t, static_cast<uint8_t>(status), static_cast<uint8_t>(note), static_cast<uint8_t>(vel)});
+    }
+  }
+  std::fclose(fp);
+  return true;
+}
+
+/// 一致すれば true。違えば最初の違いを stderr に出す
+bool compare_midi(const std::vector<MidiEvent>& expected, const std::vector<MidiEvent>& actual, int tolerance) {
+  size_t n = std::min(expected.size(), actual.size());
+  for (size_t i = 0; i < n; i++) {
+    const MidiEvent& e = expected[i];
+    const MidiEvent& a = actual[i];
+    int dv = static_cast<int>(a.velocity) - static_cast<int>(e.velocity);
+    if ((e.time_us != a.time_us) || (e.status != a.status) || (e.note != a.note) ||
+        (dv > tolerance) || (dv < -tolerance)) {
+      std::fprintf(stderr, "MISMATCH at event %zu\n  expected: midi %llu %02x %u %u\n  actual:   midi %llu %02x %u %u\n", i,
+                   static_cast<unsigned long long>(e.time_us), e.status, e.note, e.velocity,
+                   static_cast<unsigned long long>(a.time_us), a.status, a.note, a.velocity);
+      return false;
+    }
+  }
+  if (expected.size() != actual.size()) {
+    std::fprintf(stderr, "MISMATCH: expected %zu events, got %zu\n", expected.size(), actual.size());
+    return false;
+  }
+  return true;
+}
+
+/// Note On / Off がすべて 0-(pads-1) のパッドから出ていれば true (zone ごとに channel が一つ進む)
+bool notes_within_pads(const std::vector<MidiEvent>& events, size_t pads) {
+  for (const MidiEvent& ev : events) {
+    const int zone = ((ev.status & 0x0f) - TouchPoint::DEFAULT_CHANNEL) & 0x0f;
+    const int pad = zone * ZONE_PADS + ev.note - TouchPoint::OFFSET_NOTE;
+    if ((ev.note < TouchPoint::OFFSET_NOTE) || (pad >= static_cast<int>(pads))) {
+      std::fprintf(stderr, "OUT OF RANGE: midi %llu %02x %u %u is pad %d of %zu\n",
+                   static_cast<unsigned long long>(ev.time_us), ev.status, ev.note, ev.velocity, pad, pads);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*----------------------------------------------------------------------------*/
+//     Replay
+/*----------------------------------------------------------------------------*/
+void print_led_frame(uint64_t time_us) {
+  static uint8_t last[MAX_LIGHT][4] = {};
+  const size_t lights = led_frame.light_count();
+  bool changed = false;
+  for (size_t i = 0; i < lights; i++) {
+    if (std::memcmp(last[i], led_frame.pixel(i), 4) != 0) {
+      std::memcpy(last[i], led_frame.pixel(i), 4);
+      changed = true;
+    }
+  }
+  if (!changed) {return;}
+  std::printf("led %llu ", static_cast<unsigned long long>(time_us));
+  for (size_t i = 0; i < lights; i++) {
+    const uint8_t* px = led_frame.pixel(i);
+    std::printf("%02x%02x%02x%02x", px[0], px[1], px[2], px[3]);
+  }
+  std::printf("\n");
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, uint32_t permille) {
+  if (sorted.empty()) {return 0;}
+  size_t idx = (sorted.size() * permille + 999) / 1000;
+  if (idx > 0) {idx -= 1;}
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+int main(int argc, char* argv[]) {
+  uint64_t warmup_us = 0;
+  const char* path = nullptr;
+  const char* golden = nullptr;
+  int tolerance = 0;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-l") == 0) {
+      print_led = true;
+    } else if (std::strcmp(argv[i], "-q") == 0) {
+      print_midi = false;
+    } else if ((std::strcmp(argv[i], "-w") == 0) && (i + 1 < argc)) {
+      warmup_us = std::strtoull(argv[++i], nullptr, 10);
+    } else if ((std::strcmp(argv[i], "-c") == 0) && (i + 1 < argc)) {
+      golden = argv[++i];
+    } else if ((std::strcmp(argv[i], "-t") == 0) && (i + 1 < argc)) {
+      tolerance = std::atoi(argv[++i]);
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == nullptr) {
+    std::fprintf(stderr, "usage: qubit_replay [-l] [-q] [-w warmup_us] [-c expected.midi [-t tol]] <file.sweeps>\n");
+    return 2;
+  }
+
+  std::vector<Sweep> sweeps;
+  size_t pads = 0;
+  if (!read_sweeps(path, sweeps, pads)) {return 1;}
+  if (sweeps.empty()) {
+    std::fprintf(stderr, "%s: no sweeps\n", path);
+    return 1;
+  }
+  std::vector<MidiEvent> expected;
+  if ((golden != nullptr) && !read_midi_events(golden, expected)) {return 1;}
+  midi_events.reserve(expected.size() + 1024);
+  // 本体の Topology と同じく、ring は trace のパッドの数で折り返す
+  const size_t used = std::min<size_t>(pads, MAX_SENS);
+  qt.set_pad_count(used);
+  led_frame.set_light_count(used);
+
+  // 一フレーム = touch_task + led_task (LED の送信と伴奏・白色は除く)
+  using clock = std::chrono::steady_clock;
+  std::vector<uint32_t> touch_ns, led_ns, frame_ns;
+  touch_ns.reserve(sweeps.size());
+  led_ns.reserve(sweeps.size());
+  frame_ns.reserve(sweeps.size());
+  const uint64_t start_us = sweeps.front().time_us;
+  auto wall_start = clock::now();
+  for (const Sweep& sw : sweeps) {
+    if (sw.time_us - start_us < warmup_us) {continue;}
+    auto t0 = clock::now();
+    for (size_t i = 0; i < used; i++) {
+      qt.set_value(i, sw.values[i]);
+    }
+    qt.set_frame_time(sw.time_us);
+    qt.seek_and_update_touch_point();
+    auto t1 = clock::now();
+    led_frame.clear_touch();
+    qt.lighten_leds([](float locate, int16_t sensor_value) {
+      led_frame.set_by_touch(locate, sensor_value, true);
+    });
+    auto t2 = clock::now();
+    touch_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+    led_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()));
+    frame_ns.push_back(touch_ns.back() + led_ns.back());
+    if (print_led) {print_led_frame(sw.time_us);}
+  }
+  double wall_s = std::chrono::duration<double>(clock::now() - wall_start).count();
+
+  const size_t frames = frame_ns.size();
+  const double span_s = (sweeps.back().time_us - start_us) / 1e6;
+  std::fprintf(stderr, "frames %zu  pads %zu  span %.3f s  capture %.1f fps  midi events %zu\n",
+               frames, pads, span_s, span_s > 0 ? (sweeps.size() - 1) / span_s : 0.0,
+               midi_events.size());
+  std::fprintf(stderr, "replay %.1f fps (host, including output)\n", wall_s > 0 ? frames / wall_s : 0.0);
+  std::fprintf(stderr, "%-6s %10s %10s %10s %10s  [ns]\n", "stage", "p50", "p90", "p99", "max");
+  const char* names[] = {"touch", "led", "frame"};
+  std::vector<uint32_t>* samples[] = {&touch_ns, &led_ns, &frame_ns};
+  for (size_t s = 0; s < 3; s++) {
+    std::vector<uint32_t>& v = *samples[s];
+    std::sort(v.begin(), v.end());
+    std::fprintf(stderr, "%-6s %10u %10u %10u %10u\n", names[s],
+                 percentile(v, 500), percentile(v, 900), percentile(v, 990), v.empty() ? 0 : v.back());
+  }
+  if (print_midi) {
+    for (const MidiEvent& ev : midi_events) {print_midi_event(ev);}
+  }
+  if (!notes_within_pads(midi_events, used)) {return 1;}
+  if (golden != nullptr) {
+    if (!compare_midi(expected, midi_events, tolerance)) {return 1;}
+    std::fprintf(stderr, "golden OK (%zu events)\n", expected.size());
+  }
+  return 0;
+}
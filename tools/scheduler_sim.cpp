@@ -0,0 +1,182 @@
+/* ========================================
+ *
+ *  scheduler_sim.cpp
+ *    description: FrameScheduler (scheduler.h) を偽の時計で動かし、選ぶ順と統計を確かめる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  Clock に偽の時計を渡し、タスクは決めた時間だけ時計を進める
+ *  - 優先度の順、同じ優先度なら締め切りの早い順 (EDF)
+ *  - 起動時刻からの遅れ (jitter)、締め切り超え (overrun)、一周期以上の遅れ (skip) の数
+ *  - 止めたタスク、slack_us()
+ *  - 本体と同じ 5 つのタスクを 1 秒回し、Touch の遅れが一番長い他のタスクで抑えられること
+ *
+ *  build / run:
+ *    make -C tools scheduler_sim && tools/scheduler_sim
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "../scheduler.h"
+
+namespace {
+uint64_t fake_us = 0;
+uint64_t fake_clock() {return fake_us;}
+
+// タスク番号 ID のタスク: 呼ばれた順を残し、exec_us[ID] だけ時計を進める
+uint32_t exec_us[MAX_SCHED_TASKS];
+std::vector<int> ran;
+template <int ID>
+void task_fn() {
+  ran.push_back(ID);
+  fake_us += exec_us[ID];
+}
+constexpr SchedTask::Func FUNCS[MAX_SCHED_TASKS] = {
+  task_fn<0>, task_fn<1>, task_fn<2>, task_fn<3>, task_fn<4>, task_fn<5>, task_fn<6>, task_fn<7>,
+};
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+void reset(uint64_t now_us) {
+  fake_us = now_us;
+  ran.clear();
+  for (auto& e : exec_us) {e = 0;}
+}
+
+void pick_order() {
+  std::printf("== pick order\n");
+  reset(1000);
+  FrameScheduler sched(fake_clock);
+  // 登録の順と優先度の順を逆にする
+  sched.add_task("C", FUNCS[0], 1000, 1000, 2);
+  sched.add_task("B", FUNCS[1], 1000, 1000, 1);
+  sched.add_task("A", FUNCS[2], 1000, 1000, 0);
+  sched.run();
+  sched.run();
+  sched.run();
+  check((ran == std::vector<int>{2, 1, 0}), "higher priority runs first");
+  check(sched.run() == -1, "nothing runs before the next release");
+  check(sched.slack_us() == 1000, "slack is the time to the nearest release");
+
+  // 同じ優先度: 起動時刻 + 締め切りの早いもの
+  reset(0);
+  FrameScheduler edf(fake_clock);
+  edf.add_task("late", FUNCS[0], 1000, 4000, 1);
+  edf.add_task("early", FUNCS[1], 1000, 500, 1);
+  fake_us = 100;
+  edf.run();
+  edf.run();
+  check((ran == std::vector<int>{1, 0}), "same priority: earliest deadline first");
+  // 締め切りの長いものでも、ずっと前に起動時刻が来ていれば先
+  reset(0);
+  FrameScheduler edf2(fake_clock);
+  edf2.add_task("old", FUNCS[0], 1000, 4000, 1);
+  fake_us = 5000;
+  edf2.add_task("new", FUNCS[1], 1000, 500, 1);
+  edf2.run();
+  check((ran == std::vector<int>{0}), "same priority: an old release beats a new short deadline");
+
+  // 止めたタスクは起動時刻が来ても走らない
+  reset(0);
+  FrameScheduler off(fake_clock);
+  const int id = off.add_task("off", FUNCS[0], 1000, 1000, 0);
+  off.set_enabled(id, false);
+  check((off.run() == -1) && ran.empty(), "a disabled task never runs");
+  check(off.slack_us() == UINT32_MAX, "no enabled task: slack is unbounded");
+  off.set_enabled(id, true);
+  check(off.run() == id, "it runs again once enabled");
+}
+
+void counters() {
+  std::printf("== jitter, overrun and skip counters\n");
+  reset(0);
+  FrameScheduler sched(fake_clock);
+  const int id = sched.add_task("T", FUNCS[0], 1000, 1000, 0);
+  // 300usec 遅れて起動し、200usec で終わる
+  fake_us = 300;
+  exec_us[0] = 200;
+  sched.run();
+  const SchedTask& t = sched.task(id);
+  check((t.runs == 1) && (t.last_jitter_us == 300) && (t.max_jitter_us == 300), "jitter is start minus release");
+  check((t.last_exec_us == 200) && (t.overruns == 0) && (t.skipped == 0), "on time: no overrun, no skip");
+  check(t.release_us == 1000, "next release is one period after the last one (no drift)");
+
+  // 締め切り (1000) を越える: 起動 1000、終わり 2100
+  fake_us = 1000;
+  exec_us[0] = 1100;
+  sched.run();
+  check((t.overruns == 1) && (t.skipped == 0) && (t.release_us == 2000), "ending past the deadline counts an overrun");
+  check(t.max_exec_us == 1100, "max exec time is kept");
+
+  // 一周期以上遅れて始めた: 溜めずに今から数え直す
+  exec_us[0] = 100;
+  fake_us = 4500;
+  sched.run();
+  check((t.skipped == 1) && (t.release_us == 4600), "a period or more late: skip and restart from now");
+  check(t.max_jitter_us == 2500, "max jitter covers the late start");
+  fake_us = 4600;
+  sched.run();
+  check((t.runs == 4) && (t.skipped == 1) && (t.release_us == 5600), "then it runs on the new grid");
+  check(t.avg_jitter_us() == (300 + 0 + 2500 + 0) / 4, "average jitter over all runs");
+
+  // 周期を変えると次の起動から
+  sched.set_period(id, 250);
+  fake_us = 5600;
+  sched.run();
+  check(t.release_us == 5850, "a new period applies from the next release");
+}
+
+void frame_loop() {
+  std::printf("== one second of the Core0 task set\n");
+  reset(0);
+  FrameScheduler sched(fake_clock);
+  // 本体 (loopian_qubit.ino の setup()) と同じ周期・締め切り・優先度
+  const int touch = sched.add_task("Touch", FUNCS[0], 1000, 1000, 0);
+  const int midi = sched.add_task("MIDI", FUNCS[1], 1000, 2000, 1);
+  const int led = sched.add_task("LED", FUNCS[2], 16667, 16667, 2);
+  const int disp = sched.add_task("Disp", FUNCS[3], 250000, 250000, 3);
+  const int ser = sched.add_task("Ser", FUNCS[4], 20000, 20000, 4);
+  exec_us[touch] = 120;
+  exec_us[midi] = 60;
+  exec_us[led] = 700;
+  exec_us[disp] = 900;
+  exec_us[ser] = 150;
+  uint32_t longest_other = 0;
+  for (int i = 1; i < 5; i++) {longest_other = std::max(longest_other, exec_us[i]);}
+  constexpr uint32_t LOOP_US = 10;     // 何も走らない時の loop() 一回
+  while (fake_us < 1000000) {
+    if (sched.run() < 0) {fake_us += LOOP_US;}
+  }
+  const SchedTask& t = sched.task(touch);
+  std::printf("  Touch runs %u max jitter %u us, LED runs %u, Disp runs %u, Ser runs %u\n",
+              t.runs, t.max_jitter_us, sched.task(led).runs, sched.task(disp).runs, sched.task(ser).runs);
+  check((t.runs >= 999) && (t.runs <= 1001) && (t.skipped == 0), "Touch runs every millisecond");
+  check(t.max_jitter_us <= longest_other + LOOP_US, "Touch waits at most for the longest other task");
+  check(t.overruns == 0, "Touch never misses its deadline");
+  check((sched.task(led).runs >= 59) && (sched.task(led).runs <= 61), "LED keeps about 60 Hz");
+  check(sched.task(disp).runs == 4, "Disp runs at 4 Hz");
+  check(sched.task(ser).runs == 50, "Ser runs at 50 Hz");
+  // 全部が同時に起動する最初: 優先度の順。Disp が終わる間に来た Touch / MIDI は Ser より先
+  const std::vector<int> first(ran.begin(), ran.begin() + std::min<size_t>(ran.size(), 7));
+  check((first == std::vector<int>{touch, midi, led, disp, touch, midi, ser}), "the first frame runs in priority order");
+}
+}
+
+int main() {
+  pick_order();
+  counters();
+  frame_loop();
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,401 @@
+/* ========================================
+ *
+ *  stream_check.cpp
+ *    description: SweepEncoder / SweepDecoder (sensor_stream.h) と telemetry_decode.py の往復を確かめる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  決めた乱数と端の値の sweep を SweepEncoder で telemetry フレームの列にし、
+ *  C++ の SweepDecoder と telemetry_decode.py の SweepDecoder (capture) の両方で戻して、
+ *  元の値と時刻に一 bit も違わないことを確かめる
+ *  - keyframe が STREAM_KEYFRAME_INTERVAL ごと (と force_keyframe() の後) に出ること
+ *  - 抜けた seq (本体と同じく捨てた後に force_keyframe() する場合としない場合):
+ *    lost() が捨てた数と合い、次の keyframe までは値を出さないこと
+ *  - 32bit の時刻の折り返し (Python は 64bit に伸ばす)
+ *  - ±32767 と ±65535 の差分
+ *  - フレームの間に混ざったテキスト ('l' のレポートなど) を読み飛ばすこと
+ *  - ByteRing::copy_out() が折り返しをまたいだフレームを丸ごと取り出すこと
+ *  - drain_frames(): 192 パッドで USB の送信 FIFO (256 byte) より大きくなったフレームを捨て、
+ *    その後も stream が止まらず、keyframe から元の値に戻ること
+ *
+ *  build / run:
+ *    make -C tools stream_check && tools/stream_check [-k]
+ *    -k : 作った stream と Python の出力を消さずに残す
+ *  python3 が要る。全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../sensor_stream.h"
+#include "../telemetry.h"
+#include "../constants.h"
+
+namespace {
+constexpr size_t PADS = 96;
+
+int failures = 0;
+std::string tools_dir = "tools";
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+struct Sweep {
+  uint64_t  time_us;
+  uint16_t  values[PADS];
+};
+
+enum class Drop : uint8_t {
+  NONE,
+  RING_FULL,    // stream_sweep() と同じ: 捨てて次は keyframe
+  LOST,         // 途中で消えた (encoder は知らない)
+};
+
+// 決まった乱数 (xorshift)
+uint32_t rng_state = 2463534242u;
+uint32_t rnd() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+/// 一つの stream の元の sweep。32bit の時刻がはじめの 2 つ目の keyframe 区間で折り返す
+auto make_sweeps() -> std::vector<Sweep> {
+  std::vector<Sweep> sweeps;
+  Sweep s = {};
+  s.time_us = (1ull << 32) - 500000;
+  for (size_t p = 0; p < PADS; p++) {s.values[p] = static_cast<uint16_t>(rnd() % 1024);}
+  for (uint32_t k = 0; k < 1200; k++) {
+    s.time_us += 3000 + rnd() % 2000;
+    if ((k >= 400) && (k < 440)) {
+      // 端の値: ±32767 と ±65535 の差分
+      for (size_t p = 0; p < PADS; p++) {
+        switch (p % 4) {
+        case 0: s.values[p] = (k % 2) ? 32767 : 0; break;
+        case 1: s.values[p] = (k % 2) ? 0 : 32767; break;
+        case 2: s.values[p] = (k % 2) ? 65535 : 0; break;
+        default: s.values[p] = (k % 2) ? 32768 : 1; break;
+        }
+      }
+    } else if (k == 700) {
+      // 時刻の大きな飛び (32bit の差分に収まる一番大きなもの)
+      s.time_us += UINT32_MAX - 5000;
+    } else {
+      // ふだん: 少しずつ動き、ときどき大きく跳ぶ
+      for (size_t p = 0; p < PADS; p++) {
+        int v = s.values[p] + static_cast<int>(rnd() % 21) - 10;
+        if (rnd() % 50 == 0) {v = static_cast<int>(rnd() % 1024);}
+        s.values[p] = static_cast<uint16_t>(v < 0 ? 0 : (v > 1023 ? 1023 : v));
+      }
+    }
+    sweeps.push_back(s);
+  }
+  return sweeps;
+}
+
+auto drop_at(uint32_t k) -> Drop {
+  if ((k == 150) || (k == 151) || (k == 600) || (k == 1000)) {return Drop::RING_FULL;}
+  if ((k == 300) || (k == 520) || (k == 521) || (k == 522) || (k == 1100)) {return Drop::LOST;}
+  return Drop::NONE;
+}
+
+struct Expected {
+  uint32_t  index;      // sweeps の何番目か
+};
+
+void round_trip(bool keep) {
+  std::printf("== round trip (%zu pads)\n", PADS);
+  const std::vector<Sweep> sweeps = make_sweeps();
+  static SweepEncoder<PADS> encoder;
+  uint8_t frame[SweepEncoder<PADS>::MAX_FRAME];
+  std::vector<uint8_t> stream;
+  std::vector<bool> sent_key(sweeps.size(), false);
+  std::vector<bool> sent(sweeps.size(), false);
+  uint32_t dropped = 0;
+  uint32_t since_key = 0;
+  bool spacing_ok = true;
+  bool forced_ok = true;
+  bool force_pending = false;
+  for (uint32_t k = 0; k < sweeps.size(); k++) {
+    const size_t len = encoder.encode(frame, sizeof(frame), static_cast<uint32_t>(sweeps[k].time_us), sweeps[k].values, PADS);
+    const bool key = (frame[TELEMETRY_OVERHEAD - 1] & STREAM_FLAG_KEYFRAME) != 0;
+    // keyframe は STREAM_KEYFRAME_INTERVAL 回に一回、force_keyframe() の直後は必ず
+    if (force_pending && !key) {forced_ok = false;}
+    if (!force_pending && (key != (since_key == STREAM_KEYFRAME_INTERVAL || k == 0))) {spacing_ok = false;}
+    since_key = key ? 1 : since_key + 1;
+    force_pending = false;
+    const Drop drop = drop_at(k);
+    if (drop != Drop::NONE) {
+      dropped += 1;
+      if (drop == Drop::RING_FULL) {
+        encoder.force_keyframe();
+        force_pending = true;
+      }
+      continue;
+    }
+    stream.insert(stream.end(), frame, frame + len);
+    sent[k] = true;
+    sent_key[k] = key;
+    // ときどきフレームの間にテキストが入る
+    if (k % 97 == 5) {
+      const char* text = "Sw>NoteQ 120 8 35 60 71 140\r\n";
+      stream.insert(stream.end(), text, text + std::strlen(text));
+    }
+  }
+  check(spacing_ok, "keyframe every STREAM_KEYFRAME_INTERVAL frames");
+  check(forced_ok, "force_keyframe() makes the next frame a keyframe");
+
+  // C++: TelemetryReader + SweepDecoder
+  TelemetryReader<SweepEncoder<PADS>::MAX_FRAME> reader;
+  SweepDecoder<PADS> decoder;
+  std::vector<uint32_t> decoded;   // 戻った sweep の番号
+  uint32_t seq_base = 0;
+  bool exact = true;
+  bool waited_for_key = true;
+  bool after_gap = false;
+  for (uint8_t b : stream) {
+    if (!reader.feed(b) || (reader.type() != TelemetryType::SWEEP)) {continue;}
+    const bool key = (reader.payload()[0] & STREAM_FLAG_KEYFRAME) != 0;
+    const uint32_t lost_before = decoder.lost();
+    const bool ok = decoder.decode(reader.payload(), reader.length());
+    if (decoder.lost() != lost_before) {after_gap = true;}
+    if (!ok) {continue;}
+    if (after_gap && !key) {waited_for_key = false;}
+    after_gap = false;
+    const uint32_t k = decoder.seq() - seq_base;
+    if ((k >= sweeps.size()) || !sent[k]) {
+      exact = false;
+      continue;
+    }
+    decoded.push_back(k);
+    const Sweep& s = sweeps[k];
+    if ((decoder.time_us() != static_cast<uint32_t>(s.time_us)) || (decoder.pads() != PADS)) {exact = false;}
+    for (size_t p = 0; p < PADS; p++) {
+      if (decoder.value(p) != s.values[p]) {exact = false;}
+    }
+  }
+  uint32_t keys_sent = 0, keys_decoded = 0;
+  for (uint32_t k = 0; k < sweeps.size(); k++) {keys_sent += sent_key[k] ? 1 : 0;}
+  for (uint32_t k : decoded) {keys_decoded += sent_key[k] ? 1 : 0;}
+  std::printf("  %zu sweeps, %u dropped, %zu bytes, C++ decoded %zu (lost %u), %u keyframes\n", sweeps.size(), dropped,
+              stream.size(), decoded.size(), decoder.lost(), keys_sent);
+  check(reader.errors() == 0, "every frame passes its checksum");
+  check(exact, "C++: every decoded sweep is bit-exact (values and 32-bit time)");
+  check(decoder.lost() == dropped, "C++: lost() counts every dropped frame");
+  check(waited_for_key, "C++: after a gap nothing is decoded before a keyframe");
+  check(keys_decoded == keys_sent, "C++: every keyframe is decoded");
+  uint32_t wrapped = 0;
+  for (uint32_t k = 1; k < sweeps.size(); k++) {
+    if ((sweeps[k].time_us >> 32) != (sweeps[k - 1].time_us >> 32)) {wrapped += 1;}
+  }
+  check(wrapped >= 2, "the stream crosses the 32-bit time wrap");
+
+  // Python: telemetry_decode.py capture
+  const std::string stream_path = "/tmp/stream_check.bin";
+  const std::string out_path = "/tmp/stream_check.sweeps";
+  FILE* fp = std::fopen(stream_path.c_str(), "wb");
+  if (fp == nullptr) {
+    check(false, "write the stream file");
+    return;
+  }
+  std::fwrite(stream.data(), 1, stream.size(), fp);
+  std::fclose(fp);
+  std::remove(out_path.c_str());
+  const std::string cmd = "python3 " + tools_dir + "/telemetry_decode.py capture " + stream_path + " " + out_path + " 2>/dev/null";
+  const int rc = std::system(cmd.c_str());
+  check(rc == 0, "telemetry_decode.py capture runs");
+  fp = std::fopen(out_path.c_str(), "r");
+  if (fp == nullptr) {
+    check(false, "telemetry_decode.py wrote its output");
+    return;
+  }
+  char line[8192];
+  size_t pads = 0;
+  bool header = (std::fgets(line, sizeof(line), fp) != nullptr) &&
+                (std::sscanf(line, "# qubit-sweeps v1 pads=%zu", &pads) == 1) && (pads == PADS);
+  size_t row = 0;
+  bool py_exact = true;
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    char* p = line;
+    char* end = nullptr;
+    const uint64_t t = std::strtoull(p, &end, 10);
+    if ((row >= decoded.size()) || (end == p)) {
+      py_exact = false;
+      break;
+    }
+    const Sweep& s = sweeps[decoded[row]];
+    if (t != s.time_us) {py_exact = false;}
+    for (size_t i = 0; i < PADS; i++) {
+      p = end;
+      const unsigned long v = std::strtoul(p, &end, 10);
+      if ((end == p) || (v != s.values[i])) {py_exact = false;}
+    }
+    row += 1;
+  }
+  std::fclose(fp);
+  std::printf("  Python decoded %zu\n", row);
+  check(header, "Python: header has the pad count");
+  check(py_exact && (row == decoded.size()), "Python: same sweeps as C++, bit-exact with 64-bit time");
+  if (!keep) {
+    std::remove(stream_path.c_str());
+    std::remove(out_path.c_str());
+  }
+}
+
+/// drain_sensor_stream() と同じ読み方: ヘッダを見て、丸ごと取り出せる時だけ
+void ring_frames() {
+  std::printf("== whole frames out of a wrapping ByteRing\n");
+  ByteRing<256> ring;
+  static SweepEncoder<PADS> encoder;
+  uint8_t frame[SweepEncoder<PADS>::MAX_FRAME];
+  uint8_t out[SweepEncoder<PADS>::MAX_FRAME];
+  uint16_t values[PADS] = {};
+  uint32_t pushed = 0, popped = 0, straddled = 0;
+  bool intact = true;
+  uint32_t tail = 0;
+  auto drain = [&]() {
+    while (ring.copy_out(out, TELEMETRY_OVERHEAD - 1)) {
+      const size_t flen = TELEMETRY_OVERHEAD + (out[2] | (static_cast<size_t>(out[3]) << 8));
+      if ((out[0] != TELEMETRY_SYNC) || !ring.copy_out(out, flen)) {
+        intact = false;
+        return;
+      }
+      if (((tail & 255) + flen) > 256) {straddled += 1;}
+      TelemetryReader<SweepEncoder<PADS>::MAX_FRAME> reader;
+      bool one = false;
+      for (size_t i = 0; i < flen; i++) {one = reader.feed(out[i]);}
+      if (!one) {intact = false;}
+      ring.consume(flen);
+      tail += static_cast<uint32_t>(flen);
+      popped += 1;
+    }
+  };
+  for (uint32_t k = 0; k < 2000; k++) {
+    for (size_t p = 0; p < 8; p++) {values[p] = static_cast<uint16_t>(rnd() % 1024);}
+    const size_t len = encoder.encode(frame, sizeof(frame), k * 4000, values, 8);
+    if (ring.push(frame, len)) {
+      pushed += 1;
+    } else {
+      encoder.force_keyframe();
+    }
+    // 読む側は時々しか来ない
+    if (k % 3 == 0) {drain();}
+  }
+  drain();
+  std::printf("  pushed %u popped %u, %u frames straddled the wrap\n", pushed, popped, straddled);
+  check(intact && (straddled > 0), "copy_out() returns whole frames across the wrap");
+  check((popped == pushed) && (ring.used() == 0), "every pushed frame comes out");
+}
+}
+
+/// 本体と同じ: Core1 が encode して ring に入れ、Core0 が drain_frames() で FIFO に送る
+/// drop_oversize が false なら前の drain_sensor_stream() (大きいフレームを待ち続ける)
+struct OversizeRun {
+  uint32_t  oversize = 0;       // Core0 が捨てたフレーム
+  uint32_t  dropped = 0;        // Core1 の stream_dropped
+  uint32_t  written = 0;        // FIFO に書いたフレーム
+  uint32_t  last_decoded = 0;   // 最後に戻った sweep の番号
+  uint32_t  decoded = 0;
+  size_t    largest = 0;        // FIFO に書いた一番大きなフレーム
+  bool      exact = true;
+  bool      overflow = false;
+};
+
+auto oversize_run(bool drop_oversize) -> OversizeRun {
+  constexpr size_t BIG = 192;
+  OversizeRun r;
+  static SweepEncoder<BIG> encoder;
+  encoder = SweepEncoder<BIG>();
+  static ByteRing<4096> ring;
+  ring.consume(ring.used());
+  uint8_t frame[SweepEncoder<BIG>::MAX_FRAME];
+  uint8_t work[SweepEncoder<BIG>::MAX_FRAME];
+  TelemetryReader<SweepEncoder<BIG>::MAX_FRAME> reader;
+  SweepDecoder<BIG> decoder;
+  std::vector<std::vector<uint16_t>> history;
+  uint16_t values[BIG] = {};
+  size_t fifo_used = 0;
+  uint32_t oversize_seen = 0;
+  for (uint32_t k = 0; k < 1000; k++) {
+    // ふだんは小さな値 (1 byte の varint)。二度、多くのパッドが大きく動く
+    const bool burst = ((k >= 200) && (k < 205)) || ((k >= 600) && (k < 603));
+    for (size_t p = 0; p < BIG; p++) {
+      values[p] = static_cast<uint16_t>(burst && (p % 3 != 0) ? 300 + rnd() % 700 : rnd() % 40);
+    }
+    history.emplace_back(values, values + BIG);
+    // Core1: stream_sweep()
+    if (r.oversize != oversize_seen) {
+      r.dropped += r.oversize - oversize_seen;
+      oversize_seen = r.oversize;
+      encoder.force_keyframe();
+    }
+    const size_t len = encoder.encode(frame, sizeof(frame), k * 3000, values, BIG);
+    if ((len == 0) || !ring.push(frame, len)) {
+      r.dropped += 1;
+      encoder.force_keyframe();
+    }
+    // Core0: drain_sensor_stream()。USB は一回りで 256 byte 運ぶ
+    r.oversize += drain_frames(ring, work, sizeof(work), drop_oversize ? TELEMETRY_TX_FIFO : sizeof(work),
+      [&]() {return TELEMETRY_TX_FIFO - fifo_used;},
+      [&](const uint8_t* p, size_t n) {
+        if (fifo_used + n > TELEMETRY_TX_FIFO) {
+          r.overflow = true;
+          return;
+        }
+        fifo_used += n;
+        r.written += 1;
+        r.largest = std::max(r.largest, n);
+        for (size_t i = 0; i < n; i++) {
+          if (!reader.feed(p[i]) || !decoder.decode(reader.payload(), reader.length())) {continue;}
+          const uint32_t s = decoder.seq();
+          r.decoded += 1;
+          r.last_decoded = s;
+          for (size_t q = 0; q < BIG; q++) {
+            if ((s >= history.size()) || (decoder.value(q) != history[s][q])) {r.exact = false;}
+          }
+        }
+      });
+    fifo_used -= std::min(fifo_used, TELEMETRY_TX_FIFO);
+  }
+  return r;
+}
+
+void oversize() {
+  std::printf("== frames larger than the %zu-byte USB FIFO (192 pads)\n", TELEMETRY_TX_FIFO);
+  const OversizeRun stall = oversize_run(false);
+  std::printf("  waiting for room: %u frames written, last sweep out %u\n", stall.written, stall.last_decoded);
+  check(stall.last_decoded < 200, "waiting for room, the first oversize frame stalls the stream");
+  const OversizeRun r = oversize_run(true);
+  std::printf("  dropping: %u written, %u oversize, %u dropped, %u decoded, largest %zu bytes\n", r.written, r.oversize,
+              r.dropped, r.decoded, r.largest);
+  check((r.oversize > 0) && (r.dropped >= r.oversize), "oversize frames are counted in stream_dropped");
+  check(!r.overflow && (r.largest <= TELEMETRY_TX_FIFO), "every written frame fits the FIFO");
+  check(r.last_decoded == 999, "the stream keeps going after both bursts");
+  check(r.exact && (r.decoded + r.dropped + 20 >= 1000), "decoded sweeps are bit-exact, resynced by a keyframe");
+}
+
+int main(int argc, char* argv[]) {
+  // telemetry_decode.py はこの実行ファイルの隣
+  const std::string self = argv[0];
+  const size_t slash = self.find_last_of('/');
+  tools_dir = (slash == std::string::npos) ? "." : self.substr(0, slash);
+  bool keep = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-k") == 0) {keep = true;}
+  }
+  round_trip(keep);
+  ring_frames();
+  oversize();
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
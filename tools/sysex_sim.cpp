@@ -0,0 +1,259 @@
+/* ========================================
+ *
+ *  sysex_sim.cpp
+ *    description: SysexTuner (tuning.h) に正しい / 壊れた SysEx を流して返事を確かめる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  決まった場面 (ping / get / set / get all / save / perf / defaults / freeze) の返事を確かめたあと、
+ *  でたらめな frame と、正しい frame を少し壊したものを流し続けて
+ *    - 返事が cap を超えない、F0 ... F7 で中身は 7bit
+ *    - 値はいつも範囲の中、失敗した set は何も変えない
+ *  ことを確かめる
+ *
+ *  build / run:
+ *    make -C tools sysex_sim && tools/sysex_sim [-n frames]
+ *  全部通れば終了コード 0、どれかが違えば 1
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../tuning.h"
+
+namespace {
+int failures = 0;
+bool save_ok = true;
+int saves = 0;
+int freezes = 0;
+Tuning saved;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-52s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+void mock_perf(PerfSnapshot& out) {
+  for (size_t i = 0; i < PERF_COUNTERS; i++) {out.value[i] = 0x0f000000u + static_cast<uint32_t>(i) * 1000;}
+}
+bool mock_freeze() {
+  freezes += 1;
+  return freezes == 1;   // 一度止めたら、dump して記録し直すまでは止まったまま
+}
+bool mock_save(const Tuning& tuning) {
+  if (!save_ok) {return false;}
+  saved = tuning;
+  saves += 1;
+  return true;
+}
+
+std::vector<uint8_t> frame(uint8_t cmd, std::vector<uint8_t> payload = {}) {
+  std::vector<uint8_t> f = {SYSEX_START, SYSEX_ID, SYSEX_DEVICE, cmd};
+  for (uint8_t b : payload) {f.push_back(b);}
+  f.push_back(SYSEX_END);
+  return f;
+}
+std::vector<uint8_t> set_frame(std::vector<std::pair<uint8_t, uint16_t>> values) {
+  std::vector<uint8_t> payload;
+  for (const auto& v : values) {
+    uint8_t b[3];
+    SysexTuner::put16(b, v.second);
+    payload.push_back(v.first);
+    payload.insert(payload.end(), b, b + 3);
+  }
+  return frame(static_cast<uint8_t>(SysexCmd::SET), payload);
+}
+
+std::vector<uint8_t> send(SysexTuner& tuner, const std::vector<uint8_t>& msg) {
+  uint8_t reply[SYSEX_MAX_REPLY];
+  size_t len = tuner.handle(msg.data(), msg.size(), reply, sizeof(reply));
+  return std::vector<uint8_t>(reply, reply + len);
+}
+/// F0 7D 51 ... F7 で、間は全部 7bit
+bool well_formed(const std::vector<uint8_t>& r) {
+  if (r.empty()) {return true;}
+  if ((r.size() < SYSEX_HEADER + 1) || (r.size() > SYSEX_MAX_REPLY)) {return false;}
+  if ((r[0] != SYSEX_START) || (r[1] != SYSEX_ID) || (r[2] != SYSEX_DEVICE) || (r.back() != SYSEX_END)) {return false;}
+  for (size_t i = 1; i + 1 < r.size(); i++) {
+    if (r[i] & 0x80) {return false;}
+  }
+  return true;
+}
+bool all_in_range(const Tuning& t) {
+  for (size_t i = 0; i < TUNE_PARAMS; i++) {
+    if (!Tuning::in_range(i, t.value[i])) {return false;}
+  }
+  return true;
+}
+bool status_is(const std::vector<uint8_t>& r, uint8_t cmd, SysexStatus status) {
+  return (r.size() >= SYSEX_HEADER + 2) && (r[3] == (cmd | SYSEX_REPLY)) && (r[4] == static_cast<uint8_t>(status));
+}
+}
+
+/*----------------------------------------------------------------------------*/
+//     Scenarios
+/*----------------------------------------------------------------------------*/
+void commands() {
+  std::printf("== commands\n");
+  SysexTuner tuner;
+  tuner.begin(SysexHooks{mock_perf, mock_save, mock_freeze});
+  Tuning t;
+  check(!tuner.take_pending(t), "nothing pending after construction");
+
+  auto r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::PING)));
+  check((r.size() == 6) && (r[3] == 0x41) && (r[4] == SYSEX_VERSION), "ping returns the version");
+
+  const uint8_t th = static_cast<uint8_t>(TuneParam::THRESHOLD);
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::GET), {th}));
+  check((r.size() == 9) && (r[4] == th) && (SysexTuner::get16(&r[5]) == TUNE_INFO[th].def), "get threshold returns the default");
+
+  r = send(tuner, set_frame({{th, 45}, {static_cast<uint8_t>(TuneParam::LED_PERIOD), 20000}}));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::SET), SysexStatus::OK), "set two values: ok");
+  check(tuner.take_pending(t) && (t.get(TuneParam::THRESHOLD) == 45) && (t.get(TuneParam::LED_PERIOD) == 20000),
+        "set values are pending for the next frame");
+  check(!tuner.take_pending(t), "pending is taken only once");
+
+  // 二つ目が範囲外: 一つ目も変わらない
+  r = send(tuner, set_frame({{th, 60}, {static_cast<uint8_t>(TuneParam::FILTER_LEN), 9}}));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::SET), SysexStatus::OUT_OF_RANGE) &&
+        (r[5] == static_cast<uint8_t>(TuneParam::FILTER_LEN)), "out of range: status names the param");
+  check((tuner.tuning().get(TuneParam::THRESHOLD) == 45) && !tuner.take_pending(t), "failed set changes nothing");
+
+  r = send(tuner, set_frame({{static_cast<uint8_t>(TUNE_PARAMS), 1}}));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::SET), SysexStatus::UNKNOWN_PARAM), "unknown param");
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::SET), {th, 1, 0}));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::SET), SysexStatus::BAD_LENGTH), "truncated set: bad length");
+
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::GET_ALL)));
+  bool ok = (r.size() == SYSEX_HEADER + TUNE_PARAMS * 4 + 1);
+  for (size_t i = 0; ok && (i < TUNE_PARAMS); i++) {
+    ok = (r[4 + i * 4] == i) && (SysexTuner::get16(&r[5 + i * 4]) == tuner.tuning().value[i]);
+  }
+  check(ok, "get all matches the current values");
+
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::PERF)));
+  ok = (r.size() == SYSEX_HEADER + PERF_COUNTERS * 6 + 1);
+  for (size_t i = 0; ok && (i < PERF_COUNTERS); i++) {
+    ok = (r[4 + i * 6] == i) && (SysexTuner::get32(&r[5 + i * 6]) == 0x0f000000u + i * 1000);
+  }
+  check(ok && well_formed(r), "perf returns every counter as 32bit");
+
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::SAVE)));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::SAVE), SysexStatus::OK) && (saves == 1) &&
+        (saved.get(TuneParam::THRESHOLD) == 45), "save hands the current values to the hook");
+  save_ok = false;
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::SAVE)));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::SAVE), SysexStatus::SAVE_FAILED), "save failure is reported");
+  save_ok = true;
+
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::DEFAULTS)));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::DEFAULTS), SysexStatus::OK) && tuner.take_pending(t) &&
+        (t.get(TuneParam::THRESHOLD) == TUNE_INFO[th].def), "defaults restores every value");
+
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::FREEZE)));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::FREEZE), SysexStatus::OK) && (freezes == 1), "freeze calls the hook");
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::FREEZE)));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::FREEZE), SysexStatus::NOT_RECORDING), "second freeze: not recording");
+  SysexTuner bare;
+  r = send(bare, frame(static_cast<uint8_t>(SysexCmd::FREEZE)));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::FREEZE), SysexStatus::NOT_RECORDING), "freeze without a recorder");
+
+  r = send(tuner, frame(0x3e));
+  check((r.size() == 7) && (r[3] == SYSEX_NAK) && (r[4] == 0x3e) &&
+        (r[5] == static_cast<uint8_t>(SysexStatus::UNKNOWN_CMD)), "unknown cmd: nak");
+  r = send(tuner, frame(static_cast<uint8_t>(SysexCmd::GET), {0x80}));
+  check(status_is(r, static_cast<uint8_t>(SysexCmd::GET), SysexStatus::BAD_DATA), "8bit payload byte: bad data");
+
+  // 他の機器宛て、途中で切れたもの、cap が足りない時は返事をしない
+  std::vector<uint8_t> other = {SYSEX_START, 0x41, 0x10, 0x42, 0x12, SYSEX_END};
+  check(send(tuner, other).empty(), "foreign manufacturer id: no reply");
+  std::vector<uint8_t> cut = frame(static_cast<uint8_t>(SysexCmd::PING));
+  cut.pop_back();
+  check(send(tuner, cut).empty(), "missing F7: no reply");
+  uint8_t small[SYSEX_MAX_REPLY - 1];
+  auto ping = frame(static_cast<uint8_t>(SysexCmd::PING));
+  check(tuner.handle(ping.data(), ping.size(), small, sizeof(small)) == 0, "short reply buffer: no reply");
+
+  SysexTuner fresh;
+  Tuning stored = Tuning::defaults();
+  stored.value[static_cast<size_t>(TuneParam::HYSTERESIS)] = 500;
+  stored.value[static_cast<size_t>(TuneParam::SCAN_PERIOD)] = 1000;
+  fresh.load(stored);
+  check(fresh.take_pending(t) && (t.get(TuneParam::HYSTERESIS) == TUNE_INFO[2].def) &&
+        (t.get(TuneParam::SCAN_PERIOD) == 1000), "load sanitizes stored values");
+}
+
+void fuzz(int frames) {
+  std::printf("== fuzz (%d frames)\n", frames);
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<int> len(0, 40);
+  std::uniform_int_distribution<int> pick(0, 3);
+  SysexTuner tuner;
+  tuner.begin(SysexHooks{mock_perf, mock_save, mock_freeze});
+  bool formed = true;
+  bool ranged = true;
+  bool atomic = true;
+  int replies = 0;
+  for (int n = 0; n < frames; n++) {
+    std::vector<uint8_t> msg;
+    switch (pick(rng)) {
+    case 0: {   // 全くでたらめ
+      int l = len(rng);
+      for (int i = 0; i < l; i++) {msg.push_back(static_cast<uint8_t>(byte(rng)));}
+      break;
+    }
+    case 1: {   // 頭と尻尾は正しく、中はでたらめ
+      msg = frame(static_cast<uint8_t>(byte(rng) & 0x7f));
+      int l = len(rng);
+      for (int i = 0; i < l; i++) {msg.insert(msg.end() - 1, static_cast<uint8_t>(byte(rng) & (i % 5 ? 0x7f : 0xff)));}
+      break;
+    }
+    default: {  // 正しい set を一 byte だけ壊す (壊さないこともある)
+      std::vector<std::pair<uint8_t, uint16_t>> values;
+      int count = 1 + byte(rng) % 4;
+      for (int i = 0; i < count; i++) {
+        uint8_t id = static_cast<uint8_t>(byte(rng) % (TUNE_PARAMS + 1));
+        uint16_t v = (id < TUNE_PARAMS) ? static_cast<uint16_t>(TUNE_INFO[id].min + byte(rng) * 97 % 20000) : 1;
+        values.push_back({id, v});
+      }
+      msg = set_frame(values);
+      size_t at = static_cast<size_t>(byte(rng)) % (msg.size() + 8);
+      if (at < msg.size()) {msg[at] = static_cast<uint8_t>(byte(rng));}
+      break;
+    }
+    }
+    Tuning before = tuner.tuning();
+    auto r = send(tuner, msg);
+    if (!r.empty()) {replies += 1;}
+    formed = formed && well_formed(r);
+    ranged = ranged && all_in_range(tuner.tuning());
+    // OK を返さなかった set は値を変えない (defaults だけは変えてよい)
+    bool changed = std::memcmp(&before, &tuner.tuning(), sizeof(Tuning)) != 0;
+    bool set_ok = (r.size() >= SYSEX_HEADER + 2) && (r[3] == (static_cast<uint8_t>(SysexCmd::SET) | SYSEX_REPLY)) &&
+                  (r[4] == static_cast<uint8_t>(SysexStatus::OK));
+    bool defaults = (r.size() >= SYSEX_HEADER + 2) && (r[3] == (static_cast<uint8_t>(SysexCmd::DEFAULTS) | SYSEX_REPLY));
+    if (changed && !set_ok && !defaults) {atomic = false;}
+  }
+  std::printf("  %d replies\n", replies);
+  check(formed, "every reply is a bounded 7bit SysEx frame");
+  check(ranged, "values always stay in range");
+  check(atomic, "only accepted set / defaults change values");
+}
+
+int main(int argc, char* argv[]) {
+  int frames = 200000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {frames = std::atoi(argv[i + 1]);}
+  }
+  commands();
+  fuzz(frames);
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+#  Created by Hasebe Masahiko on 2025/10/19.
+#  Copyright (c) 2025 Hasebe Masahiko.
+#  Released under the MIT license
+#  https://opensource.org/licenses/mit-license.php
+#
+#  Loopian::QUBIT の USB CDC (Serial) に流れるバイナリレコードを読む
+#    frame: [0xA5][type][len lo][len hi][payload ...][checksum]
+#
+#  使い方:
+#    python3 telemetry_decode.py profile /dev/ttyACM0    処理時間の表を表示し続ける
+#    python3 telemetry_decode.py capture /dev/ttyACM0 out.sweeps
+#                                                       全 sweep をファイルに書く (Ctrl-C で終了)
+#    python3 telemetry_decode.py flight /dev/ttyACM0 out.qfd
+#                                                       flash にある flight recorder の dump を受け取る
+#                                                       (tools/flight_decode で trace に直す)
+#
+#  capture ファイル (一行一 sweep、テキスト):
+#    # qubit-sweeps v1 pads=96
+#    <time usec> <pad0> <pad1> ... <pad95>
+#
+import struct
+import sys
+
+SYNC = 0xA5
+REGIONS = ["SCAN", "TOUCH", "LED_RENDER", "LED_SHOW", "MIDI_READ", "OLED_PAGE", "OLED_FLUSH", "FLIGHT", "LED_I2C", "CLUSTER"]
+
+
+def open_source(path, start_cmd=None):
+    """シリアルポートかファイルを開く"""
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial  # pyserial
+        port = serial.Serial(path, 115200, timeout=0.1)
+        if start_cmd:
+            port.write(start_cmd)
+        return port
+    return open(path, "rb")
+
+
+def frames(src):
+    """テキスト出力が混ざっていても、同期 byte と checksum でフレームを拾う"""
+    buf = bytearray()
+    while True:
+        chunk = src.read(4096)
+        if chunk is None:
+            continue
+        if not chunk:
+            if hasattr(src, "in_waiting"):
+                continue
+            return
+        buf += chunk
+        while True:
+            start = buf.find(bytes([SYNC]))
+            if start < 0:
+                buf.clear()
+                break
+            del buf[:start]
+            if len(buf) < 5:
+                break
+            ftype = buf[1]
+            length = buf[2] | (buf[3] << 8)
+            if len(buf) < length + 5:
+                break
+            body = buf[1:length + 5]
+            if sum(body) & 0xFF != 0:
+                del buf[:1]  # 偽の同期 byte
+                continue
+            yield ftype, bytes(buf[4:4 + length])
+            del buf[:length + 5]
+
+
+def show_profile(payload):
+    period_us = struct.unpack_from("<I", payload, 0)[0]
+    rows = []
+    for off in range(4, len(payload), 18):
+        core, region, count, total, mn, mx = struct.unpack_from("<BBIIII", payload, off)
+        rows.append((core, region, count, total, mn, mx))
+    print("\x1b[2J\x1b[H", end="")
+    print(f"period {period_us / 1000:.1f} ms")
+    print(f"{'core':>4} {'region':<11} {'calls':>6} {'mean':>7} {'min':>7} {'max':>7} {'load%':>6}")
+    for core, region, count, total, mn, mx in rows:
+        name = REGIONS[region] if region < len(REGIONS) else str(region)
+        mean = total / count if count else 0
+        load = 100.0 * total / period_us if period_us else 0
+        print(f"{core:>4} {name:<11} {count:>6} {mean:>7.0f} {mn:>7} {mx:>7} {load:>6.1f}")
+    sys.stdout.flush()
+
+
+def varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+class SweepDecoder:
+    """sensor_stream.h の SweepDecoder と同じ手順で値を戻す"""
+
+    def __init__(self):
+        self.values = []
+        self.time_us = 0
+        self.seq = None
+        self.synced = False
+        self.lost = 0
+
+    def decode(self, payload):
+        key = payload[0] & 0x01
+        seq, pos = varint(payload, 1)
+        t, pos = varint(payload, pos)
+        pads, pos = varint(payload, pos)
+        if self.synced and self.seq is not None and seq != (self.seq + 1) & 0xFFFFFFFF:
+            self.lost += (seq - self.seq - 1) & 0xFFFFFFFF
+            self.synced = False
+        self.seq = seq
+        if not key and not self.synced:
+            return False
+        values = []
+        for i in range(pads):
+            v, pos = varint(payload, pos)
+            values.append(v if key else (self.values[i] + unzigzag(v)) & 0xFFFF)
+        if key:
+            # 32bit の時刻を、前の時刻に一番近い先の 64bit に伸ばす
+            # (差分のフレームで折り返しを越えていることもあるので、前の時刻の上位から)
+            t64 = (self.time_us & ~0xFFFFFFFF) | t
+            if t64 < self.time_us:
+                t64 += 1 << 32
+            self.time_us = t64
+        else:
+            self.time_us += t
+        self.values = values
+        self.synced = True
+        return True
+
+
+def capture(path, out_path):
+    decoder = SweepDecoder()
+    count = 0
+    with open(out_path, "w") as out:
+        try:
+            for ftype, payload in frames(open_source(path, b"s")):
+                if ftype != ord("S") or not decoder.decode(payload):
+                    continue
+                if count == 0:
+                    out.write(f"# qubit-sweeps v1 pads={len(decoder.values)}\n")
+                out.write(f"{decoder.time_us} " + " ".join(map(str, decoder.values)) + "\n")
+                count += 1
+                if count % 100 == 0:
+                    print(f"\r{count} sweeps, {decoder.lost} lost", end="", file=sys.stderr)
+        except KeyboardInterrupt:
+            pass
+    print(f"\n{count} sweeps written to {out_path}, {decoder.lost} lost", file=sys.stderr)
+
+
+def flight(path, out_path):
+    """'d' で送られる [offset u32][data] を頭から並べる。長さは dump の header (page 0) から"""
+    image = bytearray()
+    total = None
+    for ftype, payload in frames(open_source(path, b"d")):
+        if ftype != ord("F") or len(payload) < 4:
+            continue
+        offset = struct.unpack_from("<I", payload)[0]
+        if offset != len(image):
+            print(f"chunk at {offset}, expected {len(image)}: send 'd' again", file=sys.stderr)
+            sys.exit(1)
+        image += payload[4:]
+        if total is None and len(image) >= 32:
+            sweep_bytes = struct.unpack_from("<I", image, 16)[0]
+            event_bytes = struct.unpack_from("<I", image, 28)[0]
+            total = 256 + sweep_bytes + event_bytes
+        print(f"\r{len(image)} / {total} bytes", end="", file=sys.stderr)
+        if total is not None and len(image) >= total:
+            break
+    with open(out_path, "wb") as out:
+        out.write(image[:total])
+    print(f"\n{out_path} written", file=sys.stderr)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: telemetry_decode.py profile <port|file>")
+        print("       telemetry_decode.py capture <port|file> <out.sweeps>")
+        print("       telemetry_decode.py flight <port|file> <out.qfd>")
+        sys.exit(1)
+    mode, path = sys.argv[1], sys.argv[2]
+    if mode == "profile":
+        for ftype, payload in frames(open_source(path, b"p")):
+            if ftype == ord("P"):
+                show_profile(payload)
+    elif mode == "capture" and len(sys.argv) >= 4:
+        capture(path, sys.argv[3])
+    elif mode == "flight" and len(sys.argv) >= 4:
+        flight(path, sys.argv[3])
+    else:
+        print(f"unknown mode: {mode}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,282 @@
+/* ========================================
+ *
+ *  timer_check.cpp
+ *    description: GlobalTimer::advanceTo() (global_timer.h) を偽の時計で動かし、以前の 2msec 割り込みと比べる
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  Timebase に偽の時計を入れ、本体の generateTimer() と同じ順で advanceTo() / updateTimer() を呼ぶ
+ *  比べる相手は以前の作り: 起動から 2msec ごとの割り込みで incGlobalTime() し、
+ *  loop では globalTime - gtOld を updateTimer() に渡す
+ *  毎回の diff、globalTime、10msec / 100msec / 1sec の数とイベント、missed10ms() が同じになることを
+ *  - 1msec ごと、決まった乱数の不揃いな間隔、2msec に少し足りない間隔 (端数の繰り越し)、長い停止
+ *  - 32bit (約 71 分) と 64bit の時刻の折り返し、16bit の globalTime の折り返しをまたいで
+ *  確かめる
+ *  Timebase::elapsed_us() の飽和と折り返し、Deadline の締め切りと周期も偽の時計で確かめる
+ *  SharedTime は二つの thread (Core1 の書き手と Core0 の読み手の代わり) で、ちぎれた値を読まないこと
+ *
+ *  build / run:
+ *    make -C tools timer_check && tools/timer_check
+ *  全部通れば終了コード 0
+ *
+ * ========================================
+*/
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../global_timer.h"
+#include "../timebase.h"
+
+namespace {
+uint64_t fake_us = 0;
+uint64_t fake_clock() {return fake_us;}
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  std::printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) {failures += 1;}
+}
+
+/// 以前の作り: 起動時刻 start_us から 2msec ごとに割り込みが入る
+class InterruptTimer {
+  GlobalTimer gt_;
+  uint64_t start_us_;
+  uint64_t fired_ = 0;
+
+public:
+  explicit InterruptTimer(uint64_t start_us) : start_us_(start_us) {}
+
+  auto timer() -> GlobalTimer& {return gt_;}
+  /// now_us までに入った割り込みを処理し、以前の generateTimer() と同じことをする
+  auto generate(uint64_t now_us) -> long {
+    const uint64_t due = (now_us - start_us_) / MINIMUM_RESOLUTION_US;
+    while (fired_ < due) {
+      gt_.incGlobalTime();
+      fired_ += 1;
+    }
+    long diff = static_cast<uint16_t>(gt_.globalTime() - gt_.gtOld());
+    gt_.setGtOld(gt_.globalTime());
+    gt_.clearAllTimerEvent();
+    gt_.updateTimer(diff);
+    return diff;
+  }
+};
+
+/// 本体の generateTimer()
+auto generate(GlobalTimer& gt) -> long {
+  long diff = gt.advanceTo(Timebase::now_us());
+  gt.setGtOld(gt.globalTime());
+  gt.clearAllTimerEvent();
+  gt.updateTimer(diff);
+  return diff;
+}
+
+struct Run {
+  uint32_t steps = 0;
+  uint32_t mismatches = 0;
+  uint64_t ticks = 0;
+  uint32_t max_diff = 0;
+  uint32_t missed = 0;
+  uint32_t ref_missed = 0;
+  uint16_t sec = 0;
+  bool wrapped_gt = false;
+};
+
+/// start_us から steps の間隔で進め、毎回以前の作りと比べる
+auto compare(uint64_t start_us, const std::vector<uint32_t>& steps) -> Run {
+  Run run;
+  fake_us = start_us;
+  GlobalTimer gt;
+  gt.advanceTo(Timebase::now_us());     // setup() と同じ
+  InterruptTimer ref(start_us);
+  uint16_t last_gt = 0;
+  for (uint32_t step : steps) {
+    fake_us += step;
+    const long diff = generate(gt);
+    const long ref_diff = ref.generate(fake_us);
+    const GlobalTimer& r = ref.timer();
+    const bool same = (diff == ref_diff) && (gt.globalTime() == r.globalTime()) &&
+                      (gt.timer10ms() == r.timer10ms()) && (gt.timer100ms() == r.timer100ms()) &&
+                      (gt.timer1s() == r.timer1s()) && (gt.timer10msecEvent() == r.timer10msecEvent()) &&
+                      (gt.timer100msecEvent() == r.timer100msecEvent()) && (gt.timer1secEvent() == r.timer1secEvent()) &&
+                      (gt.missed10ms() == r.missed10ms());
+    if (!same && (run.mismatches++ == 0)) {
+      std::printf("  first mismatch at step %u (+%u us): diff %ld/%ld gt %u/%u 10ms %u/%u\n", run.steps, step,
+                  diff, ref_diff, gt.globalTime(), r.globalTime(), gt.timer10ms(), r.timer10ms());
+    }
+    if (gt.globalTime() < last_gt) {run.wrapped_gt = true;}
+    last_gt = gt.globalTime();
+    run.steps += 1;
+    run.ticks += static_cast<uint64_t>(diff);
+    if (static_cast<uint32_t>(diff) > run.max_diff) {run.max_diff = static_cast<uint32_t>(diff);}
+  }
+  run.missed = gt.missed10ms();
+  run.ref_missed = ref.timer().missed10ms();
+  run.sec = gt.timer1s();
+  return run;
+}
+
+auto repeat(uint32_t step, uint32_t n) -> std::vector<uint32_t> {
+  return std::vector<uint32_t>(n, step);
+}
+/// 決まった乱数の不揃いな間隔 (0 から 25msec、ときどき 1usec と 0)
+auto irregular(uint32_t n) -> std::vector<uint32_t> {
+  std::vector<uint32_t> v;
+  uint32_t x = 12345;
+  for (uint32_t i = 0; i < n; i++) {
+    x = x * 1103515245u + 12345u;
+    const uint32_t r = (x >> 8) % 1000;
+    if (r < 50) {
+      v.push_back(0);
+    } else if (r < 100) {
+      v.push_back(1);
+    } else {
+      v.push_back((x >> 4) % 25000);
+    }
+  }
+  return v;
+}
+
+void regular_and_carry() {
+  std::printf("== regular steps and remainder carry\n");
+  Run r = compare(1000, repeat(1000, 10000));
+  check((r.mismatches == 0) && (r.ticks == 5000) && (r.sec == 10), "1 ms steps: 5000 ticks, 10 seconds, same as the interrupt");
+
+  // 2msec に 1usec 足りない: 端数が溜まって、ときどき 0 になるだけで一度に 2 は出ない
+  r = compare(0, repeat(1999, 2000));
+  check(r.mismatches == 0, "1999 us steps match the interrupt");
+  check((r.ticks == 1999ull * 2000 / MINIMUM_RESOLUTION_US) && (r.max_diff == 1), "the remainder carries: total is exact, never 2 at once");
+
+  // 2msec より 1usec 多い
+  r = compare(7, repeat(2001, 3000));
+  check((r.mismatches == 0) && (r.ticks == 2001ull * 3000 / MINIMUM_RESOLUTION_US), "2001 us steps: total is exact");
+
+  // 1usec ずつ: 2000 回で一つ
+  r = compare(0, repeat(1, 10000));
+  check((r.mismatches == 0) && (r.ticks == 5), "1 us steps add up to a tick every 2000 calls");
+}
+
+void irregular_steps() {
+  std::printf("== irregular steps\n");
+  const std::vector<uint32_t> steps = irregular(200000);
+  uint64_t span = 0;
+  for (uint32_t s : steps) {span += s;}
+  Run r = compare(123456, steps);
+  std::printf("  %u steps over %.1f s: %llu ticks, max %u per call, missed10ms %u\n", r.steps, span * 1e-6,
+              static_cast<unsigned long long>(r.ticks), r.max_diff, r.missed);
+  check(r.mismatches == 0, "every step matches the interrupt");
+  check(r.ticks == span / MINIMUM_RESOLUTION_US, "total ticks = elapsed / 2 ms");
+  check(r.wrapped_gt, "the 16-bit globalTime wrapped on the way");
+  check((r.missed > 0) && (r.missed == r.ref_missed), "missed10ms counts the folded 10 ms events");
+}
+
+void stalls() {
+  std::printf("== long stalls\n");
+  // 10msec ごとに回っていたのが、一度だけ 57msec 止まる
+  std::vector<uint32_t> steps = repeat(10000, 10);
+  steps.push_back(57000);
+  steps.push_back(10000);
+  steps.push_back(3000);
+  steps.push_back(37000);
+  Run r = compare(0, steps);
+  check(r.mismatches == 0, "stalls match the interrupt");
+  // 57msec: 28 tick で 10msec を 5 回 (4 回余分に) 畳む。37msec: 18 tick で 3 回 (2 回余分に)
+  check(r.missed == 4 + 2, "missed10ms = extra 10 ms events folded into one call");
+}
+
+void wraps() {
+  std::printf("== time wrap\n");
+  // 32bit の usec (time_us_32()) が折り返す所 (約 71.6 分) をまたぐ
+  const uint64_t wrap32 = 1ull << 32;
+  Run r = compare(wrap32 - 5001, irregular(2000));
+  check(r.mismatches == 0, "crossing 2^32 us matches the interrupt");
+  r = compare(wrap32 - 3, repeat(1, 10));
+  check((r.mismatches == 0) && (r.ticks == 0), "1 us steps across 2^32 carry without a jump");
+  r = compare(wrap32 - 1000, repeat(2000, 5));
+  check((r.mismatches == 0) && (r.ticks == 5), "2 ms steps across 2^32 give one tick each");
+
+  // 64bit の折り返し (実際には来ないが、差の計算が折り返しに強いこと)
+  r = compare(UINT64_MAX - 7000, irregular(2000));
+  check(r.mismatches == 0, "crossing 2^64 us matches the interrupt");
+  r = compare(UINT64_MAX - 999, repeat(2000, 5));
+  check((r.mismatches == 0) && (r.ticks == 5), "2 ms steps across 2^64 give one tick each");
+}
+}
+
+void elapsed_and_deadline() {
+  std::printf("== Timebase::elapsed_us and Deadline\n");
+  fake_us = 5000;
+  check(Timebase::elapsed_us(1000) == 4000, "elapsed since an earlier time");
+  check(Timebase::elapsed_us(6000) == 0, "a start in the future gives 0, not UINT32_MAX");
+  check(Timebase::elapsed_us(7000, 3000) == 0, "until before since gives 0");
+  const uint64_t base = 1ull << 40;
+  check(Timebase::elapsed_us(base, base + UINT32_MAX) == UINT32_MAX, "exactly UINT32_MAX is kept");
+  check(Timebase::elapsed_us(base, base + UINT32_MAX + 1ull) == UINT32_MAX, "2^32 saturates");
+  check(Timebase::elapsed_us(base, base + (1ull << 50)) == UINT32_MAX, "far beyond 2^32 saturates");
+  const uint64_t wrap32 = 1ull << 32;
+  check(Timebase::elapsed_us(wrap32 - 10, wrap32 + 15) == 25, "across the 32-bit wrap");
+  fake_us = 20;
+  check(Timebase::elapsed_us(UINT64_MAX - 9) == 30, "across the 64-bit wrap");
+  check(Timebase::elapsed_us(30) == 0, "just after the 64-bit wrap, a later start gives 0");
+
+  // loop1 の周期の待ち: 締め切りちょうどで切れ、advance() しても周期がずれない
+  fake_us = wrap32 - 2500;
+  Deadline next = Deadline::in_us(2000);
+  check(!next.expired() && (next.remaining_us() == 2000), "a fresh deadline has its full time");
+  fake_us += 1999;
+  check(!next.expired() && (next.remaining_us() == 1), "1 us before: not expired");
+  fake_us += 1;
+  check(next.expired() && (next.remaining_us() == 0), "expires exactly at the deadline");
+  fake_us += 700;   // 遅れた
+  next.advance(2000);
+  check(!next.expired() && (next.remaining_us() == 1300), "advance() keeps the period after a late wake-up");
+  fake_us = UINT64_MAX - 100;
+  Deadline wrap = Deadline::in_us(300);
+  check(!wrap.expired() && (wrap.remaining_us() == 300), "a deadline past 2^64 is not expired early");
+  fake_us += 300;
+  check(wrap.expired() && (wrap.remaining_us() == 0), "and expires on time after the wrap");
+}
+
+void shared_time() {
+  std::printf("== SharedTime across two threads\n");
+  // 上と下の 32bit が同じ値だけを書くので、ちぎれて読めばすぐ分かる
+  constexpr uint64_t SAME_HALVES = 0x0000000100000001ull;
+  constexpr uint32_t WRITES = 2000000;
+  SharedTime t;
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    for (uint32_t k = 1; k <= WRITES; k++) {t.store(k * SAME_HALVES);}
+    done.store(true);
+  });
+  uint32_t reads = 0, torn = 0, backwards = 0;
+  uint64_t last = 0;
+  while (!done.load()) {
+    const uint64_t v = t.load();
+    if ((v >> 32) != (v & 0xffffffffu)) {torn += 1;}
+    if (v < last) {backwards += 1;}
+    last = v;
+    reads += 1;
+  }
+  writer.join();
+  std::printf("  %u reads while %u writes\n", reads, WRITES);
+  check(torn == 0, "no torn 64-bit value is read");
+  check(backwards == 0, "values never go backwards");
+  check(t.load() == WRITES * SAME_HALVES, "the last write is read");
+}
+
+int main() {
+  Timebase::set_clock(fake_clock);
+  regular_and_carry();
+  irregular_steps();
+  stalls();
+  wraps();
+  elapsed_and_deadline();
+  shared_time();
+  std::printf("%s\n", failures == 0 ? "all ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
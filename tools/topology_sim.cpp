@@ -0,0 +1,134 @@
+/* ========================================
+ *
+ *  topology_sim.cpp
+ *    description: 偽の I2C バスで起動時のかまぼこ探索を動かす
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  mux ごとに、AT42QT がつながっている channel を与えると、
+ *  Topology::discover() が作る表と、一回の sweep の I2C のやりとりの数を出す
+ *
+ *  build / run:
+ *    make -C tools topology_sim
+ *    tools/topology_sim                   よくある構成 (4/8/16/32 ブロック、抜け、無し) を全部
+ *    tools/topology_sim 0:3210 1:32       mux 0 の ch3-0 と mux 1 の ch3,2 にある
+ *    tools/topology_sim 0:3210 2:x1       x: その channel のチップが違う ID を返す
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "../topology.h"
+
+/*----------------------------------------------------------------------------*/
+//     Mock bus
+/*----------------------------------------------------------------------------*/
+namespace {
+enum class Chip : uint8_t { NONE, AT42QT, OTHER };
+bool mux_present[TOPO_MAX_MUX];
+Chip chips[TOPO_MAX_MUX][TOPO_MUX_CHANNELS];
+int selected_mux = -1;
+int selected_ch = -1;
+int transactions = 0;
+int inits = 0;
+
+int mock_select(uint8_t mux, uint8_t channel) {
+  transactions++;
+  if (!mux_present[mux]) {return 2;}  // NACK
+  selected_mux = mux;
+  selected_ch = channel;
+  return 0;
+}
+int mock_read_chip_id(uint8_t& id) {
+  transactions++;
+  if (selected_mux < 0) {return 2;}
+  switch (chips[selected_mux][selected_ch]) {
+    case Chip::AT42QT: id = AT42QT_CHIP_ID; return 0;
+    case Chip::OTHER:  id = 0x55; return 0;
+    default:           return 2;
+  }
+}
+void mock_init_chip() {
+  transactions++;
+  inits++;
+}
+
+void reset_bus() {
+  std::memset(mux_present, 0, sizeof(mux_present));
+  std::memset(chips, 0, sizeof(chips));
+  selected_mux = selected_ch = -1;
+  transactions = inits = 0;
+}
+/// "M:CCCC" (M: mux 0-7, C: channel 0-3 か、違うチップの x 付き channel)
+bool parse(const char* spec) {
+  if ((spec[0] < '0') || (spec[0] > '7') || (spec[1] != ':')) {return false;}
+  int mux = spec[0] - '0';
+  mux_present[mux] = true;
+  Chip kind = Chip::AT42QT;
+  for (const char* p = spec + 2; *p; p++) {
+    if (*p == 'x') {kind = Chip::OTHER; continue;}
+    if ((*p < '0') || (*p > '3')) {return false;}
+    chips[mux][*p - '0'] = kind;
+    kind = Chip::AT42QT;
+  }
+  return true;
+}
+}
+
+/*----------------------------------------------------------------------------*/
+//     Report
+/*----------------------------------------------------------------------------*/
+void run(const char* name) {
+  const TopologyBus bus = {mock_select, mock_read_chip_id, mock_init_chip};
+  Topology topo;
+  topo.discover(bus);
+  int probe = transactions;
+  std::printf("== %s\n", name);
+  std::printf("  blocks %zu  pads %zu  mux_found 0x%02x  %s  probe %d transactions, %d chips set up\n",
+              topo.block_count(), topo.pad_count(), topo.mux_found(),
+              topo.fallback() ? "FALLBACK(all)" : "ok", probe, inits);
+  for (size_t b = 0; b < topo.block_count(); b++) {
+    const KamabokoInfo& k = topo.block(b);
+    std::printf("  ring %2zu  mux 0x%02x ch %u  pads %3u-%3u\n", b, 0x70 + k.mux, k.channel,
+                k.first_pad, k.first_pad + MAX_EACH_SENS - 1);
+  }
+  // 一 sweep: かまぼこごとに mux 1 回 + センサ 6 回 (以前はセンサごとに mux を書いていた)
+  size_t now = topo.block_count() * (1 + MAX_EACH_SENS);
+  size_t before = static_cast<size_t>(TOPO_LEGACY_BLOCKS) * MAX_EACH_SENS * 2;
+  std::printf("  sweep: %zu I2C transactions (fixed %u blocks, mux per sensor: %zu)\n", now, TOPO_LEGACY_BLOCKS, before);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    reset_bus();
+    for (int i = 1; i < argc; i++) {
+      if (!parse(argv[i])) {
+        std::fprintf(stderr, "bad spec: %s (expected M:CCCC, e.g. 0:3210)\n", argv[i]);
+        return 2;
+      }
+    }
+    run("command line");
+    return 0;
+  }
+  struct Case {const char* name; const char* specs[TOPO_MAX_MUX + 1];};
+  const Case CASES[] = {
+    {"4 blocks",              {"0:3210", nullptr}},
+    {"8 blocks",              {"0:3210", "1:3210", nullptr}},
+    {"16 blocks",             {"0:3210", "1:3210", "2:3210", "3:3210", nullptr}},
+    {"16 blocks, one dead",   {"0:3210", "1:310", "2:3210", "3:3210", nullptr}},
+    {"gap in mux addresses",  {"0:3210", "2:3210", nullptr}},
+    {"foreign chip on ch 1",  {"0:32x10", nullptr}},
+    {"20 blocks (5 mux)",     {"0:3210", "1:3210", "2:3210", "3:3210", "4:3210", nullptr}},
+    {"32 blocks (8 mux)",     {"0:3210", "1:3210", "2:3210", "3:3210", "4:3210", "5:3210", "6:3210", "7:3210", nullptr}},
+    {"nothing answers",       {nullptr}},
+  };
+  for (const Case& c : CASES) {
+    reset_bus();
+    for (size_t i = 0; c.specs[i] != nullptr; i++) {parse(c.specs[i]);}
+    run(c.name);
+  }
+  return 0;
+}
@@ -0,0 +1,284 @@
+/* ========================================
+ *
+ *  touch_bench.cpp
+ *    description: 合成した指の動きで QubitTouch の処理時間と追従の正確さを測る
+ *
+ *  Copyright(c)2025- Masahiko Hasebe at Kigakudoh
+ *  This software is released under the MIT License, see LICENSE.txt
+ *
+ *  N 本の指 (位置・速さ・押す強さの変化・ノイズ・同じかまぼこ内の漏れ) から
+ *  パッドの値を作り、本体と同じく set_value → seek_and_update_touch_point を呼ぶ
+ *  パッド数と窓の幅はコンパイル時の定数なので、組み合わせごとにビルドする
+ *
+ *  build / run:
+ *    make -C tools bench                       (16/32/48/64 ブロック x 窓 2/3/4)
+ *    make -C tools bench BENCH_BLOCKS="16 24" BENCH_WINDOWS=3
+ *    make -C tools bench BENCH_BLOCKS="16 32" BENCH_WINDOWS=3     96 / 192 パッド
+ *  単体:
+ *    touch_bench [-n frames] [-s seed] [-v speed] [-x noise]
+ *
+ *  出力 (一行一条件):
+ *    blocks pads window fingers  ns/frame p50 p99 mean seek  detect% loc_err note_err% ghost/s
+ *      seek      mean のうち、タッチの検出と追従 (seek_and_update_touch_point) の分
+ *                set_value の分はパッドの数に比例するが、seek は触っているかまぼこの数で決まる
+ *      detect%   押されている指のうち、CLOSE_RANGE 内にタッチポイントがあったフレームの割合
+ *      loc_err   その時の位置の誤差の平均 (パッド単位)
+ *      note_err% 鳴っているノートが指の位置 (四捨五入) と違ったフレームの割合
+ *      ghost/s   どの指からも離れたタッチポイントの数 (一秒あたり)
+ *
+ * ========================================
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "../qtouch.h"
+#include "../constants.h"
+
+/*----------------------------------------------------------------------------*/
+//     Hardware stand-in
+/*----------------------------------------------------------------------------*/
+namespace {
+bool note_on[MAX_SENS];   // パッドの番号ごと (ZONE_PADS を超えた所は次の channel で鳴る)
+}
+void sendMidiMessage(uint8_t status, uint8_t note, uint8_t velocity, uint64_t sweep_us) {
+  (void)velocity;
+  (void)sweep_us;
+  int zone = ((status & 0x0f) - TouchPoint::DEFAULT_CHANNEL) & 0x0f;
+  int pad = zone * ZONE_PADS + note - TouchPoint::OFFSET_NOTE;
+  if ((pad < 0) || (pad >= MAX_SENS)) {return;}
+  if ((status & 0xf0) == 0x90) {note_on[pad] = true;}
+  else if ((status & 0xf0) == 0x80) {note_on[pad] = false;}
+}
+void debug_pt(int pt) {
+  (void)pt;
+}
+
+/*----------------------------------------------------------------------------*/
+//     Finger model
+/*----------------------------------------------------------------------------*/
+constexpr float SWEEP_SEC = 0.004f;   // 一回の sweep の時間
+constexpr float SPREAD = 1.6f;        // 指一本が反応させるパッドの半径
+constexpr float CROSSTALK = 0.04f;    // 同じかまぼこ (同じチップ) の他のパッドへの漏れ
+constexpr float PRESENT_LEVEL = 0.5f; // peak のこの割合以上なら押されているとみなす
+
+class Rng {
+  uint64_t s_;
+public:
+  explicit Rng(uint64_t seed) : s_(seed * 0x9e3779b97f4a7c15ull + 1) {}
+  auto next() -> uint32_t {
+    s_ ^= s_ << 13;
+    s_ ^= s_ >> 7;
+    s_ ^= s_ << 17;
+    return static_cast<uint32_t>(s_ >> 32);
+  }
+  auto uniform() -> float {return (next() >> 8) * (1.0f / 16777216.0f);}
+  auto gauss() -> float {
+    // 12 個の和で近似 (分散 1)
+    float sum = 0.0f;
+    for (int i = 0; i < 12; i++) {sum += uniform();}
+    return sum - 6.0f;
+  }
+};
+
+struct Finger {
+  float home;       // 中心位置
+  float swing;      // 左右に揺らす幅 (パッド)
+  float swing_hz;
+  float phase;
+  float peak;       // 押した時の最大値
+  int   press;      // 押している sweep 数
+  int   gap;        // 離している sweep 数
+  int   attack;
+  int   offset;     // 押し始めをずらす
+
+  /// frame 時点の位置 (0..pads) と強さ (0..peak)
+  void state(int frame, float glide, float pads, float& loc, float& level) const {
+    float t = frame * SWEEP_SEC;
+    loc = home + glide * t + swing * std::sin(6.2831853f * swing_hz * t + phase);
+    loc = std::fmod(loc, pads);
+    if (loc < 0.0f) {loc += pads;}
+    int cycle = press + gap;
+    int n = (frame + offset) % cycle;
+    if (n >= press) {
+      level = 0.0f;
+    } else if (n < attack) {
+      level = peak * (n + 1) / attack;
+    } else if (n >= press - attack) {
+      level = peak * (press - n) / attack;
+    } else {
+      level = peak;
+    }
+  }
+};
+
+auto circular_distance(float a, float b, float pads) -> float {
+  float d = std::fabs(std::fmod(a - b, pads));
+  return std::min(d, pads - d);
+}
+
+void render(const std::vector<Finger>& fingers, int frame, float glide, float noise, Rng& rng,
+            uint16_t* values, std::vector<float>& locs, std::vector<float>& levels) {
+  static float raw[MAX_SENS];
+  for (int p = 0; p < MAX_SENS; p++) {raw[p] = 0.0f;}
+  for (size_t f = 0; f < fingers.size(); f++) {
+    float loc, level;
+    fingers[f].state(frame, glide, static_cast<float>(MAX_SENS), loc, level);
+    locs[f] = loc;
+    levels[f] = level;
+    if (level <= 0.0f) {continue;}
+    int lo = static_cast<int>(std::floor(loc - SPREAD));
+    int hi = static_cast<int>(std::ceil(loc + SPREAD));
+    for (int p = lo; p <= hi; p++) {
+      float d = std::fabs(p - loc);
+      if (d >= SPREAD) {continue;}
+      raw[(p + MAX_SENS) % MAX_SENS] += level * (1.0f - (d / SPREAD) * (d / SPREAD));
+    }
+  }
+  for (int k = 0; k < MAX_KAMABOKO_NUM; k++) {
+    float block = 0.0f;
+    for (int e = 0; e < MAX_EACH_SENS; e++) {block += raw[k * MAX_EACH_SENS + e];}
+    for (int e = 0; e < MAX_EACH_SENS; e++) {
+      int p = k * MAX_EACH_SENS + e;
+      float v = raw[p] + CROSSTALK * (block - raw[p]) + std::fabs(rng.gauss() * noise);
+      values[p] = static_cast<uint16_t>(std::min(1023.0f, v));
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+//     Benchmark
+/*----------------------------------------------------------------------------*/
+struct Result {
+  uint32_t  p50_ns, p99_ns, mean_ns;
+  uint32_t  seek_mean_ns;   // そのうち seek_and_update_touch_point の分
+  uint64_t  present, detected, note_frames, note_wrong, ghosts;
+  double    loc_err_sum;
+};
+
+auto run(size_t finger_count, int frames, uint64_t seed, float glide, float noise) -> Result {
+  Rng rng(seed + finger_count);
+  std::vector<Finger> fingers(finger_count);
+  const float spacing = static_cast<float>(MAX_SENS) / finger_count;
+  for (size_t f = 0; f < finger_count; f++) {
+    Finger& fg = fingers[f];
+    fg.home = spacing * f + rng.uniform() * spacing * 0.3f;
+    fg.swing = 0.5f + rng.uniform() * 1.5f;
+    fg.swing_hz = 0.5f + rng.uniform() * 3.0f;
+    fg.phase = rng.uniform() * 6.2831853f;
+    fg.peak = 150.0f + rng.uniform() * 200.0f;
+    fg.press = 60 + static_cast<int>(rng.uniform() * 200);
+    fg.gap = 20 + static_cast<int>(rng.uniform() * 60);
+    fg.attack = 4 + static_cast<int>(rng.uniform() * 6);
+    fg.offset = static_cast<int>(rng.uniform() * 100);
+  }
+
+  QubitTouch qt([](uint8_t status, uint8_t note, uint8_t intensity) {
+    sendMidiMessage(status, note, intensity, 0);
+  });
+  std::memset(note_on, 0, sizeof(note_on));
+
+  static uint16_t values[MAX_SENS];
+  std::vector<float> locs(finger_count), levels(finger_count);
+  std::vector<uint32_t> ns;
+  ns.reserve(frames);
+  uint64_t seek_sum = 0;
+  Result r = {};
+  using clock = std::chrono::steady_clock;
+  const float pads = static_cast<float>(MAX_SENS);
+  for (int frame = 0; frame < frames; frame++) {
+    render(fingers, frame, glide, noise, rng, values, locs, levels);
+    auto t0 = clock::now();
+    for (int i = 0; i < MAX_SENS; i++) {
+      qt.set_value(i, values[i]);
+    }
+    auto ts = clock::now();
+    qt.seek_and_update_touch_point();
+    auto t1 = clock::now();
+    ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+    seek_sum += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - ts).count());
+
+    // 指とタッチポイントを突き合わせる (最初の 20 フレームは移動平均が落ち着くまで待つ)
+    if (frame < 20) {continue;}
+    for (size_t t = 0; t < MAX_TOUCH_POINTS; t++) {
+      const TouchPoint& tp = qt.touch_point(t);
+      if (!tp.is_touched()) {continue;}
+      bool near = false;
+      for (size_t f = 0; f < finger_count; f++) {
+        if ((levels[f] > 0.0f) && (circular_distance(tp.get_location(), locs[f], pads) <= CLOSE_RANGE)) {
+          near = true;
+        }
+      }
+      if (!near) {r.ghosts += 1;}
+    }
+    for (size_t f = 0; f < finger_count; f++) {
+      if (levels[f] < fingers[f].peak * PRESENT_LEVEL) {continue;}
+      r.present += 1;
+      float best = CLOSE_RANGE + 1.0f;
+      for (size_t t = 0; t < MAX_TOUCH_POINTS; t++) {
+        const TouchPoint& tp = qt.touch_point(t);
+        if (!tp.is_touched()) {continue;}
+        best = std::min(best, circular_distance(tp.get_location(), locs[f], pads));
+      }
+      if (best <= CLOSE_RANGE) {
+        r.detected += 1;
+        r.loc_err_sum += best;
+      }
+      // 鳴っているノートが指の位置のノートか (ヒステリシス分は許す)
+      float nearest = std::round(locs[f]);
+      if (nearest >= pads - 0.5f) {continue;}   // 折り返しの所は本体も端に寄せるので数えない
+      r.note_frames += 1;
+      bool ok = false;
+      for (int dn = -1; dn <= 1; dn++) {
+        int pad = static_cast<int>(nearest) + dn;
+        if ((pad >= 0) && (pad < MAX_SENS) && note_on[pad] &&
+            (std::fabs(nearest + dn - locs[f]) <= 0.5f + HISTERESIS)) {
+          ok = true;
+        }
+      }
+      if (!ok) {r.note_wrong += 1;}
+    }
+  }
+  std::vector<uint32_t> sorted = ns;
+  std::sort(sorted.begin(), sorted.end());
+  uint64_t sum = 0;
+  for (uint32_t v : ns) {sum += v;}
+  r.p50_ns = sorted[sorted.size() / 2];
+  r.p99_ns = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+  r.mean_ns = static_cast<uint32_t>(sum / ns.size());
+  r.seek_mean_ns = static_cast<uint32_t>(seek_sum / ns.size());
+  return r;
+}
+
+int main(int argc, char* argv[]) {
+  int frames = 5000;
+  uint64_t seed = 1;
+  float glide = 0.0f;   // 全部の指をまとめて動かす速さ (パッド/秒)
+  float noise = 2.0f;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {frames = std::atoi(argv[i + 1]);}
+    else if (std::strcmp(argv[i], "-s") == 0) {seed = std::strtoull(argv[i + 1], nullptr, 10);}
+    else if (std::strcmp(argv[i], "-v") == 0) {glide = static_cast<float>(std::atof(argv[i + 1]));}
+    else if (std::strcmp(argv[i], "-x") == 0) {noise = static_cast<float>(std::atof(argv[i + 1]));}
+  }
+  if (frames < 100) {frames = 100;}
+
+  const size_t FINGERS[] = {1, 2, 4, 6, 8};
+  for (size_t n : FINGERS) {
+    Result r = run(n, frames, seed, glide, noise);
+    double secs = (frames - 20) * SWEEP_SEC;
+    std::printf("%3d %4d %2zu %2zu  %7u %7u %7u %7u  %6.1f %5.2f %6.1f %7.1f\n",
+                MAX_KAMABOKO_NUM, MAX_SENS, FINGER_RANGE, n,
+                r.p50_ns, r.p99_ns, r.mean_ns, r.seek_mean_ns,
+                r.present ? 100.0 * r.detected / r.present : 0.0,
+                r.detected ? r.loc_err_sum / r.detected : 0.0,
+                r.note_frames ? 100.0 * r.note_wrong / r.note_frames : 0.0,
+                r.ghosts / secs);
+  }
+  return 0;
+}
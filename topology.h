@@ -0,0 +1,124 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "constants.h"
+
+// =========================================================
+//      Topology Constants
+// =========================================================
+constexpr uint8_t TOPO_MAX_MUX = 8;             // PCA9544A: 0x70-0x77
+constexpr uint8_t TOPO_MUX_CHANNELS = 4;
+constexpr uint8_t AT42QT_CHIP_ID = 0x2E;        // AT42QT1070 の register 0
+constexpr uint8_t TOPO_LEGACY_BLOCKS = 16;      // 何も見つからない時に読みに行く数 (以前の固定の構成)
+// 一つの mux の中で、かまぼこが並んでいる channel の順番
+constexpr uint8_t TOPO_RING_CHANNEL[TOPO_MUX_CHANNELS] = {3, 2, 1, 0};
+
+// 起動時の探索で使う I2C の操作 (ホストでは偽物を渡す)
+struct TopologyBus {
+    int (*select)(uint8_t mux, uint8_t channel);    // 0: ACK あり
+    int (*read_chip_id)(uint8_t& id);               // 選んだ channel の AT42QT を読む
+    void (*init_chip)();                            // 見つかった AT42QT を設定する (nullptr 可)
+};
+
+struct KamabokoInfo {
+    uint8_t     mux;        // 0-7 (I2C address 0x70 + mux)
+    uint8_t     channel;    // 0-3
+    uint16_t    first_pad;  // このかまぼこの最初のパッド番号 (ring の順)
+};
+
+// =========================================================
+//      Topology Class
+// =========================================================
+// 起動時に mux と AT42QT を探し、実際につながっているかまぼこだけを ring の順に並べる
+// 見つかったかまぼこのパッドは 0 から詰めて番号を振る
+class Topology {
+    KamabokoInfo    block_[MAX_KAMABOKO_NUM];
+    uint8_t         block_count_;
+    uint8_t         mux_found_;     // 見つかった mux の bit
+    bool            fallback_;      // 何も見つからなかったので、全部あるものとした
+
+// impl Topology
+public:
+    Topology() : block_{}, block_count_(0), mux_found_(0), fallback_(false) {
+        assume_all();
+        fallback_ = false;
+    }
+
+    /// mux / channel / AT42QT を順に探す。見つかったかまぼこの数を返す
+    auto discover(const TopologyBus& bus) -> size_t {
+        block_count_ = 0;
+        mux_found_ = 0;
+        fallback_ = false;
+        for (uint8_t mux = 0; (mux < TOPO_MAX_MUX) && (block_count_ < MAX_KAMABOKO_NUM); ++mux) {
+            bool mux_present = false;
+            for (uint8_t r = 0; (r < TOPO_MUX_CHANNELS) && (block_count_ < MAX_KAMABOKO_NUM); ++r) {
+                uint8_t ch = TOPO_RING_CHANNEL[r];
+                if (bus.select(mux, ch) != 0) {
+                    break;  // mux が無い
+                }
+                mux_present = true;
+                uint8_t id = 0;
+                if ((bus.read_chip_id(id) != 0) || (id != AT42QT_CHIP_ID)) {
+                    continue;
+                }
+                if (bus.init_chip) {bus.init_chip();}
+                block_[block_count_] = KamabokoInfo{mux, ch, static_cast<uint16_t>(block_count_ * MAX_EACH_SENS)};
+                block_count_ += 1;
+            }
+            if (mux_present) {mux_found_ |= static_cast<uint8_t>(1u << mux);}
+        }
+        if (block_count_ == 0) {
+            assume_all();   // 読めなくても、以前と同じように全部読みに行く
+        }
+        return block_count_;
+    }
+    /// 保存してあった表をそのまま使う (温め起動。合っているかは使う側が確かめる)
+    void restore(const KamabokoInfo* blocks, size_t count) {
+        if (count > MAX_KAMABOKO_NUM) {count = MAX_KAMABOKO_NUM;}
+        mux_found_ = 0;
+        for (size_t n = 0; n < count; ++n) {
+            block_[n] = KamabokoInfo{blocks[n].mux, blocks[n].channel, static_cast<uint16_t>(n * MAX_EACH_SENS)};
+            mux_found_ |= static_cast<uint8_t>(1u << (blocks[n].mux & 0x07));
+        }
+        block_count_ = static_cast<uint8_t>(count);
+        fallback_ = false;
+    }
+    /// restore した表が、今つながっているかまぼこと同じか、全部の mux / channel を読んで確かめる
+    /// (チップは設定しない)。かまぼこが増えても減っても、つなぎ替えても false
+    auto matches(const TopologyBus& bus) const -> bool {
+        const TopologyBus probe_bus = {bus.select, bus.read_chip_id, nullptr};
+        Topology probe;
+        probe.discover(probe_bus);
+        if (probe.fallback() || (probe.block_count_ != block_count_)) {return false;}
+        for (size_t n = 0; n < block_count_; ++n) {
+            if ((probe.block_[n].mux != block_[n].mux) || (probe.block_[n].channel != block_[n].channel)) {return false;}
+        }
+        return true;
+    }
+    /// 以前の固定の配置 (mux = n/4, channel = 3 - n%4) で全部あるものとする
+    void assume_all() {
+        const uint8_t count = (MAX_KAMABOKO_NUM < TOPO_LEGACY_BLOCKS) ? MAX_KAMABOKO_NUM : TOPO_LEGACY_BLOCKS;
+        for (uint8_t n = 0; n < count; ++n) {
+            block_[n] = KamabokoInfo{static_cast<uint8_t>(n / TOPO_MUX_CHANNELS),
+                                     TOPO_RING_CHANNEL[n % TOPO_MUX_CHANNELS],
+                                     static_cast<uint16_t>(n * MAX_EACH_SENS)};
+        }
+        block_count_ = count;
+        fallback_ = true;
+    }
+
+    auto block_count() const -> size_t {return block_count_;}
+    auto pad_count() const -> size_t {return static_cast<size_t>(block_count_) * MAX_EACH_SENS;}
+    auto block(size_t index) const -> const KamabokoInfo& {return block_[index];}
+    auto mux_found() const -> uint8_t {return mux_found_;}
+    auto fallback() const -> bool {return fallback_;}
+};
+#endif // TOPOLOGY_H
@@ -0,0 +1,308 @@
+//  Created by Hasebe Masahiko on 2025/10/19.
+//  Copyright (c) 2025 Hasebe Masahiko.
+//  Released under the MIT license
+//  https://opensource.org/licenses/mit-license.php
+//
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <cstdint>
+#include <cstddef>
+
+// =========================================================
+//      Tuning Parameters
+// =========================================================
+// 設置した場所で、書き直さずに変えたい値 (SysEx で読み書きし、calibration store に保存できる)
+// 小数は 1/100 単位の整数で持つ
+enum class TuneParam : uint8_t {
+    THRESHOLD,      // タッチとみなす移動平均の値 (filter_len 個の合計)
+    CLOSE_RANGE,    // 同じタッチとみなす動作範囲 [1/100 pad]
+    HYSTERESIS,     // Note を変えるまでのずれ [1/100 pad]
+    RELEASE_HOLD,   // 離れたとみなすまでの、更新のない sweep 数
+    FILTER_LEN,     // 移動平均の sample 数
+    SCAN_PERIOD,    // Core1 の sweep の最短周期 [usec] (0: 待たずに回す)
+    LED_PERIOD,     // LED の更新周期 [usec]
+    CLUSTER,        // 何台かをつなぐ時の役割: 0 一台で使う、1 leader、2-8 follower (ring の順。cluster.h)
+    MAX
+};
+constexpr size_t TUNE_PARAMS = static_cast<size_t>(TuneParam::MAX);
+
+struct TuneParamInfo {
+    const char*     name;
+    uint16_t        min;
+    uint16_t        max;
+    uint16_t        def;    // 以前の固定値
+};
+constexpr TuneParamInfo TUNE_INFO[TUNE_PARAMS] = {
+    {"threshold",       1,      4000,   30},
+    {"close_range",     50,     2000,   300},
+    {"hysteresis",      0,      200,    70},
+    {"release_hold",    1,      100,    5},
+    {"filter_len",      1,      4,      4},
+    {"scan_period",     0,      20000,  0},
+    {"led_period",      8333,   50000,  16667},
+    {"cluster",         0,      8,      0},
+};
+
+struct Tuning {
+    uint16_t    value[TUNE_PARAMS];
+
+    auto get(TuneParam p) const -> uint16_t {return value[static_cast<size_t>(p)];}
+    static auto defaults() -> Tuning {
+        Tuning t{};
+        for (size_t i = 0; i < TUNE_PARAMS; ++i) {t.value[i] = TUNE_INFO[i].def;}
+        return t;
+    }
+    static auto in_range(size_t id, uint16_t v) -> bool {
+        return (id < TUNE_PARAMS) && (v >= TUNE_INFO[id].min) && (v <= TUNE_INFO[id].max);
+    }
+    /// 範囲外の値は既定値に戻す (flash から読んだ時)。全部範囲内なら true
+    auto sanitize() -> bool {
+        bool ok = true;
+        for (size_t i = 0; i < TUNE_PARAMS; ++i) {
+            if (!in_range(i, value[i])) {
+                value[i] = TUNE_INFO[i].def;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+};
+
+// =========================================================
+//      Performance Counters
+// =========================================================
+enum class PerfCounter : uint8_t {
+    SWEEP_HZ,           // 直近 1 秒の sweep 数
+    LOOP_SLACK_PCT,     // Core0 の空き時間 [%]
+    LOAD_LEVEL,         // governor の段階
+    I2C_ERRORS,         // 起動からの I2C の失敗数
+    MIDI_DROPPED,       // 出力待ちから溢れた MIDI
+    NOTE_P50_US,        // sweep → Note On を積むまで
+    NOTE_P99_US,
+    USB_P50_US,         // Note On を積む → USB
+    USB_P99_US,
+    PIXEL_P50_US,       // sweep → LED
+    PIXEL_P99_US,
+    SHED_TOTAL,         // 負荷で省いた処理の数
+    MAX
+};
+constexpr size_t PERF_COUNTERS = static_cast<size_t>(PerfCounter::MAX);
+
+struct PerfSnapshot {
+    uint32_t    value[PERF_COUNTERS];
+};
+
+// =========================================================
+//      SysEx Protocol
+// =========================================================
+//  F0 7D 51 <cmd> <payload> F7   (7D: 非商用の ID、51: 'Q')
+//  値は 7bit ずつ下位から: u16 は 3byte、u32 は 5byte
+//  cmd                 payload                     reply (cmd | 0x40)
+//   01 ping             -                           version
+//   02 get              id                          id v16
+//   03 set              (id v16) x n                status [id]   全部確かめてから、全部まとめて変える
+//   04 get all          -                           (id v16) x TUNE_PARAMS
+//   05 save             -                           status        今の値を flash に保存する
+//   06 perf             -                           (id v32) x PERF_COUNTERS
+//   07 defaults         -                           status        全部を既定値に戻す
+//   08 freeze           -                           status        flight recorder を止めて flash に書く
+//  知らない cmd には 7F cmd status を返す。ID の違う SysEx には何も返さない
+//  set / defaults で変えた値は、次のフレームの頭で一度に使い始める (take_pending)
+constexpr uint8_t SYSEX_START = 0xF0;
+constexpr uint8_t SYSEX_END = 0xF7;
+constexpr uint8_t SYSEX_ID = 0x7D;
+constexpr uint8_t SYSEX_DEVICE = 0x51;
+constexpr uint8_t SYSEX_VERSION = 1;
+constexpr uint8_t SYSEX_REPLY = 0x40;
+constexpr uint8_t SYSEX_NAK = 0x7F;
+constexpr size_t SYSEX_HEADER = 4;      // F0 7D 51 cmd
+constexpr size_t SYSEX_MAX_REPLY = SYSEX_HEADER + PERF_COUNTERS * 6 + 1;
+static_assert(SYSEX_MAX_REPLY >= SYSEX_HEADER + TUNE_PARAMS * 4 + 1, "get all must fit in a reply");
+
+enum class SysexCmd : uint8_t {PING = 1, GET, SET, GET_ALL, SAVE, PERF, DEFAULTS, FREEZE};
+enum class SysexStatus : uint8_t {
+    OK,
+    BAD_LENGTH,
+    UNKNOWN_CMD,
+    UNKNOWN_PARAM,
+    OUT_OF_RANGE,
+    SAVE_FAILED,
+    BAD_DATA,       // 7bit を超える byte
+    NOT_RECORDING,  // freeze: flight recorder が記録していない (もう止まっている)
+};
+
+// 本体の状態を読む / 保存する (ホストでは偽物を渡す)
+struct SysexHooks {
+    void (*read_perf)(PerfSnapshot& out);   // nullptr 可 (全部 0)
+    bool (*save)(const Tuning& tuning);     // nullptr 可 (SAVE_FAILED)
+    bool (*freeze)();                       // nullptr 可 (NOT_RECORDING)
+};
+
+// =========================================================
+//      SysexTuner Class
+// =========================================================
+// MIDI の受信 (midi_task) から handle() を呼び、返事があれば送る
+// 変えた値は pending_ に置き、タッチの処理が frame の頭で take_pending() で受け取る (同じ core なので lock は要らない)
+class SysexTuner {
+    Tuning      pending_;   // 次のフレームから使う値 (get で返すのもこちら)
+    bool        dirty_;
+    SysexHooks  hooks_;
+    uint32_t    handled_;   // 返事をした数
+    uint32_t    rejected_;  // OK 以外を返した数
+
+// impl SysexTuner
+public:
+    SysexTuner() : pending_(Tuning::defaults()), dirty_(false), hooks_{nullptr, nullptr, nullptr}, handled_(0), rejected_(0) {}
+
+    void begin(const SysexHooks& hooks) {hooks_ = hooks;}
+    /// flash から読んだ値を使う (範囲外のものは既定値)
+    void load(const Tuning& stored) {
+        pending_ = stored;
+        pending_.sanitize();
+        dirty_ = true;
+    }
+    /// frame の頭で呼ぶ。変わっていれば out に入れて true
+    auto take_pending(Tuning& out) -> bool {
+        if (!dirty_) {return false;}
+        out = pending_;
+        dirty_ = false;
+        return true;
+    }
+    auto tuning() const -> const Tuning& {return pending_;}
+    auto handled() const -> uint32_t {return handled_;}
+    auto rejected() const -> uint32_t {return rejected_;}
+
+    /// msg: F0 から F7 まで。返事を reply に作り、その長さを返す (返事なしは 0)
+    auto handle(const uint8_t* msg, size_t len, uint8_t* reply, size_t cap) -> size_t {
+        if ((msg == nullptr) || (len < SYSEX_HEADER + 1) || (cap < SYSEX_MAX_REPLY)) {return 0;}
+        if ((msg[0] != SYSEX_START) || (msg[1] != SYSEX_ID) || (msg[2] != SYSEX_DEVICE) || (msg[len - 1] != SYSEX_END)) {
+            return 0;
+        }
+        const uint8_t cmd = msg[3];
+        if (cmd & 0x80) {return 0;}
+        const uint8_t* p = msg + SYSEX_HEADER;
+        const size_t n = len - SYSEX_HEADER - 1;    // payload の長さ
+        handled_ += 1;
+        for (size_t i = 0; i < n; ++i) {
+            if (p[i] & 0x80) {return status_reply(reply, cmd, SysexStatus::BAD_DATA);}
+        }
+        size_t r = begin_reply(reply, static_cast<uint8_t>(cmd | SYSEX_REPLY));
+        switch (static_cast<SysexCmd>(cmd)) {
+        case SysexCmd::PING:
+            if (n != 0) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            reply[r++] = SYSEX_VERSION;
+            break;
+        case SysexCmd::GET:
+            if (n != 1) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            if (p[0] >= TUNE_PARAMS) {return status_reply(reply, cmd, SysexStatus::UNKNOWN_PARAM, p[0]);}
+            reply[r++] = p[0];
+            r += put16(reply + r, pending_.value[p[0]]);
+            break;
+        case SysexCmd::SET:
+            return set(p, n, reply, cmd);
+        case SysexCmd::GET_ALL:
+            if (n != 0) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            for (size_t i = 0; i < TUNE_PARAMS; ++i) {
+                reply[r++] = static_cast<uint8_t>(i);
+                r += put16(reply + r, pending_.value[i]);
+            }
+            break;
+        case SysexCmd::SAVE:
+            if (n != 0) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            if ((hooks_.save == nullptr) || !hooks_.save(pending_)) {
+                return status_reply(reply, cmd, SysexStatus::SAVE_FAILED);
+            }
+            reply[r++] = static_cast<uint8_t>(SysexStatus::OK);
+            break;
+        case SysexCmd::PERF: {
+            if (n != 0) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            PerfSnapshot snap{};
+            if (hooks_.read_perf != nullptr) {hooks_.read_perf(snap);}
+            for (size_t i = 0; i < PERF_COUNTERS; ++i) {
+                reply[r++] = static_cast<uint8_t>(i);
+                r += put32(reply + r, snap.value[i]);
+            }
+            break;
+        }
+        case SysexCmd::DEFAULTS:
+            if (n != 0) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            pending_ = Tuning::defaults();
+            dirty_ = true;
+            reply[r++] = static_cast<uint8_t>(SysexStatus::OK);
+            break;
+        case SysexCmd::FREEZE:
+            if (n != 0) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+            if ((hooks_.freeze == nullptr) || !hooks_.freeze()) {
+                return status_reply(reply, cmd, SysexStatus::NOT_RECORDING);
+            }
+            reply[r++] = static_cast<uint8_t>(SysexStatus::OK);
+            break;
+        default:
+            rejected_ += 1;
+            r = begin_reply(reply, SYSEX_NAK);
+            reply[r++] = cmd;
+            reply[r++] = static_cast<uint8_t>(SysexStatus::UNKNOWN_CMD);
+            break;
+        }
+        reply[r++] = SYSEX_END;
+        return r;
+    }
+
+    static auto put16(uint8_t* p, uint16_t v) -> size_t {
+        p[0] = v & 0x7f;
+        p[1] = (v >> 7) & 0x7f;
+        p[2] = (v >> 14) & 0x03;
+        return 3;
+    }
+    static auto get16(const uint8_t* p) -> uint32_t {
+        return p[0] | (p[1] << 7) | (static_cast<uint32_t>(p[2]) << 14);
+    }
+    static auto put32(uint8_t* p, uint32_t v) -> size_t {
+        for (size_t i = 0; i < 5; ++i) {
+            p[i] = static_cast<uint8_t>((v >> (7 * i)) & 0x7f);
+        }
+        return 5;
+    }
+    static auto get32(const uint8_t* p) -> uint32_t {
+        uint32_t v = 0;
+        for (size_t i = 0; i < 5; ++i) {
+            v |= static_cast<uint32_t>(p[i]) << (7 * i);
+        }
+        return v;
+    }
+
+private:
+    /// 全部確かめてから一度に変える。だめなら何も変えない
+    auto set(const uint8_t* p, size_t n, uint8_t* reply, uint8_t cmd) -> size_t {
+        if ((n == 0) || (n % 4 != 0)) {return status_reply(reply, cmd, SysexStatus::BAD_LENGTH);}
+        for (size_t k = 0; k < n; k += 4) {
+            if (p[k] >= TUNE_PARAMS) {return status_reply(reply, cmd, SysexStatus::UNKNOWN_PARAM, p[k]);}
+            uint32_t v = get16(p + k + 1);
+            if ((v > 0xffff) || !Tuning::in_range(p[k], static_cast<uint16_t>(v))) {
+                return status_reply(reply, cmd, SysexStatus::OUT_OF_RANGE, p[k]);
+            }
+        }
+        for (size_t k = 0; k < n; k += 4) {
+            pending_.value[p[k]] = static_cast<uint16_t>(get16(p + k + 1));
+        }
+        dirty_ = true;
+        return status_reply(reply, cmd, SysexStatus::OK);
+    }
+    static auto begin_reply(uint8_t* reply, uint8_t cmd) -> size_t {
+        reply[0] = SYSEX_START;
+        reply[1] = SYSEX_ID;
+        reply[2] = SYSEX_DEVICE;
+        reply[3] = cmd;
+        return SYSEX_HEADER;
+    }
+    auto status_reply(uint8_t* reply, uint8_t cmd, SysexStatus status, int param = -1) -> size_t {
+        if (status != SysexStatus::OK) {rejected_ += 1;}
+        size_t r = begin_reply(reply, static_cast<uint8_t>((cmd & 0x3f) | SYSEX_REPLY));
+        reply[r++] = static_cast<uint8_t>(status);
+        if (param >= 0) {reply[r++] = static_cast<uint8_t>(param & 0x7f);}
+        reply[r++] = SYSEX_END;
+        return r;
+    }
+};
+#endif // TUNING_H